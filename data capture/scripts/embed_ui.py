@@ -0,0 +1,47 @@
+# Gzips web/index.html into src/ui_index.h so the page is served straight
+# out of flash. Runs before every PlatformIO build (see extra_scripts in
+# platformio.ini); run it by hand after editing the page when building
+# with the Arduino IDE.
+import gzip
+import hashlib
+import os
+
+try:
+    Import("env")  # noqa: F821 - provided by PlatformIO
+    project_dir = env.subst("$PROJECT_DIR")  # noqa: F821
+except NameError:
+    project_dir = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+source = os.path.join(project_dir, "web", "index.html")
+target = os.path.join(project_dir, "src", "ui_index.h")
+
+with open(source, "rb") as f:
+    html = f.read()
+
+# mtime=0 keeps the output, and so the ETag, identical for identical input
+data = gzip.compress(html, compresslevel=9, mtime=0)
+etag = hashlib.sha256(data).hexdigest()[:16]
+
+lines = [
+    "// Generated by scripts/embed_ui.py from web/index.html - do not edit",
+    "#pragma once",
+    "",
+    "#define UI_INDEX_ETAG \"\\\"%s\\\"\"" % etag,
+    "",
+    "const size_t uiIndexGzLen = %d;  // %d bytes uncompressed" % (len(data), len(html)),
+    "const uint8_t uiIndexGz[] PROGMEM = {",
+]
+for i in range(0, len(data), 16):
+    lines.append("  " + ", ".join("0x%02x" % b for b in data[i:i + 16]) + ",")
+lines.append("};")
+header = "\n".join(lines) + "\n"
+
+old = None
+if os.path.exists(target):
+    with open(target) as f:
+        old = f.read()
+# Only rewrite on a change so the sketch isn't rebuilt for nothing
+if header != old:
+    with open(target, "w", newline="\r\n") as f:
+        f.write(header)
+    print("embed_ui: %s -> %s (%d -> %d bytes)" % (source, target, len(html), len(data)))
@@ -0,0 +1,274 @@
+# Load generator for the camera's web server. Runs simulated clients
+# against a board and reports throughput and latency percentiles per
+# route, next to the server's own handler times from /routestats.
+#
+#   python3 scripts/load_test.py 192.168.1.50 --duration 60 \
+#       --mix gallery=3,status=2,download=1,capture=1
+#
+# Client types (each runs its steps in a loop, with --think seconds between
+# requests):
+#   gallery   - the page (revalidated by ETag after the first load), one
+#               page of /list and the thumbnails on it, then an image
+#   status    - polls /burststatus and /getsettings, like an open page
+#   download  - downloads /archive?format=zip in full
+#   capture   - triggers /capture
+#
+# With --burst N a burst of N frames is started after --warmup seconds
+# (POST /burstcapture) and watched until it ends; the run lasts at least
+# that long, and the requests answered while it ran get a table of their
+# own. --max-p99 MS then fails the run (exit status 1) if any route's p99
+# during the burst is over MS, /archive excepted since its time is the
+# download's size:
+#
+#   python3 scripts/load_test.py 192.168.1.50 --mix gallery=2,status=3 \
+#       --burst 200 --max-p99 500
+#
+# Latency is measured from connecting to the last byte of the body, so it
+# includes waiting behind other clients; /routestats only covers the time
+# inside each handler. Needs only the Python standard library.
+import argparse
+import http.client
+import json
+import sys
+import threading
+import time
+import urllib.parse
+
+
+class Recorder:
+    """Latencies (ms) and failures per route, shared by all clients."""
+
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.samples = {}   # route -> [(finished, ms, bytes, ok)]
+
+    def record(self, route, ms, size, ok):
+        with self.lock:
+            self.samples.setdefault(route, []).append((time.monotonic(), ms, size, ok))
+
+    def window(self, start, end):
+        """The samples of requests that finished between start and end."""
+        with self.lock:
+            return {route: [s for s in samples if start <= s[0] <= end]
+                    for route, samples in self.samples.items()}
+
+
+def percentile(values, fraction):
+    """Nearest-rank percentile of a sorted list."""
+    if not values:
+        return 0.0
+    index = min(len(values) - 1, max(0, int(round(fraction * len(values) + 0.5)) - 1))
+    return values[index]
+
+
+class Client:
+    def __init__(self, host, port, timeout, recorder):
+        self.host = host
+        self.port = port
+        self.timeout = timeout
+        self.recorder = recorder
+        self.etag = None
+
+    def request(self, method, path, body=None, headers=None, expect=(200,)):
+        """One request on a fresh connection (the server closes them);
+        returns (status, body) or (None, b"") on a network error."""
+        route = method + " " + urllib.parse.urlsplit(path).path
+        start = time.monotonic()
+        status, data = None, b""
+        try:
+            conn = http.client.HTTPConnection(self.host, self.port, timeout=self.timeout)
+            conn.request(method, path, body=body, headers=headers or {})
+            response = conn.getresponse()
+            status = response.status
+            data = response.read()
+            if path == "/" and response.getheader("ETag"):
+                self.etag = response.getheader("ETag")
+            conn.close()
+        except (OSError, http.client.HTTPException):
+            pass
+        ms = (time.monotonic() - start) * 1000
+        self.recorder.record(route, ms, len(data), status in expect)
+        return status, data
+
+    def get_json(self, path):
+        status, data = self.request("GET", path)
+        if status != 200:
+            return None
+        try:
+            return json.loads(data)
+        except ValueError:
+            return None
+
+
+def gallery(client, think, stop):
+    headers = {"If-None-Match": client.etag} if client.etag else {}
+    client.request("GET", "/", headers=headers, expect=(200, 304))
+    listing = client.get_json("/list?limit=24")
+    images = listing.get("images", []) if listing else []
+    for image in images:
+        if stop.is_set():
+            return
+        client.request("GET", "/thumb?n=%d&v=%s" % (image["number"], image.get("v", "")))
+    if images:
+        time.sleep(think)
+        client.request("GET", "/image?n=%d&v=%s" % (images[0]["number"], images[0].get("v", "")))
+
+
+def status(client, think, stop):
+    client.request("GET", "/burststatus")
+    time.sleep(think)
+    client.request("GET", "/getsettings")
+
+
+def download(client, think, stop):
+    # 503 means another archive is being sent; counts as an error here
+    client.request("GET", "/archive?format=zip")
+
+
+def capture(client, think, stop):
+    # 503 is the capture queue being full, which is the server working as meant
+    client.request("GET", "/capture", expect=(200, 503))
+
+
+CLIENT_TYPES = {"gallery": gallery, "status": status, "download": download, "capture": capture}
+
+
+def run_client(kind, client, think, stop):
+    while not stop.is_set():
+        CLIENT_TYPES[kind](client, think, stop)
+        stop.wait(think)
+
+
+def parse_mix(text):
+    mix = {}
+    for part in text.split(","):
+        name, _, count = part.partition("=")
+        if name not in CLIENT_TYPES:
+            raise argparse.ArgumentTypeError("unknown client type: %s" % name)
+        mix[name] = int(count or 1)
+    return mix
+
+
+def print_table(title, samples, seconds):
+    """Prints one row per route; returns {route: p99 ms}."""
+    print("\n%s" % title)
+    print("%-22s %7s %8s %6s %9s %9s %9s %9s %9s" % (
+        "route", "count", "req/s", "errors", "KB/s", "p50 ms", "p95 ms", "p99 ms", "max ms"))
+    p99 = {}
+    for route in sorted(samples):
+        if not samples[route]:
+            continue
+        values = sorted(s[1] for s in samples[route])
+        errors = sum(1 for s in samples[route] if not s[3])
+        size = sum(s[2] for s in samples[route])
+        p99[route] = percentile(values, 0.99)
+        print("%-22s %7d %8.2f %6d %9.1f %9.1f %9.1f %9.1f %9.1f" % (
+            route, len(values), len(values) / seconds, errors, size / 1024.0 / seconds,
+            percentile(values, 0.50), percentile(values, 0.95), p99[route], values[-1]))
+    return p99
+
+
+def print_server_stats(server_stats):
+    if server_stats:
+        print("\nServer handler time (/routestats)")
+        print("%-22s %7s %9s %9s %9s %9s" % ("route", "count", "p50 ms", "p95 ms", "p99 ms", "max ms"))
+        for entry in server_stats.get("routes", []):
+            if entry["count"]:
+                print("%-22s %7d %9.1f %9.1f %9.1f %9.1f" % (
+                    entry["method"] + " " + entry["route"], entry["count"],
+                    entry["p50Ms"], entry["p95Ms"], entry["p99Ms"], entry["maxMs"]))
+
+
+def run_burst(client, count, interval, warmup, stop, result):
+    """Starts a burst after warmup seconds and waits for it to end; puts
+    its start and end times (or an error) in result."""
+    if stop.wait(warmup):
+        return
+    body = json.dumps({"count": count, "interval": interval})
+    status, data = client.request("POST", "/burstcapture", body=body, headers={"Content-Type": "application/json"})
+    if status != 200:
+        result["error"] = "POST /burstcapture answered %s: %s" % (status, data[:200].decode(errors="replace"))
+        return
+    result["start"] = time.monotonic()
+    # Capped at 10x the burst's nominal length, in case it never reports done
+    deadline = result["start"] + max(60, count * interval * 10)
+    while time.monotonic() < deadline:
+        time.sleep(0.5)
+        state = client.get_json("/burststatus")
+        if state is not None and not state.get("inProgress") and not state.get("flushing"):
+            result["end"] = time.monotonic()
+            return
+    result["error"] = "burst still running after %.0f s" % (deadline - result["start"])
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Replay browser traffic against the camera's web server")
+    parser.add_argument("host", help="board address, e.g. 192.168.1.50 or xiao-camera.local")
+    parser.add_argument("--port", type=int, default=80)
+    parser.add_argument("--duration", type=float, default=30, help="seconds to run (default 30)")
+    parser.add_argument("--mix", type=parse_mix, default=parse_mix("gallery=2,status=2"),
+                        help="clients of each type, e.g. gallery=3,status=2,download=1,capture=1")
+    parser.add_argument("--think", type=float, default=0.5, help="seconds between a client's requests (default 0.5)")
+    parser.add_argument("--timeout", type=float, default=30, help="per-request timeout in seconds (default 30)")
+    parser.add_argument("--burst", type=int, default=0, metavar="N", help="start a burst of N frames during the run")
+    parser.add_argument("--burst-interval", type=float, default=0.2, help="seconds between burst frames (default 0.2)")
+    parser.add_argument("--warmup", type=float, default=5, help="seconds before the burst starts (default 5)")
+    parser.add_argument("--max-p99", type=float, metavar="MS",
+                        help="exit with status 1 if a route's p99 during the burst is over MS")
+    args = parser.parse_args()
+
+    recorder = Recorder()
+    probe = Client(args.host, args.port, args.timeout, Recorder())
+    # Clears the server's histograms so they cover this run only
+    if probe.get_json("/routestats?reset") is None:
+        print("No answer from /routestats on %s" % args.host, file=sys.stderr)
+        return 1
+
+    stop = threading.Event()
+    threads = []
+    for kind, count in sorted(args.mix.items()):
+        for _ in range(count):
+            client = Client(args.host, args.port, args.timeout, recorder)
+            thread = threading.Thread(target=run_client, args=(kind, client, args.think, stop), daemon=True)
+            threads.append(thread)
+    print("Running %d clients (%s) for %.0f s%s" % (
+        len(threads), ", ".join("%s=%d" % item for item in sorted(args.mix.items())), args.duration,
+        " or until a %d-frame burst ends" % args.burst if args.burst > 0 else ""))
+
+    start = time.monotonic()
+    for thread in threads:
+        thread.start()
+    burst = {}
+    if args.burst > 0:
+        controller = threading.Thread(target=run_burst, args=(Client(args.host, args.port, args.timeout, recorder),
+                                      args.burst, args.burst_interval, args.warmup, stop, burst))
+        controller.start()
+        controller.join()
+    remaining = args.duration - (time.monotonic() - start)
+    if remaining > 0:
+        stop.wait(remaining)
+    stop.set()
+    for thread in threads:
+        thread.join(args.timeout)
+    end = time.monotonic()
+
+    print_table("Whole run (%.0f s)" % (end - start), recorder.window(start, end), end - start)
+    failed = False
+    if "error" in burst:
+        print("\nBurst: %s" % burst["error"], file=sys.stderr)
+        failed = True
+    elif burst:
+        seconds = burst["end"] - burst["start"]
+        p99 = print_table("During the %d-frame burst (%.1f s)" % (args.burst, seconds),
+                          recorder.window(burst["start"], burst["end"]), seconds)
+        if args.max_p99 is not None:
+            over = [route for route, ms in p99.items() if ms > args.max_p99 and not route.endswith("/archive")]
+            for route in over:
+                print("p99 of %s during the burst is %.1f ms, over %.1f ms" % (route, p99[route], args.max_p99))
+            failed = bool(over)
+    print_server_stats(probe.get_json("/routestats"))
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,208 @@
+#include "archive_format.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "esp_rom_crc.h"
+
+void archivePut16(uint8_t *p, uint16_t v) {
+  p[0] = v & 0xFF;
+  p[1] = v >> 8;
+}
+
+void archivePut32(uint8_t *p, uint32_t v) {
+  p[0] = v & 0xFF;
+  p[1] = (v >> 8) & 0xFF;
+  p[2] = (v >> 16) & 0xFF;
+  p[3] = v >> 24;
+}
+
+// MS-DOS date and time for ZIP headers. Images written before the clock was
+// set get the format's earliest date, 1980-01-01.
+void archiveDosTime(uint32_t timestamp, uint16_t *dosTime, uint16_t *dosDate) {
+  *dosTime = 0;
+  *dosDate = (1 << 5) | 1;
+  if (timestamp <= 1600000000) {
+    return;
+  }
+  time_t t = timestamp;
+  struct tm tm;
+  localtime_r(&t, &tm);
+  *dosTime = (tm.tm_hour << 11) | (tm.tm_min << 5) | (tm.tm_sec / 2);
+  *dosDate = ((tm.tm_year - 80) << 9) | ((tm.tm_mon + 1) << 5) | tm.tm_mday;
+}
+
+// Fills a 512-byte ustar header for a regular file
+void archiveTarHeader(uint8_t *header, const char *name, uint32_t size, uint32_t timestamp) {
+  memset(header, 0, 512);
+  strncpy((char*)header, name, 99);
+  memcpy(header + 100, "0000644", 7);                        // mode
+  memcpy(header + 108, "0000000", 7);                        // uid
+  memcpy(header + 116, "0000000", 7);                        // gid
+  snprintf((char*)header + 124, 12, "%011lo", (unsigned long)size);
+  snprintf((char*)header + 136, 12, "%011lo", (unsigned long)timestamp);
+  header[156] = '0';                                         // Regular file
+  memcpy(header + 257, "ustar", 6);
+  memcpy(header + 263, "00", 2);
+  
+  // The checksum is taken with its own field read as spaces
+  memset(header + 148, ' ', 8);
+  uint32_t sum = 0;
+  for (int i = 0; i < 512; i++) {
+    sum += header[i];
+  }
+  snprintf((char*)header + 148, 8, "%06lo", (unsigned long)sum);
+}
+
+static bool archiveSend(ArchiveWriter &w, const uint8_t *data, size_t len) {
+  if (w.ok && len > 0) {
+    w.ok = w.sink(w.sinkCtx, data, len);
+    w.position += len;
+  }
+  return w.ok;
+}
+
+static size_t archiveName(char *name, uint32_t number) {
+  return snprintf(name, 16, "%lu.jpg", (unsigned long)number);
+}
+
+void archiveBegin(ArchiveWriter &w, bool tar, uint8_t *buf, size_t bufSize, ArchiveSinkFn sink, void *sinkCtx) {
+  w.tar = tar;
+  w.sink = sink;
+  w.sinkCtx = sinkCtx;
+  w.buf = buf;
+  w.bufSize = bufSize;
+  w.ok = buf && bufSize >= ARCHIVE_MIN_BUFFER;
+  w.position = 0;
+  w.entries.clear();
+  memset(&w.current, 0, sizeof(w.current));
+  w.promised = 0;
+}
+
+// The header goes out first; for a ZIP the CRC and sizes follow the data
+bool archiveFileBegin(ArchiveWriter &w, uint32_t number, uint32_t timestamp, uint32_t size) {
+  char name[16];
+  size_t nameLength = archiveName(name, number);
+  w.current.number = number;
+  w.current.timestamp = timestamp;
+  w.current.crc = 0;
+  w.current.size = 0;
+  w.current.offset = w.position;
+  w.promised = size;
+  if (!w.ok) {
+    return false;
+  }
+  
+  if (w.tar) {
+    archiveTarHeader(w.buf, name, size, timestamp);
+    return archiveSend(w, w.buf, 512);
+  }
+  uint16_t dosTime, dosDate;
+  archiveDosTime(timestamp, &dosTime, &dosDate);
+  memset(w.buf, 0, 30);
+  archivePut32(w.buf, 0x04034b50);
+  archivePut16(w.buf + 4, 20);        // Version needed
+  archivePut16(w.buf + 6, 0x0008);    // CRC and sizes follow the data
+  archivePut16(w.buf + 10, dosTime);
+  archivePut16(w.buf + 12, dosDate);
+  archivePut16(w.buf + 26, nameLength);
+  memcpy(w.buf + 30, name, nameLength);
+  return archiveSend(w, w.buf, 30 + nameLength);
+}
+
+bool archiveFileData(ArchiveWriter &w, const uint8_t *data, size_t len) {
+  if (!w.tar) {
+    w.current.crc = esp_rom_crc32_le(w.current.crc, data, len);
+  }
+  w.current.size += len;
+  return archiveSend(w, data, len);
+}
+
+bool archiveFileEnd(ArchiveWriter &w) {
+  if (!w.ok) {
+    return false;
+  }
+  if (w.tar) {
+    // Pad to the 512-byte block, plus whatever a failed read left short
+    // of the size already promised in the header
+    uint32_t shortfall = w.current.size < w.promised ? w.promised - w.current.size : 0;
+    uint32_t padding = shortfall + (512 - w.promised % 512) % 512;
+    memset(w.buf, 0, w.bufSize);
+    while (padding > 0 && w.ok) {
+      uint32_t chunk = padding < w.bufSize ? padding : w.bufSize;
+      archiveSend(w, w.buf, chunk);
+      padding -= chunk;
+    }
+    return w.ok;
+  }
+  
+  archivePut32(w.buf, 0x08074b50);
+  archivePut32(w.buf + 4, w.current.crc);
+  archivePut32(w.buf + 8, w.current.size);
+  archivePut32(w.buf + 12, w.current.size);
+  if (archiveSend(w, w.buf, 16)) {
+    w.entries.push_back(w.current);
+  }
+  return w.ok;
+}
+
+bool archiveFinish(ArchiveWriter &w) {
+  if (!w.ok) {
+    return false;
+  }
+  if (w.tar) {
+    // Two empty blocks end the archive
+    memset(w.buf, 0, 1024);
+    return archiveSend(w, w.buf, 1024);
+  }
+  
+  // Central directory, batched into the buffer, then the end record
+  uint32_t directoryStart = w.position;
+  uint32_t directoryBytes = 0;
+  size_t used = 0;
+  for (size_t i = 0; i < w.entries.size(); i++) {
+    const ArchiveEntry &entry = w.entries[i];
+    if (used + 64 > w.bufSize) {
+      archiveSend(w, w.buf, used);
+      used = 0;
+    }
+    char name[16];
+    size_t nameLength = archiveName(name, entry.number);
+    uint16_t dosTime, dosDate;
+    archiveDosTime(entry.timestamp, &dosTime, &dosDate);
+  
+    uint8_t *p = w.buf + used;
+    memset(p, 0, 46);
+    archivePut32(p, 0x02014b50);
+    archivePut16(p + 4, 20);          // Version made by
+    archivePut16(p + 6, 20);          // Version needed
+    archivePut16(p + 8, 0x0008);
+    archivePut16(p + 12, dosTime);
+    archivePut16(p + 14, dosDate);
+    archivePut32(p + 16, entry.crc);
+    archivePut32(p + 20, entry.size);
+    archivePut32(p + 24, entry.size);
+    archivePut16(p + 28, nameLength);
+    archivePut32(p + 42, entry.offset);
+    memcpy(p + 46, name, nameLength);
+    used += 46 + nameLength;
+    directoryBytes += 46 + nameLength;
+  }
+  if (used + ARCHIVE_ZIP_END_BYTES > w.bufSize) {
+    archiveSend(w, w.buf, used);
+    used = 0;
+  }
+  uint8_t *p = w.buf + used;
+  memset(p, 0, ARCHIVE_ZIP_END_BYTES);
+  archivePut32(p, 0x06054b50);
+  archivePut16(p + 8, w.entries.size());
+  archivePut16(p + 10, w.entries.size());
+  archivePut32(p + 12, directoryBytes);
+  archivePut32(p + 16, directoryStart);
+  return archiveSend(w, w.buf, used + ARCHIVE_ZIP_END_BYTES);
+}
+
+// Local header, name, data descriptor and central directory entry
+uint64_t archiveZipFileBytes(uint32_t number, uint32_t size) {
+  char name[16];
+  return 30 + 16 + 46 + 2 * archiveName(name, number) + (uint64_t)size;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+// Uncompressed ZIP and TAR output for /archive, written as the files are
+// read. Each piece goes straight to a sink, so neither the archive nor a
+// whole file is ever held in memory; ZIP entries use a data descriptor so
+// each CRC can be worked out on the way through. Kept apart from main.cpp
+// so the host tests (env:native) can check the output byte for byte.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+#define ARCHIVE_MIN_BUFFER  1024  // Smallest buffer ArchiveWriter can work with
+
+// Receives each piece of the archive; returns false to stop
+typedef bool (*ArchiveSinkFn)(void *ctx, const uint8_t *data, size_t len);
+
+// What the ZIP central directory needs per file, kept until the end
+struct ArchiveEntry {
+  uint32_t number;
+  uint32_t timestamp;
+  uint32_t crc;
+  uint32_t size;
+  uint32_t offset;   // Of the file's local header
+};
+
+// One archive being written. Files go in as archiveFileBegin(), any number
+// of archiveFileData() calls, then archiveFileEnd(); archiveFinish() ends
+// it. Every call returns false (and the rest do nothing) once the sink has
+// failed. Entries are named N.jpg.
+struct ArchiveWriter {
+  bool tar;
+  ArchiveSinkFn sink;
+  void *sinkCtx;
+  uint8_t *buf;       // Headers, padding and the central directory are built here
+  size_t bufSize;
+  bool ok;
+  uint32_t position;  // Bytes sent so far
+  std::vector<ArchiveEntry> entries;
+  ArchiveEntry current;
+  uint32_t promised;  // Size given in the current TAR header
+};
+
+void archiveBegin(ArchiveWriter &w, bool tar, uint8_t *buf, size_t bufSize, ArchiveSinkFn sink, void *sinkCtx);
+bool archiveFileBegin(ArchiveWriter &w, uint32_t number, uint32_t timestamp, uint32_t size);
+bool archiveFileData(ArchiveWriter &w, const uint8_t *data, size_t len);
+bool archiveFileEnd(ArchiveWriter &w);
+bool archiveFinish(ArchiveWriter &w);
+
+// Bytes one file adds to a ZIP, and the fixed end record, for checking the
+// 4 GB limit before anything is sent
+uint64_t archiveZipFileBytes(uint32_t number, uint32_t size);
+#define ARCHIVE_ZIP_END_BYTES  22
+
+void archivePut16(uint8_t *p, uint16_t v);
+void archivePut32(uint8_t *p, uint32_t v);
+void archiveDosTime(uint32_t timestamp, uint16_t *dosTime, uint16_t *dosDate);
+void archiveTarHeader(uint8_t *header, const char *name, uint32_t size, uint32_t timestamp);
@@ -0,0 +1,56 @@
+#pragma once
+
+// Burst pack: all frames of one burst in a single preallocated file, so a
+// burst frame costs no directory entry, cluster allocation or close() of its
+// own. Layout: header, the frames back to back (each followed by its
+// thumbnail), then the index table. The header's frame count and index
+// offset are filled in when the burst ends; a pack without them is removed
+// the next time the card is indexed.
+// Fields are little-endian, as the ESP32 writes them.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define BURST_PACK_MAGIC        "XBURST01"
+
+struct BurstPackHeader {
+  char magic[8];
+  uint32_t burstId;
+  uint32_t frameCount;
+  uint32_t indexOffset;
+  uint32_t startTime;   // time() when the burst started (seconds)
+  uint32_t reserved[2];
+};
+
+struct BurstPackEntry {
+  uint32_t number;       // Image number the frame is listed under; 0 once deleted on its own
+  uint32_t offset;
+  uint32_t size;
+  uint32_t thumbOffset;  // 0 if the frame has no thumbnail
+  uint32_t thumbSize;
+  uint32_t timeMs;       // Capture time relative to the burst start
+};
+
+// Packs already on cards depend on these
+static_assert(sizeof(BurstPackHeader) == 32, "BurstPackHeader is 32 bytes on the card");
+static_assert(sizeof(BurstPackEntry) == 24, "BurstPackEntry is 24 bytes on the card");
+static_assert(offsetof(BurstPackHeader, indexOffset) == 16, "indexOffset moved");
+static_assert(offsetof(BurstPackEntry, number) == 0, "Deleting a frame blanks the first field");
+
+inline void burstPackHeaderInit(BurstPackHeader &header, uint32_t burstId, uint32_t startTime) {
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, BURST_PACK_MAGIC, sizeof(header.magic));
+  header.burstId = burstId;
+  header.startTime = startTime;
+}
+
+// A pack whose burst finished, so its index table can be read
+inline bool burstPackHeaderValid(const BurstPackHeader &header) {
+  return memcmp(header.magic, BURST_PACK_MAGIC, sizeof(header.magic)) == 0 && header.indexOffset != 0;
+}
+
+// Where a frame's entry sits in the file
+inline uint32_t burstPackEntryOffset(const BurstPackHeader &header, uint32_t frame) {
+  return header.indexOffset + frame * sizeof(BurstPackEntry);
+}
@@ -0,0 +1,71 @@
+#include "capture_stages.h"
+#include <string.h>
+
+int captureJpegQuality(int cameraQuality, pixformat_t format, framesize_t frameSize) {
+  // Map quality (0-63 camera quality to 10-100 encoder quality), as map() would
+  int jpegQuality = cameraQuality * (100 - 10) / 63 + 10;
+  if (jpegQuality < 10) jpegQuality = 10;
+  if (jpegQuality > 100) jpegQuality = 100;
+  
+  // For very high resolution (SXGA/UXGA), cap quality to reduce processing time
+  if (format == PIXFORMAT_RGB565 && (frameSize == FRAMESIZE_SXGA || frameSize == FRAMESIZE_UXGA) && jpegQuality > 80) {
+    jpegQuality = 80;
+  }
+  return jpegQuality;
+}
+
+bool thumbDimensions(uint16_t width, uint16_t height, pixformat_t format, uint16_t *thumbWidth, uint16_t *thumbHeight, int *scale) {
+  if (format == PIXFORMAT_JPEG) {
+    int shift = 0;
+    while (shift < 3 && (width >> (shift + 1)) >= THUMB_WIDTH) {
+      shift++;
+    }
+    if (shift == 0) {
+      return false;
+    }
+    *thumbWidth = width >> shift;
+    *thumbHeight = height >> shift;
+    *scale = shift;
+    return true;
+  } else if (format == PIXFORMAT_RGB565 || format == PIXFORMAT_GRAYSCALE) {
+    int step = width / THUMB_WIDTH;
+    if (step < 2) {
+      return false;
+    }
+    *thumbWidth = width / step;
+    *thumbHeight = height / step;
+    *scale = step;
+    return true;
+  }
+  return false;
+}
+
+void thumbSubsample(const camera_fb_t *fb, uint16_t thumbWidth, uint16_t thumbHeight, int scale, uint8_t *out) {
+  size_t bpp = (fb->format == PIXFORMAT_RGB565) ? 2 : 1;
+  for (uint16_t y = 0; y < thumbHeight; y++) {
+    const uint8_t *row = fb->buf + (y * scale) * fb->width * bpp;
+    for (uint16_t x = 0; x < thumbWidth; x++) {
+      const uint8_t *px = row + x * scale * bpp;
+      *out++ = px[0];
+      if (bpp == 2) {
+        *out++ = px[1];
+      }
+    }
+  }
+}
+
+size_t cardWriteAligned(size_t position, const uint8_t *data, size_t len, uint8_t *bounce, size_t chunkSize,
+                        CardWriteFn write, void *ctx) {
+  size_t done = 0;
+  while (done < len) {
+    size_t chunk = chunkSize - (position + done) % chunkSize;
+    if (chunk > len - done) {
+      chunk = len - done;
+    }
+    memcpy(bounce, data + done, chunk);
+    size_t written = write(ctx, bounce, chunk);
+    done += written;
+    if (written != chunk) break;
+  }
+  return done;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+// The parts of the capture path that only do arithmetic on frames: the
+// encoder quality for a capture, thumbnail sizing and subsampling, and the
+// way writes are cut for the card. Kept apart from main.cpp so the host
+// pipeline benchmark (env:native) runs the same code as the grab, encode
+// and write tasks.
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_camera.h"   // pixformat_t, framesize_t, camera_fb_t
+
+#define THUMB_WIDTH         160  // Thumbnails are at least this wide
+#define THUMB_JPEG_QUALITY  60   // Encoder quality (1-100)
+
+// Encoder quality (10-100) for a raw frame captured at the web page's
+// quality setting (0-63). RGB565 at SXGA and UXGA is capped at 80 to keep
+// the encode time down.
+int captureJpegQuality(int cameraQuality, pixformat_t format, framesize_t frameSize);
+
+// Works out the thumbnail size for a frame. Sensor JPEGs are decoded at 1/2,
+// 1/4 or 1/8 scale (*scale is the shift); raw frames are subsampled every
+// *scale pixels. Frames that are already about thumbnail size don't get one.
+bool thumbDimensions(uint16_t width, uint16_t height, pixformat_t format, uint16_t *thumbWidth, uint16_t *thumbHeight, int *scale);
+
+// Copies every scale'th pixel of a raw frame into out, which holds
+// thumbWidth x thumbHeight pixels in the frame's format
+void thumbSubsample(const camera_fb_t *fb, uint16_t thumbWidth, uint16_t thumbHeight, int scale, uint8_t *out);
+
+// Writes to the card; returns the bytes actually written
+typedef size_t (*CardWriteFn)(void *ctx, const uint8_t *data, size_t len);
+
+// Writes len bytes, at file offset position, through bounce (chunkSize
+// bytes), cut so that every piece after the first starts on a multiple of
+// chunkSize in the file. Stops at the first short write; returns the bytes
+// written.
+size_t cardWriteAligned(size_t position, const uint8_t *data, size_t len, uint8_t *bounce, size_t chunkSize,
+                        CardWriteFn write, void *ctx);
@@ -0,0 +1,20 @@
+#pragma once
+
+// One entry of the image index, shared by main.cpp and the web routes
+// (web_routes.*).
+
+#include <stdint.h>
+
+#define IMAGE_FLAG_BURST  0x01  // Captured as part of a burst
+#define IMAGE_FLAG_THUMB  0x02  // Has a thumbnail next to it on the card
+
+// One saved image. The index is kept sorted by number and mirrors the card,
+// so listings and filename allocation never have to probe the SD card.
+struct ImageInfo {
+  uint32_t number;
+  uint32_t size;
+  uint32_t timestamp;  // File write time (seconds)
+  uint8_t flags;       // IMAGE_FLAG_* bits
+  uint16_t burstId;    // Burst pack holding the image, 0 for a standalone /N.jpg
+  uint16_t frame;      // Frame within the burst pack
+};
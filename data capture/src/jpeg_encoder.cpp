@@ -0,0 +1,835 @@
+#include "jpeg_encoder.h"
+#include <string.h>
+
+#if defined(ESP_PLATFORM)
+#include "sdkconfig.h"
+#endif
+#if defined(CONFIG_IDF_TARGET_ESP32S3)
+#include "esp_attr.h"
+#define JPEG_SIMD_PIE 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define JPEG_SIMD_SSE2 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define JPEG_SIMD_NEON 1
+#endif
+
+// Baseline JPEG encoder for raw (RGB565 / grayscale) frames. Pixels are
+// fetched, colour converted and DCT'd one MCU strip at a time straight from
+// the frame buffer, so byte order is handled in the fetch and no converted
+// copy of the frame is ever made. Output goes through a small buffer to a
+// sink callback. Quality follows fmt2jpg() (1-100, IJG table scaling) and
+// colour frames use 4:2:0 subsampling like fmt2jpg() does.
+
+static const uint8_t jpegZigzag[64] = {
+   0,  1,  8, 16,  9,  2,  3, 10, 17, 24, 32, 25, 18, 11,  4,  5,
+  12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13,  6,  7, 14, 21, 28,
+  35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+  58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63
+};
+
+static const uint8_t jpegStdLumQuant[64] = {
+  16, 11, 10, 16,  24,  40,  51,  61,
+  12, 12, 14, 19,  26,  58,  60,  55,
+  14, 13, 16, 24,  40,  57,  69,  56,
+  14, 17, 22, 29,  51,  87,  80,  62,
+  18, 22, 37, 56,  68, 109, 103,  77,
+  24, 35, 55, 64,  81, 104, 113,  92,
+  49, 64, 78, 87, 103, 121, 120, 101,
+  72, 92, 95, 98, 112, 100, 103,  99
+};
+
+static const uint8_t jpegStdChromaQuant[64] = {
+  17, 18, 24, 47, 99, 99, 99, 99,
+  18, 21, 26, 66, 99, 99, 99, 99,
+  24, 26, 56, 99, 99, 99, 99, 99,
+  47, 66, 99, 99, 99, 99, 99, 99,
+  99, 99, 99, 99, 99, 99, 99, 99,
+  99, 99, 99, 99, 99, 99, 99, 99,
+  99, 99, 99, 99, 99, 99, 99, 99,
+  99, 99, 99, 99, 99, 99, 99, 99
+};
+
+static const uint8_t jpegDcLumBits[16] = { 0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0 };
+static const uint8_t jpegDcChromaBits[16] = { 0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0 };
+static const uint8_t jpegDcVals[12] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+
+static const uint8_t jpegAcLumBits[16] = { 0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d };
+static const uint8_t jpegAcLumVals[162] = {
+  0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+  0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+  0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+  0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+  0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+  0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+  0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+  0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+  0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+  0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+  0xf9, 0xfa
+};
+
+static const uint8_t jpegAcChromaBits[16] = { 0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77 };
+static const uint8_t jpegAcChromaVals[162] = {
+  0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+  0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+  0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+  0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+  0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+  0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+  0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+  0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+  0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+  0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+  0xf9, 0xfa
+};
+
+static const float jpegAanScale[8] = {
+  1.0f, 1.387039845f, 1.306562965f, 1.175875602f,
+  1.0f, 0.785694958f, 0.541196100f, 0.275899379f
+};
+
+// Huffman code/length per symbol, built once from the standard tables
+struct JpegHuffman {
+  uint16_t code[256];
+  uint8_t size[256];
+};
+
+static JpegHuffman jpegDcLum, jpegDcChroma, jpegAcLum, jpegAcChroma;
+static bool jpegTablesReady = false;
+
+static void jpegBuildHuffman(JpegHuffman &table, const uint8_t *bits, const uint8_t *vals) {
+  memset(&table, 0, sizeof(table));
+  uint16_t code = 0;
+  int k = 0;
+  for (int len = 1; len <= 16; len++) {
+    for (int i = 0; i < bits[len - 1]; i++) {
+      table.code[vals[k]] = code++;
+      table.size[vals[k]] = len;
+      k++;
+    }
+    code <<= 1;
+  }
+}
+
+#if defined(JPEG_SIMD_SSE2) || defined(JPEG_SIMD_NEON)
+static bool jpegSimdReady = true;
+#else
+static bool jpegSimdReady = false;  // Set by jpegInitTables() once the PIE kernel has checked out
+#endif
+
+static int32_t jpegLutYR[32], jpegLutYG[64], jpegLutYB[32];
+static int32_t jpegLutCbR[32], jpegLutCbG[64], jpegLutCbB[32];
+static int32_t jpegLutCrR[32], jpegLutCrG[64], jpegLutCrB[32];
+
+static void jpegBuildColorTables() {
+  for (int i = 0; i < 32; i++) {
+    int v = i << 3;  // 5-bit red/blue expanded the way fmt2jpg() does
+    jpegLutYR[i] = 19595 * v + 32768;  // Rounding folded into one table
+    jpegLutYB[i] = 7471 * v;
+    jpegLutCbR[i] = -11059 * v;
+    jpegLutCbB[i] = 32768 * v + 8421375;
+    jpegLutCrR[i] = 32768 * v + 8421375;
+    jpegLutCrB[i] = -5329 * v;
+  }
+  for (int i = 0; i < 64; i++) {
+    int v = i << 2;  // 6-bit green
+    jpegLutYG[i] = 38470 * v;
+    jpegLutCbG[i] = -21709 * v;
+    jpegLutCrG[i] = -27439 * v;
+  }
+}
+
+#if defined(JPEG_SIMD_PIE)
+static bool jpegPieCheck();
+#endif
+
+void jpegInitTables() {
+  if (jpegTablesReady) {
+    return;
+  }
+  jpegBuildHuffman(jpegDcLum, jpegDcLumBits, jpegDcVals);
+  jpegBuildHuffman(jpegDcChroma, jpegDcChromaBits, jpegDcVals);
+  jpegBuildHuffman(jpegAcLum, jpegAcLumBits, jpegAcLumVals);
+  jpegBuildHuffman(jpegAcChroma, jpegAcChromaBits, jpegAcChromaVals);
+  jpegBuildColorTables();
+#if defined(JPEG_SIMD_PIE)
+  jpegSimdReady = jpegPieCheck();
+#endif
+  jpegTablesReady = true;
+}
+
+const char *jpegSimdName() {
+  if (!jpegSimdReady) {
+    return NULL;
+  }
+#if defined(JPEG_SIMD_PIE)
+  return "PIE";
+#elif defined(JPEG_SIMD_SSE2)
+  return "SSE2";
+#else
+  return "NEON";
+#endif
+}
+
+struct JpegEncoder {
+  JpegSinkFn sink;
+  void *sinkCtx;
+  bool ok;
+  uint8_t out[JPEG_SINK_BUFFER_SIZE];
+  size_t outLen;
+  uint32_t bitBuffer;
+  int bitCount;
+  uint8_t quantLum[64];    // Natural order, as written to DQT in zigzag order
+  uint8_t quantChroma[64];
+  float fdtblLum[64];      // Reciprocal divisors with the AAN scale folded in
+  float fdtblChroma[64];
+};
+
+static void jpegFlushOut(JpegEncoder &enc) {
+  if (enc.outLen > 0 && enc.ok) {
+    enc.ok = enc.sink(enc.sinkCtx, enc.out, enc.outLen);
+  }
+  enc.outLen = 0;
+}
+
+static inline void jpegPutByte(JpegEncoder &enc, uint8_t c) {
+  enc.out[enc.outLen++] = c;
+  if (enc.outLen == JPEG_SINK_BUFFER_SIZE) {
+    jpegFlushOut(enc);
+  }
+}
+
+static void jpegPutWord(JpegEncoder &enc, uint16_t w) {
+  jpegPutByte(enc, w >> 8);
+  jpegPutByte(enc, w & 0xFF);
+}
+
+static inline void jpegPutBits(JpegEncoder &enc, uint32_t bits, int size) {
+  enc.bitBuffer = (enc.bitBuffer << size) | (bits & ((1UL << size) - 1));
+  enc.bitCount += size;
+  while (enc.bitCount >= 8) {
+    uint8_t c = (enc.bitBuffer >> (enc.bitCount - 8)) & 0xFF;
+    jpegPutByte(enc, c);
+    if (c == 0xFF) {
+      jpegPutByte(enc, 0); // Byte stuffing
+    }
+    enc.bitCount -= 8;
+  }
+}
+
+static void jpegSetQuality(JpegEncoder &enc, int quality) {
+  if (quality < 1) quality = 1;
+  if (quality > 100) quality = 100;
+  int scale = (quality < 50) ? 5000 / quality : 200 - quality * 2;
+  
+  for (int i = 0; i < 64; i++) {
+    int lum = (jpegStdLumQuant[i] * scale + 50) / 100;
+    int chroma = (jpegStdChromaQuant[i] * scale + 50) / 100;
+    enc.quantLum[i] = lum < 1 ? 1 : (lum > 255 ? 255 : lum);
+    enc.quantChroma[i] = chroma < 1 ? 1 : (chroma > 255 ? 255 : chroma);
+  }
+  for (int row = 0; row < 8; row++) {
+    for (int col = 0; col < 8; col++) {
+      int i = row * 8 + col;
+      float aan = jpegAanScale[row] * jpegAanScale[col] * 8.0f;
+      enc.fdtblLum[i] = 1.0f / (enc.quantLum[i] * aan);
+      enc.fdtblChroma[i] = 1.0f / (enc.quantChroma[i] * aan);
+    }
+  }
+}
+
+static void jpegWriteHuffmanTable(JpegEncoder &enc, uint8_t tableClass, const uint8_t *bits, const uint8_t *vals, int count) {
+  jpegPutByte(enc, tableClass);
+  for (int i = 0; i < 16; i++) jpegPutByte(enc, bits[i]);
+  for (int i = 0; i < count; i++) jpegPutByte(enc, vals[i]);
+}
+
+static void jpegWriteHeaders(JpegEncoder &enc, uint16_t width, uint16_t height, bool color) {
+  int components = color ? 3 : 1;
+  
+  // SOI + JFIF APP0
+  static const uint8_t jfif[] = {
+    0xFF, 0xD8, 0xFF, 0xE0, 0x00, 0x10, 'J', 'F', 'I', 'F', 0x00,
+    0x01, 0x01, 0x00, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00
+  };
+  for (size_t i = 0; i < sizeof(jfif); i++) jpegPutByte(enc, jfif[i]);
+  
+  // DQT
+  jpegPutWord(enc, 0xFFDB);
+  jpegPutWord(enc, 2 + 65 * (color ? 2 : 1));
+  jpegPutByte(enc, 0);
+  for (int i = 0; i < 64; i++) jpegPutByte(enc, enc.quantLum[jpegZigzag[i]]);
+  if (color) {
+    jpegPutByte(enc, 1);
+    for (int i = 0; i < 64; i++) jpegPutByte(enc, enc.quantChroma[jpegZigzag[i]]);
+  }
+  
+  // SOF0
+  jpegPutWord(enc, 0xFFC0);
+  jpegPutWord(enc, 8 + 3 * components);
+  jpegPutByte(enc, 8);
+  jpegPutWord(enc, height);
+  jpegPutWord(enc, width);
+  jpegPutByte(enc, components);
+  if (color) {
+    static const uint8_t sof[] = { 1, 0x22, 0, 2, 0x11, 1, 3, 0x11, 1 };
+    for (size_t i = 0; i < sizeof(sof); i++) jpegPutByte(enc, sof[i]);
+  } else {
+    jpegPutByte(enc, 1);
+    jpegPutByte(enc, 0x11);
+    jpegPutByte(enc, 0);
+  }
+  
+  // DHT
+  jpegPutWord(enc, 0xFFC4);
+  jpegPutWord(enc, 2 + (17 + 12) + (17 + 162) + (color ? (17 + 12) + (17 + 162) : 0));
+  jpegWriteHuffmanTable(enc, 0x00, jpegDcLumBits, jpegDcVals, 12);
+  jpegWriteHuffmanTable(enc, 0x10, jpegAcLumBits, jpegAcLumVals, 162);
+  if (color) {
+    jpegWriteHuffmanTable(enc, 0x01, jpegDcChromaBits, jpegDcVals, 12);
+    jpegWriteHuffmanTable(enc, 0x11, jpegAcChromaBits, jpegAcChromaVals, 162);
+  }
+  
+  // SOS
+  jpegPutWord(enc, 0xFFDA);
+  jpegPutWord(enc, 6 + 2 * components);
+  jpegPutByte(enc, components);
+  if (color) {
+    static const uint8_t sos[] = { 1, 0x00, 2, 0x11, 3, 0x11 };
+    for (size_t i = 0; i < sizeof(sos); i++) jpegPutByte(enc, sos[i]);
+  } else {
+    jpegPutByte(enc, 1);
+    jpegPutByte(enc, 0x00);
+  }
+  jpegPutByte(enc, 0);
+  jpegPutByte(enc, 63);
+  jpegPutByte(enc, 0);
+}
+
+// In-place forward DCT (AAN, floating point); output is scaled by the AAN
+// factors, which the quantiser divisors account for
+static void jpegFdct(float *data) {
+  float *p = data;
+  for (int pass = 0; pass < 2; pass++) {
+    int step = (pass == 0) ? 1 : 8;     // Rows, then columns
+    int next = (pass == 0) ? 8 : 1;
+    p = data;
+    for (int i = 0; i < 8; i++, p += next) {
+      float tmp0 = p[0] + p[7 * step];
+      float tmp7 = p[0] - p[7 * step];
+      float tmp1 = p[1 * step] + p[6 * step];
+      float tmp6 = p[1 * step] - p[6 * step];
+      float tmp2 = p[2 * step] + p[5 * step];
+      float tmp5 = p[2 * step] - p[5 * step];
+      float tmp3 = p[3 * step] + p[4 * step];
+      float tmp4 = p[3 * step] - p[4 * step];
+  
+      float tmp10 = tmp0 + tmp3;
+      float tmp13 = tmp0 - tmp3;
+      float tmp11 = tmp1 + tmp2;
+      float tmp12 = tmp1 - tmp2;
+  
+      p[0] = tmp10 + tmp11;
+      p[4 * step] = tmp10 - tmp11;
+      float z1 = (tmp12 + tmp13) * 0.707106781f;
+      p[2 * step] = tmp13 + z1;
+      p[6 * step] = tmp13 - z1;
+  
+      tmp10 = tmp4 + tmp5;
+      tmp11 = tmp5 + tmp6;
+      tmp12 = tmp6 + tmp7;
+      float z5 = (tmp10 - tmp12) * 0.382683433f;
+      float z2 = 0.541196100f * tmp10 + z5;
+      float z4 = 1.306562965f * tmp12 + z5;
+      float z3 = tmp11 * 0.707106781f;
+      float z11 = tmp7 + z3;
+      float z13 = tmp7 - z3;
+      p[5 * step] = z13 + z2;
+      p[3 * step] = z13 - z2;
+      p[1 * step] = z11 + z4;
+      p[7 * step] = z11 - z4;
+    }
+  }
+}
+
+static inline void jpegPutValue(JpegEncoder &enc, int value, const JpegHuffman &table, int run) {
+  int magnitude = value < 0 ? -value : value;
+  int nbits = 0;
+  while (magnitude) {
+    nbits++;
+    magnitude >>= 1;
+  }
+  int symbol = (run << 4) | nbits;
+  jpegPutBits(enc, table.code[symbol], table.size[symbol]);
+  if (nbits) {
+    jpegPutBits(enc, value < 0 ? value - 1 : value, nbits);
+  }
+}
+
+void jpegLevelShiftRef(const uint8_t *src, int stride, float *block) {
+  for (int row = 0; row < 8; row++) {
+    const uint8_t *line = src + row * stride;
+    for (int col = 0; col < 8; col++) {
+      block[row * 8 + col] = (float)line[col] - 128.0f;
+    }
+  }
+}
+
+// Encodes one 8x8 block of 8-bit samples taken from a plane with the given stride
+static void jpegEncodeBlock(JpegEncoder &enc, const uint8_t *src, int stride, const float *fdtbl,
+                            int &dcPrev, const JpegHuffman &dc, const JpegHuffman &ac) {
+  float block[64];
+  jpegLevelShiftSimd(src, stride, block);
+  jpegFdct(block);
+  
+  int coeffs[64];
+  for (int i = 0; i < 64; i++) {
+    int n = jpegZigzag[i];
+    float v = block[n] * fdtbl[n];
+    coeffs[i] = (int)(v < 0 ? v - 0.5f : v + 0.5f);
+  }
+  
+  int diff = coeffs[0] - dcPrev;
+  dcPrev = coeffs[0];
+  jpegPutValue(enc, diff, dc, 0);
+  
+  int run = 0;
+  for (int i = 1; i < 64; i++) {
+    if (coeffs[i] == 0) {
+      run++;
+      continue;
+    }
+    while (run > 15) {
+      jpegPutBits(enc, ac.code[0xF0], ac.size[0xF0]); // ZRL
+      run -= 16;
+    }
+    jpegPutValue(enc, coeffs[i], ac, run);
+    run = 0;
+  }
+  if (run > 0) {
+    jpegPutBits(enc, ac.code[0x00], ac.size[0x00]); // EOB
+  }
+}
+
+void jpegRowRgb565Ref(const uint8_t *src, int width, bool swapBytes, uint8_t *outY, uint8_t *outCb, uint8_t *outCr) {
+  int hiIndex = swapBytes ? 1 : 0;
+  int loIndex = swapBytes ? 0 : 1;
+  for (int x = 0; x < width; x++) {
+    uint8_t hi = src[x * 2 + hiIndex];
+    uint8_t lo = src[x * 2 + loIndex];
+    int red = hi & 0xF8;
+    int green = ((hi & 0x07) << 5) | ((lo & 0xE0) >> 3);
+    int blue = (lo & 0x1F) << 3;
+    outY[x] = (uint8_t)((19595 * red + 38470 * green + 7471 * blue + 32768) >> 16);
+    outCb[x] = (uint8_t)((-11059 * red - 21709 * green + 32768 * blue + 8421375) >> 16);
+    outCr[x] = (uint8_t)((32768 * red - 27439 * green - 5329 * blue + 8421375) >> 16);
+  }
+}
+
+static inline void jpegPixelFast(uint32_t p, uint8_t *outY, uint8_t *outCb, uint8_t *outCr) {
+  uint32_t r = p >> 11;
+  uint32_t g = (p >> 5) & 0x3F;
+  uint32_t b = p & 0x1F;
+  *outY = (uint8_t)((jpegLutYR[r] + jpegLutYG[g] + jpegLutYB[b]) >> 16);
+  *outCb = (uint8_t)((jpegLutCbR[r] + jpegLutCbG[g] + jpegLutCbB[b]) >> 16);
+  *outCr = (uint8_t)((jpegLutCrR[r] + jpegLutCrG[g] + jpegLutCrB[b]) >> 16);
+}
+
+void jpegRowRgb565Fast(const uint8_t *src, int width, bool swapBytes, uint8_t *outY, uint8_t *outCb, uint8_t *outCr) {
+  const uint32_t *words = (const uint32_t*)src;
+  for (int x = 0; x < width; x += 2) {
+    uint32_t w = *words++;
+    // Little-endian load: a pixel stored high byte first comes out swapped,
+    // so the sensor's order needs the swap and "big endian" doesn't
+    if (!swapBytes) {
+      w = ((w & 0x00FF00FF) << 8) | ((w >> 8) & 0x00FF00FF);
+    }
+    jpegPixelFast(w & 0xFFFF, outY + x, outCb + x, outCr + x);
+    jpegPixelFast(w >> 16, outY + x + 1, outCb + x + 1, outCr + x + 1);
+  }
+}
+
+// The SIMD row kernel does the reference kernel's arithmetic eight pixels
+// at a time, so its output is identical too. 38470 and 32768 don't fit in a
+// 16-bit lane, so where a lane multiplier is 16 bits wide they are applied
+// as two halves.
+#if defined(JPEG_SIMD_SSE2)
+
+// One 16-bit coefficient pair for _mm_madd_epi16 over interleaved a/b lanes
+static inline __m128i jpegPair(int a, int b) {
+  return _mm_set1_epi32((int)((uint16_t)a | ((uint32_t)(uint16_t)b << 16)));
+}
+
+// Eight 32-bit weighted sums (as two halves), shifted down and packed to bytes
+static inline void jpegStoreChannel(__m128i lo, __m128i hi, uint8_t *out) {
+  __m128i words = _mm_packs_epi32(_mm_srai_epi32(lo, 16), _mm_srai_epi32(hi, 16));
+  _mm_storel_epi64((__m128i*)out, _mm_packus_epi16(words, words));
+}
+
+void jpegRowRgb565Simd(const uint8_t *src, int width, bool swapBytes, uint8_t *outY, uint8_t *outCb, uint8_t *outCr) {
+  const __m128i maskRB = _mm_set1_epi16(0xF8);
+  const __m128i maskG = _mm_set1_epi16(0xFC);
+  const __m128i biasY = _mm_set1_epi32(32768);
+  const __m128i biasC = _mm_set1_epi32(8421375);
+  const __m128i yRG = jpegPair(19595, 19235), yBG = jpegPair(7471, 19235);
+  const __m128i cbRB = jpegPair(-11059, 16384), cbGB = jpegPair(-21709, 16384);
+  const __m128i crRG = jpegPair(16384, -27439), crRB = jpegPair(16384, -5329);
+  for (int x = 0; x < width; x += 8) {
+    __m128i p = _mm_loadu_si128((const __m128i*)(src + x * 2));
+    if (!swapBytes) {
+      p = _mm_or_si128(_mm_slli_epi16(p, 8), _mm_srli_epi16(p, 8));
+    }
+    __m128i r = _mm_and_si128(_mm_srli_epi16(p, 8), maskRB);
+    __m128i g = _mm_and_si128(_mm_srli_epi16(p, 3), maskG);
+    __m128i b = _mm_and_si128(_mm_slli_epi16(p, 3), maskRB);
+    __m128i rgLo = _mm_unpacklo_epi16(r, g), rgHi = _mm_unpackhi_epi16(r, g);
+    __m128i rbLo = _mm_unpacklo_epi16(r, b), rbHi = _mm_unpackhi_epi16(r, b);
+    __m128i bgLo = _mm_unpacklo_epi16(b, g), bgHi = _mm_unpackhi_epi16(b, g);
+    __m128i gbLo = _mm_unpacklo_epi16(g, b), gbHi = _mm_unpackhi_epi16(g, b);
+    jpegStoreChannel(_mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(rgLo, yRG), _mm_madd_epi16(bgLo, yBG)), biasY),
+                     _mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(rgHi, yRG), _mm_madd_epi16(bgHi, yBG)), biasY),
+                     outY + x);
+    jpegStoreChannel(_mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(rbLo, cbRB), _mm_madd_epi16(gbLo, cbGB)), biasC),
+                     _mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(rbHi, cbRB), _mm_madd_epi16(gbHi, cbGB)), biasC),
+                     outCb + x);
+    jpegStoreChannel(_mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(rgLo, crRG), _mm_madd_epi16(rbLo, crRB)), biasC),
+                     _mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(rgHi, crRG), _mm_madd_epi16(rbHi, crRB)), biasC),
+                     outCr + x);
+  }
+}
+
+void jpegLevelShiftSimd(const uint8_t *src, int stride, float *block) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i offset = _mm_set1_epi16(128);
+  for (int row = 0; row < 8; row++) {
+    __m128i v = _mm_loadl_epi64((const __m128i*)(src + row * stride));
+    v = _mm_sub_epi16(_mm_unpacklo_epi8(v, zero), offset);
+    __m128i sign = _mm_srai_epi16(v, 15);
+    _mm_storeu_ps(block + row * 8, _mm_cvtepi32_ps(_mm_unpacklo_epi16(v, sign)));
+    _mm_storeu_ps(block + row * 8 + 4, _mm_cvtepi32_ps(_mm_unpackhi_epi16(v, sign)));
+  }
+}
+
+#elif defined(JPEG_SIMD_NEON)
+
+// Four 32-bit weighted sums per half, shifted down and narrowed to bytes
+static inline uint8x8_t jpegNeonChannel(int16x8_t r, int16x8_t g, int16x8_t b,
+                                        int32_t cr, int32_t cg, int32_t cb, int32_t bias) {
+  int32x4_t lo = vdupq_n_s32(bias), hi = vdupq_n_s32(bias);
+  lo = vmlaq_n_s32(lo, vmovl_s16(vget_low_s16(r)), cr);
+  hi = vmlaq_n_s32(hi, vmovl_s16(vget_high_s16(r)), cr);
+  lo = vmlaq_n_s32(lo, vmovl_s16(vget_low_s16(g)), cg);
+  hi = vmlaq_n_s32(hi, vmovl_s16(vget_high_s16(g)), cg);
+  lo = vmlaq_n_s32(lo, vmovl_s16(vget_low_s16(b)), cb);
+  hi = vmlaq_n_s32(hi, vmovl_s16(vget_high_s16(b)), cb);
+  return vqmovun_s16(vcombine_s16(vmovn_s32(vshrq_n_s32(lo, 16)), vmovn_s32(vshrq_n_s32(hi, 16))));
+}
+
+void jpegRowRgb565Simd(const uint8_t *src, int width, bool swapBytes, uint8_t *outY, uint8_t *outCb, uint8_t *outCr) {
+  for (int x = 0; x < width; x += 8) {
+    uint8x16_t bytes = vld1q_u8(src + x * 2);
+    if (!swapBytes) {
+      bytes = vrev16q_u8(bytes);
+    }
+    uint16x8_t p = vreinterpretq_u16_u8(bytes);
+    int16x8_t r = vreinterpretq_s16_u16(vandq_u16(vshrq_n_u16(p, 8), vdupq_n_u16(0xF8)));
+    int16x8_t g = vreinterpretq_s16_u16(vandq_u16(vshrq_n_u16(p, 3), vdupq_n_u16(0xFC)));
+    int16x8_t b = vreinterpretq_s16_u16(vandq_u16(vshlq_n_u16(p, 3), vdupq_n_u16(0xF8)));
+    vst1_u8(outY + x, jpegNeonChannel(r, g, b, 19595, 38470, 7471, 32768));
+    vst1_u8(outCb + x, jpegNeonChannel(r, g, b, -11059, -21709, 32768, 8421375));
+    vst1_u8(outCr + x, jpegNeonChannel(r, g, b, 32768, -27439, -5329, 8421375));
+  }
+}
+
+void jpegLevelShiftSimd(const uint8_t *src, int stride, float *block) {
+  for (int row = 0; row < 8; row++) {
+    int16x8_t v = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vld1_u8(src + row * stride))), vdupq_n_s16(128));
+    vst1q_f32(block + row * 8, vcvtq_f32_s32(vmovl_s16(vget_low_s16(v))));
+    vst1q_f32(block + row * 8 + 4, vcvtq_f32_s32(vmovl_s16(vget_high_s16(v))));
+  }
+}
+
+#elif defined(JPEG_SIMD_PIE)
+
+// ESP32-S3 PIE: eight 16-bit lanes per Q register, with the weighted sums
+// built in the 40-bit QACC lanes and shifted back out by EE.SRCMB. The
+// constants are loaded in the order the code below walks them.
+DRAM_ATTR static const int16_t jpegPieConst[17][8] __attribute__((aligned(16))) = {
+  { 0xF8, 0xF8, 0xF8, 0xF8, 0xF8, 0xF8, 0xF8, 0xF8 },  // Red mask (after >> 8)
+  { 0x1F, 0x1F, 0x1F, 0x1F, 0x1F, 0x1F, 0x1F, 0x1F },  // Blue field
+  { 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC },  // Green mask (after >> 3)
+  { 1, 1, 1, 1, 1, 1, 1, 1 },
+  { 16384, 16384, 16384, 16384, 16384, 16384, 16384, 16384 },  // Y rounding, applied twice
+  { 19595, 19595, 19595, 19595, 19595, 19595, 19595, 19595 },
+  { 19235, 19235, 19235, 19235, 19235, 19235, 19235, 19235 },  // Half of 38470
+  { 7471, 7471, 7471, 7471, 7471, 7471, 7471, 7471 },
+  { 32767, 32767, 32767, 32767, 32767, 32767, 32767, 32767 },  // Cb/Cr rounding, less the 128 << 16
+  { -11059, -11059, -11059, -11059, -11059, -11059, -11059, -11059 },
+  { -21709, -21709, -21709, -21709, -21709, -21709, -21709, -21709 },
+  { 16384, 16384, 16384, 16384, 16384, 16384, 16384, 16384 },  // Half of 32768
+  { 128, 128, 128, 128, 128, 128, 128, 128 },
+  { 16384, 16384, 16384, 16384, 16384, 16384, 16384, 16384 },
+  { -27439, -27439, -27439, -27439, -27439, -27439, -27439, -27439 },
+  { -5329, -5329, -5329, -5329, -5329, -5329, -5329, -5329 },
+  { 128, 128, 128, 128, 128, 128, 128, 128 },
+};
+
+// Eight pixels into q7 as 16-bit values, read as stored (swapBytes) or
+// byte swapped with an unzip/zip pair (sensor order)
+#define JPEG_PIE_LOAD_SWAPPED \
+  "ee.vld.128.ip q0, %[src], 16\n" \
+  "ee.orq q7, q0, q0\n"
+#define JPEG_PIE_LOAD_SENSOR \
+  "ee.vld.128.ip q0, %[src], 16\n" \
+  "ee.vunzip.8 q0, q7\n" \
+  "ee.vzip.8 q7, q0\n"
+
+// q0/q1/q2 = red/green/blue expanded to 8 bits, q5 = ones, then one QACC
+// pass per output. The blue field is scaled with adds since PIE has no
+// lane-wise left shift by a constant, and EE.VSR.32 crossing into the
+// neighbouring lane is masked away.
+#define JPEG_PIE_CONVERT \
+  "ee.vld.128.ip q6, %[k], 16\n" \
+  "ssai 8\n" \
+  "ee.vsr.32 q0, q7\n" \
+  "ee.andq q0, q0, q6\n" \
+  "ee.vld.128.ip q5, %[k], 16\n" \
+  "ee.andq q2, q7, q5\n" \
+  "ee.vadds.s16 q2, q2, q2\n" \
+  "ee.vadds.s16 q2, q2, q2\n" \
+  "ee.vadds.s16 q2, q2, q2\n" \
+  "ee.vld.128.ip q5, %[k], 16\n" \
+  "ssai 3\n" \
+  "ee.vsr.32 q1, q7\n" \
+  "ee.andq q1, q1, q5\n" \
+  "ee.vld.128.ip q5, %[k], 16\n" \
+  \
+  "ee.zero.qacc\n" \
+  "ee.vld.128.ip q6, %[k], 16\n" \
+  "ee.vmulas.s16.qacc q5, q6\n" \
+  "ee.vmulas.s16.qacc q5, q6\n" \
+  "ee.vld.128.ip q3, %[k], 16\n" \
+  "ee.vmulas.s16.qacc q0, q3\n" \
+  "ee.vld.128.ip q3, %[k], 16\n" \
+  "ee.vmulas.s16.qacc q1, q3\n" \
+  "ee.vmulas.s16.qacc q1, q3\n" \
+  "ee.vld.128.ip q3, %[k], 16\n" \
+  "ee.vmulas.s16.qacc q2, q3\n" \
+  "ee.srcmb.s16.qacc q4, %[shift], 0\n" \
+  "ee.vunzip.8 q4, q3\n" \
+  "ee.vst.l.64.ip q4, %[y], 8\n" \
+  \
+  "ee.zero.qacc\n" \
+  "ee.vld.128.ip q6, %[k], 16\n" \
+  "ee.vmulas.s16.qacc q5, q6\n" \
+  "ee.vld.128.ip q3, %[k], 16\n" \
+  "ee.vmulas.s16.qacc q0, q3\n" \
+  "ee.vld.128.ip q3, %[k], 16\n" \
+  "ee.vmulas.s16.qacc q1, q3\n" \
+  "ee.vld.128.ip q3, %[k], 16\n" \
+  "ee.vmulas.s16.qacc q2, q3\n" \
+  "ee.vmulas.s16.qacc q2, q3\n" \
+  "ee.srcmb.s16.qacc q4, %[shift], 0\n" \
+  "ee.vld.128.ip q3, %[k], 16\n" \
+  "ee.vadds.s16 q4, q4, q3\n" \
+  "ee.vunzip.8 q4, q3\n" \
+  "ee.vst.l.64.ip q4, %[cb], 8\n" \
+  \
+  "ee.zero.qacc\n" \
+  "ee.vmulas.s16.qacc q5, q6\n" \
+  "ee.vld.128.ip q3, %[k], 16\n" \
+  "ee.vmulas.s16.qacc q0, q3\n" \
+  "ee.vmulas.s16.qacc q0, q3\n" \
+  "ee.vld.128.ip q3, %[k], 16\n" \
+  "ee.vmulas.s16.qacc q1, q3\n" \
+  "ee.vld.128.ip q3, %[k], 16\n" \
+  "ee.vmulas.s16.qacc q2, q3\n" \
+  "ee.srcmb.s16.qacc q4, %[shift], 0\n" \
+  "ee.vld.128.ip q3, %[k], 16\n" \
+  "ee.vadds.s16 q4, q4, q3\n" \
+  "ee.vunzip.8 q4, q3\n" \
+  "ee.vst.l.64.ip q4, %[cr], 8\n"
+
+void jpegRowRgb565Simd(const uint8_t *src, int width, bool swapBytes, uint8_t *outY, uint8_t *outCb, uint8_t *outCr) {
+  for (int x = 0; x < width; x += 8) {
+    const int16_t *k = &jpegPieConst[0][0];
+    if (swapBytes) {
+      asm volatile(JPEG_PIE_LOAD_SWAPPED JPEG_PIE_CONVERT
+                   : [src] "+r"(src), [k] "+r"(k), [y] "+r"(outY), [cb] "+r"(outCb), [cr] "+r"(outCr)
+                   : [shift] "r"(16)
+                   : "memory");
+    } else {
+      asm volatile(JPEG_PIE_LOAD_SENSOR JPEG_PIE_CONVERT
+                   : [src] "+r"(src), [k] "+r"(k), [y] "+r"(outY), [cb] "+r"(outCb), [cr] "+r"(outCr)
+                   : [shift] "r"(16)
+                   : "memory");
+    }
+  }
+}
+
+// The DCT is scalar float on the ESP32-S3 and PIE has no float lanes, so the
+// level shift stays the reference loop there
+void jpegLevelShiftSimd(const uint8_t *src, int stride, float *block) {
+  jpegLevelShiftRef(src, stride, block);
+}
+
+// The host tests can't run the PIE kernel, so it is checked against the
+// reference for every pixel value in both byte orders when the tables are
+// built, and left unused if anything differs
+static bool jpegPieCheck() {
+  uint16_t src[64] __attribute__((aligned(16)));
+  uint8_t ref[3][64] __attribute__((aligned(16)));
+  uint8_t pie[3][64] __attribute__((aligned(16)));
+  for (int base = 0; base < 65536; base += 64) {
+    for (int i = 0; i < 64; i++) {
+      src[i] = base + i;
+    }
+    for (int swap = 0; swap < 2; swap++) {
+      jpegRowRgb565Ref((const uint8_t*)src, 64, swap, ref[0], ref[1], ref[2]);
+      jpegRowRgb565Simd((const uint8_t*)src, 64, swap, pie[0], pie[1], pie[2]);
+      if (memcmp(ref, pie, sizeof(ref)) != 0) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+#else
+
+void jpegRowRgb565Simd(const uint8_t *src, int width, bool swapBytes, uint8_t *outY, uint8_t *outCb, uint8_t *outCr) {
+  jpegRowRgb565Fast(src, width, swapBytes, outY, outCb, outCr);
+}
+
+void jpegLevelShiftSimd(const uint8_t *src, int stride, float *block) {
+  jpegLevelShiftRef(src, stride, block);
+}
+
+#endif
+
+static inline void jpegRowRgb565(const uint8_t *src, int width, bool swapBytes, uint8_t *outY, uint8_t *outCb, uint8_t *outCr) {
+  uintptr_t addresses = (uintptr_t)src | (uintptr_t)outY | (uintptr_t)outCb | (uintptr_t)outCr;
+  if (jpegSimdReady && (addresses & 15) == 0 && (width & 7) == 0) {
+    jpegRowRgb565Simd(src, width, swapBytes, outY, outCb, outCr);
+  } else if ((((uintptr_t)src) & 3) == 0 && (width & 1) == 0) {
+    jpegRowRgb565Fast(src, width, swapBytes, outY, outCb, outCr);
+  } else {
+    jpegRowRgb565Ref(src, width, swapBytes, outY, outCb, outCr);
+  }
+}
+
+// Fills one strip of Y/Cb/Cr planes (stride = padded width) from raw pixels,
+// repeating the last column and row into the padding. RGB565 is read in the
+// sensor's byte order, or swapped when swapBytes is set.
+static void jpegConvertStrip(const uint8_t *pixels, uint16_t width, uint16_t height, pixformat_t format,
+                             bool swapBytes, int y0, int rows, int stride,
+                             uint8_t *planeY, uint8_t *planeCb, uint8_t *planeCr) {
+  for (int r = 0; r < rows; r++) {
+    int y = y0 + r;
+    if (y >= height) y = height - 1;
+    uint8_t *outY = planeY + r * stride;
+  
+    if (format == PIXFORMAT_GRAYSCALE) {
+      memcpy(outY, pixels + (size_t)y * width, width);
+      memset(outY + width, outY[width - 1], stride - width);
+      continue;
+    }
+  
+    uint8_t *outCb = planeCb + r * stride;
+    uint8_t *outCr = planeCr + r * stride;
+    jpegRowRgb565(pixels + (size_t)y * width * 2, width, swapBytes, outY, outCb, outCr);
+    memset(outY + width, outY[width - 1], stride - width);
+    memset(outCb + width, outCb[width - 1], stride - width);
+    memset(outCr + width, outCr[width - 1], stride - width);
+  }
+}
+
+// Averages a 16x16 area of a chroma plane down to one 8x8 block
+static void jpegSubsample(const uint8_t *src, int stride, uint8_t *dst) {
+  for (int row = 0; row < 8; row++) {
+    const uint8_t *a = src + (row * 2) * stride;
+    const uint8_t *b = a + stride;
+    for (int col = 0; col < 8; col++) {
+      dst[row * 8 + col] = (a[col * 2] + a[col * 2 + 1] + b[col * 2] + b[col * 2 + 1] + 2) >> 2;
+    }
+  }
+}
+
+// Encodes an RGB565 or grayscale frame, streaming the result to sink
+bool jpegEncode(const uint8_t *pixels, uint16_t width, uint16_t height, pixformat_t format,
+                bool swapBytes, int quality, JpegSinkFn sink, void *sinkCtx) {
+  if (format != PIXFORMAT_RGB565 && format != PIXFORMAT_GRAYSCALE) {
+    return false;
+  }
+  jpegInitTables();
+  
+  bool color = (format == PIXFORMAT_RGB565);
+  int mcuSize = color ? 16 : 8;
+  int stride = (width + mcuSize - 1) / mcuSize * mcuSize;
+  
+  JpegEncoder *enc = (JpegEncoder*)jpegScratchBorrow(JPEG_SCRATCH_STATE, sizeof(JpegEncoder));
+  uint8_t *planes = (uint8_t*)jpegScratchBorrow(JPEG_SCRATCH_PLANES, stride * mcuSize * (color ? 3 : 1));
+  if (!enc || !planes) {
+    jpegScratchRelease(enc);
+    jpegScratchRelease(planes);
+    return false;
+  }
+  uint8_t *planeY = planes;
+  uint8_t *planeCb = color ? planes + stride * mcuSize : NULL;
+  uint8_t *planeCr = color ? planes + stride * mcuSize * 2 : NULL;
+  
+  enc->sink = sink;
+  enc->sinkCtx = sinkCtx;
+  enc->ok = true;
+  enc->outLen = 0;
+  enc->bitBuffer = 0;
+  enc->bitCount = 0;
+  jpegSetQuality(*enc, quality);
+  jpegWriteHeaders(*enc, width, height, color);
+  
+  int dcY = 0, dcCb = 0, dcCr = 0;
+  uint8_t chroma[64];
+  int strip = 0;
+  for (int y0 = 0; y0 < height && enc->ok; y0 += mcuSize, strip++) {
+    jpegConvertStrip(pixels, width, height, format, swapBytes, y0, mcuSize, stride, planeY, planeCb, planeCr);
+  
+    for (int x = 0; x < stride; x += mcuSize) {
+      if (color) {
+        jpegEncodeBlock(*enc, planeY + x, stride, enc->fdtblLum, dcY, jpegDcLum, jpegAcLum);
+        jpegEncodeBlock(*enc, planeY + x + 8, stride, enc->fdtblLum, dcY, jpegDcLum, jpegAcLum);
+        jpegEncodeBlock(*enc, planeY + 8 * stride + x, stride, enc->fdtblLum, dcY, jpegDcLum, jpegAcLum);
+        jpegEncodeBlock(*enc, planeY + 8 * stride + x + 8, stride, enc->fdtblLum, dcY, jpegDcLum, jpegAcLum);
+        jpegSubsample(planeCb + x, stride, chroma);
+        jpegEncodeBlock(*enc, chroma, 8, enc->fdtblChroma, dcCb, jpegDcChroma, jpegAcChroma);
+        jpegSubsample(planeCr + x, stride, chroma);
+        jpegEncodeBlock(*enc, chroma, 8, enc->fdtblChroma, dcCr, jpegDcChroma, jpegAcChroma);
+      } else {
+        jpegEncodeBlock(*enc, planeY + x, stride, enc->fdtblLum, dcY, jpegDcLum, jpegAcLum);
+      }
+    }
+  
+    // Give other tasks a turn on long frames
+    if ((strip & 7) == 7) {
+      jpegYield();
+    }
+  }
+  
+  // Pad the last byte with 1s, then EOI
+  if (enc->bitCount > 0) {
+    jpegPutBits(*enc, 0x7F, 7);
+  }
+  enc->bitCount = 0;
+  jpegPutWord(*enc, 0xFFD9);
+  jpegFlushOut(*enc);
+  
+  bool ok = enc->ok;
+  jpegScratchRelease(planes);
+  jpegScratchRelease(enc);
+  return ok;
+}
+
+size_t jpegEncoderStateSize() {
+  return sizeof(JpegEncoder);
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+// Baseline JPEG encoder for raw RGB565 and grayscale frames, used for
+// captures in those formats and for thumbnails. Kept apart from main.cpp so
+// the host tests and benchmarks (env:native) build it unchanged.
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_camera.h"   // pixformat_t
+
+#define JPEG_SINK_BUFFER_SIZE 4096  // Encoder output is handed to its sink in chunks of this size (a whole number of SD sectors)
+
+// Receives each chunk of the compressed bitstream; returns false to abort
+typedef bool (*JpegSinkFn)(void *ctx, const uint8_t *data, size_t len);
+
+// Supplied by whoever links the encoder: where its state and strip planes
+// come from, and a chance for other tasks to run during long frames. The
+// sketch lends capture arena regions and delays a tick; the host builds use
+// the heap and do nothing.
+enum JpegScratch {
+  JPEG_SCRATCH_STATE,   // jpegEncoderStateSize() bytes
+  JPEG_SCRATCH_PLANES   // Y/Cb/Cr strip planes
+};
+void *jpegScratchBorrow(JpegScratch which, size_t size);
+void jpegScratchRelease(void *ptr);
+void jpegYield();
+
+void jpegInitTables();
+size_t jpegEncoderStateSize();
+
+// Colour conversion kernels. Each converts one row of RGB565 into Y, Cb and
+// Cr rows using the same fixed-point BT.601 weights as fmt2jpg(). The
+// reference kernel is the plain per-pixel version; the fast kernel reads two
+// pixels per 32-bit load, does any byte swap word-wide, and replaces the nine
+// multiplies per pixel with table lookups whose entries are exactly those
+// products, so both produce identical output. The fast kernel needs a 4-byte
+// aligned row and an even width (the encoder checks before using it) and jpegInitTables()
+// to have run.
+void jpegRowRgb565Ref(const uint8_t *src, int width, bool swapBytes, uint8_t *outY, uint8_t *outCb, uint8_t *outCr);
+void jpegRowRgb565Fast(const uint8_t *src, int width, bool swapBytes, uint8_t *outY, uint8_t *outCb, uint8_t *outCr);
+
+// SIMD version of the same conversion, eight pixels at a time with the
+// reference kernel's fixed-point arithmetic: PIE on the ESP32-S3, SSE2 or
+// NEON on the host. Needs the row and the three outputs 16-byte aligned and
+// a width that is a multiple of 8 (the encoder checks before using it), and
+// jpegInitTables() to have run. Where there is no SIMD path it runs the fast
+// kernel.
+void jpegRowRgb565Simd(const uint8_t *src, int width, bool swapBytes, uint8_t *outY, uint8_t *outCb, uint8_t *outCr);
+
+// The DCT's input: an 8x8 block of samples from a plane with the given
+// stride, level shifted to -128..127 as floats. The SIMD version (SSE2 or
+// NEON; the reference loop on the ESP32-S3, whose float unit is scalar)
+// gives identical values.
+void jpegLevelShiftRef(const uint8_t *src, int stride, float *block);
+void jpegLevelShiftSimd(const uint8_t *src, int stride, float *block);
+
+// "PIE", "SSE2" or "NEON" for the SIMD path in use, or NULL if there is none.
+// On the ESP32-S3 the PIE kernel is checked against the reference when the
+// tables are built and only used if it matches.
+const char *jpegSimdName();
+
+// Encodes an RGB565 or grayscale frame, streaming the result to sink.
+// RGB565 is read in the sensor's byte order, or swapped when swapBytes is set.
+bool jpegEncode(const uint8_t *pixels, uint16_t width, uint16_t height, pixformat_t format,
+                bool swapBytes, int quality, JpegSinkFn sink, void *sinkCtx);
@@ -1,11 +1,26 @@
 #include "esp_camera.h"
 #include "FS.h"
 #include "SD.h"
+#include "SD_MMC.h"
+#include "ff.h"              // For f_getfree() (cluster size)
 #include <WiFi.h>
 #include <WebServer.h>
 #include <ESPmDNS.h>
 #include <string.h>
+#include <stdarg.h>
+#include <vector>
+#include <algorithm>
+#include <unistd.h>          // For truncate() (trimming burst packs)
 #include "img_converters.h"  // For fmt2jpg() function
+#include "esp_jpg_decode.h"  // For esp_jpg_decode() (thumbnails)
+#include "esp_timer.h"       // Burst deadlines and stage timings
+#include "jpeg_encoder.h"    // Encoder for raw frames and thumbnails
+#include "burst_pack.h"      // Burst pack file layout
+#include "archive_format.h"  // ZIP/TAR output for /archive
+#include "capture_stages.h"  // Quality, thumbnail and card write arithmetic
+#include "image_info.h"      // Image index entries
+#include "web_routes.h"      // /image, /thumb and /list, written against a portable request/response
+#include "ui_index.h"        // Gzipped web page, generated from web/index.html
 
 #define PWDN_GPIO_NUM     -1
 #define RESET_GPIO_NUM    -1
@@ -26,6 +41,94 @@
 #define BUTTON_PIN        0
 
 #define SD_CS_PIN         21
+#define SD_SCK_PIN        7
+#define SD_MISO_PIN       8
+#define SD_MOSI_PIN       9
+
+// Storage bus. The Sense board wires the card for SPI, but the same lines
+// can run the SDMMC peripheral in 1-bit mode (CLK on SCK, CMD on MOSI, D0 on
+// MISO), which is faster and leaves the CPU alone during transfers. 4-bit
+// mode also needs D1 and D2, which the Sense board doesn't connect, so it
+// is for boards that do: define SD_MMC_D1_PIN and SD_MMC_D2_PIN (D3 is the
+// chip select line). Pick one with -DSD_BUS_MODE=... in platformio.ini.
+#define SD_BUS_SPI         0
+#define SD_BUS_SDMMC_1BIT  1
+#define SD_BUS_SDMMC_4BIT  2
+
+#ifndef SD_BUS_MODE
+#define SD_BUS_MODE SD_BUS_SPI
+#endif
+#ifndef SD_SPI_FREQ_HZ
+#define SD_SPI_FREQ_HZ 4000000  // The SD library's default; most cards manage 20 MHz or more
+#endif
+
+#if SD_BUS_MODE == SD_BUS_SPI
+#define SD_CARD SD
+#define SD_BUS_NAME "SPI"
+#elif SD_BUS_MODE == SD_BUS_SDMMC_1BIT
+#define SD_CARD SD_MMC
+#define SD_BUS_NAME "SDMMC 1-bit"
+#elif SD_BUS_MODE == SD_BUS_SDMMC_4BIT
+#if !defined(SD_MMC_D1_PIN) || !defined(SD_MMC_D2_PIN)
+#error "SD_BUS_SDMMC_4BIT needs SD_MMC_D1_PIN and SD_MMC_D2_PIN"
+#endif
+#define SD_CARD SD_MMC
+#define SD_BUS_NAME "SDMMC 4-bit"
+#else
+#error "Unknown SD_BUS_MODE"
+#endif
+
+#define SD_MOUNT_POINT "/sd"
+#define SD_MAX_OPEN_FILES 8  // Two frames between encode and write, a thumbnail, and web downloads
+
+// Card writes from PSRAM are copied through one internal, DMA-capable
+// buffer in chunks of this size, aligned to the same multiple in the file.
+// Best set to the card's cluster size (32 KB on most SDHC cards) or a
+// multiple of it; the storage benchmark prints the cluster size.
+#ifndef SD_WRITE_CHUNK
+#define SD_WRITE_CHUNK 16384
+#endif
+
+// Logging: lines are formatted into a ring of fixed-size slots and written
+// to Serial by a low-priority task, so capturing never waits on the UART.
+// Any task can log; a slot is claimed with a compare-and-swap on the head
+// ticket, so there is no lock, and a line that finds the ring full is
+// dropped and counted. Levels above LOG_LEVEL compile to nothing; warnings
+// and errors get their level prefixed, so messages don't spell it out.
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN  2
+#define LOG_LEVEL_INFO  3
+#define LOG_LEVEL_DEBUG 4  // Per-frame detail from the capture pipeline
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+#define LOG_RING_SLOTS 64
+#define LOG_LINE_MAX   128  // Longer lines are cut short
+
+#define LOG_ERROR(...) do { if (LOG_LEVEL >= LOG_LEVEL_ERROR) logPrintf("ERROR: ", __VA_ARGS__); } while (0)
+#define LOG_WARN(...)  do { if (LOG_LEVEL >= LOG_LEVEL_WARN) logPrintf("WARNING: ", __VA_ARGS__); } while (0)
+#define LOG_INFO(...)  do { if (LOG_LEVEL >= LOG_LEVEL_INFO) logPrintf("", __VA_ARGS__); } while (0)
+#define LOG_DEBUG(...) do { if (LOG_LEVEL >= LOG_LEVEL_DEBUG) logPrintf("", __VA_ARGS__); } while (0)
+
+struct LogSlot {
+  uint32_t sequence;  // Ticket + 1 once the line for that ticket is in, ticket + slots once printed
+  char text[LOG_LINE_MAX];
+};
+
+LogSlot logRing[LOG_RING_SLOTS];
+uint32_t logHead = 0;     // Next ticket handed to a producer
+uint32_t logTail = 0;     // Next ticket the log task prints
+uint32_t logPrinted = 0;
+uint32_t logDropped = 0;
+TaskHandle_t logTaskHandle = NULL;
+
+void logBegin();
+void logFormat(char *line, const char *level, const char *format, va_list args);
+void logPrintf(const char *level, const char *format, ...);
+void logTask(void *param);
+void logFlush(unsigned long timeoutMs);
 
 const char* ssid = "YOUR_WIFI_NETWORK_NAME";
 const char* password = "YOUR_WIFI_PASSWORD";
@@ -34,11 +137,42 @@ WebServer server(80);
 camera_config_t config;
 
 bool sdCardPresent = false;
+uint8_t *cardWriteBuffer = NULL;          // SD_WRITE_CHUNK bytes of internal RAM, NULL if it couldn't be had
+SemaphoreHandle_t cardWriteMutex = NULL;
 bool wifiConnected = false;
 
-bool burstInProgress = false;
-int burstCurrent = 0;
-int burstTotal = 0;
+volatile bool burstInProgress = false;
+volatile int burstCurrent = 0;
+volatile int burstTotal = 0;
+volatile bool burstRam = false;       // The running burst is a RAM burst
+volatile bool burstFlushing = false;  // RAM burst frames are being written out
+
+#define BURST_MAX_FRAMES  200
+
+// What an interval burst does about deadlines it has already missed
+enum BurstPolicy {
+  BURST_SKIP,      // Drop the missed frames and stay on the original time grid
+  BURST_CATCH_UP   // Take the missed frames straight away, then carry on
+};
+
+// Timing of the last interval burst, for /burststatus. Grab times are
+// recorded by the grab stage, indexed by the frame's place in the burst.
+struct BurstStats {
+  bool valid;
+  BurstPolicy policy;
+  int frames;
+  int skipped;         // Deadlines dropped under BURST_SKIP
+  float intervalMs;
+  float fps;           // Achieved, first grab to last
+  float jitterMinMs;   // |inter-frame time - scheduled inter-frame time|
+  float jitterAvgMs;
+  float jitterMaxMs;
+  float jitterP99Ms;
+};
+
+BurstStats lastBurstStats;
+int64_t burstGrabUs[BURST_MAX_FRAMES];
+uint32_t burstSlot[BURST_MAX_FRAMES];  // Grid slot each frame was scheduled for
 
 int currentQuality = 12;
 framesize_t currentFrameSize = FRAMESIZE_VGA;
@@ -46,19 +180,553 @@ pixformat_t currentPixelFormat = PIXFORMAT_JPEG;
 bool currentBigEndian = false;
 int settingsMenuState = 0; // 0 = main menu, 1 = resolution, 2 = quality, 3 = color format, 4 = endianness
 
+// What the driver was last set up with. Frame buffers are allocated for
+// cameraBufferSize, which can be larger than the resolution the sensor is
+// producing (cameraFrameSize), so smaller resolutions can be switched to live.
+framesize_t cameraBufferSize = FRAMESIZE_INVALID;
+framesize_t cameraFrameSize = FRAMESIZE_INVALID;
+uint32_t cameraLiveChanges = 0;  // Resolution changes made without a reinit
+uint32_t cameraFullReinits = 0;
+
+#define PIPELINE_QUEUE_DEPTH 2
+
+// A capture waiting for the grab stage, with the settings it was queued under
+struct CaptureRequest {
+  uint32_t id;
+  int quality;
+  framesize_t frameSize;
+  bool bigEndian;
+  bool burst;
+  int burstIndex;       // Frame's place in an interval burst, -1 otherwise
+};
+
+// Raw frames are encoded straight into their file. The encoder's output is
+// copied into one of JPEG_SINK_BLOCKS internal-RAM blocks and queued to the
+// write task, so the card write of one block overlaps encoding the next.
+// The frame itself follows its blocks to the write task, which closes the
+// file, so the encoder can start on the next frame meanwhile; at most
+// JPEG_SINK_FILES frames are between the two at once.
+#define JPEG_SINK_BLOCKS 2
+#define JPEG_SINK_FILES  2
+
+// Streams the bitstream into an open file as it is produced
+struct JpegFileSink {
+  File *file;
+  size_t len;      // Bytes on the card so far
+  bool queued;     // Blocks go to the write task rather than being written here
+  bool failed;     // Set by the write task when a queued block didn't fit
+};
+
+// A block of encoder output on its way to the write task
+struct SinkBlock {
+  JpegFileSink *sink;
+  uint8_t *data;
+  size_t len;
+};
+
+// A raw frame's output from the encode stage until writeFrame() finishes it:
+// the sink, and the frame's own file unless it went into the burst pack
+struct FrameOutput {
+  JpegFileSink sink;
+  File file;
+  bool encodeFailed;
+};
+
+FrameOutput frameOutputs[JPEG_SINK_FILES];
+
+// A frame moving from the grab stage through encode to the writer
+struct CaptureJob {
+  uint32_t id;
+  camera_fb_t *fb;     // Sensor frame buffer, NULL once returned to the driver
+  uint8_t *jpegData;   // Sensor JPEG held for the write stage, NULL for raw frames
+  size_t jpegLen;
+  uint32_t number;     // Image number, once reserved
+  FrameOutput *output; // Raw frame queued to the card block by block, for writeFrame() to finish
+  bool written;        // The encoder already streamed the image to the card
+  bool packed;         // Written into the active burst pack instead of its own file
+  unsigned long captureMs;
+  uint8_t *thumbData;  // Gallery thumbnail, NULL if the frame is already small
+  size_t thumbLen;
+  int quality;
+  framesize_t frameSize;
+  bool bigEndian;
+  bool burst;
+};
+
+QueueHandle_t grabQueue = NULL;
+QueueHandle_t encodeQueue = NULL;
+QueueHandle_t writeQueue = NULL;
+QueueHandle_t sinkBlockQueue = NULL;  // Filled blocks, in file order
+QueueHandle_t sinkFreeQueue = NULL;   // Blocks the encoder can fill
+QueueHandle_t frameOutputQueue = NULL; // Free FrameOutputs
+QueueSetHandle_t writeTaskSet = NULL; // writeQueue and sinkBlockQueue, as the write task waits on them
+portMUX_TYPE pipelineMux = portMUX_INITIALIZER_UNLOCKED;
+volatile bool pipelineReady = false;
+volatile int pipelineInFlight = 0;
+uint32_t captureSequence = 0;
+volatile uint32_t capturesSaved = 0;
+volatile uint32_t capturesFailed = 0;
+
+// Latency histograms for each step a capture goes through, exported at
+// /metrics. Buckets are plain counters bumped with atomic adds, so any task
+// can record a timing without taking a lock.
+enum MetricStage {
+  STAGE_GRAB,       // esp_camera_fb_get() for captures, bursts and pre-trigger
+  STAGE_THUMBNAIL,  // Gallery thumbnail
+  STAGE_ENCODE,     // Raw frame to JPEG, byte swap included, until its last block is handed on
+  STAGE_PREVIEW,    // fmt2jpg() for raw-format preview frames
+  STAGE_RESERVE,    // Taking the next image number
+  STAGE_OPEN,       // SD.open()
+  STAGE_WRITE,      // file.write()
+  STAGE_CLOSE,      // file.close()
+  STAGE_HTTP,       // Web request handlers
+  STAGE_COUNT
+};
+
+const char *const metricStageNames[STAGE_COUNT] = {
+  "grab", "thumbnail", "encode", "preview", "reserve", "open", "write", "close", "http"
+};
+
+#define METRIC_BUCKETS 14
+const uint32_t metricBucketUs[METRIC_BUCKETS] = {
+  100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000, 2500000
+};
+const char *const metricBucketLabels[METRIC_BUCKETS] = {
+  "0.0001", "0.00025", "0.0005", "0.001", "0.0025", "0.005", "0.01", "0.025", "0.05", "0.1", "0.25", "0.5", "1", "2.5"
+};
+
+// Every field is 32 bits so recording is plain 32-bit atomics, which the
+// ESP32-S3 does lock-free (a 64-bit atomic add goes through libatomic's
+// lock). The sum is kept as a 32-bit µs count plus the number of times it
+// has wrapped, put back together by histogramSumUs().
+struct StageHistogram {
+  uint32_t buckets[METRIC_BUCKETS + 1];  // Per bucket, not cumulative; the last is +Inf
+  uint32_t sumUs;
+  uint32_t sumWraps;   // Times sumUs has gone past 2^32 us (about 71 minutes)
+  uint32_t maxUs;
+};
+
+StageHistogram stageHistograms[STAGE_COUNT];
+
+// Handler time of each registered route, so one slow route shows up on its
+// own instead of disappearing into the http stage total. Each route has two
+// histograms and httpRouteGeneration picks the one in use, so
+// /routestats?reset clears the other one and switches over rather than
+// clearing one that a timing may be going into.
+#define MAX_HTTP_ROUTES 32
+
+struct HttpRoute {
+  const char *uri;
+  HTTPMethod method;
+  StageHistogram latency[2];  // The one in use is latency[httpRouteGeneration & 1]
+};
+
+HttpRoute httpRoutes[MAX_HTTP_ROUTES];
+int httpRouteCount = 0;
+uint32_t httpRouteGeneration = 0;
+
+// Capture arena: one PSRAM block, sized for the frame size and format when
+// the camera is initialized, that the encode path borrows its scratch and
+// thumbnail buffers from instead of allocating and freeing them per frame.
+// The scratch regions are only used by the encode stage, one at a time;
+// thumbnail slots are taken by the encode stage and released by the writer.
+#define ARENA_THUMB_SLOTS  (PIPELINE_QUEUE_DEPTH + 2)  // Thumbnails that can be in flight at once
+
+enum ArenaRegion {
+  ARENA_ENCODER,      // JpegEncoder state
+  ARENA_PLANES,       // Y/Cb/Cr strip planes
+  ARENA_THUMB_PIXELS, // Downscaled frame a thumbnail is encoded from
+  ARENA_REGION_COUNT
+};
+
+struct CaptureArena {
+  uint8_t *base;
+  size_t size;
+  uint8_t *region[ARENA_REGION_COUNT];
+  size_t regionSize[ARENA_REGION_COUNT];
+  bool regionBusy[ARENA_REGION_COUNT];
+  uint8_t *slots;
+  size_t slotSize;
+  uint32_t slotsUsed;     // Bit per thumbnail slot
+  int slotsInUse;
+};
+
+// Counters for /arenastatus. Kept apart from the layout so they run on
+// from boot across every resize, rather than starting again at each one.
+struct ArenaStats {
+  int slotsPeak;
+  uint32_t borrows;
+  uint32_t heapFallbacks; // Buffers that didn't fit and came from the heap
+  uint32_t thumbOverflows;
+  uint32_t leaked;        // Blocks given up because something was still lent out
+};
+
+CaptureArena arena;
+ArenaStats arenaStats;
+portMUX_TYPE arenaMux = portMUX_INITIALIZER_UNLOCKED;
+SemaphoreHandle_t arenaMutex = NULL;   // Recursive; held by anything using the arena outside the pipeline
+uint8_t *arenaRetiredBase = NULL;      // A block freed while still lent out, kept so late releases are ignored
+size_t arenaRetiredSize = 0;
+SemaphoreHandle_t cameraMutex = NULL;  // Recursive; held while the driver must not be torn down
+
+#define JOB_QUEUE_DEPTH 4
+
+// Long-running work handed off by HTTP handlers (and the serial burst command)
+// so the request can be answered straight away
+enum JobType {
+  JOB_CAPTURE,
+  JOB_BURST,
+  JOB_RAM_BURST,
+  JOB_SAVE_PRETRIGGER,
+  JOB_REINIT_CAMERA,
+  JOB_DELETE_IMAGES
+};
+
+struct Job {
+  JobType type;
+  int count;        // JOB_BURST, JOB_RAM_BURST (0 = as many as fit)
+  float interval;   // JOB_BURST, seconds
+  BurstPolicy policy;  // JOB_BURST
+};
+
+QueueHandle_t jobQueue = NULL;
+
+// RAM burst: sensor JPEGs are copied into a PSRAM ring back to back, at the
+// sensor's own rate, and only written to the card once the grab is over
+#define RAM_BURST_MAX_FRAMES  500
+#define RAM_BURST_RESERVE     (512 * 1024)  // PSRAM left for everything else while the ring is held
+
+struct RamFrame {
+  uint32_t offset;  // Into the ring
+  uint32_t len;
+  unsigned long captureMs;
+};
+
+// Pre-trigger mode: sensor JPEGs are grabbed continuously into a ring of
+// before + after fixed-size slots. A trigger (button, serial c, /capture)
+// lets `after` more frames in, then freezes the ring and has the job task
+// save it, which gives `before` frames from ahead of the trigger. The ring
+// belongs to pretriggerTask; the save job only reads it while it is frozen.
+#define PRETRIGGER_MAX_FRAMES    60
+#define PRETRIGGER_SLOT_DIVISOR  4   // Slot size = width*height / this; larger frames are dropped
+
+struct PretriggerRing {
+  uint8_t *slots;
+  size_t slotSize;
+  int capacity;               // before + after
+  int before;
+  int after;
+  std::vector<RamFrame> frames;  // Per slot
+  int head;                   // Next slot to fill
+  int count;                  // Slots holding a frame
+  int afterRemaining;         // Frames still to store after a trigger, 0 when not triggered
+  int afterDrops;             // Frames dropped since the last trigger
+  int shortfall;              // After-trigger frames the last save went without
+  uint16_t width;
+  uint16_t height;
+  uint32_t triggers;
+  uint32_t dropped;           // Frames too large for a slot
+};
+
+PretriggerRing pretrigger;
+volatile bool pretriggerEnabled = false;
+volatile bool pretriggerFrozen = false;       // Waiting for the save job
+volatile bool pretriggerTriggered = false;    // Set by pretriggerFire(), taken by the task
+volatile bool pretriggerConfigPending = false;
+bool pretriggerWantEnabled = false;
+int pretriggerWantBefore = 10;
+int pretriggerWantAfter = 5;
+TaskHandle_t pretriggerTaskHandle = NULL;
+
+#define MAX_STREAM_CLIENTS   4
+#define STREAM_JPEG_QUALITY  50   // fmt2jpg quality (0-100) for raw-format preview frames
+#define STREAM_BOUNDARY      "xiaocamframe"
+
+// One encoded preview frame shared by every viewer. Each viewer holding it
+// owns a reference; the last one to let go frees it.
+struct StreamFrame {
+  uint8_t *data;
+  size_t len;
+  int refs;  // Guarded by streamMux
+};
+
+// A connected /stream viewer. pending is a one-slot mailbox: a newer frame
+// replaces one the viewer hasn't picked up yet, so slow viewers drop frames.
+struct StreamClient {
+  WiFiClient client;
+  StreamFrame *pending;
+  TaskHandle_t task;
+  bool active;
+};
+
+StreamClient streamClients[MAX_STREAM_CLIENTS];
+portMUX_TYPE streamMux = portMUX_INITIALIZER_UNLOCKED;
+volatile int streamClientCount = 0;
+TaskHandle_t streamTaskHandle = NULL;
+
+// Images are kept in shard directories of IMAGE_SHARD_SIZE numbers each,
+// such as /img/0012/12345.jpg with its thumbnail beside it, so no directory
+// grows past a thousand or so entries and a path is worked out from the
+// number alone. Burst packs go in IMAGE_DIR itself.
+#define IMAGE_DIR         "/img"
+#define IMAGE_SHARD_SIZE  1000
+
+std::vector<ImageInfo> imageIndex;
+SemaphoreHandle_t indexMutex = NULL;
+uint32_t nextImageNumber = 1;
+
+// Change log behind /list?since=. Every index change bumps indexGeneration
+// and notes the image number here, and a change token names a generation,
+// so a refresh only looks at what changed after it. Deletes, bulk ones
+// included, are logged image by image like any other change. Rebuilding the
+// index from the card isn't; it moves indexResetGeneration instead, and
+// older tokens get a full reload.
+#define INDEX_CHANGE_LOG_SIZE  256
+
+struct IndexChange {
+  uint32_t generation;
+  uint32_t number;
+};
+
+IndexChange indexChanges[INDEX_CHANGE_LOG_SIZE];
+uint32_t indexGeneration = 0;
+uint32_t indexResetGeneration = 0;
+uint32_t indexBootId = 0;    // Random per boot, so tokens from before a reboot never match
+
+// Bulk delete, run by the job task a batch at a time so captures, listings
+// and the web server carry on meanwhile. The selection is a number range or
+// an explicit list of numbers; /deletestatus shows progress and
+// /delete?cancel stops it after the current batch.
+#define DELETE_BATCH  16
+
+volatile bool deleteInProgress = false;
+volatile bool deleteCancel = false;       // Set to stop after the current batch
+volatile bool deleteCancelled = false;    // The last delete was stopped early
+volatile uint32_t deleteTotal = 0;
+volatile uint32_t deleteDone = 0;
+volatile uint32_t deleteFailed = 0;       // Still on the card after remove()
+uint32_t deleteFrom = 0;
+uint32_t deleteTo = 0;
+std::vector<uint32_t> deleteNumbers;      // Used instead of the range when not empty
+portMUX_TYPE deleteMux = portMUX_INITIALIZER_UNLOCKED;
+
+// The WebServer, its client and the SD card seen through web_routes.h, for
+// the /image, /thumb, /burst and /list handlers. ServerResponse keeps the
+// headers itself: WebServer only sends the ones it was given with send(),
+// and a detached response goes out on the raw client instead.
+class ServerRequest : public HttpRequest {
+public:
+  bool hasArg(const char *name);
+  std::string arg(const char *name);
+  bool hasHeader(const char *name);
+  std::string header(const char *name);
+};
+
+class ServerResponse : public HttpResponse {
+public:
+  void sendHeader(const char *name, const std::string &value);
+  void send(int code, const char *type, const std::string &body);
+  HttpConnection *detach(int code, const char *type, int64_t length);
+  
+private:
+  std::vector<std::pair<std::string, std::string> > headers;
+};
+
+// A client taken over from the server for a body
+class ClientConnection : public HttpConnection {
+public:
+  ClientConnection(const WiFiClient &client) : client(client) {}
+  size_t write(const uint8_t *data, size_t len);
+  void close();
+  
+private:
+  WiFiClient client;
+};
+
+class CardFile : public WebFile {
+public:
+  CardFile(const File &file) : file(file) {}
+  ~CardFile();
+  bool seek(uint32_t position);
+  size_t read(uint8_t *buf, size_t len);
+  
+private:
+  File file;
+};
+
+class CardBackend : public WebBackend {
+public:
+  bool cardPresent();
+  bool lookup(uint32_t number, ImageInfo &info);
+  int listAfter(uint32_t after, ImageInfo *out, int max, bool *more);
+  uint32_t generation();
+  std::string token(uint32_t generation);
+  bool changesSince(const std::string &token, std::vector<uint32_t> &numbers, uint32_t *generation);
+  WebFile *openImage(const ImageInfo &info, bool thumb, uint32_t *offset, uint32_t *length);
+  bool startBody(const WebBodyJob &job);
+};
+
+CardBackend webBackend;
+
+// Bodies of /image, /thumb, /burst frames and /list go out from sender
+// tasks, like /stream and /archive, so the http task only ever sends
+// headers and a download can't hold up the requests behind it. With the
+// queue full the handler sends the body itself.
+#define WEB_SENDER_TASKS        2
+#define WEB_SENDER_QUEUE_DEPTH  8
+#define WEB_SENDER_BUFFER_SIZE  4096
+
+QueueHandle_t webBodyQueue = NULL;
+
+// Burst packs (format in burst_pack.h)
+#define BURST_PACK_FRAME_GUESS  4   // Preallocate width*height/this bytes per frame
+
+// The pack being written. Opened and closed by the burst job while the
+// pipeline is idle; in between only the stage writing the frames touches it.
+struct BurstPack {
+  File file;
+  bool open;
+  uint32_t id;
+  uint32_t startTime;
+  unsigned long startMs;
+  uint32_t dataEnd;      // Where the next frame goes
+  std::vector<BurstPackEntry> entries;
+};
+
+BurstPack activePack;
+uint32_t nextBurstId = 1;
+
+// Archive downloads (/archive): every image, or a number range, streamed as
+// one uncompressed ZIP or TAR while it is read. Files go through a single
+// reusable buffer, so nothing is staged on the card and memory use doesn't
+// grow with the archive.
+#define ARCHIVE_BUFFER_SIZE  8192
+
+// One archive download. The handler fills it in and hands it, socket and
+// all, to archiveTask so the web server carries on serving other routes.
+struct ArchiveJob {
+  WiFiClient client;
+  std::vector<ImageInfo> images;
+  bool tar;
+  uint8_t *buf;      // ARCHIVE_BUFFER_SIZE bytes
+};
+
+volatile bool archiveBusy = false;  // One archive at a time; set by the handler, cleared by the task
+
 
 bool initCamera();
+framesize_t cameraTargetFrameSize();
+int applySensorSettings(sensor_t *s);
+bool reconfigureCameraLive();
 bool initSDCard();
+bool cardBegin();
+uint32_t cardClusterSize();
+size_t cardWrite(File &file, const uint8_t *data, size_t len);
+bool cardPreallocate(File &file, uint32_t bytes);
+void benchmarkStorage();
+void benchmarkLogging();
 bool initWiFi();
 void setupWebServer();
 void captureImage();
-String getNextFilename(const char* extension = ".jpg");
-void deleteAllImages();
+void startCapturePipeline();
+bool queueCapture(bool burst = false, int burstIndex = -1);
+void finishCapture(bool saved);
+void waitForPipelineIdle();
+void grabTask(void *param);
+void encodeTask(void *param);
+void writeTask(void *param);
+bool encodeFrame(CaptureJob &job);
+bool writeFrame(CaptureJob &job);
+void writeSinkBlock(const SinkBlock &block);
+bool finishFrameOutput(CaptureJob &job);
+void makeThumbnail(CaptureJob &job);
+void benchmarkKernels();
+void benchmarkFillFrame(uint8_t *pixels, uint16_t width, uint16_t height, pixformat_t format);
+void benchmarkPipeline();
+bool jpegEncodeToFile(const uint8_t *pixels, uint16_t width, uint16_t height, pixformat_t format,
+                      bool swapBytes, int quality, File &file, size_t *outLen);
+bool encodeFrameToFile(CaptureJob &job, pixformat_t format, bool swapBytes, int quality);
+bool encodeFrameQueued(CaptureJob &job, pixformat_t format, bool swapBytes, int quality);
+void arenaSetup(framesize_t frameSize, pixformat_t format);
+void arenaFree();
+void *arenaBorrow(ArenaRegion region, size_t size);
+uint8_t *arenaTakeSlot(size_t *capacity);
+void arenaRelease(void *ptr);
+void handleArenaStatus();
+void histogramRecord(StageHistogram &histogram, uint32_t us);
+uint32_t histogramPercentileUs(const StageHistogram &histogram, float fraction);
+uint64_t histogramSumUs(const StageHistogram &histogram);
+void metricsRecord(MetricStage stage, uint32_t us);
+void metricsRecordSince(MetricStage stage, int64_t startUs);
+String metricsHistogramText(const char *name, const String &labels, const StageHistogram &histogram);
+void handleMetrics();
+void handleRouteStats();
+StageHistogram &httpRouteLatency(HttpRoute &route);
+const char *httpMethodName(HTTPMethod method);
+void serverOnTimed(const char *uri, HTTPMethod method, WebServer::THandlerFunction handler);
+void reinitCamera();
+void runBurst(int count, float interval, BurstPolicy policy);
+void burstTimerCallback(void *arg);
+void computeBurstStats(int frames, int skipped, float interval, BurstPolicy policy);
+bool startBurst(int count, float interval, JobType type = JOB_BURST, BurstPolicy policy = BURST_SKIP);
+void runRamBurst(int maxFrames);
+bool saveBufferedFrame(const uint8_t *data, size_t len, uint16_t width, uint16_t height, unsigned long captureMs);
+void triggerCapture();
+bool pretriggerConfigure(bool enable, int before, int after);
+bool pretriggerFire();
+void pretriggerTask(void *param);
+void savePretrigger();
+void handlePretrigger();
+void handlePretriggerStatus();
+void startJobRunner();
+bool submitJob(JobType type, int count = 0, float interval = 0, BurstPolicy policy = BURST_SKIP);
+void jobTask(void *param);
+void httpTask(void *param);
+void webSenderTask(void *param);
+void handleStream();
+void streamTask(void *param);
+void streamClientTask(void *param);
+void publishStreamFrame(uint8_t *data, size_t len);
+void publishStreamFrameCopy(const uint8_t *data, size_t len);
+void releaseStreamFrame(StreamFrame *frame);
+uint32_t reserveImageNumber();
+String imageShardDir(uint32_t number);
+String imageFilename(uint32_t number);
+String thumbFilename(uint32_t number);
+File openShardFile(const String &filename, uint32_t number);
+void migrateFlatLayout();
+void indexImageFile(File &file, std::vector<ImageInfo> &found, std::vector<uint32_t> &thumbs, std::vector<uint32_t> &incomplete, uint32_t *burstIds);
+void buildImageIndex();
+void indexAddImage(uint32_t number, uint32_t size, uint8_t flags, uint16_t burstId = 0, uint16_t frame = 0);
+String burstFilename(uint32_t id);
+bool burstPackBegin(int frames, unsigned long startMs, uint64_t expectedBytes = 0);
+bool burstPackAppend(CaptureJob &job, pixformat_t format, bool swapBytes, int quality);
+bool burstPackAddFrame(CaptureJob &job, size_t written, bool ok);
+void burstPackEnd();
+bool indexBurstPack(File &file, uint32_t id, std::vector<ImageInfo> &found);
+bool openBurstFrame(uint32_t id, uint32_t frame, bool thumb, File &file, uint32_t *offset, uint32_t *length);
+bool openIndexedImage(const ImageInfo &info, File &file, uint32_t *offset, uint32_t *length);
+bool sendBurstFrame(uint32_t id, uint32_t frame, bool thumb);
+void handleBurst();
+void handleArchive();
+void archiveTask(void *param);
+bool archiveWrite(WiFiClient &client, const uint8_t *data, size_t len);
+bool archiveChunkSink(void *ctx, const uint8_t *data, size_t len);
+void indexRemoveImage(uint32_t number);
+void indexRecordChange(uint32_t number);
+void indexRecordReset();
+String indexToken(uint32_t generation);
+bool indexLookup(uint32_t number, ImageInfo &info);
+bool startDelete(uint32_t from, uint32_t to, const std::vector<uint32_t> &numbers);
+void deleteImages();
+void deleteBurstFrames(const std::vector<ImageInfo> &targets, size_t start, size_t end);
 void listImages();
 void handleRoot();
 void handleImage();
+void handleThumb();
 void handleCapture();
 void handleDelete();
+void handleDeleteStatus();
 void handleListJSON();
 void handleSetQuality();
 void handleSetResolution();
@@ -76,62 +744,159 @@ void showMainMenu();
 void setup() {
   Serial.begin(115200);
   delay(100);
-  Serial.println("BOOT");
-  Serial.flush();
+  logBegin();
+  LOG_INFO("BOOT");
   delay(400);
   
-  Serial.println("\n\nXIAO Sense ESP32 Camera Capture");
-  Serial.println("==================================");
-  Serial.flush();
+  LOG_INFO("\n\nXIAO Sense ESP32 Camera Capture");
+  LOG_INFO("==================================");
   
   pinMode(BUTTON_PIN, INPUT_PULLUP);
   
-  Serial.println("Starting initialization...");
-  Serial.flush();
+  LOG_INFO("Starting initialization...");
   
   if (!initCamera()) {
-    Serial.println("Camera initialization failed!");
-    Serial.println("Please check camera connections and power.");
-    Serial.println("The device will continue but camera features will not work.");
-    Serial.flush();
+    LOG_WARN("Camera initialization failed!");
+    LOG_INFO("Please check camera connections and power.");
+    LOG_INFO("The device will continue but camera features will not work.");
   } else {
-    Serial.println("\nTesting camera capture...");
-    Serial.flush();
+    LOG_INFO("\nTesting camera capture...");
     delay(500);
     camera_fb_t *test_fb = esp_camera_fb_get();
     if (test_fb) {
-      Serial.printf("Camera test capture successful! Size: %u bytes\n", test_fb->len);
+      LOG_INFO("Camera test capture successful! Size: %u bytes", test_fb->len);
       esp_camera_fb_return(test_fb);
     } else {
-      Serial.println("Camera test capture failed - check hardware connections");
+      LOG_WARN("Camera test capture failed - check hardware connections");
     }
-    Serial.flush();
   }
   
+  indexMutex = xSemaphoreCreateMutex();
+  indexBootId = esp_random();
+  cameraMutex = xSemaphoreCreateRecursiveMutex();
+  arenaMutex = xSemaphoreCreateRecursiveMutex();
+  
   if (!initSDCard()) {
-    Serial.println("SD card initialization failed - images cannot be saved");
-    Serial.println("Continuing without SD card...");
+    LOG_WARN("SD card initialization failed - images cannot be saved");
+    LOG_INFO("Continuing without SD card...");
   } else {
-    Serial.println("SD card initialized successfully!");
+    LOG_INFO("SD card initialized successfully!");
     sdCardPresent = true;
+    migrateFlatLayout();
+    buildImageIndex();
   }
   
+  startCapturePipeline();
+  startJobRunner();
+  
   if (initWiFi()) {
     setupWebServer();
     wifiConnected = true;
-    Serial.println("\nWeb server started!");
-    Serial.print("Open your browser and go to: http://");
-    Serial.println(WiFi.localIP());
-    Serial.println("Or use: http://xiaocamera.local (if mDNS works)");
+    LOG_INFO("\nWeb server started!");
+    LOG_INFO("Open your browser and go to: http://%s", WiFi.localIP().toString().c_str());
+    LOG_INFO("Or use: http://xiaocamera.local (if mDNS works)");
   } else {
-    Serial.println("\nWiFi connection failed. Continuing without web server.");
-    Serial.println("You can still capture images via button or serial commands.");
+    LOG_WARN("\nWiFi connection failed. Continuing without web server.");
+    LOG_INFO("You can still capture images via button or serial commands.");
   }
   
-  Serial.println("\nReady to capture images!");
+  LOG_INFO("\nReady to capture images!");
+  // The menu is printed straight to Serial, so let the boot log out first
+  logFlush(1000);
   showMainMenu();
 }
 
+void logBegin() {
+  for (uint32_t i = 0; i < LOG_RING_SLOTS; i++) {
+    logRing[i].sequence = i;
+  }
+  // Lowest priority above idle: lines go out whenever nothing else needs the CPU
+  xTaskCreatePinnedToCore(logTask, "log", 3072, NULL, 1, &logTaskHandle, 0);
+}
+
+// Writes level and message into a LOG_LINE_MAX buffer. Leading newlines stay
+// in front of the level so spacing between sections still works.
+void logFormat(char *line, const char *level, const char *format, va_list args) {
+  size_t len = 0;
+  while (*format == '\n' && len < LOG_LINE_MAX - 1) {
+    line[len++] = *format++;
+  }
+  while (*level && len < LOG_LINE_MAX - 1) {
+    line[len++] = *level++;
+  }
+  vsnprintf(line + len, LOG_LINE_MAX - len, format, args);
+}
+
+// Formats one line straight into a ring slot. The line is only visible to
+// the log task once its sequence is published.
+void logPrintf(const char *level, const char *format, ...) {
+  va_list args;
+  if (!logTaskHandle) {
+    // Not started yet; nothing else is running this early
+    char line[LOG_LINE_MAX];
+    va_start(args, format);
+    logFormat(line, level, format, args);
+    va_end(args);
+    Serial.println(line);
+    return;
+  }
+  
+  uint32_t ticket = __atomic_load_n(&logHead, __ATOMIC_RELAXED);
+  LogSlot *slot;
+  for (;;) {
+    slot = &logRing[ticket % LOG_RING_SLOTS];
+    uint32_t sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+    int32_t diff = (int32_t)(sequence - ticket);
+    if (diff == 0) {
+      // Slot free for this ticket; a failed exchange reloads ticket
+      if (__atomic_compare_exchange_n(&logHead, &ticket, ticket + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        break;
+      }
+    } else if (diff < 0) {
+      // Still holds a line from a lap ago: the ring is full
+      __atomic_fetch_add(&logDropped, 1, __ATOMIC_RELAXED);
+      return;
+    } else {
+      ticket = __atomic_load_n(&logHead, __ATOMIC_RELAXED);
+    }
+  }
+  
+  va_start(args, format);
+  logFormat(slot->text, level, format, args);
+  va_end(args);
+  __atomic_store_n(&slot->sequence, ticket + 1, __ATOMIC_RELEASE);
+}
+
+// Prints published lines in order and reports drops once the ring is empty
+void logTask(void *param) {
+  uint32_t dropsReported = 0;
+  for (;;) {
+    LogSlot *slot = &logRing[logTail % LOG_RING_SLOTS];
+    if (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != logTail + 1) {
+      uint32_t dropped = __atomic_load_n(&logDropped, __ATOMIC_RELAXED);
+      if (dropped != dropsReported) {
+        Serial.printf("[log] %u lines dropped\n", dropped - dropsReported);
+        dropsReported = dropped;
+      }
+      delay(10);
+      continue;
+    }
+    Serial.println(slot->text);
+    __atomic_store_n(&slot->sequence, logTail + LOG_RING_SLOTS, __ATOMIC_RELEASE);
+    __atomic_store_n(&logTail, logTail + 1, __ATOMIC_RELEASE);
+    logPrinted++;
+  }
+}
+
+// Waits for the log task to print everything queued so far
+void logFlush(unsigned long timeoutMs) {
+  unsigned long start = millis();
+  while (__atomic_load_n(&logTail, __ATOMIC_ACQUIRE) != __atomic_load_n(&logHead, __ATOMIC_RELAXED) &&
+         millis() - start < timeoutMs) {
+    delay(5);
+  }
+}
+
 void showSettingsMenu() {
   Serial.println("\n=== Settings Menu ===");
   Serial.println("1 - Resolution");
@@ -178,9 +943,15 @@ void showMainMenu() {
   Serial.println("\n=== Serial Commands ===");
   Serial.println("c - Capture image");
   Serial.println("b - Burst capture (50 photos at 0.2s intervals)");
+  Serial.println("r - RAM burst (sensor-rate JPEG frames into PSRAM, saved afterwards)");
+  Serial.println("p - Toggle pre-trigger mode (c/button then saves frames from before the press)");
   Serial.println("s - Settings menu");
   Serial.println("l - List all images");
   Serial.println("d - Delete all images");
+  Serial.println("k - Benchmark colour conversion kernels");
+  Serial.println("e - Benchmark encode and SD write on synthetic frames");
+  Serial.println("f - Benchmark SD card sequential writes");
+  Serial.println("g - Benchmark logging against direct Serial printing");
   Serial.println("h - Show help");
   if (wifiConnected) {
     Serial.printf("w - Web interface: http://%s\n", WiFi.localIP().toString().c_str());
@@ -189,10 +960,6 @@ void showMainMenu() {
 }
 
 void loop() {
-  if (wifiConnected) {
-    server.handleClient();
-  }
-  
   static unsigned long lastDebounceTime = 0;
   static bool lastButtonState = HIGH;
   bool currentButtonState = digitalRead(BUTTON_PIN);
@@ -203,7 +970,7 @@ void loop() {
   
   if ((millis() - lastDebounceTime) > 50) {
     if (currentButtonState == LOW && lastButtonState == HIGH) {
-      captureImage();
+      triggerCapture();
       delay(500);
     }
   }
@@ -220,7 +987,7 @@ void loop() {
     if (settingsMenuState > 0) {
       if (command == 'c' || command == 'C') {
         // Take a photo and continue in settings menu
-        captureImage();
+        triggerCapture();
         Serial.println();
         showSettingsMenu();
         return;
@@ -243,12 +1010,12 @@ void loop() {
           }
           if (currentFrameSize != newSize) {
             currentFrameSize = newSize;
-            Serial.println("\nResolution changed - reinitializing camera...");
-            Serial.flush();
-            esp_camera_deinit();
-            delay(100);
-            initCamera();
-            Serial.println("Resolution updated successfully!");
+            Serial.println("\nResolution changed - reconfiguring camera...");
+            if (submitJob(JOB_REINIT_CAMERA)) {
+              Serial.println("Resolution will be applied once current work finishes.");
+            } else {
+              Serial.println("Job queue full - resolution will apply on the next camera change.");
+            }
             delay(200);
           } else {
             Serial.println("\nResolution unchanged.");
@@ -294,11 +1061,11 @@ void loop() {
           if (currentPixelFormat != newFormat) {
             currentPixelFormat = newFormat;
             Serial.println("\nColor format changed - reinitializing camera...");
-            Serial.flush();
-            esp_camera_deinit();
-            delay(100);
-            initCamera();
-            Serial.println("Color format updated successfully!");
+            if (submitJob(JOB_REINIT_CAMERA)) {
+              Serial.println("Color format will be applied once current work finishes.");
+            } else {
+              Serial.println("Job queue full - color format will apply on the next camera change.");
+            }
             delay(200);
           } else {
             Serial.println("\nColor format unchanged.");
@@ -337,51 +1104,36 @@ void loop() {
     
     // Main command handling
     if (command == 'c' || command == 'C') {
-      captureImage();
+      triggerCapture();
     } else if (command == 'b' || command == 'B') {
       // Burst capture: default 50 photos at 0.2 second intervals
-      int count = 50;
-      float interval = 0.2;
-      
-      Serial.printf("\n=== Starting Burst Capture ===\n");
-      Serial.printf("Count: %d photos\n", count);
-      Serial.printf("Interval: %.2f seconds\n", interval);
-      Serial.flush();
-      
-      burstInProgress = true;
-      burstCurrent = 0;
-      burstTotal = count;
-      
-      unsigned long intervalMs = (unsigned long)(interval * 1000);
-      
-      for (int i = 0; i < count; i++) {
-        burstCurrent = i + 1;
-        Serial.printf("\nBurst capture %d/%d\n", i + 1, count);
-        Serial.flush();
-        
-        captureImage();
-        
-        if (i < count - 1) {
-          unsigned long startTime = millis();
-          while (millis() - startTime < intervalMs) {
-            if (wifiConnected) {
-              server.handleClient();
-            }
-            delay(10);
-          }
-        }
+      if (!startBurst(50, 0.2)) {
+        Serial.println("A burst is already in progress.");
+      }
+    } else if (command == 'r' || command == 'R') {
+      // RAM burst: as many frames as the PSRAM ring holds
+      if (!startBurst(0, 0, JOB_RAM_BURST)) {
+        Serial.println("A burst is already in progress.");
+      }
+    } else if (command == 'p' || command == 'P') {
+      bool enable = !pretriggerEnabled;
+      if (!pretriggerConfigure(enable, pretriggerWantBefore, pretriggerWantAfter)) {
+        Serial.printf("Could not turn pre-trigger mode %s\n", enable ? "on" : "off");
       }
-      
-      burstInProgress = false;
-      burstCurrent = 0;
-      burstTotal = 0;
-      
-      Serial.println("\n=== Burst Capture Complete ===");
-      Serial.flush();
     } else if (command == 'd' || command == 'D') {
-      deleteAllImages();
+      if (!startDelete(1, 0xFFFFFFFF, std::vector<uint32_t>())) {
+        Serial.println("A delete is already in progress.");
+      }
     } else if (command == 'l' || command == 'L') {
       listImages();
+    } else if (command == 'k' || command == 'K') {
+      benchmarkKernels();
+    } else if (command == 'e' || command == 'E') {
+      benchmarkPipeline();
+    } else if (command == 'f' || command == 'F') {
+      benchmarkStorage();
+    } else if (command == 'g' || command == 'G') {
+      benchmarkLogging();
     } else if (command == 's' || command == 'S') {
       settingsMenuState = 0;
       showSettingsMenu();
@@ -417,8 +1169,7 @@ void loop() {
 }
 
 bool initCamera() {
-  Serial.println("Initializing camera...");
-  Serial.flush();
+  LOG_INFO("Initializing camera...");
   
   config.ledc_channel = LEDC_CHANNEL_0;
   config.ledc_timer = LEDC_TIMER_0;
@@ -441,10 +1192,11 @@ bool initCamera() {
   config.xclk_freq_hz = 20000000;
   // Use the selected pixel format
   config.pixel_format = currentPixelFormat;
-  config.frame_size = currentFrameSize;
   config.jpeg_quality = currentQuality;
   config.grab_mode = CAMERA_GRAB_WHEN_EMPTY;
   
+  framesize_t frameSize = cameraTargetFrameSize();
+  config.frame_size = frameSize;
   if (psramFound()) {
     config.fb_location = CAMERA_FB_IN_PSRAM;
     config.fb_count = 2;
@@ -452,897 +1204,3794 @@ bool initCamera() {
     if (config.pixel_format == PIXFORMAT_JPEG && currentQuality > 10) {
       config.jpeg_quality = 10;
     }
+    // JPEG frame buffers are only a fraction of the frame, so they are
+    // allocated for the largest resolution and every later resolution
+    // change can be made live
+    if (config.pixel_format == PIXFORMAT_JPEG) {
+      config.frame_size = FRAMESIZE_UXGA;
+    }
   } else {
     config.fb_location = CAMERA_FB_IN_DRAM;
     config.fb_count = 1;
-    if (config.pixel_format == PIXFORMAT_JPEG) {
-      config.frame_size = FRAMESIZE_SVGA;
-    }
   }
   
-  Serial.println("Calling esp_camera_init()...");
-  Serial.flush();
+  LOG_DEBUG("Calling esp_camera_init()...");
   
   esp_err_t err = esp_camera_init(&config);
   if (err != ESP_OK) {
-    Serial.printf("Camera init failed with error 0x%x\n", err);
-    Serial.flush();
+    LOG_WARN("Camera init failed with error 0x%x", err);
     return false;
   }
   
-  Serial.println("Getting camera sensor...");
-  Serial.flush();
+  LOG_DEBUG("Getting camera sensor...");
   sensor_t *s = esp_camera_sensor_get();
   if (s == NULL) {
-    Serial.println("Failed to get camera sensor!");
-    Serial.flush();
+    LOG_WARN("Failed to get camera sensor!");
     return false;
   }
   
-  Serial.println("Configuring camera sensor settings...");
-  Serial.flush();
-  s->set_brightness(s, 0);
-  s->set_contrast(s, 0);
-  s->set_saturation(s, 0);
-  s->set_special_effect(s, 0);
-  s->set_whitebal(s, 1);
-  s->set_awb_gain(s, 1);
-  s->set_wb_mode(s, 0);
-  s->set_exposure_ctrl(s, 1);
-  s->set_aec2(s, 0);
-  s->set_ae_level(s, 0);
-  s->set_aec_value(s, 300);
-  s->set_gain_ctrl(s, 1);
-  s->set_agc_gain(s, 0);
-  s->set_gainceiling(s, (gainceiling_t)0);
-  s->set_bpc(s, 0);
-  s->set_wpc(s, 1);
-  s->set_raw_gma(s, 1);
-  s->set_lenc(s, 1);
-  s->set_hmirror(s, 0);
-  s->set_vflip(s, 0);
-  s->set_dcw(s, 1);
-  s->set_colorbar(s, 0);
-  
-  Serial.println("Camera initialized successfully!");
+  LOG_DEBUG("Configuring camera sensor settings...");
+  int writes = applySensorSettings(s);
+  LOG_INFO("%d sensor settings differed from the defaults", writes);
+  
+  if (config.frame_size != frameSize) {
+    s->set_framesize(s, frameSize);
+  }
+  cameraBufferSize = config.frame_size;
+  cameraFrameSize = frameSize;
+  
+  // Sized from the frame size actually in use rather than currentFrameSize,
+  // which can differ when there's no PSRAM
+  arenaSetup(frameSize, config.pixel_format);
+  
+  LOG_INFO("Camera initialized successfully!");
   delay(500);
   return true;
 }
 
+// The resolution the sensor should produce. Without PSRAM a JPEG frame
+// buffer only has room for SVGA.
+framesize_t cameraTargetFrameSize() {
+  if (!psramFound() && currentPixelFormat == PIXFORMAT_JPEG) {
+    return FRAMESIZE_SVGA;
+  }
+  return currentFrameSize;
+}
+
+// Writes the sketch's sensor settings, skipping any the sensor already has.
+// After init the driver has reset the sensor and filled in s->status, so
+// only the settings that differ from its defaults cost an SCCB write.
+// Returns how many were written.
+int applySensorSettings(sensor_t *s) {
+  int writes = 0;
+  auto apply = [&](int have, int want, int (*set)(sensor_t*, int)) {
+    if (have != want) {
+      set(s, want);
+      writes++;
+    }
+  };
+  camera_status_t &status = s->status;
+  apply(status.brightness, 0, s->set_brightness);
+  apply(status.contrast, 0, s->set_contrast);
+  apply(status.saturation, 0, s->set_saturation);
+  apply(status.special_effect, 0, s->set_special_effect);
+  apply(status.awb, 1, s->set_whitebal);
+  apply(status.awb_gain, 1, s->set_awb_gain);
+  apply(status.wb_mode, 0, s->set_wb_mode);
+  apply(status.aec, 1, s->set_exposure_ctrl);
+  apply(status.aec2, 0, s->set_aec2);
+  apply(status.ae_level, 0, s->set_ae_level);
+  apply(status.aec_value, 300, s->set_aec_value);
+  apply(status.agc, 1, s->set_gain_ctrl);
+  apply(status.agc_gain, 0, s->set_agc_gain);
+  if (status.gainceiling != (gainceiling_t)0) {
+    s->set_gainceiling(s, (gainceiling_t)0);
+    writes++;
+  }
+  apply(status.bpc, 0, s->set_bpc);
+  apply(status.wpc, 1, s->set_wpc);
+  apply(status.raw_gma, 1, s->set_raw_gma);
+  apply(status.lenc, 1, s->set_lenc);
+  apply(status.hmirror, 0, s->set_hmirror);
+  apply(status.vflip, 0, s->set_vflip);
+  apply(status.dcw, 1, s->set_dcw);
+  apply(status.colorbar, 0, s->set_colorbar);
+  return writes;
+}
+
+// Switches resolution through the sensor's framesize (windowing) registers,
+// leaving the driver and every other register alone. Only possible when the
+// pixel format is unchanged and the new frame fits the allocated buffers.
+bool reconfigureCameraLive() {
+  sensor_t *s = esp_camera_sensor_get();
+  if (!s || cameraBufferSize == FRAMESIZE_INVALID || currentPixelFormat != config.pixel_format) {
+    return false;
+  }
+  framesize_t frameSize = cameraTargetFrameSize();
+  if (frameSize == cameraFrameSize) {
+    return true;
+  }
+  if ((uint32_t)resolution[frameSize].width * resolution[frameSize].height >
+      (uint32_t)resolution[cameraBufferSize].width * resolution[cameraBufferSize].height) {
+    return false;
+  }
+  
+  unsigned long startTime = millis();
+  arenaFree();
+  if (s->set_framesize(s, frameSize) != 0) {
+    arenaSetup(cameraFrameSize, config.pixel_format);
+    return false;
+  }
+  cameraFrameSize = frameSize;
+  arenaSetup(frameSize, config.pixel_format);
+  
+  // Frames already captured still have the old size
+  for (size_t i = 0; i < config.fb_count; i++) {
+    camera_fb_t *fb = esp_camera_fb_get();
+    if (fb) {
+      esp_camera_fb_return(fb);
+    }
+  }
+  cameraLiveChanges++;
+  LOG_INFO("Resolution changed live in %lu ms", millis() - startTime);
+  return true;
+}
+
+// Brings the camera in line with the current settings: live when only the
+// resolution changed and still fits the frame buffers, otherwise by tearing
+// the driver down and starting it again. The pipeline is drained first so
+// no stage is still holding a frame buffer, and buffered burst saves are
+// waited for since they use the arena too.
+void reinitCamera() {
+  xSemaphoreTakeRecursive(cameraMutex, portMAX_DELAY);
+  waitForPipelineIdle();
+  xSemaphoreTakeRecursive(arenaMutex, portMAX_DELAY);
+  if (!reconfigureCameraLive()) {
+    // Give the arena back first so the new frame buffers get the most room
+    arenaFree();
+    esp_camera_deinit();
+    delay(100); // Brief delay before reinit
+    initCamera();
+    cameraFullReinits++;
+  }
+  xSemaphoreGiveRecursive(arenaMutex);
+  xSemaphoreGiveRecursive(cameraMutex);
+}
+
+// Mounts the card on the bus chosen by SD_BUS_MODE, always at SD_MOUNT_POINT
+bool cardBegin() {
+#if SD_BUS_MODE == SD_BUS_SPI
+  return SD.begin(SD_CS_PIN, SPI, SD_SPI_FREQ_HZ, SD_MOUNT_POINT, SD_MAX_OPEN_FILES);
+#elif SD_BUS_MODE == SD_BUS_SDMMC_1BIT
+  SD_MMC.setPins(SD_SCK_PIN, SD_MOSI_PIN, SD_MISO_PIN);
+  return SD_MMC.begin(SD_MOUNT_POINT, true, false, BOARD_MAX_SDMMC_FREQ, SD_MAX_OPEN_FILES);
+#else
+  SD_MMC.setPins(SD_SCK_PIN, SD_MOSI_PIN, SD_MISO_PIN, SD_MMC_D1_PIN, SD_MMC_D2_PIN, SD_CS_PIN);
+  return SD_MMC.begin(SD_MOUNT_POINT, false, false, BOARD_MAX_SDMMC_FREQ, SD_MAX_OPEN_FILES);
+#endif
+}
+
+// Bytes per FAT cluster on the mounted card, 0 if FATFS won't say. The
+// library doesn't expose which FATFS drive it mounted the card as, so this
+// looks for the drive whose size matches what the card reports.
+uint32_t cardClusterSize() {
+  uint64_t cardBytes = SD_CARD.totalBytes();
+  for (int drive = 0; drive < FF_VOLUMES; drive++) {
+    char path[3] = { (char)('0' + drive), ':', 0 };
+    FATFS *fs = NULL;
+    DWORD freeClusters = 0;
+    if (f_getfree(path, &freeClusters, &fs) != FR_OK || !fs) {
+      continue;
+    }
+#if FF_MAX_SS != FF_MIN_SS
+    uint32_t sectorSize = fs->ssize;
+#else
+    uint32_t sectorSize = FF_MAX_SS;
+#endif
+    uint32_t clusterSize = fs->csize * sectorSize;
+    if ((uint64_t)(fs->n_fatent - 2) * clusterSize == cardBytes) {
+      return clusterSize;
+    }
+  }
+  return 0;
+}
+
+static size_t cardFileWrite(void *ctx, const uint8_t *data, size_t len) {
+  return ((File*)ctx)->write(data, len);
+}
+
+// Writes len bytes at the file's position through cardWriteBuffer, cut so
+// that every piece after the first starts on a multiple of SD_WRITE_CHUNK
+// in the file. File data starts on a cluster, so with the chunk a multiple
+// of the cluster size each piece fills whole clusters, and FATFS hands it
+// to the driver as one multi-block write. Frames live in PSRAM, which
+// neither driver can DMA from; written directly they would be bounced
+// through a small internal buffer a sector at a time.
+size_t cardWrite(File &file, const uint8_t *data, size_t len) {
+  if (!cardWriteBuffer) {
+    return file.write(data, len);
+  }
+  
+  xSemaphoreTake(cardWriteMutex, portMAX_DELAY);
+  size_t done = cardWriteAligned(file.position(), data, len, cardWriteBuffer, SD_WRITE_CHUNK, cardFileWrite, &file);
+  xSemaphoreGive(cardWriteMutex);
+  return done;
+}
+
+// Grows a new file to bytes before anything is written to it. Seeking past
+// the end in write mode makes FATFS allocate the whole cluster chain in one
+// pass, rather than a cluster at a time as the data arrives; FATFS has no
+// fallocate, so this is as close as it gets. Leaves the position at 0.
+bool cardPreallocate(File &file, uint32_t bytes) {
+  bool ok = bytes > 0 && file.seek(bytes - 1) && file.write((uint8_t)0) == 1;
+  file.seek(0);
+  return ok;
+}
+
 bool initSDCard() {
-  Serial.println("Initializing SD card...");
-  Serial.flush();
+  LOG_INFO("Initializing SD card...");
   
   unsigned long startTime = millis();
   bool success = false;
   
   for (int i = 0; i < 5; i++) {
-    if (SD.begin(SD_CS_PIN)) {
+    if (cardBegin()) {
       success = true;
       break;
     }
-    Serial.print("SD init attempt ");
-    Serial.print(i + 1);
-    Serial.println(" failed, retrying...");
+    LOG_WARN("SD init attempt %d failed, retrying...", i + 1);
     delay(500);
   }
   
   if (!success) {
-    Serial.println("SD.begin() failed after retries");
+    LOG_WARN("SD card mount (%s) failed after retries", SD_BUS_NAME);
     return false;
   }
   
   delay(100);
   
-  uint8_t cardType = SD.cardType();
+  uint8_t cardType = SD_CARD.cardType();
   if (cardType == CARD_NONE) {
-    Serial.println("No SD card detected");
+    LOG_INFO("No SD card detected");
     return false;
   }
   
-  Serial.print("SD Card Type: ");
+  const char *cardName = "UNKNOWN";
   if (cardType == CARD_MMC) {
-    Serial.println("MMC");
+    cardName = "MMC";
   } else if (cardType == CARD_SD) {
-    Serial.println("SDSC");
+    cardName = "SDSC";
   } else if (cardType == CARD_SDHC) {
-    Serial.println("SDHC");
-  } else {
-    Serial.println("UNKNOWN");
+    cardName = "SDHC";
   }
+  LOG_INFO("SD Card Type: %s on %s", cardName, SD_BUS_NAME);
+  
+  uint64_t totalMB = SD_CARD.totalBytes() / (1024 * 1024);
+  uint64_t freeMB = (SD_CARD.totalBytes() - SD_CARD.usedBytes()) / (1024 * 1024);
+  LOG_INFO("SD Card: %llu MB total, %llu MB free", totalMB, freeMB);
   
-  uint64_t totalMB = SD.totalBytes() / (1024 * 1024);
-  uint64_t freeMB = (SD.totalBytes() - SD.usedBytes()) / (1024 * 1024);
-  Serial.printf("SD Card: %llu MB total, %llu MB free\n", totalMB, freeMB);
+  if (!cardWriteBuffer) {
+    cardWriteBuffer = (uint8_t*)heap_caps_malloc(SD_WRITE_CHUNK, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+    cardWriteMutex = xSemaphoreCreateMutex();
+  }
+  if (!cardWriteBuffer) {
+    LOG_WARN("No internal RAM for the SD write buffer - writing directly");
+  }
+  LOG_INFO("SD cluster size: %u KB, write chunk: %u KB", cardClusterSize() / 1024, SD_WRITE_CHUNK / 1024);
   
-  Serial.print("Filesystem Format: ");
-  File root = SD.open("/");
+  File root = SD_CARD.open("/");
   if (root && root.isDirectory()) {
-    Serial.println("FAT32");
+    LOG_INFO("Filesystem Format: FAT32");
     root.close();
   } else {
-    Serial.println("UNKNOWN");
+    LOG_INFO("Filesystem Format: UNKNOWN");
     if (root) root.close();
   }
   
   return true;
 }
 
-void captureImage() {
-  Serial.println("\nCapturing image...");
-  Serial.flush();
+// The encoder's output buffer is part of its state in the PSRAM arena and
+// its chunks fall wherever the frame starts in the file, so they go through
+// cardWrite() like any other PSRAM data. Queued, a chunk is copied into a
+// free block and handed to the write task; the encoder only waits when both
+// blocks are still on their way to the card.
+static bool jpegFileSinkWrite(void *ctx, const uint8_t *data, size_t len) {
+  JpegFileSink *sink = (JpegFileSink*)ctx;
+  if (!sink->queued) {
+    int64_t start = esp_timer_get_time();
+    size_t written = cardWrite(*sink->file, data, len);
+    metricsRecordSince(STAGE_WRITE, start);
+    sink->len += written;
+    return written == len;
+  }
   
-  // For high-resolution RGB565, add a small delay to let camera stabilize
-  if (currentPixelFormat == PIXFORMAT_RGB565 && 
-      (currentFrameSize == FRAMESIZE_SXGA || currentFrameSize == FRAMESIZE_UXGA)) {
-    delay(100); // Extra stabilization for high-res RGB565
+  SinkBlock block;
+  xQueueReceive(sinkFreeQueue, &block.data, portMAX_DELAY);
+  if (sink->failed) {
+    xQueueSend(sinkFreeQueue, &block.data, 0);
+    return false;
+  }
+  memcpy(block.data, data, len);
+  block.sink = sink;
+  block.len = len;
+  xQueueSend(sinkBlockQueue, &block, portMAX_DELAY);
+  return true;
+}
+
+// Run by the write task for each queued block. The block goes back to the
+// free queue once it's written.
+void writeSinkBlock(const SinkBlock &block) {
+  JpegFileSink *sink = block.sink;
+  if (!sink->failed) {
+    int64_t start = esp_timer_get_time();
+    size_t written = cardWrite(*sink->file, block.data, block.len);
+    metricsRecordSince(STAGE_WRITE, start);
+    sink->len += written;
+    sink->failed = (written != block.len);
+  }
+  xQueueSend(sinkFreeQueue, &block.data, portMAX_DELAY);
+}
+
+// Encodes straight into file, writing as it goes, so only one strip and one
+// sink buffer are ever held rather than the whole compressed image. *outLen
+// gets the bytes written. Used when the write task's blocks aren't there.
+bool jpegEncodeToFile(const uint8_t *pixels, uint16_t width, uint16_t height, pixformat_t format,
+                      bool swapBytes, int quality, File &file, size_t *outLen) {
+  JpegFileSink sink;
+  sink.file = &file;
+  sink.len = 0;
+  sink.queued = false;
+  sink.failed = false;
+  int64_t start = esp_timer_get_time();
+  bool ok = jpegEncode(pixels, width, height, format, swapBytes, quality, jpegFileSinkWrite, &sink);
+  metricsRecordSince(STAGE_ENCODE, start);
+  *outLen = sink.len;
+  return ok;
+}
+
+// Fills a fixed-size buffer; fails once the buffer is full
+struct JpegBufferSink {
+  uint8_t *data;
+  size_t len;
+  size_t capacity;
+  bool overflow;
+};
+
+static bool jpegBufferSinkWrite(void *ctx, const uint8_t *data, size_t len) {
+  JpegBufferSink *sink = (JpegBufferSink*)ctx;
+  if (sink->len + len > sink->capacity) {
+    sink->overflow = true;
+    return false;
   }
+  memcpy(sink->data + sink->len, data, len);
+  sink->len += len;
+  return true;
+}
+
+// Lays the arena out for frames of this size and format: encoder state,
+// strip planes wide enough for the frame (or just its thumbnail when the
+// sensor delivers JPEG), the thumbnail's pixels and the thumbnail slots.
+void arenaSetup(framesize_t frameSize, pixformat_t format) {
+  arenaFree();
   
-  Serial.println("Getting frame buffer...");
-  Serial.flush();
+  uint16_t width = resolution[frameSize].width;
+  uint16_t height = resolution[frameSize].height;
+  uint16_t thumbWidth = 0, thumbHeight = 0;
+  int scale = 0;
+  bool thumb = thumbDimensions(width, height, format, &thumbWidth, &thumbHeight, &scale);
+  // Thumbnails are grayscale for grayscale frames and RGB565 otherwise
+  int thumbBpp = (format == PIXFORMAT_GRAYSCALE) ? 1 : 2;
   
-  // Capture in the selected format
-  camera_fb_t *fb = esp_camera_fb_get();
-  if (!fb) {
-    Serial.println("ERROR: Camera capture failed!");
-    Serial.flush();
+  int encodeWidth = (format == PIXFORMAT_JPEG) ? thumbWidth : width;
+  int mcuSize = (format == PIXFORMAT_GRAYSCALE) ? 8 : 16;
+  int stride = (encodeWidth + mcuSize - 1) / mcuSize * mcuSize;
+  
+  memset(&arena, 0, sizeof(arena));
+  // Regions start on 16-byte boundaries so the strip planes suit the PIE kernel
+  arena.regionSize[ARENA_ENCODER] = (jpegEncoderStateSize() + 15) & ~15;
+  arena.regionSize[ARENA_PLANES] = (stride * mcuSize * ((format == PIXFORMAT_GRAYSCALE) ? 1 : 3) + 15) & ~15;
+  arena.regionSize[ARENA_THUMB_PIXELS] = thumb ? (thumbWidth * thumbHeight * thumbBpp + 3) & ~3 : 0;
+  // Thumbnails at THUMB_JPEG_QUALITY come to well under half a byte a pixel
+  arena.slotSize = thumb ? (thumbWidth * thumbHeight / 2 + 1024 + 3) & ~3 : 0;
+  
+  size_t total = arena.slotSize * ARENA_THUMB_SLOTS;
+  for (int i = 0; i < ARENA_REGION_COUNT; i++) {
+    total += arena.regionSize[i];
+  }
+  arena.base = (uint8_t*)ps_malloc(total + 15);
+  if (!arena.base) {
+    LOG_WARN("No room for %u KB capture arena, encoding will use the heap", total / 1024);
     return;
   }
+  arena.size = total;
   
-  Serial.printf("Captured image size: %u bytes, format: %d\n", fb->len, fb->format);
-  Serial.flush();
-  
-  uint8_t* jpegData = NULL;
-  size_t jpegLen = 0;
-  bool needsFree = false;
+  uint8_t *next = (uint8_t*)(((uintptr_t)arena.base + 15) & ~(uintptr_t)15);
+  for (int i = 0; i < ARENA_REGION_COUNT; i++) {
+    arena.region[i] = next;
+    next += arena.regionSize[i];
+  }
+  arena.slots = next;
   
-  // Process based on format
-  if (fb->format == PIXFORMAT_JPEG) {
-    // Already JPEG, use as-is
-    Serial.println("Image is already JPEG format");
-    Serial.flush();
-    jpegData = fb->buf;
-    jpegLen = fb->len;
-  } else if (fb->format == PIXFORMAT_GRAYSCALE) {
-    // Convert grayscale to JPEG using fmt2jpg() - preserves grayscale appearance
-    Serial.println("Converting grayscale to JPEG...");
-    Serial.flush();
-    
-    // Map quality (0-63 camera quality to 0-100 fmt2jpg quality)
-    int jpegQuality = map(currentQuality, 0, 63, 10, 100);
-    if (jpegQuality < 10) jpegQuality = 10;
-    if (jpegQuality > 100) jpegQuality = 100;
-    
-    // Convert grayscale to JPEG
-    uint8_t *jpeg_buf = NULL;
-    size_t jpeg_buf_len = 0;
-    
-    bool success = fmt2jpg(fb->buf, fb->len, fb->width, fb->height, PIXFORMAT_GRAYSCALE, jpegQuality, &jpeg_buf, &jpeg_buf_len);
-    
-    if (!success || !jpeg_buf) {
-      Serial.println("ERROR: Grayscale to JPEG conversion failed!");
-      Serial.flush();
-      esp_camera_fb_return(fb);
-      return;
-    }
-    
-    jpegData = jpeg_buf;
-    jpegLen = jpeg_buf_len;
-    needsFree = true; // We need to free jpeg_buf later
-    
-    Serial.printf("Grayscale converted to JPEG: %u bytes\n", jpegLen);
-    Serial.flush();
-    
-    // Return the original frame buffer
-    esp_camera_fb_return(fb);
-    fb = NULL; // Mark as returned so we don't return it again
-    
-  } else if (fb->format == PIXFORMAT_RGB565) {
-    // Convert RGB565 to JPEG using fmt2jpg() - preserves RGB565 appearance
-    Serial.println("Converting RGB565 to JPEG...");
-    Serial.flush();
-    
-    // Handle endianness if needed
-    uint8_t* rgb565Data = fb->buf;
-    bool swappedData = false;
-    if (currentBigEndian) {
-      // Swap bytes for big endian
-      Serial.println("Swapping bytes for big endian...");
-      Serial.flush();
-      rgb565Data = (uint8_t*)malloc(fb->len);
-      if (rgb565Data) {
-        // Process in chunks to avoid blocking for too long on large images
-        size_t chunkSize = 65536; // Process 64KB at a time
-        for (size_t i = 0; i < fb->len - 1; i += 2) {
-          rgb565Data[i] = fb->buf[i + 1];
-          rgb565Data[i + 1] = fb->buf[i];
-          // Yield periodically for large images to prevent watchdog issues
-          if (i > 0 && (i % chunkSize == 0)) {
-            delay(1);
-          }
-        }
-        swappedData = true;
-        Serial.println("Byte swap complete");
-        Serial.flush();
-      } else {
-        Serial.println("ERROR: Failed to allocate swap buffer!");
-        Serial.flush();
-        esp_camera_fb_return(fb);
-        return;
-      }
+  LOG_INFO("Capture arena: %u KB in PSRAM (%d thumbnail slots of %u bytes)",
+                arena.size / 1024, ARENA_THUMB_SLOTS, arena.slotSize);
+}
+
+// Only called from reinitCamera(), with the pipeline idle and arenaMutex
+// held, so nothing should be lent out. If something is, the block is leaked
+// rather than freed under it.
+void arenaFree() {
+  if (arena.base) {
+    bool lent = arena.slotsUsed != 0;
+    for (int i = 0; i < ARENA_REGION_COUNT; i++) {
+      lent = lent || arena.regionBusy[i];
     }
-    
-    // Map quality (0-63 camera quality to 0-100 fmt2jpg quality)
-    // For high-resolution images, use slightly lower quality to reduce processing time
-    int jpegQuality = map(currentQuality, 0, 63, 10, 100);
-    if (jpegQuality < 10) jpegQuality = 10;
-    if (jpegQuality > 100) jpegQuality = 100;
-    
-    // For very high resolution (SXGA/UXGA), cap quality to reduce processing time
-    if ((currentFrameSize == FRAMESIZE_SXGA || currentFrameSize == FRAMESIZE_UXGA) && jpegQuality > 80) {
-      jpegQuality = 80;
-      Serial.println("Reducing quality for high-resolution capture");
-      Serial.flush();
+    if (lent) {
+      LOG_ERROR("Capture arena freed while in use - leaking %u KB", arena.size / 1024);
+      arenaRetiredBase = arena.base;
+      arenaRetiredSize = arena.size;
+      portENTER_CRITICAL(&arenaMux);
+      arenaStats.leaked++;
+      portEXIT_CRITICAL(&arenaMux);
+    } else {
+      free(arena.base);
     }
+  }
+  memset(&arena, 0, sizeof(arena));
+}
+
+// Lends out a scratch region, or heap memory if it is too small or already lent
+void *arenaBorrow(ArenaRegion region, size_t size) {
+  bool fits = false;
+  portENTER_CRITICAL(&arenaMux);
+  arenaStats.borrows++;
+  if (arena.base && size <= arena.regionSize[region] && !arena.regionBusy[region]) {
+    arena.regionBusy[region] = true;
+    fits = true;
+  } else {
+    arenaStats.heapFallbacks++;
+  }
+  portEXIT_CRITICAL(&arenaMux);
+  return fits ? arena.region[region] : ps_malloc(size);
+}
+
+// Takes a free thumbnail slot; *capacity gets its size
+uint8_t *arenaTakeSlot(size_t *capacity) {
+  int slot = -1;
+  portENTER_CRITICAL(&arenaMux);
+  arenaStats.borrows++;
+  if (arena.base) {
+    for (int i = 0; i < ARENA_THUMB_SLOTS; i++) {
+      if (!(arena.slotsUsed & (1u << i))) {
+        arena.slotsUsed |= (1u << i);
+        arena.slotsInUse++;
+        if (arena.slotsInUse > arenaStats.slotsPeak) arenaStats.slotsPeak = arena.slotsInUse;
+        slot = i;
+        break;
+      }
+    }
+  }
+  if (slot < 0) {
+    arenaStats.heapFallbacks++;
+  }
+  size_t slotSize = arena.slotSize;
+  portEXIT_CRITICAL(&arenaMux);
+  
+  if (slot >= 0) {
+    *capacity = slotSize;
+    return arena.slots + slot * slotSize;
+  }
+  // Out of slots (or no arena): fall back to a buffer of the usual size
+  *capacity = slotSize ? slotSize : 32768;
+  return (uint8_t*)ps_malloc(*capacity);
+}
+
+// Hands back anything arenaBorrow() or arenaTakeSlot() gave out
+void arenaRelease(void *ptr) {
+  uint8_t *p = (uint8_t*)ptr;
+  if (!p) {
+    return;
+  }
+  if (arenaRetiredBase && p >= arenaRetiredBase && p < arenaRetiredBase + arenaRetiredSize) {
+    return;  // From a block arenaFree() had to leak, never from the heap
+  }
+  if (!arena.base || p < arena.base || p >= arena.base + arena.size) {
+    free(p);
+    return;
+  }
+  portENTER_CRITICAL(&arenaMux);
+  if (p >= arena.slots) {
+    arena.slotsUsed &= ~(1u << ((p - arena.slots) / arena.slotSize));
+    arena.slotsInUse--;
+  } else {
+    for (int i = 0; i < ARENA_REGION_COUNT; i++) {
+      if (p == arena.region[i]) {
+        arena.regionBusy[i] = false;
+      }
+    }
+  }
+  portEXIT_CRITICAL(&arenaMux);
+}
+
+// The encoder's scratch memory comes from the arena
+void *jpegScratchBorrow(JpegScratch which, size_t size) {
+  return arenaBorrow(which == JPEG_SCRATCH_STATE ? ARENA_ENCODER : ARENA_PLANES, size);
+}
+
+void jpegScratchRelease(void *ptr) {
+  arenaRelease(ptr);
+}
+
+// Lets lower-priority tasks (and the idle task's watchdog) run on long frames
+void jpegYield() {
+  delay(1);
+}
+
+// Serial 'k': checks the fast and SIMD conversion kernels against the
+// reference for both byte orders, then times each over a frame's worth of
+// rows at every supported resolution. Rows are converted from one cached
+// source row, so the figures are kernel throughput rather than PSRAM
+// bandwidth.
+void benchmarkKernels() {
+  static const struct { const char *name; int width; int height; } sizes[] = {
+    { "QQVGA", 160, 120 }, { "QCIF", 176, 144 }, { "QVGA", 320, 240 }, { "VGA", 640, 480 },
+    { "SVGA", 800, 600 }, { "XGA", 1024, 768 }, { "SXGA", 1280, 1024 }, { "UXGA", 1600, 1200 }
+  };
+  const int maxWidth = 1600;
+  
+  jpegInitTables();
+  // One block, carved into 16-byte aligned rows for the SIMD kernel
+  uint8_t *block = (uint8_t*)malloc(maxWidth * 11 + 15);
+  if (!block) {
+    Serial.println("ERROR: Not enough memory for kernel benchmark");
+    return;
+  }
+  uint8_t *src = (uint8_t*)(((uintptr_t)block + 15) & ~(uintptr_t)15);
+  uint8_t *rows = src + maxWidth * 2;
+  uint8_t *refY = rows, *refCb = rows + maxWidth, *refCr = rows + maxWidth * 2;
+  uint8_t *fastY = rows + maxWidth * 3, *fastCb = rows + maxWidth * 4, *fastCr = rows + maxWidth * 5;
+  uint8_t *simdY = rows + maxWidth * 6, *simdCb = rows + maxWidth * 7, *simdCr = rows + maxWidth * 8;
+  
+  Serial.println("\n=== Colour Conversion Kernels ===");
+  Serial.printf("SIMD path: %s\n", jpegSimdName() ? jpegSimdName() : "none (PIE kernel failed its check)");
+  uint32_t seed = 0x12345678;
+  bool exact = true, simdExact = true;
+  for (int pass = 0; pass < 16 && exact && simdExact; pass++) {
+    for (int i = 0; i < maxWidth * 2; i++) {
+      seed = seed * 1664525 + 1013904223;
+      src[i] = seed >> 24;
+    }
+    for (int swap = 0; swap < 2; swap++) {
+      jpegRowRgb565Ref(src, maxWidth, swap, refY, refCb, refCr);
+      jpegRowRgb565Fast(src, maxWidth, swap, fastY, fastCb, fastCr);
+      jpegRowRgb565Simd(src, maxWidth, swap, simdY, simdCb, simdCr);
+      if (memcmp(refY, fastY, maxWidth) || memcmp(refCb, fastCb, maxWidth) || memcmp(refCr, fastCr, maxWidth)) {
+        exact = false;
+      }
+      if (memcmp(refY, simdY, maxWidth) || memcmp(refCb, simdCb, maxWidth) || memcmp(refCr, simdCr, maxWidth)) {
+        simdExact = false;
+      }
+    }
+  }
+  Serial.printf("Fast kernel matches reference: %s\n", exact ? "yes" : "NO");
+  Serial.printf("SIMD kernel matches reference: %s\n", simdExact ? "yes" : "NO");
+  
+  Serial.println("Size     Reference     Fast          SIMD          Speedup");
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    int width = sizes[i].width;
+    int height = sizes[i].height;
+    
+    unsigned long start = micros();
+    for (int y = 0; y < height; y++) {
+      jpegRowRgb565Ref(src, width, false, refY, refCb, refCr);
+    }
+    unsigned long refUs = micros() - start;
+    
+    start = micros();
+    for (int y = 0; y < height; y++) {
+      jpegRowRgb565Fast(src, width, false, fastY, fastCb, fastCr);
+    }
+    unsigned long fastUs = micros() - start;
+    
+    start = micros();
+    for (int y = 0; y < height; y++) {
+      jpegRowRgb565Simd(src, width, false, simdY, simdCb, simdCr);
+    }
+    unsigned long simdUs = micros() - start;
     
-    Serial.printf("Encoding RGB565 to JPEG (quality: %d)...\n", jpegQuality);
+    float pixels = (float)width * height;
+    Serial.printf("%-8s %6.2f MPix/s  %6.2f MPix/s  %6.2f MPix/s  %.2fx\n", sizes[i].name,
+                  pixels / max(refUs, 1UL), pixels / max(fastUs, 1UL), pixels / max(simdUs, 1UL),
+                  (float)refUs / max(simdUs, 1UL));
+    delay(1);  // Let the idle task feed the watchdog between sizes
+  }
+  
+  free(block);
+  Serial.flush();
+}
+
+// Sink for the pipeline benchmark. Writes to the file the way the capture
+// path does, keeping the time spent in file.write() apart from encoding;
+// with no file it just counts bytes.
+struct BenchmarkSink {
+  File *file;
+  size_t len;
+  int64_t writeUs;
+};
+
+static bool benchmarkSinkWrite(void *ctx, const uint8_t *data, size_t len) {
+  BenchmarkSink *sink = (BenchmarkSink*)ctx;
+  if (!sink->file) {
+    sink->len += len;
+    return true;
+  }
+  int64_t start = esp_timer_get_time();
+  size_t written = sink->file->write(data, len);
+  sink->writeUs += esp_timer_get_time() - start;
+  sink->len += written;
+  return written == len;
+}
+
+// Fills a frame with a fixed test scene: colour gradients with a little
+// noise, so the encoder sees something like real content and every run
+// compresses exactly the same data. RGB565 is high byte first, like the
+// sensor delivers it.
+void benchmarkFillFrame(uint8_t *pixels, uint16_t width, uint16_t height, pixformat_t format) {
+  uint32_t seed = 0x2545F491;
+  for (uint16_t y = 0; y < height; y++) {
+    for (uint16_t x = 0; x < width; x++) {
+      seed = seed * 1664525 + 1013904223;
+      int noise = (int)(seed >> 28) - 8;
+      int r = constrain(x * 255 / width + noise, 0, 255);
+      int g = constrain(y * 255 / height + noise, 0, 255);
+      int b = constrain((x + y) * 255 / (width + height) - noise, 0, 255);
+      if (format == PIXFORMAT_RGB565) {
+        uint16_t px = ((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3);
+        *pixels++ = px >> 8;
+        *pixels++ = px & 0xFF;
+      } else {
+        *pixels++ = (r + 2 * g + b) >> 2;
+      }
+    }
+  }
+}
+
+// Runs the encode and storage half of the capture path on synthetic frames
+// at every resolution, raw format and a few qualities, without touching the
+// camera, and prints frames/s, bytes/s and time per stage. Gives comparable
+// numbers from one build to the next since the input never changes.
+void benchmarkPipeline() {
+  static const struct { framesize_t size; const char *name; } sizes[] = {
+    { FRAMESIZE_QQVGA, "QQVGA" }, { FRAMESIZE_QVGA, "QVGA" }, { FRAMESIZE_VGA, "VGA" }, { FRAMESIZE_SVGA, "SVGA" },
+    { FRAMESIZE_XGA, "XGA" }, { FRAMESIZE_SXGA, "SXGA" }, { FRAMESIZE_UXGA, "UXGA" }
+  };
+  static const struct { pixformat_t format; bool swap; const char *name; } formats[] = {
+    { PIXFORMAT_RGB565, false, "RGB565 LE" }, { PIXFORMAT_RGB565, true, "RGB565 BE" }, { PIXFORMAT_GRAYSCALE, false, "Grayscale" }
+  };
+  static const int qualities[] = { 50, 80, 95 };  // Encoder quality (1-100)
+  const int framesPerRun = 3;
+  const char *benchFile = "/bench.tmp";
+  
+  jpegInitTables();
+  uint8_t *frame = (uint8_t*)ps_malloc(resolution[FRAMESIZE_UXGA].width * resolution[FRAMESIZE_UXGA].height * 2);
+  if (!frame) {
+    Serial.println("ERROR: Not enough PSRAM for pipeline benchmark");
+    return;
+  }
+  
+  bool useCard = sdCardPresent;
+  Serial.println("\n=== Encode + Storage Pipeline (synthetic frames) ===");
+  if (!useCard) {
+    Serial.println("No SD card - timing the encoder only");
+  }
+  Serial.println("Size   Format     Q    fps     KB/frame  KB/s     encode ms  write ms  open ms  close ms");
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    uint16_t width = resolution[sizes[s].size].width;
+    uint16_t height = resolution[sizes[s].size].height;
+    for (size_t f = 0; f < sizeof(formats) / sizeof(formats[0]); f++) {
+      benchmarkFillFrame(frame, width, height, formats[f].format);
+      for (size_t q = 0; q < sizeof(qualities) / sizeof(qualities[0]); q++) {
+        int64_t encodeUs = 0, writeUs = 0, openUs = 0, closeUs = 0;
+        size_t bytes = 0;
+        int frames = 0;
+        for (int i = 0; i < framesPerRun; i++) {
+          BenchmarkSink sink = { NULL, 0, 0 };
+          File file;
+          if (useCard) {
+            int64_t start = esp_timer_get_time();
+            file = SD_CARD.open(benchFile, FILE_WRITE);
+            openUs += esp_timer_get_time() - start;
+            if (file) {
+              sink.file = &file;
+            }
+          }
+          
+          int64_t start = esp_timer_get_time();
+          bool ok = jpegEncode(frame, width, height, formats[f].format, formats[f].swap, qualities[q], benchmarkSinkWrite, &sink);
+          encodeUs += esp_timer_get_time() - start - sink.writeUs;
+          writeUs += sink.writeUs;
+          
+          if (file) {
+            start = esp_timer_get_time();
+            file.close();
+            closeUs += esp_timer_get_time() - start;
+          }
+          if (!ok) {
+            break;
+          }
+          bytes += sink.len;
+          frames++;
+          delay(1);  // Let the idle task feed the watchdog between frames
+        }
+        if (frames == 0) {
+          Serial.printf("%-6s %-10s %-3d  FAILED\n", sizes[s].name, formats[f].name, qualities[q]);
+          continue;
+        }
+        
+        float totalMs = (encodeUs + writeUs + openUs + closeUs) / 1000.0f;
+        Serial.printf("%-6s %-10s %-3d  %6.2f  %8.1f  %7.1f  %9.1f  %8.1f  %7.1f  %8.1f\n",
+                      sizes[s].name, formats[f].name, qualities[q],
+                      frames * 1000.0f / totalMs, bytes / 1024.0f / frames, bytes / 1024.0f * 1000.0f / totalMs,
+                      encodeUs / 1000.0f / frames, writeUs / 1000.0f / frames,
+                      openUs / 1000.0f / frames, closeUs / 1000.0f / frames);
+      }
+    }
+  }
+  
+  if (useCard) {
+    SD_CARD.remove(benchFile);
+  }
+  free(frame);
+  Serial.flush();
+}
+
+// Times sequential writes of a 4 MB file at several write sizes: plain
+// File::write from PSRAM, through cardWrite(), and through cardWrite() into
+// a preallocated file. Reports MB/s (including close) and the latency of
+// the individual writes.
+void benchmarkStorage() {
+  if (!sdCardPresent) {
+    Serial.println("No SD card");
+    return;
+  }
+  
+  static const char *modeNames[] = { "direct", "buffered", "prealloc" };
+  static const size_t writeSizes[] = { 512, 4096, SD_WRITE_CHUNK, 65536 };
+  const size_t fileBytes = 4 * 1024 * 1024;
+  const char *benchFile = "/bench.tmp";
+  
+  uint8_t *data = (uint8_t*)ps_malloc(fileBytes);
+  if (!data) {
+    Serial.println("ERROR: Not enough PSRAM for storage benchmark");
+    return;
+  }
+  for (size_t i = 0; i < fileBytes; i++) {
+    data[i] = (uint8_t)(i * 31 + (i >> 9));
+  }
+  std::vector<uint32_t> latencies;
+  latencies.reserve(fileBytes / writeSizes[0]);
+  
+  Serial.println("\n=== SD Card Sequential Write ===");
+  Serial.printf("Bus: %s, cluster: %u KB, write chunk: %u KB, file: %u KB\n", SD_BUS_NAME,
+                cardClusterSize() / 1024, SD_WRITE_CHUNK / 1024, fileBytes / 1024);
+  Serial.println("Mode      write B  MB/s    p50 ms  p90 ms  p99 ms  max ms");
+  for (int mode = 0; mode < 3; mode++) {
+    for (size_t w = 0; w < sizeof(writeSizes) / sizeof(writeSizes[0]); w++) {
+      size_t writeSize = writeSizes[w];
+      File file = SD_CARD.open(benchFile, FILE_WRITE);
+      if (!file) {
+        Serial.println("ERROR: Failed to open benchmark file");
+        free(data);
+        return;
+      }
+      
+      int64_t start = esp_timer_get_time();
+      if (mode == 2) {
+        cardPreallocate(file, fileBytes);
+      }
+      latencies.clear();
+      bool ok = true;
+      for (size_t offset = 0; offset < fileBytes && ok; offset += writeSize) {
+        int64_t writeStart = esp_timer_get_time();
+        size_t written = (mode == 0) ? file.write(data + offset, writeSize) : cardWrite(file, data + offset, writeSize);
+        latencies.push_back((uint32_t)(esp_timer_get_time() - writeStart));
+        ok = (written == writeSize);
+      }
+      file.close();
+      int64_t totalUs = esp_timer_get_time() - start;
+      SD_CARD.remove(benchFile);
+      
+      if (!ok) {
+        Serial.printf("%-8s  %-7u  FAILED\n", modeNames[mode], writeSize);
+        continue;
+      }
+      std::sort(latencies.begin(), latencies.end());
+      size_t count = latencies.size();
+      Serial.printf("%-8s  %-7u  %6.2f  %6.2f  %6.2f  %6.2f  %6.2f\n", modeNames[mode], writeSize,
+                    fileBytes / (totalUs / 1000000.0f) / (1024 * 1024),
+                    latencies[count / 2] / 1000.0f, latencies[count * 9 / 10] / 1000.0f,
+                    latencies[count * 99 / 100] / 1000.0f, latencies[count - 1] / 1000.0f);
+      delay(1);  // Let the idle task feed the watchdog between runs
+    }
+  }
+  
+  free(data);
+  Serial.flush();
+}
+
+// Serial 'g': what a log line costs the caller. Times LOG_INFO into the ring,
+// once with a burst that fits and once with one that overruns it, against
+// the Serial.printf() + flush() the sketch used before the ring. Lines the
+// ring had no room for are counted, not waited on.
+void benchmarkLogging() {
+  static const int bursts[] = { LOG_RING_SLOTS / 2, LOG_RING_SLOTS * 4 };
+  
+  logFlush(1000);
+  Serial.println("\n=== Logging ===");
+  Serial.flush();
+  uint32_t ringUs[2];
+  uint32_t ringDropped[2];
+  for (int b = 0; b < 2; b++) {
+    uint32_t droppedBefore = __atomic_load_n(&logDropped, __ATOMIC_RELAXED);
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i < bursts[b]; i++) {
+      LOG_INFO("[bench] ring line %d of %d, %lu ms", i + 1, bursts[b], millis());
+    }
+    ringUs[b] = (uint32_t)(esp_timer_get_time() - start);
+    ringDropped[b] = __atomic_load_n(&logDropped, __ATOMIC_RELAXED) - droppedBefore;
+    logFlush(5000);
+  }
+  
+  const int direct = LOG_RING_SLOTS / 2;
+  int64_t start = esp_timer_get_time();
+  for (int i = 0; i < direct; i++) {
+    Serial.printf("[bench] direct line %d of %d, %lu ms\n", i + 1, direct, millis());
     Serial.flush();
+  }
+  uint32_t directUs = (uint32_t)(esp_timer_get_time() - start);
+  
+  Serial.println("Path              lines  us/call  dropped");
+  for (int b = 0; b < 2; b++) {
+    Serial.printf("LOG_INFO (ring)   %5d  %7.1f  %u\n", bursts[b], (float)ringUs[b] / bursts[b], ringDropped[b]);
+  }
+  Serial.printf("printf + flush    %5d  %7.1f  -\n", direct, (float)directUs / direct);
+  Serial.flush();
+}
+
+// Capture pipeline: the sensor grab, JPEG encode and SD write stages run as
+// separate tasks connected by bounded queues, so frame N+1 can be grabbed
+// while frame N is encoded and frame N-1 is written. A full queue blocks the
+// stage feeding it, which keeps burst throughput at the pace of the slowest
+// stage without ever holding more frames than the queues allow.
+void startCapturePipeline() {
+  jpegInitTables();
+  LOG_INFO("Colour conversion: %s", jpegSimdName() ? jpegSimdName() : "fast kernel (PIE kernel failed its check)");
+  
+  grabQueue = xQueueCreate(PIPELINE_QUEUE_DEPTH, sizeof(CaptureRequest));
+  encodeQueue = xQueueCreate(PIPELINE_QUEUE_DEPTH, sizeof(CaptureJob));
+  writeQueue = xQueueCreate(PIPELINE_QUEUE_DEPTH, sizeof(CaptureJob));
+  if (!grabQueue || !encodeQueue || !writeQueue) {
+    LOG_ERROR("Failed to create capture pipeline queues!");
+    return;
+  }
+  
+  // Without the sink blocks the encoder writes its output itself
+  uint8_t *blocks = (uint8_t*)heap_caps_malloc(JPEG_SINK_BLOCKS * JPEG_SINK_BUFFER_SIZE, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+  QueueHandle_t filled = xQueueCreate(JPEG_SINK_BLOCKS, sizeof(SinkBlock));
+  QueueHandle_t empty = xQueueCreate(JPEG_SINK_BLOCKS, sizeof(uint8_t*));
+  QueueHandle_t outputs = xQueueCreate(JPEG_SINK_FILES, sizeof(FrameOutput*));
+  writeTaskSet = xQueueCreateSet(PIPELINE_QUEUE_DEPTH + JPEG_SINK_BLOCKS);
+  if (blocks && filled && empty && outputs && writeTaskSet) {
+    for (int i = 0; i < JPEG_SINK_BLOCKS; i++) {
+      uint8_t *block = blocks + i * JPEG_SINK_BUFFER_SIZE;
+      xQueueSend(empty, &block, 0);
+    }
+    for (int i = 0; i < JPEG_SINK_FILES; i++) {
+      FrameOutput *output = &frameOutputs[i];
+      xQueueSend(outputs, &output, 0);
+    }
+    sinkFreeQueue = empty;
+    sinkBlockQueue = filled;
+    frameOutputQueue = outputs;
+    xQueueAddToSet(sinkBlockQueue, writeTaskSet);
+  } else {
+    LOG_WARN("No internal RAM for the encoder's write blocks - encoding and writing in turn");
+    free(blocks);
+  }
+  if (writeTaskSet) {
+    xQueueAddToSet(writeQueue, writeTaskSet);
+  }
+  
+  // Grab and write share core 1 with loop(); encoding is CPU bound and gets
+  // core 0 to itself apart from the WiFi stack, which runs at higher priority
+  xTaskCreatePinnedToCore(grabTask, "grab", 4096, NULL, 3, NULL, 1);
+  xTaskCreatePinnedToCore(encodeTask, "encode", 16384, NULL, 2, NULL, 0);
+  xTaskCreatePinnedToCore(writeTask, "write", 8192, NULL, 2, NULL, 1);
+  // Idle until pre-trigger mode is switched on
+  xTaskCreatePinnedToCore(pretriggerTask, "pretrigger", 4096, NULL, 1, &pretriggerTaskHandle, 1);
+  
+  pipelineReady = true;
+  LOG_INFO("Capture pipeline started");
+}
+
+bool queueCapture(bool burst, int burstIndex) {
+  if (!pipelineReady) {
+    LOG_ERROR("Capture pipeline not running");
+    return false;
+  }
+  
+  // Snapshot the settings so a change mid-burst can't affect frames in flight
+  CaptureRequest request;
+  request.quality = currentQuality;
+  request.frameSize = currentFrameSize;
+  request.bigEndian = currentBigEndian;
+  request.burst = burst;
+  request.burstIndex = burstIndex;
+  
+  // Reconfiguration waits for the pipeline to drain while holding the camera
+  // lock, so taking it here means nothing new is queued during a reinit
+  xSemaphoreTakeRecursive(cameraMutex, portMAX_DELAY);
+  
+  portENTER_CRITICAL(&pipelineMux);
+  request.id = ++captureSequence;
+  pipelineInFlight++;
+  portEXIT_CRITICAL(&pipelineMux);
+  
+  // Blocks while the grab queue is full - this is the pipeline's back-pressure
+  bool queued = xQueueSend(grabQueue, &request, portMAX_DELAY) == pdTRUE;
+  xSemaphoreGiveRecursive(cameraMutex);
+  
+  if (!queued) {
+    finishCapture(false);
+    return false;
+  }
+  return true;
+}
+
+void finishCapture(bool saved) {
+  portENTER_CRITICAL(&pipelineMux);
+  if (pipelineInFlight > 0) pipelineInFlight--;
+  if (saved) {
+    capturesSaved++;
+  } else {
+    capturesFailed++;
+  }
+  portEXIT_CRITICAL(&pipelineMux);
+}
+
+void waitForPipelineIdle() {
+  while (pipelineInFlight > 0) {
+    delay(5);
+  }
+}
+
+void captureImage() {
+  LOG_INFO("\nCapturing image...");
+  
+  if (queueCapture()) {
+    waitForPipelineIdle();
+  }
+}
+
+void grabTask(void *param) {
+  CaptureRequest request;
+  
+  for (;;) {
+    if (xQueueReceive(grabQueue, &request, portMAX_DELAY) != pdTRUE) {
+      continue;
+    }
+    
+    // For high-resolution RGB565, add a small delay to let camera stabilize
+    if (currentPixelFormat == PIXFORMAT_RGB565 && 
+        (request.frameSize == FRAMESIZE_SXGA || request.frameSize == FRAMESIZE_UXGA)) {
+      delay(100); // Extra stabilization for high-res RGB565
+    }
     
-    // Convert RGB565 to JPEG
-    uint8_t *jpeg_buf = NULL;
-    size_t jpeg_buf_len = 0;
+    int64_t grabStart = esp_timer_get_time();
+    camera_fb_t *fb = esp_camera_fb_get();
+    metricsRecordSince(STAGE_GRAB, grabStart);
+    if (request.burstIndex >= 0 && request.burstIndex < BURST_MAX_FRAMES) {
+      burstGrabUs[request.burstIndex] = esp_timer_get_time();
+    }
+    if (!fb) {
+      LOG_ERROR("Camera capture failed!");
+      finishCapture(false);
+      continue;
+    }
     
-    bool success = fmt2jpg(rgb565Data, fb->len, fb->width, fb->height, PIXFORMAT_RGB565, jpegQuality, &jpeg_buf, &jpeg_buf_len);
+    LOG_DEBUG("Captured image size: %u bytes, format: %d", fb->len, fb->format);
     
-    if (swappedData) {
-      free(rgb565Data);
+    CaptureJob job;
+    job.id = request.id;
+    job.fb = fb;
+    job.jpegData = NULL;
+    job.jpegLen = 0;
+    job.number = 0;
+    job.output = NULL;
+    job.written = false;
+    job.packed = false;
+    job.captureMs = millis();
+    job.thumbData = NULL;
+    job.thumbLen = 0;
+    job.quality = request.quality;
+    job.frameSize = request.frameSize;
+    job.bigEndian = request.bigEndian;
+    job.burst = request.burst;
+    
+    xQueueSend(encodeQueue, &job, portMAX_DELAY);
+  }
+}
+
+void encodeTask(void *param) {
+  CaptureJob job;
+  
+  for (;;) {
+    if (xQueueReceive(encodeQueue, &job, portMAX_DELAY) != pdTRUE) {
+      continue;
     }
     
-    if (!success || !jpeg_buf) {
-      Serial.println("ERROR: RGB565 to JPEG conversion failed!");
-      Serial.flush();
-      esp_camera_fb_return(fb);
-      return;
+    if (!encodeFrame(job)) {
+      arenaRelease(job.thumbData);
+      finishCapture(false);
+      continue;
+    }
+    
+    xQueueSend(writeQueue, &job, portMAX_DELAY);
+  }
+}
+
+// Saves finished frames and writes the blocks the encoder streams out, in
+// the order they were queued
+void writeTask(void *param) {
+  CaptureJob job;
+  SinkBlock block;
+  
+  for (;;) {
+    QueueSetMemberHandle_t ready = writeTaskSet ? xQueueSelectFromSet(writeTaskSet, portMAX_DELAY) : writeQueue;
+    if (ready == sinkBlockQueue) {
+      if (xQueueReceive(sinkBlockQueue, &block, 0) == pdTRUE) {
+        writeSinkBlock(block);
+      }
+      continue;
     }
+    if (xQueueReceive(writeQueue, &job, writeTaskSet ? 0 : portMAX_DELAY) != pdTRUE) {
+      continue;
+    }
+    
+    finishCapture(writeFrame(job));
+  }
+}
+
+// Turns the grabbed frame into JPEG data. Raw frames are encoded strip by
+// strip straight into their file on the card and their frame buffer handed
+// back to the driver straight away; sensor JPEG frames pass through and keep
+// the frame buffer until the write stage is done.
+bool encodeFrame(CaptureJob &job) {
+  camera_fb_t *fb = job.fb;
+  
+  // Done first, while the raw frame is still held
+  int64_t thumbStart = esp_timer_get_time();
+  makeThumbnail(job);
+  metricsRecordSince(STAGE_THUMBNAIL, thumbStart);
+  
+  // Process based on format
+  if (fb->format == PIXFORMAT_JPEG) {
+    // Already JPEG, use as-is
+    LOG_DEBUG("Image is already JPEG format");
+    job.jpegData = fb->buf;
+    job.jpegLen = fb->len;
+    return true;
+  } else if (fb->format == PIXFORMAT_GRAYSCALE) {
+    // Convert grayscale to JPEG - preserves grayscale appearance
+    LOG_DEBUG("Converting grayscale to JPEG...");
     
-    jpegData = jpeg_buf;
-    jpegLen = jpeg_buf_len;
-    needsFree = true; // We need to free jpeg_buf later
+    int jpegQuality = captureJpegQuality(job.quality, PIXFORMAT_GRAYSCALE, job.frameSize);
     
-    Serial.printf("RGB565 converted to JPEG: %u bytes\n", jpegLen);
-    Serial.flush();
+    // Convert grayscale to JPEG, straight into the image file
+    bool success = encodeFrameToFile(job, PIXFORMAT_GRAYSCALE, false, jpegQuality);
     
-    // Return the original frame buffer
+    // Return the original frame buffer so the sensor can reuse it
     esp_camera_fb_return(fb);
-    fb = NULL; // Mark as returned so we don't return it again
-  } else {
-    Serial.printf("ERROR: Unsupported format: %d\n", fb->format);
-    Serial.flush();
+    job.fb = NULL;
+    
+    if (!success) {
+      LOG_ERROR("Grayscale to JPEG conversion failed!");
+      return false;
+    }
+    
+    LOG_DEBUG("Grayscale converted to JPEG");
+    return true;
+  } else if (fb->format == PIXFORMAT_RGB565) {
+    // Convert RGB565 to JPEG - preserves RGB565 appearance. Big endian byte
+    // order is handled as the encoder fetches pixels, so no swapped copy of
+    // the frame is made.
+    LOG_DEBUG("Converting RGB565 to JPEG...");
+    
+    // High resolutions get a slightly lower quality to reduce processing time
+    int jpegQuality = captureJpegQuality(job.quality, PIXFORMAT_RGB565, job.frameSize);
+    
+    LOG_DEBUG("Encoding RGB565 to JPEG (quality: %d)...", jpegQuality);
+    
+    // Convert RGB565 to JPEG, straight into the image file
+    bool success = encodeFrameToFile(job, PIXFORMAT_RGB565, job.bigEndian, jpegQuality);
+    
+    // Return the original frame buffer so the sensor can reuse it
     esp_camera_fb_return(fb);
-    return;
+    job.fb = NULL;
+    
+    if (!success) {
+      LOG_ERROR("RGB565 to JPEG conversion failed!");
+      return false;
+    }
+    
+    LOG_DEBUG("RGB565 converted to JPEG");
+    return true;
   }
   
-  // Save JPEG file
-  String filename = getNextFilename(".jpg");
-  Serial.printf("Saving as: %s\n", filename.c_str());
-  Serial.flush();
-  
+  LOG_ERROR("Unsupported format: %d", fb->format);
+  esp_camera_fb_return(fb);
+  job.fb = NULL;
+  return false;
+}
+
+// Reserves the job's image number and encodes its raw frame into that file,
+// or into the burst pack while one is open. A partly written file is removed
+// if the encode or the card fails.
+bool encodeFrameToFile(CaptureJob &job, pixformat_t format, bool swapBytes, int quality) {
   if (!sdCardPresent) {
-    Serial.println("ERROR: SD card not available");
-    Serial.flush();
-    if (needsFree) free(jpegData);
-    esp_camera_fb_return(fb);
-    return;
+    LOG_ERROR("SD card not available");
+    return false;
   }
   
-  Serial.println("Opening file for writing...");
-  Serial.flush();
+  if (frameOutputQueue) {
+    return encodeFrameQueued(job, format, swapBytes, quality);
+  }
+  if (job.burst && activePack.open) {
+    return burstPackAppend(job, format, swapBytes, quality);
+  }
   
-  File file = SD.open(filename.c_str(), FILE_WRITE);
-  bool saved = false;
-  if (file) {
-    Serial.println("Writing data to SD card...");
-    Serial.flush();
-    size_t written = file.write(jpegData, jpegLen);
-    file.close();
-    saved = (written == jpegLen);
-    Serial.printf("Written: %u bytes\n", written);
-    Serial.flush();
+  job.number = reserveImageNumber();
+  String filename = imageFilename(job.number);
+  LOG_DEBUG("Saving as: %s", filename.c_str());
+  
+  int64_t start = esp_timer_get_time();
+  File file = openShardFile(filename, job.number);
+  metricsRecordSince(STAGE_OPEN, start);
+  if (!file) {
+    LOG_ERROR("Failed to open file for writing");
+    return false;
+  }
+  
+  camera_fb_t *fb = job.fb;
+  size_t written = 0;
+  bool ok = jpegEncodeToFile(fb->buf, fb->width, fb->height, format, swapBytes, quality, file, &written);
+  start = esp_timer_get_time();
+  file.close();
+  metricsRecordSince(STAGE_CLOSE, start);
+  if (!ok) {
+    SD_CARD.remove(filename.c_str());
+    return false;
+  }
+  
+  job.jpegLen = written;
+  job.written = true;
+  return true;
+}
+
+// encodeFrameToFile() with the write task doing the writing: the output is
+// queued block by block, and the job follows its blocks to writeFrame(),
+// which closes the file or adds the frame to the burst pack. A frame that
+// fails to encode still goes to the write task, to be cleaned up there.
+bool encodeFrameQueued(CaptureJob &job, pixformat_t format, bool swapBytes, int quality) {
+  FrameOutput *output;
+  xQueueReceive(frameOutputQueue, &output, portMAX_DELAY);
+  
+  // Everything touching the pack happens on the write task, in queue order
+  job.packed = job.burst && activePack.open;
+  if (job.packed) {
+    output->sink.file = &activePack.file;
   } else {
-    Serial.println("ERROR: Failed to open file for writing");
-    Serial.flush();
+    job.number = reserveImageNumber();
+    String filename = imageFilename(job.number);
+    LOG_DEBUG("Saving as: %s", filename.c_str());
+    
+    int64_t start = esp_timer_get_time();
+    output->file = openShardFile(filename, job.number);
+    metricsRecordSince(STAGE_OPEN, start);
+    if (!output->file) {
+      LOG_ERROR("Failed to open file for writing");
+      xQueueSend(frameOutputQueue, &output, 0);
+      return false;
+    }
+    output->sink.file = &output->file;
+  }
+  output->sink.len = 0;
+  output->sink.queued = true;
+  output->sink.failed = false;
+  
+  camera_fb_t *fb = job.fb;
+  int64_t start = esp_timer_get_time();
+  output->encodeFailed = !jpegEncode(fb->buf, fb->width, fb->height, format, swapBytes, quality,
+                                     jpegFileSinkWrite, &output->sink);
+  metricsRecordSince(STAGE_ENCODE, start);
+  job.output = output;
+  return true;
+}
+
+// Run by the write task once all of a queued frame's blocks are written:
+// closes its file, or records it in the burst pack, and frees the output
+bool finishFrameOutput(CaptureJob &job) {
+  FrameOutput *output = job.output;
+  job.output = NULL;
+  bool ok = !output->encodeFailed && !output->sink.failed;
+  if (output->encodeFailed) {
+    LOG_ERROR("JPEG encoding failed!");
+  }
+  LOG_DEBUG("Encoded and written: %u bytes", output->sink.len);
+  
+  if (job.packed) {
+    ok = burstPackAddFrame(job, output->sink.len, ok);
+  } else {
+    int64_t start = esp_timer_get_time();
+    output->file.close();
+    metricsRecordSince(STAGE_CLOSE, start);
+    if (ok) {
+      job.jpegLen = output->sink.len;
+      job.written = true;
+    } else {
+      SD_CARD.remove(imageFilename(job.number).c_str());
+    }
+  }
+  xQueueSend(frameOutputQueue, &output, portMAX_DELAY);
+  return ok;
+}
+
+// Decode target for JPEG thumbnails, stored as RGB565 (high byte first, like
+// the sensor delivers it) so the built-in encoder can take it
+struct ThumbDecode {
+  const uint8_t *src;
+  uint8_t *out;
+  uint16_t width;
+  uint16_t height;
+};
+
+static size_t thumbJpegRead(void *arg, size_t index, uint8_t *buf, size_t len) {
+  ThumbDecode *decode = (ThumbDecode*)arg;
+  if (buf) {
+    memcpy(buf, decode->src + index, len);
+  }
+  return len;
+}
+
+static bool thumbJpegWrite(void *arg, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8_t *data) {
+  ThumbDecode *decode = (ThumbDecode*)arg;
+  if (!data) {
+    return true; // Start/end of image
+  }
+  for (uint16_t row = 0; row < h && y + row < decode->height; row++) {
+    const uint8_t *in = data + row * w * 3;
+    uint8_t *out = decode->out + ((y + row) * decode->width + x) * 2;
+    for (uint16_t col = 0; col < w && x + col < decode->width; col++) {
+      uint16_t px = ((in[col * 3] & 0xF8) << 8) | ((in[col * 3 + 1] & 0xFC) << 3) | (in[col * 3 + 2] >> 3);
+      out[col * 2] = px >> 8;
+      out[col * 2 + 1] = px & 0xFF;
+    }
+  }
+  return true;
+}
+
+// Produces a small JPEG for the gallery from the frame the job holds, using
+// the arena's thumbnail buffers and a thumbnail slot for the output
+void makeThumbnail(CaptureJob &job) {
+  camera_fb_t *fb = job.fb;
+  uint16_t width = 0;
+  uint16_t height = 0;
+  int scale = 0;
+  if (!thumbDimensions(fb->width, fb->height, fb->format, &width, &height, &scale)) {
+    return;
+  }
+  
+  pixformat_t format = (fb->format == PIXFORMAT_GRAYSCALE) ? PIXFORMAT_GRAYSCALE : PIXFORMAT_RGB565;
+  size_t bpp = (format == PIXFORMAT_RGB565) ? 2 : 1;
+  bool swap = false;
+  uint8_t *pixels = (uint8_t*)arenaBorrow(ARENA_THUMB_PIXELS, width * height * bpp);
+  if (!pixels) {
+    return;
+  }
+  
+  if (fb->format == PIXFORMAT_JPEG) {
+    ThumbDecode decode = { fb->buf, pixels, width, height };
+    if (esp_jpg_decode(fb->len, (jpg_scale_t)scale, thumbJpegRead, thumbJpegWrite, &decode) != ESP_OK) {
+      arenaRelease(pixels);
+      return;
+    }
+  } else {
+    // Byte-swapped like the full image when big endian is selected
+    swap = (bpp == 2 && job.bigEndian);
+    thumbSubsample(fb, width, height, scale, pixels);
+  }
+  
+  size_t capacity = 0;
+  uint8_t *slot = arenaTakeSlot(&capacity);
+  if (slot) {
+    JpegBufferSink sink = { slot, 0, capacity, false };
+    if (jpegEncode(pixels, width, height, format, swap, THUMB_JPEG_QUALITY, jpegBufferSinkWrite, &sink)) {
+      job.thumbData = slot;
+      job.thumbLen = sink.len;
+    } else {
+      if (sink.overflow) {
+        portENTER_CRITICAL(&arenaMux);
+        arenaStats.thumbOverflows++;
+        portEXIT_CRITICAL(&arenaMux);
+      }
+      arenaRelease(slot);
+    }
+  }
+  arenaRelease(pixels);
+}
+
+// Saves the encoded frame to the SD card and releases everything the job holds
+bool writeFrame(CaptureJob &job) {
+  bool saved = false;
+  if (job.output) {
+    saved = finishFrameOutput(job);
+  } else if (job.written) {
+    // Raw frames were encoded straight into their file by the encode stage
+    saved = true;
+  } else if (job.burst && activePack.open) {
+    saved = burstPackAppend(job, PIXFORMAT_JPEG, false, 0);
+  } else if (!sdCardPresent) {
+    LOG_ERROR("SD card not available");
+  } else {
+    // Save JPEG file
+    job.number = reserveImageNumber();
+    String filename = imageFilename(job.number);
+    LOG_DEBUG("Saving as: %s", filename.c_str());
+    LOG_DEBUG("Opening file for writing...");
+    
+    int64_t start = esp_timer_get_time();
+    File file = openShardFile(filename, job.number);
+    metricsRecordSince(STAGE_OPEN, start);
+    if (file) {
+      LOG_DEBUG("Writing data to SD card...");
+      start = esp_timer_get_time();
+      size_t written = cardWrite(file, job.jpegData, job.jpegLen);
+      metricsRecordSince(STAGE_WRITE, start);
+      start = esp_timer_get_time();
+      file.close();
+      metricsRecordSince(STAGE_CLOSE, start);
+      saved = (written == job.jpegLen);
+      LOG_DEBUG("Written: %u bytes", written);
+    } else {
+      LOG_ERROR("Failed to open file for writing");
+    }
+  }
+  
+  // Packed frames are indexed together when their burst pack is closed
+  if (saved && !job.packed) {
+    uint8_t flags = job.burst ? IMAGE_FLAG_BURST : 0;
+    if (job.thumbData) {
+      int64_t start = esp_timer_get_time();
+      File thumb = openShardFile(thumbFilename(job.number), job.number);
+      metricsRecordSince(STAGE_OPEN, start);
+      if (thumb) {
+        start = esp_timer_get_time();
+        if (cardWrite(thumb, job.thumbData, job.thumbLen) == job.thumbLen) {
+          flags |= IMAGE_FLAG_THUMB;
+        }
+        metricsRecordSince(STAGE_WRITE, start);
+        start = esp_timer_get_time();
+        thumb.close();
+        metricsRecordSince(STAGE_CLOSE, start);
+      }
+    }
+    indexAddImage(job.number, job.jpegLen, flags);
+  }
+  if (saved) {
+    // The preview can't grab its own frames during a burst, so viewers get
+    // the burst frames instead. Raw frames never exist as a whole JPEG in
+    // memory, so their thumbnail stands in.
+    if (job.jpegData) {
+      publishStreamFrameCopy(job.jpegData, job.jpegLen);
+    } else if (job.thumbData) {
+      publishStreamFrameCopy(job.thumbData, job.thumbLen);
+    }
+  }
+  
+  arenaRelease(job.thumbData);
+  
+  if (job.fb != NULL) {
+    esp_camera_fb_return(job.fb);
+  }
+  
+  if (saved) {
+    if (job.packed) {
+      LOG_INFO("SUCCESS: Image %u saved to %s!", job.number, burstFilename(activePack.id).c_str());
+    } else {
+      LOG_INFO("SUCCESS: Image saved as %s!", imageFilename(job.number).c_str());
+    }
+  } else {
+    LOG_ERROR("Failed to save image!");
+  }
+  return saved;
+}
+
+// Hands out the next free image number. Numbers only ever grow (until the
+// card is emptied), so a deleted image's number is never reused.
+uint32_t reserveImageNumber() {
+  int64_t start = esp_timer_get_time();
+  xSemaphoreTake(indexMutex, portMAX_DELAY);
+  uint32_t fileNumber = nextImageNumber++;
+  xSemaphoreGive(indexMutex);
+  metricsRecordSince(STAGE_RESERVE, start);
+  return fileNumber;
+}
+
+String imageShardDir(uint32_t number) {
+  char dir[16];
+  snprintf(dir, sizeof(dir), IMAGE_DIR "/%04lu", (unsigned long)(number / IMAGE_SHARD_SIZE));
+  return String(dir);
+}
+
+String imageFilename(uint32_t number) {
+  return imageShardDir(number) + "/" + String(number) + ".jpg";
+}
+
+String thumbFilename(uint32_t number) {
+  return imageShardDir(number) + "/" + String(number) + "_thumb.jpg";
+}
+
+// Creates a file in an image's shard directory. The directory is only made
+// when the open fails, so the usual save costs no extra FAT lookup.
+File openShardFile(const String &filename, uint32_t number) {
+  File file = SD_CARD.open(filename.c_str(), FILE_WRITE);
+  if (!file) {
+    SD_CARD.mkdir(imageShardDir(number).c_str());
+    file = SD_CARD.open(filename.c_str(), FILE_WRITE);
+  }
+  return file;
+}
+
+// Moves images left in the root by the old flat layout (/N.jpg,
+// /N_thumb.jpg, /burst_N.pak) into IMAGE_DIR. A rename only rewrites
+// directory entries, so even a full card moves over quickly, and once the
+// root holds no images this is a single directory pass.
+void migrateFlatLayout() {
+  SD_CARD.mkdir(IMAGE_DIR);
+  
+  // Names are collected first; renaming while listing the root would skip
+  // or repeat entries
+  std::vector<uint32_t> images;
+  std::vector<uint32_t> thumbs;
+  std::vector<uint32_t> packs;
+  File root = SD_CARD.open("/");
+  if (root && root.isDirectory()) {
+    File file = root.openNextFile();
+    while (file) {
+      if (!file.isDirectory()) {
+        const char* name = file.name();
+        const char* slash = strrchr(name, '/');
+        if (slash) name = slash + 1;
+        
+        char* end = NULL;
+        unsigned long number = strtoul(name, &end, 10);
+        if (number > 0 && end != name && strcmp(end, ".jpg") == 0) {
+          images.push_back(number);
+        } else if (number > 0 && end != name && strcmp(end, "_thumb.jpg") == 0) {
+          thumbs.push_back(number);
+        } else if (strncmp(name, "burst_", 6) == 0) {
+          uint32_t id = strtoul(name + 6, &end, 10);
+          if (id > 0 && strcmp(end, ".pak") == 0) {
+            packs.push_back(id);
+          }
+        }
+      }
+      file.close();
+      file = root.openNextFile();
+    }
+  }
+  if (root) root.close();
+  
+  if (images.empty() && thumbs.empty() && packs.empty()) {
+    return;
+  }
+  
+  LOG_INFO("Moving %u images from the card root into " IMAGE_DIR "...", images.size() + packs.size());
+  unsigned long startTime = millis();
+  int failed = 0;
+  for (size_t i = 0; i < images.size() + thumbs.size(); i++) {
+    bool thumb = i >= images.size();
+    uint32_t number = thumb ? thumbs[i - images.size()] : images[i];
+    String from = "/" + String(number) + (thumb ? "_thumb.jpg" : ".jpg");
+    String to = thumb ? thumbFilename(number) : imageFilename(number);
+    if (!SD_CARD.rename(from.c_str(), to.c_str())) {
+      SD_CARD.mkdir(imageShardDir(number).c_str());
+      if (!SD_CARD.rename(from.c_str(), to.c_str())) {
+        LOG_WARN("Failed to move %s", from.c_str());
+        failed++;
+      }
+    }
+  }
+  for (size_t i = 0; i < packs.size(); i++) {
+    String from = "/burst_" + String(packs[i]) + ".pak";
+    if (!SD_CARD.rename(from.c_str(), burstFilename(packs[i]).c_str())) {
+      LOG_WARN("Failed to move %s", from.c_str());
+      failed++;
+    }
+  }
+  LOG_INFO("Moved in %lu ms (%d failed)", millis() - startTime, failed);
+}
+
+// Adds one file of IMAGE_DIR or a shard to the index being built
+void indexImageFile(File &file, std::vector<ImageInfo> &found, std::vector<uint32_t> &thumbs, std::vector<uint32_t> &incomplete, uint32_t *burstIds) {
+  // Older cores return the full path from name(), newer ones the basename
+  const char* name = file.name();
+  const char* slash = strrchr(name, '/');
+  if (slash) name = slash + 1;
+  
+  char* end = NULL;
+  unsigned long number = strtoul(name, &end, 10);
+  if (number > 0 && end != name && strcmp(end, ".jpg") == 0) {
+    ImageInfo info;
+    info.number = number;
+    info.size = file.size();
+    info.timestamp = (uint32_t)file.getLastWrite();
+    info.flags = 0;
+    info.burstId = 0;
+    info.frame = 0;
+    found.push_back(info);
+  } else if (number > 0 && end != name && strcmp(end, "_thumb.jpg") == 0) {
+    thumbs.push_back(number);
+  } else if (strncmp(name, "burst_", 6) == 0) {
+    uint32_t id = strtoul(name + 6, &end, 10);
+    if (id > 0 && strcmp(end, ".pak") == 0) {
+      if (!indexBurstPack(file, id, found)) {
+        incomplete.push_back(id);
+      }
+      if (id >= *burstIds) *burstIds = id + 1;
+    }
+  }
+}
+
+// Builds the image index from one pass over IMAGE_DIR and its shards.
+// Burst packs that were never finished (power lost mid-burst) still hold
+// their whole preallocation but no index table, so their frames can't be
+// listed; they are removed once the walk is done.
+void buildImageIndex() {
+  LOG_INFO("Indexing images on SD card...");
+  
+  unsigned long startTime = millis();
+  std::vector<ImageInfo> found;
+  std::vector<uint32_t> thumbs;
+  std::vector<uint32_t> incomplete;
+  uint32_t burstIds = 1;
+  
+  File root = SD_CARD.open(IMAGE_DIR);
+  if (root && root.isDirectory()) {
+    File file = root.openNextFile();
+    while (file) {
+      if (file.isDirectory()) {
+        File entry = file.openNextFile();
+        while (entry) {
+          if (!entry.isDirectory()) {
+            indexImageFile(entry, found, thumbs, incomplete, &burstIds);
+          }
+          entry.close();
+          entry = file.openNextFile();
+        }
+      } else {
+        indexImageFile(file, found, thumbs, incomplete, &burstIds);
+      }
+      file.close();
+      file = root.openNextFile();
+    }
+  }
+  if (root) root.close();
+  
+  for (size_t i = 0; i < incomplete.size(); i++) {
+    if (activePack.open && activePack.id == incomplete[i]) {
+      continue;  // Still being written
+    }
+    String filename = burstFilename(incomplete[i]);
+    File pack = SD_CARD.open(filename.c_str(), FILE_READ);
+    uint32_t kb = pack ? (uint32_t)(pack.size() / 1024) : 0;
+    if (pack) pack.close();
+    if (SD_CARD.remove(filename.c_str())) {
+      LOG_WARN("Removed incomplete burst pack %s (%u KB)", filename.c_str(), kb);
+    } else {
+      LOG_WARN("Failed to remove incomplete burst pack %s", filename.c_str());
+    }
+  }
+  
+  std::sort(found.begin(), found.end(), [](const ImageInfo &a, const ImageInfo &b) {
+    return a.number < b.number;
+  });
+  for (size_t i = 0; i < thumbs.size(); i++) {
+    std::vector<ImageInfo>::iterator it = std::lower_bound(found.begin(), found.end(), thumbs[i],
+      [](const ImageInfo &entry, uint32_t n) { return entry.number < n; });
+    if (it != found.end() && it->number == thumbs[i]) {
+      it->flags |= IMAGE_FLAG_THUMB;
+    }
+  }
+  
+  xSemaphoreTake(indexMutex, portMAX_DELAY);
+  imageIndex.swap(found);
+  nextImageNumber = imageIndex.empty() ? 1 : imageIndex.back().number + 1;
+  nextBurstId = burstIds;
+  indexRecordReset();
+  xSemaphoreGive(indexMutex);
+  
+  LOG_INFO("Indexed %u images in %lu ms (next: %u.jpg)", imageIndex.size(), millis() - startTime, nextImageNumber);
+}
+
+void indexAddImage(uint32_t number, uint32_t size, uint8_t flags, uint16_t burstId, uint16_t frame) {
+  ImageInfo info;
+  info.number = number;
+  info.size = size;
+  info.timestamp = (uint32_t)time(NULL);
+  info.flags = flags;
+  info.burstId = burstId;
+  info.frame = frame;
+  
+  xSemaphoreTake(indexMutex, portMAX_DELAY);
+  // New images almost always carry the highest number, so this is an append
+  std::vector<ImageInfo>::iterator it = std::lower_bound(imageIndex.begin(), imageIndex.end(), number,
+    [](const ImageInfo &entry, uint32_t n) { return entry.number < n; });
+  if (it != imageIndex.end() && it->number == number) {
+    *it = info;
+  } else {
+    imageIndex.insert(it, info);
+  }
+  if (number >= nextImageNumber) {
+    nextImageNumber = number + 1;
+  }
+  indexRecordChange(number);
+  xSemaphoreGive(indexMutex);
+}
+
+void indexRemoveImage(uint32_t number) {
+  xSemaphoreTake(indexMutex, portMAX_DELAY);
+  std::vector<ImageInfo>::iterator it = std::lower_bound(imageIndex.begin(), imageIndex.end(), number,
+    [](const ImageInfo &entry, uint32_t n) { return entry.number < n; });
+  if (it != imageIndex.end() && it->number == number) {
+    imageIndex.erase(it);
+    indexRecordChange(number);
+  }
+  // nextImageNumber stays put even when the index empties: numbers already
+  // handed to frames still in the pipeline or an open burst pack would
+  // otherwise be given out again
+  xSemaphoreGive(indexMutex);
+}
+
+// Both called with indexMutex held
+void indexRecordChange(uint32_t number) {
+  indexGeneration++;
+  IndexChange &change = indexChanges[indexGeneration % INDEX_CHANGE_LOG_SIZE];
+  change.generation = indexGeneration;
+  change.number = number;
+}
+
+void indexRecordReset() {
+  indexGeneration++;
+  indexResetGeneration = indexGeneration;
+}
+
+String indexToken(uint32_t generation) {
+  return String(indexBootId, HEX) + "-" + String(generation);
+}
+
+bool indexLookup(uint32_t number, ImageInfo &info) {
+  bool found = false;
+  xSemaphoreTake(indexMutex, portMAX_DELAY);
+  std::vector<ImageInfo>::iterator it = std::lower_bound(imageIndex.begin(), imageIndex.end(), number,
+    [](const ImageInfo &entry, uint32_t n) { return entry.number < n; });
+  if (it != imageIndex.end() && it->number == number) {
+    info = *it;
+    found = true;
+  }
+  xSemaphoreGive(indexMutex);
+  return found;
+}
+
+// Queues a delete of the images numbered from..to, or of the given numbers
+// if there are any. Only one runs at a time.
+bool startDelete(uint32_t from, uint32_t to, const std::vector<uint32_t> &numbers) {
+  portENTER_CRITICAL(&deleteMux);
+  bool busy = deleteInProgress;
+  if (!busy) {
+    deleteInProgress = true;
+  }
+  portEXIT_CRITICAL(&deleteMux);
+  if (busy) {
+    return false;
+  }
+  
+  deleteFrom = from;
+  deleteTo = to;
+  deleteNumbers = numbers;
+  std::sort(deleteNumbers.begin(), deleteNumbers.end());
+  deleteCancel = false;
+  deleteCancelled = false;
+  deleteTotal = 0;
+  deleteDone = 0;
+  deleteFailed = 0;
+  
+  if (!submitJob(JOB_DELETE_IMAGES)) {
+    deleteInProgress = false;
+    return false;
+  }
+  return true;
+}
+
+// Each image leaves the index before its file goes, so nothing is served
+// half deleted. indexMutex is only held per image, never across a batch.
+void deleteImages() {
+  unsigned long startTime = millis();
+  
+  std::vector<ImageInfo> targets;
+  xSemaphoreTake(indexMutex, portMAX_DELAY);
+  for (size_t i = 0; i < imageIndex.size(); i++) {
+    const ImageInfo &info = imageIndex[i];
+    bool wanted = deleteNumbers.empty()
+      ? (info.number >= deleteFrom && info.number <= deleteTo)
+      : std::binary_search(deleteNumbers.begin(), deleteNumbers.end(), info.number);
+    if (wanted) {
+      targets.push_back(info);
+    }
+  }
+  xSemaphoreGive(indexMutex);
+  
+  deleteTotal = targets.size();
+  LOG_INFO("\nDeleting %u images...", (unsigned)targets.size());
+  
+  for (size_t start = 0; start < targets.size() && !deleteCancel; start += DELETE_BATCH) {
+    size_t end = min(start + DELETE_BATCH, targets.size());
+    for (size_t i = start; i < end; i++) {
+      const ImageInfo &info = targets[i];
+      indexRemoveImage(info.number);
+      if (info.burstId == 0) {
+        String filename = imageFilename(info.number);
+        if (!SD_CARD.remove(filename.c_str()) && SD_CARD.exists(filename.c_str())) {
+          deleteFailed++;
+        }
+        if (info.flags & IMAGE_FLAG_THUMB) {
+          SD_CARD.remove(thumbFilename(info.number).c_str());
+        }
+      }
+      deleteDone++;
+    }
+    deleteBurstFrames(targets, start, end);
+    
+    // Lets the web server and lower-priority work in between batches
+    delay(1);
+  }
+  
+  // Drop shard directories left empty; rmdir() refuses any still in use
+  uint32_t lastShard = 0xFFFFFFFF;
+  for (size_t i = 0; i < deleteDone; i++) {
+    uint32_t shard = targets[i].number / IMAGE_SHARD_SIZE;
+    if (targets[i].burstId == 0 && shard != lastShard) {
+      SD_CARD.rmdir(imageShardDir(targets[i].number).c_str());
+      lastShard = shard;
+    }
+  }
+  
+  deleteCancelled = deleteCancel;
+  LOG_INFO("Deleted %u of %u images in %lu ms%s", (unsigned)(deleteDone - deleteFailed), (unsigned)targets.size(),
+           millis() - startTime, deleteCancelled ? " (cancelled)" : "");
+  deleteInProgress = false;
+}
+
+// Burst frames deleted in targets[start..end) share pack files. A pack goes
+// once none of its frames are left; until then the deleted frames are
+// blanked in the pack's index table, so they stay gone after a reboot.
+void deleteBurstFrames(const std::vector<ImageInfo> &targets, size_t start, size_t end) {
+  for (size_t i = start; i < end; i++) {
+    uint16_t id = targets[i].burstId;
+    bool seen = false;
+    for (size_t j = start; j < i; j++) {
+      seen = seen || targets[j].burstId == id;
+    }
+    if (id == 0 || seen) continue;
+    
+    bool framesLeft = false;
+    xSemaphoreTake(indexMutex, portMAX_DELAY);
+    for (size_t j = 0; j < imageIndex.size() && !framesLeft; j++) {
+      framesLeft = imageIndex[j].burstId == id;
+    }
+    xSemaphoreGive(indexMutex);
+    
+    String filename = burstFilename(id);
+    if (!framesLeft) {
+      if (!SD_CARD.remove(filename.c_str())) {
+        LOG_WARN("Failed to remove burst pack %s", filename.c_str());
+      }
+      continue;
+    }
+    
+    File file = SD_CARD.open(filename.c_str(), "r+");
+    BurstPackHeader header;
+    if (!file || file.read((uint8_t*)&header, sizeof(header)) != sizeof(header)) {
+      LOG_WARN("Failed to update burst pack %s", filename.c_str());
+      file.close();
+      continue;
+    }
+    uint32_t blank = 0;
+    for (size_t j = i; j < end; j++) {
+      if (targets[j].burstId != id) continue;
+      // The image number is the first field of an entry
+      file.seek(burstPackEntryOffset(header, targets[j].frame));
+      file.write((const uint8_t*)&blank, sizeof(blank));
+    }
+    file.close();
+  }
+}
+
+void listImages() {
+  Serial.println("\nListing all images:");
+  
+  xSemaphoreTake(indexMutex, portMAX_DELAY);
+  size_t count = imageIndex.size();
+  for (size_t i = 0; i < count; i++) {
+    const ImageInfo &info = imageIndex[i];
+    if (info.burstId != 0) {
+      Serial.printf("  %u.jpg (%u bytes) [frame %u of %s]\n", info.number, info.size, info.frame, burstFilename(info.burstId).c_str());
+    } else {
+      Serial.printf("  %s (%u bytes)%s\n", imageFilename(info.number).c_str(), info.size,
+                    (info.flags & IMAGE_FLAG_BURST) ? " [burst]" : "");
+    }
+  }
+  xSemaphoreGive(indexMutex);
+  
+  if (count == 0) {
+    Serial.println("  No images found");
+  } else {
+    Serial.printf("\nTotal: %u images\n", count);
+  }
+}
+
+String burstFilename(uint32_t id) {
+  return IMAGE_DIR "/burst_" + String(id) + ".pak";
+}
+
+// Opens a new pack for a burst of the given length and preallocates room for
+// it, so the FAT work for the whole burst happens once, up front. startMs is
+// when the first frame was taken; expectedBytes, if known, replaces the
+// estimate made from the frame size.
+bool burstPackBegin(int frames, unsigned long startMs, uint64_t expectedBytes) {
+  if (!sdCardPresent) {
+    return false;
+  }
+  
+  xSemaphoreTake(indexMutex, portMAX_DELAY);
+  uint32_t id = nextBurstId++;
+  xSemaphoreGive(indexMutex);
+  
+  String filename = burstFilename(id);
+  activePack.file = SD_CARD.open(filename.c_str(), FILE_WRITE);
+  if (!activePack.file) {
+    LOG_ERROR("Failed to create burst pack");
+    return false;
+  }
+  
+  BurstPackHeader header;
+  burstPackHeaderInit(header, id, (uint32_t)time(NULL) - (millis() - startMs) / 1000);
+  activePack.file.write((const uint8_t*)&header, sizeof(header));
+  
+  // Allocates the cluster chain up front; the pack is trimmed back to what
+  // was used when the burst ends
+  uint64_t estimate = expectedBytes;
+  if (estimate == 0) {
+    estimate = (uint64_t)resolution[currentFrameSize].width * resolution[currentFrameSize].height
+               / BURST_PACK_FRAME_GUESS * frames;
+  }
+  estimate += (uint64_t)frames * sizeof(BurstPackEntry);
+  uint64_t freeBytes = SD_CARD.totalBytes() - SD_CARD.usedBytes();
+  if (estimate > freeBytes / 2) estimate = freeBytes / 2;
+  if (estimate > 0x7FFFFFFF) estimate = 0x7FFFFFFF;
+  cardPreallocate(activePack.file, sizeof(header) + estimate);
+  activePack.file.seek(sizeof(header));
+  
+  activePack.id = id;
+  activePack.startTime = header.startTime;
+  activePack.startMs = startMs;
+  activePack.dataEnd = sizeof(header);
+  activePack.entries.clear();
+  activePack.entries.reserve(frames);
+  activePack.open = true;
+  
+  LOG_INFO("Burst pack %s opened (%u KB preallocated)", filename.c_str(), (uint32_t)(estimate / 1024));
+  return true;
+}
+
+// Appends one frame (and its thumbnail) to the active pack. Sensor JPEGs are
+// copied in; raw frames are encoded straight into the pack.
+bool burstPackAppend(CaptureJob &job, pixformat_t format, bool swapBytes, int quality) {
+  size_t written = 0;
+  bool ok;
+  if (job.jpegData) {
+    int64_t start = esp_timer_get_time();
+    written = cardWrite(activePack.file, job.jpegData, job.jpegLen);
+    metricsRecordSince(STAGE_WRITE, start);
+    ok = (written == job.jpegLen);
+  } else {
+    camera_fb_t *fb = job.fb;
+    ok = jpegEncodeToFile(fb->buf, fb->width, fb->height, format, swapBytes, quality, activePack.file, &written);
+  }
+  return burstPackAddFrame(job, written, ok);
+}
+
+// Records the frame just written at the end of the active pack: adds its
+// thumbnail, an image number and an index entry. A failed frame is dropped.
+bool burstPackAddFrame(CaptureJob &job, size_t written, bool ok) {
+  BurstPackEntry entry;
+  entry.offset = activePack.dataEnd;
+  entry.timeMs = job.captureMs - activePack.startMs;
+  
+  if (!ok) {
+    // The next frame overwrites whatever made it into the pack
+    activePack.file.seek(activePack.dataEnd);
+    return false;
+  }
+  entry.size = written;
+  
+  entry.thumbOffset = 0;
+  entry.thumbSize = 0;
+  if (job.thumbData && cardWrite(activePack.file, job.thumbData, job.thumbLen) == job.thumbLen) {
+    entry.thumbOffset = entry.offset + entry.size;
+    entry.thumbSize = job.thumbLen;
+  }
+  
+  entry.number = reserveImageNumber();
+  activePack.dataEnd = entry.offset + entry.size + entry.thumbSize;
+  activePack.file.seek(activePack.dataEnd);
+  activePack.entries.push_back(entry);
+  
+  job.number = entry.number;
+  job.jpegLen = written;
+  job.written = true;
+  job.packed = true;
+  return true;
+}
+
+// Writes the index table and final header, trims the preallocation and lists
+// the frames in the image index. Called once the pipeline is idle.
+void burstPackEnd() {
+  if (!activePack.open) {
+    return;
+  }
+  activePack.open = false;
+  
+  String filename = burstFilename(activePack.id);
+  uint32_t frameCount = activePack.entries.size();
+  if (frameCount == 0) {
+    activePack.file.close();
+    SD_CARD.remove(filename.c_str());
+    return;
+  }
+  
+  size_t indexBytes = frameCount * sizeof(BurstPackEntry);
+  activePack.file.seek(activePack.dataEnd);
+  bool ok = activePack.file.write((const uint8_t*)activePack.entries.data(), indexBytes) == indexBytes;
+  
+  BurstPackHeader header;
+  burstPackHeaderInit(header, activePack.id, activePack.startTime);
+  header.frameCount = frameCount;
+  header.indexOffset = activePack.dataEnd;
+  activePack.file.seek(0);
+  ok = ok && activePack.file.write((const uint8_t*)&header, sizeof(header)) == sizeof(header);
+  activePack.file.close();
+  
+  // The Arduino File has no truncate, so go through the VFS path
+  truncate((SD_MOUNT_POINT + filename).c_str(), activePack.dataEnd + indexBytes);
+  
+  if (!ok) {
+    LOG_ERROR("Failed to finish burst pack");
+    activePack.entries.clear();
+    return;
+  }
+  
+  for (uint32_t i = 0; i < frameCount; i++) {
+    const BurstPackEntry &entry = activePack.entries[i];
+    uint8_t flags = IMAGE_FLAG_BURST | (entry.thumbSize ? IMAGE_FLAG_THUMB : 0);
+    indexAddImage(entry.number, entry.size, flags, activePack.id, i);
+  }
+  LOG_INFO("Burst pack %s closed: %u frames, %u bytes", filename.c_str(), frameCount, activePack.dataEnd + indexBytes);
+  activePack.entries.clear();
+}
+
+// Adds the frames of a finished pack to the index being built. Returns false
+// for a pack that was never finished.
+bool indexBurstPack(File &file, uint32_t id, std::vector<ImageInfo> &found) {
+  BurstPackHeader header;
+  if (file.read((uint8_t*)&header, sizeof(header)) != sizeof(header) ||
+      !burstPackHeaderValid(header) || !file.seek(header.indexOffset)) {
+    return false;
+  }
+  
+  for (uint32_t i = 0; i < header.frameCount; i++) {
+    BurstPackEntry entry;
+    if (file.read((uint8_t*)&entry, sizeof(entry)) != sizeof(entry)) {
+      break;
+    }
+    if (entry.number == 0) {
+      continue;  // Frame deleted on its own
+    }
+    ImageInfo info;
+    info.number = entry.number;
+    info.size = entry.size;
+    info.timestamp = header.startTime + entry.timeMs / 1000;
+    info.flags = IMAGE_FLAG_BURST | (entry.thumbSize ? IMAGE_FLAG_THUMB : 0);
+    info.burstId = id;
+    info.frame = i;
+    found.push_back(info);
+  }
+  return true;
+}
+
+// Opens a burst pack and finds where one frame (or its thumbnail) sits in it
+bool openBurstFrame(uint32_t id, uint32_t frame, bool thumb, File &file, uint32_t *offset, uint32_t *length) {
+  file = SD_CARD.open(burstFilename(id).c_str(), FILE_READ);
+  if (!file) {
+    return false;
+  }
+  
+  BurstPackHeader header;
+  BurstPackEntry entry;
+  bool ok = file.read((uint8_t*)&header, sizeof(header)) == sizeof(header) &&
+            burstPackHeaderValid(header) && frame < header.frameCount &&
+            file.seek(burstPackEntryOffset(header, frame)) &&
+            file.read((uint8_t*)&entry, sizeof(entry)) == sizeof(entry);
+  if (!ok) {
+    file.close();
+    return false;
+  }
+  
+  *offset = entry.offset;
+  *length = entry.size;
+  if (thumb && entry.thumbSize) {
+    *offset = entry.thumbOffset;
+    *length = entry.thumbSize;
+  }
+  return true;
+}
+
+// Opens an indexed image, standalone or inside a burst pack, and finds
+// where its bytes are in the file
+bool openIndexedImage(const ImageInfo &info, File &file, uint32_t *offset, uint32_t *length) {
+  if (info.burstId != 0) {
+    return openBurstFrame(info.burstId, info.frame, false, file, offset, length);
+  }
+  file = SD_CARD.open(imageFilename(info.number).c_str(), FILE_READ);
+  if (!file) {
+    return false;
+  }
+  *offset = 0;
+  *length = file.size();
+  return true;
+}
+
+// Sends one frame (or its thumbnail) of a finished pack, looked up through
+// the pack's index table and streamed from its offset
+bool sendBurstFrame(uint32_t id, uint32_t frame, bool thumb) {
+  File file;
+  uint32_t offset = 0;
+  uint32_t length = 0;
+  if (!openBurstFrame(id, frame, thumb, file, &offset, &length)) {
+    return false;
+  }
+  // A closed pack never changes, so its frames can be cached like images
+  String etag = "\"b" + String(id) + "-" + String(frame) + (thumb ? "t-" : "-") + String(offset, HEX) + "-" + String(length, HEX) + "\"";
+  ServerRequest request;
+  ServerResponse response;
+  webSendFile(request, response, webBackend, new CardFile(file), offset, length, etag.c_str(), 0, false);
+  return true;
+}
+
+bool initWiFi() {
+  LOG_INFO("\nConnecting to WiFi...");
+  LOG_INFO("SSID: %s", ssid);
+  
+  WiFi.mode(WIFI_STA);
+  WiFi.setSleep(false);
+  WiFi.setAutoReconnect(true);
+  WiFi.begin(ssid, password);
+  
+  int attempts = 0;
+  while (WiFi.status() != WL_CONNECTED && attempts < 30) {
+    delay(500);
+    attempts++;
+    if (attempts % 10 == 0) {
+      LOG_INFO("Still connecting... (attempt %d/30)", attempts);
+      WiFi.disconnect();
+      delay(100);
+      WiFi.begin(ssid, password);
+    }
+  }
+  
+  if (WiFi.status() == WL_CONNECTED) {
+    LOG_INFO("\nWiFi connected!");
+    LOG_INFO("IP address: %s", WiFi.localIP().toString().c_str());
+    LOG_INFO("Signal strength (RSSI): %d dBm", WiFi.RSSI());
+    
+    if (!MDNS.begin("xiaocamera")) {
+      LOG_WARN("mDNS responder failed to start");
+    } else {
+      LOG_INFO("mDNS responder started - try http://xiaocamera.local");
+    }
+    
+    return true;
+  } else {
+    LOG_WARN("\nWiFi connection failed!");
+    LOG_INFO("WiFi status: %d", WiFi.status());
+    LOG_INFO("Possible issues:");
+    LOG_INFO("  - Wrong SSID or password");
+    LOG_INFO("  - WiFi router not in range");
+    LOG_INFO("  - Router only supports 5GHz (ESP32 only supports 2.4GHz)");
+    return false;
+  }
+}
+
+void setupWebServer() {
+  // Request headers the handlers look at; WebServer drops the rest
+  static const char *headerKeys[] = { "If-None-Match", "If-Modified-Since", "Range", "If-Range" };
+  server.collectHeaders(headerKeys, sizeof(headerKeys) / sizeof(headerKeys[0]));
+  
+  serverOnTimed("/", HTTP_ANY, handleRoot);
+  serverOnTimed("/image", HTTP_GET, handleImage);
+  serverOnTimed("/thumb", HTTP_GET, handleThumb);
+  serverOnTimed("/stream", HTTP_GET, handleStream);
+  serverOnTimed("/capture", HTTP_GET, handleCapture);
+  serverOnTimed("/delete", HTTP_GET, handleDelete);
+  serverOnTimed("/deletestatus", HTTP_GET, handleDeleteStatus);
+  serverOnTimed("/list", HTTP_GET, handleListJSON);
+  serverOnTimed("/setquality", HTTP_POST, handleSetQuality);
+  serverOnTimed("/setresolution", HTTP_POST, handleSetResolution);
+  serverOnTimed("/setpixelformat", HTTP_POST, handleSetPixelFormat);
+  serverOnTimed("/setendianness", HTTP_POST, handleSetEndianness);
+  serverOnTimed("/getsettings", HTTP_GET, handleGetSettings);
+  // Backend burst endpoints (not exposed in web UI, but available for API use)
+  serverOnTimed("/burstcapture", HTTP_POST, handleBurstCapture);
+  serverOnTimed("/burststatus", HTTP_GET, handleBurstStatus);
+  serverOnTimed("/burst", HTTP_GET, handleBurst);
+  serverOnTimed("/archive", HTTP_GET, handleArchive);
+  serverOnTimed("/arenastatus", HTTP_GET, handleArenaStatus);
+  serverOnTimed("/pretrigger", HTTP_GET, handlePretriggerStatus);
+  serverOnTimed("/pretrigger", HTTP_POST, handlePretrigger);
+  serverOnTimed("/metrics", HTTP_GET, handleMetrics);
+  serverOnTimed("/routestats", HTTP_GET, handleRouteStats);
+  
+  server.begin();
+  webBodyQueue = xQueueCreate(WEB_SENDER_QUEUE_DEPTH, sizeof(WebBodyJob));
+  int senders = 0;
+  for (int i = 0; i < WEB_SENDER_TASKS && webBodyQueue; i++) {
+    uint8_t *buf = (uint8_t*)malloc(WEB_SENDER_BUFFER_SIZE);
+    if (buf && xTaskCreatePinnedToCore(webSenderTask, "websend", 6144, buf, 1, NULL, 0) == pdPASS) {
+      senders++;
+    } else {
+      free(buf);
+    }
+  }
+  if (senders < WEB_SENDER_TASKS) {
+    LOG_WARN("Only %d of %d web sender tasks started", senders, WEB_SENDER_TASKS);
+  }
+  if (senders == 0) {
+    webBodyQueue = NULL;  // Handlers send bodies themselves
+  }
+  xTaskCreatePinnedToCore(httpTask, "http", 8192, NULL, 3, NULL, 0);
+  // Preview frames are grabbed below the capture stages' priority so a
+  // viewer never slows down a capture
+  xTaskCreatePinnedToCore(streamTask, "stream", 8192, NULL, 1, &streamTaskHandle, 0);
+  LOG_INFO("HTTP server started");
+}
+
+// Registers a route whose handler time is recorded in the http stage and
+// the route's own histogram. The stream handler only hands its client to a
+// viewer task, so it is timed too.
+void serverOnTimed(const char *uri, HTTPMethod method, WebServer::THandlerFunction handler) {
+  HttpRoute *route = NULL;
+  if (httpRouteCount < MAX_HTTP_ROUTES) {
+    route = &httpRoutes[httpRouteCount++];
+    route->uri = uri;
+    route->method = method;
+  }
+  server.on(uri, method, [handler, route]() {
+    int64_t start = esp_timer_get_time();
+    handler();
+    uint32_t us = (uint32_t)(esp_timer_get_time() - start);
+    metricsRecord(STAGE_HTTP, us);
+    if (route) {
+      histogramRecord(httpRouteLatency(*route), us);
+    }
+  });
+}
+
+StageHistogram &httpRouteLatency(HttpRoute &route) {
+  return route.latency[__atomic_load_n(&httpRouteGeneration, __ATOMIC_ACQUIRE) & 1];
+}
+
+const char *httpMethodName(HTTPMethod method) {
+  switch (method) {
+    case HTTP_GET: return "GET";
+    case HTTP_POST: return "POST";
+    case HTTP_PUT: return "PUT";
+    case HTTP_DELETE: return "DELETE";
+    default: return "ANY";
+  }
+}
+
+// The page is web/index.html, gzipped into ui_index.h at build time and sent
+// straight out of flash. Browsers revalidate it against its ETag, so a
+// reload normally costs a 304 with no body.
+void handleRoot() {
+  server.sendHeader("ETag", UI_INDEX_ETAG);
+  server.sendHeader("Cache-Control", "no-cache");
+  if (server.header("If-None-Match").indexOf(UI_INDEX_ETAG) >= 0) {
+    server.send(304);
+    return;
+  }
+  server.sendHeader("Content-Encoding", "gzip");
+  server.send_P(200, "text/html", (const char*)uiIndexGz, uiIndexGzLen);
+}
+
+void handleBurstCapture() {
+  if (!sdCardPresent) {
+    server.send(400, "application/json", "{\"status\":\"error\",\"message\":\"SD card required for burst capture\"}");
+    return;
+  }
+  if (!server.hasArg("plain")) {
+    server.send(400, "application/json", "{\"status\":\"error\",\"message\":\"Missing parameters\"}");
+    return;
+  }
+  
+  String body = server.arg("plain");
+  
+  // Parse JSON manually (simple parsing)
+  int count = 50;
+  float interval = 0.2;
+  // "mode":"ram" grabs at sensor rate into PSRAM; count is then a limit
+  bool ram = body.indexOf("\"ram\"") >= 0;
+  if (ram) count = 0;
+  
+  // Extract count
+  int countIndex = body.indexOf("\"count\":");
+  if (countIndex >= 0) {
+    int countStart = body.indexOf(':', countIndex) + 1;
+    int countEnd = body.indexOf(',', countStart);
+    if (countEnd < 0) countEnd = body.indexOf('}', countStart);
+    if (countEnd > countStart) {
+      count = body.substring(countStart, countEnd).toInt();
+    }
+  }
+  
+  // Extract interval
+  int intervalIndex = body.indexOf("\"interval\":");
+  if (intervalIndex >= 0) {
+    int intervalStart = body.indexOf(':', intervalIndex) + 1;
+    int intervalEnd = body.indexOf('}', intervalStart);
+    if (intervalEnd > intervalStart) {
+      interval = body.substring(intervalStart, intervalEnd).toFloat();
+    }
+  }
+  
+  if (ram) {
+    if (count < 0 || count > RAM_BURST_MAX_FRAMES) {
+      server.send(400, "application/json", "{\"status\":\"error\",\"message\":\"Count must be between 0 (as many as fit) and " + String(RAM_BURST_MAX_FRAMES) + " for a RAM burst\"}");
+      return;
+    }
+    if (currentPixelFormat != PIXFORMAT_JPEG) {
+      server.send(400, "application/json", "{\"status\":\"error\",\"message\":\"RAM burst needs the RGB (JPEG) color format\"}");
+      return;
+    }
+    if (!startBurst(count, 0, JOB_RAM_BURST)) {
+      server.send(409, "application/json", "{\"status\":\"error\",\"message\":\"A burst is already in progress\"}");
+      return;
+    }
+    server.send(200, "application/json", "{\"status\":\"ok\",\"mode\":\"ram\",\"count\":" + String(count) + "}");
+    return;
+  }
+  
+  // Validate
+  if (count < 1 || count > BURST_MAX_FRAMES) {
+    server.send(400, "application/json", "{\"status\":\"error\",\"message\":\"Count must be between 1 and " + String(BURST_MAX_FRAMES) + "\"}");
+    return;
+  }
+  if (interval < 0.1 || interval > 5.0) {
+    server.send(400, "application/json", "{\"status\":\"error\",\"message\":\"Interval must be between 0.1 and 5.0 seconds\"}");
+    return;
+  }
+  
+  // "policy":"catchup" takes missed frames late instead of skipping them
+  BurstPolicy policy = body.indexOf("\"catchup\"") >= 0 ? BURST_CATCH_UP : BURST_SKIP;
+  
+  if (!startBurst(count, interval, JOB_BURST, policy)) {
+    server.send(409, "application/json", "{\"status\":\"error\",\"message\":\"A burst is already in progress\"}");
+    return;
+  }
+  server.send(200, "application/json", "{\"status\":\"ok\",\"count\":" + String(count) + ",\"interval\":" + String(interval) +
+              ",\"policy\":\"" + String(policy == BURST_SKIP ? "skip" : "catchup") + "\"}");
+}
+
+// Queues one capture per interval. Frame k is due at start + k * interval,
+// an absolute deadline kept by a one-shot esp_timer (the hardware system
+// timer), so capture time doesn't add to the period or make it drift.
+// Frames overlap in the pipeline, so the interval only has to cover the
+// slowest stage. A frame that is still late once the previous one is queued
+// is handled per policy. Runs on the job task; holding the camera lock keeps
+// reconfiguration out until the last frame is on the card.
+void runBurst(int count, float interval, BurstPolicy policy) {
+  xSemaphoreTakeRecursive(cameraMutex, portMAX_DELAY);
+  
+  LOG_INFO("\n=== Starting Burst Capture ===");
+  LOG_INFO("Count: %d photos", count);
+  LOG_INFO("Interval: %.2f seconds (%s)", interval, policy == BURST_SKIP ? "skip late frames" : "catch up late frames");
+  
+  if (count > BURST_MAX_FRAMES) count = BURST_MAX_FRAMES;
+  burstInProgress = true;
+  burstCurrent = 0;
+  burstTotal = count;
+  
+  esp_timer_handle_t timer = NULL;
+  esp_timer_create_args_t timerArgs;
+  memset(&timerArgs, 0, sizeof(timerArgs));
+  timerArgs.callback = burstTimerCallback;
+  timerArgs.arg = xTaskGetCurrentTaskHandle();
+  timerArgs.name = "burst";
+  if (esp_timer_create(&timerArgs, &timer) != ESP_OK) {
+    timer = NULL;  // Falls back to delay() below
+  }
+  
+  int64_t periodUs = (int64_t)(interval * 1000000.0f);
+  int64_t lateUs = periodUs / 4;  // Later than this counts as missing the deadline
+  uint32_t slot = 0;
+  int skipped = 0;
+  
+  // Frames go into one pack file; if it can't be created they are saved as
+  // separate images as before
+  burstPackBegin(count, millis());
+  
+  ulTaskNotifyTake(pdTRUE, 0);
+  int64_t startUs = esp_timer_get_time();
+  for (int i = 0; i < count; i++) {
+    int64_t waitUs = startUs + slot * periodUs - esp_timer_get_time();
+    if (waitUs > 0) {
+      if (timer && esp_timer_start_once(timer, waitUs) == ESP_OK) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+      } else {
+        delay(waitUs / 1000);
+      }
+    }
+    
+    burstCurrent = i + 1;
+    LOG_INFO("\nBurst capture %d/%d", i + 1, count);
+    
+    burstSlot[i] = slot;
+    queueCapture(true, i);
+    slot++;
+    
+    if (policy == BURST_SKIP) {
+      // Stay on the grid: drop every deadline that has already gone by
+      int64_t now = esp_timer_get_time();
+      while (i < count - 1 && now - (startUs + slot * periodUs) > lateUs) {
+        slot++;
+        skipped++;
+      }
+    }
+  }
+  if (timer) {
+    esp_timer_delete(timer);
+  }
+  
+  // Let the frames still in the pipeline reach the card
+  waitForPipelineIdle();
+  burstPackEnd();
+  computeBurstStats(count, skipped, interval, policy);
+  
+  burstInProgress = false;
+  burstCurrent = 0;
+  burstTotal = 0;
+  
+  xSemaphoreGiveRecursive(cameraMutex);
+  
+  LOG_INFO("\n=== Burst Capture Complete (%u saved, %u failed in total) ===", capturesSaved, capturesFailed);
+  if (lastBurstStats.valid) {
+    LOG_INFO("Achieved %.2f fps, %d skipped; jitter min %.2f / avg %.2f / max %.2f / p99 %.2f ms",
+                  lastBurstStats.fps, lastBurstStats.skipped, lastBurstStats.jitterMinMs,
+                  lastBurstStats.jitterAvgMs, lastBurstStats.jitterMaxMs, lastBurstStats.jitterP99Ms);
+  }
+}
+
+// Runs in the esp_timer task at each burst deadline
+void burstTimerCallback(void *arg) {
+  xTaskNotifyGive((TaskHandle_t)arg);
+}
+
+// Works out the achieved rate and inter-frame jitter from the grab times.
+// Jitter compares each gap with what the schedule asked for, so skipped
+// deadlines (a gap of two or more intervals) aren't counted as jitter.
+void computeBurstStats(int frames, int skipped, float interval, BurstPolicy policy) {
+  BurstStats stats;
+  memset(&stats, 0, sizeof(stats));
+  stats.policy = policy;
+  stats.frames = frames;
+  stats.skipped = skipped;
+  stats.intervalMs = interval * 1000.0f;
+  
+  if (frames >= 2) {
+    int64_t periodUs = (int64_t)(interval * 1000000.0f);
+    std::vector<float> jitter;
+    jitter.reserve(frames - 1);
+    float total = 0;
+    for (int i = 1; i < frames; i++) {
+      int64_t gap = burstGrabUs[i] - burstGrabUs[i - 1];
+      int64_t scheduled = (int64_t)(burstSlot[i] - burstSlot[i - 1]) * periodUs;
+      float ms = llabs(gap - scheduled) / 1000.0f;
+      jitter.push_back(ms);
+      total += ms;
+    }
+    std::sort(jitter.begin(), jitter.end());
+    int64_t spanUs = burstGrabUs[frames - 1] - burstGrabUs[0];
+    stats.fps = spanUs > 0 ? (frames - 1) * 1000000.0f / spanUs : 0;
+    stats.jitterMinMs = jitter.front();
+    stats.jitterMaxMs = jitter.back();
+    stats.jitterAvgMs = total / jitter.size();
+    stats.jitterP99Ms = jitter[(jitter.size() - 1) * 99 / 100];
+    stats.valid = true;
+  }
+  lastBurstStats = stats;
+}
+
+// Marks a burst as in progress and hands it to the job task. Fails if a
+// burst is already running or queued.
+bool startBurst(int count, float interval, JobType type, BurstPolicy policy) {
+  portENTER_CRITICAL(&pipelineMux);
+  bool busy = burstInProgress;
+  if (!busy) {
+    burstInProgress = true;
+    burstRam = (type == JOB_RAM_BURST);
+    burstCurrent = 0;
+    burstTotal = count;
+  }
+  portEXIT_CRITICAL(&pipelineMux);
+  if (busy) {
+    return false;
+  }
+  
+  if (!submitJob(type, count, interval, policy)) {
+    burstInProgress = false;
+    burstTotal = 0;
+    return false;
+  }
+  return true;
+}
+
+// Grabs up to maxFrames sensor JPEGs (0 = as many as the ring holds) back to
+// back into a PSRAM ring, then writes them into a burst pack. Only the grab
+// holds the camera; the write-out runs at the job task's low priority while
+// live view and single captures carry on. The write-out encodes thumbnails
+// in the arena, so it holds arenaMutex to keep reinitCamera() from freeing it.
+void runRamBurst(int maxFrames) {
+  int limit = (maxFrames > 0 && maxFrames < RAM_BURST_MAX_FRAMES) ? maxFrames : RAM_BURST_MAX_FRAMES;
+  
+  xSemaphoreTakeRecursive(cameraMutex, portMAX_DELAY);
+  waitForPipelineIdle();
+  
+  const char *error = NULL;
+  uint8_t *ring = NULL;
+  size_t ringSize = heap_caps_get_largest_free_block(MALLOC_CAP_SPIRAM);
+  ringSize = (ringSize > RAM_BURST_RESERVE) ? ringSize - RAM_BURST_RESERVE : 0;
+  if (currentPixelFormat != PIXFORMAT_JPEG) {
+    error = "RAM burst needs the RGB (JPEG) color format";
+  } else if (!sdCardPresent) {
+    error = "SD card not available";
+  } else if (ringSize == 0 || (ring = (uint8_t*)ps_malloc(ringSize)) == NULL) {
+    error = "Not enough PSRAM for a RAM burst";
+  }
+  if (error) {
+    LOG_ERROR("%s", error);
+    xSemaphoreGiveRecursive(cameraMutex);
+    burstInProgress = false;
+    burstRam = false;
+    burstTotal = 0;
+    return;
+  }
+  
+  LOG_INFO("\n=== Starting RAM Burst (up to %d frames, %u KB ring) ===", limit, ringSize / 1024);
+  burstTotal = limit;
+  
+  std::vector<RamFrame> frames;
+  frames.reserve(limit);
+  size_t used = 0;
+  uint16_t width = 0;
+  uint16_t height = 0;
+  unsigned long startMs = millis();
+  while ((int)frames.size() < limit) {
+    int64_t grabStart = esp_timer_get_time();
+    camera_fb_t *fb = esp_camera_fb_get();
+    metricsRecordSince(STAGE_GRAB, grabStart);
+    if (!fb) {
+      break;
+    }
+    if (used + fb->len > ringSize) {
+      esp_camera_fb_return(fb);
+      break;
+    }
+    memcpy(ring + used, fb->buf, fb->len);
+    RamFrame frame = { (uint32_t)used, (uint32_t)fb->len, millis() };
+    frames.push_back(frame);
+    used += fb->len;
+    width = fb->width;
+    height = fb->height;
+    esp_camera_fb_return(fb);
+    burstCurrent = frames.size();
+  }
+  unsigned long grabMs = millis() - startMs;
+  xSemaphoreGiveRecursive(cameraMutex);
+  
+  int count = frames.size();
+  LOG_INFO("Grabbed %d frames (%u KB) in %lu ms (%.1f fps)", count, used / 1024, grabMs,
+                grabMs > 0 ? count * 1000.0f / grabMs : 0.0f);
+  
+  // Write-out: each frame gets its thumbnail and goes into one pack
+  burstFlushing = true;
+  burstCurrent = 0;
+  burstTotal = count;
+  xSemaphoreTakeRecursive(arenaMutex, portMAX_DELAY);
+  burstPackBegin(count, startMs, used);
+  int saved = 0;
+  for (int i = 0; i < count; i++) {
+    if (saveBufferedFrame(ring + frames[i].offset, frames[i].len, width, height, frames[i].captureMs)) {
+      saved++;
+    }
+    burstCurrent = i + 1;
+  }
+  burstPackEnd();
+  xSemaphoreGiveRecursive(arenaMutex);
+  free(ring);
+  
+  burstFlushing = false;
+  burstInProgress = false;
+  burstRam = false;
+  burstCurrent = 0;
+  burstTotal = 0;
+  
+  LOG_INFO("\n=== RAM Burst Complete (%d of %d frames saved) ===", saved, count);
+}
+
+// Saves a sensor JPEG held in memory (rather than in a driver frame buffer)
+// the way the write stage saves a burst frame, thumbnail included. Callers
+// hold arenaMutex, since the thumbnail is built in the arena.
+bool saveBufferedFrame(const uint8_t *data, size_t len, uint16_t width, uint16_t height, unsigned long captureMs) {
+  camera_fb_t fb;
+  memset(&fb, 0, sizeof(fb));
+  fb.buf = (uint8_t*)data;
+  fb.len = len;
+  fb.width = width;
+  fb.height = height;
+  fb.format = PIXFORMAT_JPEG;
+  
+  CaptureJob job;
+  memset(&job, 0, sizeof(job));
+  job.fb = &fb;
+  job.jpegData = fb.buf;
+  job.jpegLen = fb.len;
+  job.burst = true;
+  job.captureMs = captureMs;
+  int64_t thumbStart = esp_timer_get_time();
+  makeThumbnail(job);
+  metricsRecordSince(STAGE_THUMBNAIL, thumbStart);
+  job.fb = NULL;  // Not a driver frame buffer, so writeFrame() mustn't return it
+  
+  bool ok = writeFrame(job);
+  portENTER_CRITICAL(&pipelineMux);
+  if (ok) {
+    capturesSaved++;
+  } else {
+    capturesFailed++;
+  }
+  portEXIT_CRITICAL(&pipelineMux);
+  return ok;
+}
+
+// Button, serial c and /capture all come here: a normal capture, or the
+// trigger when pre-trigger mode is on
+void triggerCapture() {
+  if (!pretriggerEnabled) {
+    captureImage();
+    return;
+  }
+  if (pretriggerFire()) {
+    LOG_INFO("\nTriggered - saving %d frames before and %d after", pretrigger.before, pretrigger.after);
+  } else {
+    LOG_INFO("\nPre-trigger frames are still being saved - trigger ignored");
+  }
+}
+
+// Asks pretriggerTask to switch the mode on or off (or change the frame
+// counts) and waits briefly for it to do so. Returns false if the mode
+// didn't end up as asked, e.g. no PSRAM or a non-JPEG pixel format.
+bool pretriggerConfigure(bool enable, int before, int after) {
+  if (!pretriggerTaskHandle || before < 0 || after < 0 || before + after < 1 || before + after > PRETRIGGER_MAX_FRAMES) {
+    return false;
+  }
+  pretriggerWantEnabled = enable;
+  pretriggerWantBefore = before;
+  pretriggerWantAfter = after;
+  pretriggerConfigPending = true;
+  xTaskNotifyGive(pretriggerTaskHandle);
+  
+  unsigned long start = millis();
+  while (pretriggerConfigPending && millis() - start < 2000) {
+    delay(10);
+  }
+  return !pretriggerConfigPending && pretriggerEnabled == enable;
+}
+
+// Returns false if the ring is still collecting or saving the last trigger
+bool pretriggerFire() {
+  if (!pretriggerEnabled || pretriggerFrozen || pretriggerTriggered || pretrigger.afterRemaining > 0) {
+    return false;
+  }
+  pretriggerTriggered = true;
+  return true;
+}
+
+static void pretriggerApplyConfig() {
+  if (pretrigger.slots) {
+    free(pretrigger.slots);
+  }
+  pretrigger.slots = NULL;
+  pretrigger.frames.clear();
+  pretrigger.head = 0;
+  pretrigger.count = 0;
+  pretrigger.afterRemaining = 0;
+  pretrigger.afterDrops = 0;
+  pretrigger.shortfall = 0;
+  pretrigger.before = pretriggerWantBefore;
+  pretrigger.after = pretriggerWantAfter;
+  pretriggerTriggered = false;
+  pretriggerEnabled = false;
+  
+  if (!pretriggerWantEnabled) {
+    LOG_INFO("Pre-trigger mode off");
+    return;
+  }
+  if (currentPixelFormat != PIXFORMAT_JPEG) {
+    LOG_ERROR("Pre-trigger mode needs the RGB (JPEG) color format");
+    pretriggerWantEnabled = false;
+    return;
+  }
+  
+  pretrigger.width = resolution[currentFrameSize].width;
+  pretrigger.height = resolution[currentFrameSize].height;
+  pretrigger.slotSize = (pretrigger.width * pretrigger.height / PRETRIGGER_SLOT_DIVISOR + 3) & ~3;
+  pretrigger.capacity = pretrigger.before + pretrigger.after;
+  pretrigger.slots = (uint8_t*)ps_malloc(pretrigger.slotSize * pretrigger.capacity);
+  if (!pretrigger.slots) {
+    LOG_ERROR("Not enough PSRAM for the pre-trigger ring");
+    pretriggerWantEnabled = false;
+    return;
+  }
+  RamFrame empty = { 0, 0, 0 };
+  pretrigger.frames.assign(pretrigger.capacity, empty);
+  pretriggerEnabled = true;
+  
+  LOG_INFO("Pre-trigger mode on: keeping %d frames before and %d after a trigger (%u KB ring)",
+                pretrigger.before, pretrigger.after, pretrigger.slotSize * pretrigger.capacity / 1024);
+}
+
+// Stops the ring and hands it to the job task to save
+static void pretriggerFreeze() {
+  pretrigger.afterRemaining = 0;
+  pretriggerFrozen = true;
+  if (!submitJob(JOB_SAVE_PRETRIGGER)) {
+    LOG_ERROR("Job queue full - pre-trigger frames dropped");
+    pretriggerFrozen = false;
+  }
+}
+
+// Keeps the ring filled with the latest frames. Takes the camera one frame
+// at a time, so bursts and reconfiguration simply pause it.
+void pretriggerTask(void *param) {
+  for (;;) {
+    if (pretriggerConfigPending && !pretriggerFrozen) {
+      pretriggerApplyConfig();
+      pretriggerConfigPending = false;
+    }
+    if (!pretriggerEnabled || pretriggerFrozen) {
+      ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100));
+      continue;
+    }
+    
+    if (pretriggerTriggered) {
+      pretriggerTriggered = false;
+      pretrigger.triggers++;
+      pretrigger.afterRemaining = pretrigger.after;
+      pretrigger.afterDrops = 0;
+      pretrigger.shortfall = 0;
+      if (pretrigger.after == 0) {
+        pretriggerFreeze();
+        continue;
+      }
+    }
+    
+    if (xSemaphoreTakeRecursive(cameraMutex, pdMS_TO_TICKS(100)) != pdTRUE) {
+      continue;
+    }
+    if (currentPixelFormat != PIXFORMAT_JPEG ||
+        resolution[currentFrameSize].width != pretrigger.width || resolution[currentFrameSize].height != pretrigger.height) {
+      // The camera was reconfigured; rebuild the ring to match (or turn off)
+      xSemaphoreGiveRecursive(cameraMutex);
+      pretriggerConfigPending = true;
+      continue;
+    }
+    int64_t grabStart = esp_timer_get_time();
+    camera_fb_t *fb = esp_camera_fb_get();
+    metricsRecordSince(STAGE_GRAB, grabStart);
+    if (!fb) {
+      xSemaphoreGiveRecursive(cameraMutex);
+      delay(10);
+      continue;
+    }
+    bool stored = false;
+    if (fb->len > pretrigger.slotSize) {
+      pretrigger.dropped++;
+    } else {
+      stored = true;
+      int slot = pretrigger.head;
+      memcpy(pretrigger.slots + slot * pretrigger.slotSize, fb->buf, fb->len);
+      pretrigger.frames[slot].offset = slot * pretrigger.slotSize;
+      pretrigger.frames[slot].len = fb->len;
+      pretrigger.frames[slot].captureMs = millis();
+      pretrigger.head = (slot + 1) % pretrigger.capacity;
+      if (pretrigger.count < pretrigger.capacity) pretrigger.count++;
+    }
+    esp_camera_fb_return(fb);
+    xSemaphoreGiveRecursive(cameraMutex);
+    
+    // Only stored frames count towards the after-trigger total. If as many
+    // frames are dropped as were asked for, save what there is and report
+    // the shortfall rather than waiting on a scene that stays too detailed.
+    if (pretrigger.afterRemaining > 0) {
+      if (stored) {
+        pretrigger.afterRemaining--;
+      } else {
+        pretrigger.afterDrops++;
+      }
+      if (pretrigger.afterRemaining == 0) {
+        pretriggerFreeze();
+      } else if (pretrigger.afterDrops >= pretrigger.after) {
+        pretrigger.shortfall = pretrigger.afterRemaining;
+        LOG_WARN("%d after-trigger frames too large for the ring - saving without them", pretrigger.shortfall);
+        pretriggerFreeze();
+      }
+    }
+  }
+}
+
+// Job: writes the frozen ring, oldest frame first, into a burst pack and
+// starts the ring over. Thumbnails are built in the arena, so this holds
+// arenaMutex like the RAM burst write-out.
+void savePretrigger() {
+  if (!pretriggerFrozen) {
+    return;
+  }
+  
+  int count = pretrigger.count;
+  int oldest = (pretrigger.head - count + pretrigger.capacity) % pretrigger.capacity;
+  uint64_t bytes = 0;
+  for (int i = 0; i < count; i++) {
+    bytes += pretrigger.frames[(oldest + i) % pretrigger.capacity].len;
+  }
+  
+  LOG_INFO("\nSaving %d pre-trigger frames...", count);
+  int saved = 0;
+  if (count > 0) {
+    xSemaphoreTakeRecursive(arenaMutex, portMAX_DELAY);
+    burstPackBegin(count, pretrigger.frames[oldest].captureMs, bytes);
+    for (int i = 0; i < count; i++) {
+      const RamFrame &frame = pretrigger.frames[(oldest + i) % pretrigger.capacity];
+      if (saveBufferedFrame(pretrigger.slots + frame.offset, frame.len, pretrigger.width, pretrigger.height, frame.captureMs)) {
+        saved++;
+      }
+    }
+    burstPackEnd();
+    xSemaphoreGiveRecursive(arenaMutex);
+  }
+  LOG_INFO("Pre-trigger save complete (%d of %d frames saved)", saved, count);
+  
+  pretrigger.head = 0;
+  pretrigger.count = 0;
+  pretriggerFrozen = false;
+  xTaskNotifyGive(pretriggerTaskHandle);
+}
+
+void startJobRunner() {
+  jobQueue = xQueueCreate(JOB_QUEUE_DEPTH, sizeof(Job));
+  if (!jobQueue) {
+    LOG_ERROR("Failed to create job queue!");
+    return;
+  }
+  xTaskCreatePinnedToCore(jobTask, "jobs", 8192, NULL, 1, NULL, 1);
+}
+
+// Never blocks: a full queue is reported back so the handler can answer 503
+bool submitJob(JobType type, int count, float interval, BurstPolicy policy) {
+  if (!jobQueue) {
+    return false;
+  }
+  Job job;
+  job.type = type;
+  job.count = count;
+  job.interval = interval;
+  job.policy = policy;
+  return xQueueSend(jobQueue, &job, 0) == pdTRUE;
+}
+
+// Runs jobs one at a time, in the order they were submitted
+void jobTask(void *param) {
+  Job job;
+  
+  for (;;) {
+    if (xQueueReceive(jobQueue, &job, portMAX_DELAY) != pdTRUE) {
+      continue;
+    }
+    
+    switch (job.type) {
+      case JOB_CAPTURE:
+        captureImage();
+        break;
+      case JOB_BURST:
+        runBurst(job.count, job.interval, job.policy);
+        break;
+      case JOB_RAM_BURST:
+        runRamBurst(job.count);
+        break;
+      case JOB_SAVE_PRETRIGGER:
+        savePretrigger();
+        break;
+      case JOB_REINIT_CAMERA:
+        LOG_INFO("Applying new camera settings...");
+        reinitCamera();
+        break;
+      case JOB_DELETE_IMAGES:
+        deleteImages();
+        break;
+    }
+  }
+}
+
+// Services the web server on its own task so neither loop() nor captures
+// decide how quickly clients are answered
+void httpTask(void *param) {
+  for (;;) {
+    server.handleClient();
+    delay(2);
+  }
+}
+
+void handleBurstStatus() {
+  String json = "{";
+  json += "\"inProgress\":" + String(burstInProgress ? "true" : "false") + ",";
+  json += "\"mode\":\"" + String(burstRam ? "ram" : "interval") + "\",";
+  json += "\"flushing\":" + String(burstFlushing ? "true" : "false") + ",";
+  json += "\"current\":" + String(burstCurrent) + ",";
+  json += "\"total\":" + String(burstTotal);
+  if (lastBurstStats.valid) {
+    const BurstStats &stats = lastBurstStats;
+    json += ",\"lastBurst\":{";
+    json += "\"policy\":\"" + String(stats.policy == BURST_SKIP ? "skip" : "catchup") + "\",";
+    json += "\"frames\":" + String(stats.frames) + ",";
+    json += "\"skipped\":" + String(stats.skipped) + ",";
+    json += "\"intervalMs\":" + String(stats.intervalMs, 1) + ",";
+    json += "\"fps\":" + String(stats.fps, 2) + ",";
+    json += "\"jitterMs\":{\"min\":" + String(stats.jitterMinMs, 2) + ",\"avg\":" + String(stats.jitterAvgMs, 2) +
+            ",\"max\":" + String(stats.jitterMaxMs, 2) + ",\"p99\":" + String(stats.jitterP99Ms, 2) + "}";
+    json += "}";
+  }
+  json += "}";
+  server.send(200, "application/json", json);
+}
+
+// POST /pretrigger {"enabled":true,"before":10,"after":5}. Omitted counts
+// keep their current values.
+void handlePretrigger() {
+  if (!server.hasArg("plain")) {
+    server.send(400, "application/json", "{\"status\":\"error\",\"message\":\"Missing parameters\"}");
+    return;
+  }
+  String body = server.arg("plain");
+  bool enable = body.indexOf("\"enabled\":true") >= 0 || body.indexOf("\"enabled\": true") >= 0;
+  int before = pretriggerWantBefore;
+  int after = pretriggerWantAfter;
+  
+  int index = body.indexOf("\"before\":");
+  if (index >= 0) {
+    before = body.substring(body.indexOf(':', index) + 1).toInt();
+  }
+  index = body.indexOf("\"after\":");
+  if (index >= 0) {
+    after = body.substring(body.indexOf(':', index) + 1).toInt();
+  }
+  
+  if (before < 0 || after < 0 || before + after < 1 || before + after > PRETRIGGER_MAX_FRAMES) {
+    server.send(400, "application/json", "{\"status\":\"error\",\"message\":\"before + after must be between 1 and " + String(PRETRIGGER_MAX_FRAMES) + "\"}");
+    return;
+  }
+  if (!pretriggerConfigure(enable, before, after)) {
+    server.send(500, "application/json", "{\"status\":\"error\",\"message\":\"Pre-trigger mode needs the RGB (JPEG) color format and enough PSRAM\"}");
+    return;
+  }
+  handlePretriggerStatus();
+}
+
+void handlePretriggerStatus() {
+  String json = "{";
+  json += "\"enabled\":" + String(pretriggerEnabled ? "true" : "false") + ",";
+  json += "\"before\":" + String(pretriggerWantBefore) + ",";
+  json += "\"after\":" + String(pretriggerWantAfter) + ",";
+  json += "\"buffered\":" + String(pretrigger.count) + ",";
+  json += "\"collecting\":" + String(pretrigger.afterRemaining > 0 ? "true" : "false") + ",";
+  json += "\"saving\":" + String(pretriggerFrozen ? "true" : "false") + ",";
+  json += "\"triggers\":" + String(pretrigger.triggers) + ",";
+  json += "\"dropped\":" + String(pretrigger.dropped) + ",";
+  json += "\"shortfall\":" + String(pretrigger.shortfall);
+  json += "}";
+  server.send(200, "application/json", json);
+}
+
+// Arena layout and counters. heapFallbacks stays put across frames when
+// every encode buffer comes from the arena; the counters are totals since
+// boot, so they carry on across resolution and format changes.
+void handleArenaStatus() {
+  portENTER_CRITICAL(&arenaMux);
+  CaptureArena layout = arena;
+  ArenaStats stats = arenaStats;
+  portEXIT_CRITICAL(&arenaMux);
+  
+  String json = "{";
+  json += "\"size\":" + String(layout.size) + ",";
+  json += "\"encoderBytes\":" + String(layout.regionSize[ARENA_ENCODER]) + ",";
+  json += "\"planeBytes\":" + String(layout.regionSize[ARENA_PLANES]) + ",";
+  json += "\"thumbPixelBytes\":" + String(layout.regionSize[ARENA_THUMB_PIXELS]) + ",";
+  json += "\"thumbSlots\":" + String(ARENA_THUMB_SLOTS) + ",";
+  json += "\"thumbSlotBytes\":" + String(layout.slotSize) + ",";
+  json += "\"slotsInUse\":" + String(layout.slotsInUse) + ",";
+  json += "\"slotsPeak\":" + String(stats.slotsPeak) + ",";
+  json += "\"borrows\":" + String(stats.borrows) + ",";
+  json += "\"heapFallbacks\":" + String(stats.heapFallbacks) + ",";
+  json += "\"thumbOverflows\":" + String(stats.thumbOverflows) + ",";
+  json += "\"leaked\":" + String(stats.leaked);
+  json += "}";
+  server.send(200, "application/json", json);
+}
+
+void histogramRecord(StageHistogram &histogram, uint32_t us) {
+  int bucket = 0;
+  while (bucket < METRIC_BUCKETS && us > metricBucketUs[bucket]) {
+    bucket++;
+  }
+  __atomic_fetch_add(&histogram.buckets[bucket], 1, __ATOMIC_RELAXED);
+  uint32_t before = __atomic_fetch_add(&histogram.sumUs, us, __ATOMIC_RELAXED);
+  if (before + us < before) {
+    __atomic_fetch_add(&histogram.sumWraps, 1, __ATOMIC_RELAXED);
+  }
+  uint32_t seen = __atomic_load_n(&histogram.maxUs, __ATOMIC_RELAXED);
+  while (us > seen && !__atomic_compare_exchange_n(&histogram.maxUs, &seen, us, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+  }
+}
+
+// Total recorded time. A read that lands between sumUs wrapping and
+// sumWraps catching up comes out 2^32 us short, once an hour at most.
+uint64_t histogramSumUs(const StageHistogram &histogram) {
+  uint32_t wraps, low;
+  do {
+    wraps = __atomic_load_n(&histogram.sumWraps, __ATOMIC_RELAXED);
+    low = __atomic_load_n(&histogram.sumUs, __ATOMIC_RELAXED);
+  } while (wraps != __atomic_load_n(&histogram.sumWraps, __ATOMIC_RELAXED));
+  return ((uint64_t)wraps << 32) | low;
+}
+
+// Estimates a percentile by interpolating inside the bucket it falls in, the
+// way Prometheus' histogram_quantile() does. Capped at the largest value seen.
+uint32_t histogramPercentileUs(const StageHistogram &histogram, float fraction) {
+  uint32_t counts[METRIC_BUCKETS + 1];
+  uint32_t total = 0;
+  for (int bucket = 0; bucket <= METRIC_BUCKETS; bucket++) {
+    counts[bucket] = __atomic_load_n(&histogram.buckets[bucket], __ATOMIC_RELAXED);
+    total += counts[bucket];
+  }
+  uint32_t maxUs = __atomic_load_n(&histogram.maxUs, __ATOMIC_RELAXED);
+  if (total == 0) {
+    return 0;
+  }
+  
+  float rank = fraction * total;
+  uint32_t below = 0;
+  for (int bucket = 0; bucket < METRIC_BUCKETS; bucket++) {
+    if (counts[bucket] > 0 && below + counts[bucket] >= rank) {
+      uint32_t lower = (bucket > 0) ? metricBucketUs[bucket - 1] : 0;
+      uint32_t upper = metricBucketUs[bucket];
+      uint32_t us = lower + (uint32_t)((upper - lower) * (rank - below) / counts[bucket]);
+      return min(us, maxUs);
+    }
+    below += counts[bucket];
+  }
+  return maxUs;
+}
+
+void metricsRecord(MetricStage stage, uint32_t us) {
+  histogramRecord(stageHistograms[stage], us);
+}
+
+void metricsRecordSince(MetricStage stage, int64_t startUs) {
+  metricsRecord(stage, (uint32_t)(esp_timer_get_time() - startUs));
+}
+
+// One histogram's bucket, sum and count lines in Prometheus text format
+String metricsHistogramText(const char *name, const String &labels, const StageHistogram &histogram) {
+  String text;
+  uint32_t cumulative = 0;
+  for (int bucket = 0; bucket <= METRIC_BUCKETS; bucket++) {
+    cumulative += __atomic_load_n(&histogram.buckets[bucket], __ATOMIC_RELAXED);
+    const char *le = (bucket < METRIC_BUCKETS) ? metricBucketLabels[bucket] : "+Inf";
+    text += String(name) + "_bucket{" + labels + ",le=\"" + le + "\"} " + String(cumulative) + "\n";
+  }
+  uint64_t sumUs = histogramSumUs(histogram);
+  text += String(name) + "_sum{" + labels + "} " + String((double)sumUs / 1000000.0, 6) + "\n";
+  text += String(name) + "_count{" + labels + "} " + String(cumulative) + "\n";
+  return text;
+}
+
+// GET /metrics: stage and route histograms, capture counters and heap/PSRAM
+// watermarks in Prometheus text format. Sent a histogram at a time so the
+// whole page is never built in memory.
+void handleMetrics() {
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200, "text/plain; version=0.0.4", "");
+  
+  server.sendContent("# HELP xiao_stage_seconds Time spent in each capture pipeline stage\n"
+                     "# TYPE xiao_stage_seconds histogram\n");
+  for (int stage = 0; stage < STAGE_COUNT; stage++) {
+    String labels = "stage=\"" + String(metricStageNames[stage]) + "\"";
+    server.sendContent(metricsHistogramText("xiao_stage_seconds", labels, stageHistograms[stage]));
+  }
+  
+  server.sendContent("# HELP xiao_http_request_seconds Handler time of each web route\n"
+                     "# TYPE xiao_http_request_seconds histogram\n");
+  for (int i = 0; i < httpRouteCount; i++) {
+    String labels = "method=\"" + String(httpMethodName(httpRoutes[i].method)) + "\",route=\"" + String(httpRoutes[i].uri) + "\"";
+    server.sendContent(metricsHistogramText("xiao_http_request_seconds", labels, httpRouteLatency(httpRoutes[i])));
+  }
+  
+  String text;
+  text += "# HELP xiao_captures_total Captures finished, by result\n";
+  text += "# TYPE xiao_captures_total counter\n";
+  text += "xiao_captures_total{result=\"saved\"} " + String(capturesSaved) + "\n";
+  text += "xiao_captures_total{result=\"failed\"} " + String(capturesFailed) + "\n";
+  text += "# HELP xiao_camera_reconfigures_total Camera setting changes, made live or by reinitializing the driver\n";
+  text += "# TYPE xiao_camera_reconfigures_total counter\n";
+  text += "xiao_camera_reconfigures_total{kind=\"live\"} " + String(cameraLiveChanges) + "\n";
+  text += "xiao_camera_reconfigures_total{kind=\"reinit\"} " + String(cameraFullReinits) + "\n";
+  text += "# HELP xiao_log_lines_total Log lines printed, and dropped because the log ring was full\n";
+  text += "# TYPE xiao_log_lines_total counter\n";
+  text += "xiao_log_lines_total{result=\"printed\"} " + String(logPrinted) + "\n";
+  text += "xiao_log_lines_total{result=\"dropped\"} " + String(logDropped) + "\n";
+  text += "# HELP xiao_heap_free_bytes Free internal heap\n";
+  text += "# TYPE xiao_heap_free_bytes gauge\n";
+  text += "xiao_heap_free_bytes " + String(ESP.getFreeHeap()) + "\n";
+  text += "# HELP xiao_heap_min_free_bytes Lowest free internal heap since boot\n";
+  text += "# TYPE xiao_heap_min_free_bytes gauge\n";
+  text += "xiao_heap_min_free_bytes " + String(ESP.getMinFreeHeap()) + "\n";
+  text += "# HELP xiao_heap_max_alloc_bytes Largest internal heap block that can be allocated\n";
+  text += "# TYPE xiao_heap_max_alloc_bytes gauge\n";
+  text += "xiao_heap_max_alloc_bytes " + String(ESP.getMaxAllocHeap()) + "\n";
+  text += "# HELP xiao_psram_free_bytes Free PSRAM\n";
+  text += "# TYPE xiao_psram_free_bytes gauge\n";
+  text += "xiao_psram_free_bytes " + String(ESP.getFreePsram()) + "\n";
+  text += "# HELP xiao_psram_min_free_bytes Lowest free PSRAM since boot\n";
+  text += "# TYPE xiao_psram_min_free_bytes gauge\n";
+  text += "xiao_psram_min_free_bytes " + String(ESP.getMinFreePsram()) + "\n";
+  text += "# HELP xiao_psram_max_alloc_bytes Largest PSRAM block that can be allocated\n";
+  text += "# TYPE xiao_psram_max_alloc_bytes gauge\n";
+  text += "xiao_psram_max_alloc_bytes " + String(ESP.getMaxAllocPsram()) + "\n";
+  text += "# HELP xiao_wifi_rssi_dbm WiFi signal strength\n";
+  text += "# TYPE xiao_wifi_rssi_dbm gauge\n";
+  text += "xiao_wifi_rssi_dbm " + String(WiFi.RSSI()) + "\n";
+  text += "# HELP xiao_uptime_seconds Time since boot\n";
+  text += "# TYPE xiao_uptime_seconds gauge\n";
+  text += "xiao_uptime_seconds " + String((uint32_t)(esp_timer_get_time() / 1000000)) + "\n";
+  server.sendContent(text);
+  server.sendContent("");
+}
+
+// GET /routestats: request count and handler time percentiles per route,
+// for watching the server under load. ?reset clears them afterwards so the
+// next run starts from zero.
+void handleRouteStats() {
+  String json = "{\"routes\":[";
+  for (int i = 0; i < httpRouteCount; i++) {
+    const StageHistogram &histogram = httpRouteLatency(httpRoutes[i]);
+    uint32_t count = 0;
+    for (int bucket = 0; bucket <= METRIC_BUCKETS; bucket++) {
+      count += __atomic_load_n(&histogram.buckets[bucket], __ATOMIC_RELAXED);
+    }
+    uint64_t sumUs = histogramSumUs(histogram);
+    if (i > 0) json += ",";
+    json += "{\"method\":\"" + String(httpMethodName(httpRoutes[i].method)) + "\",";
+    json += "\"route\":\"" + String(httpRoutes[i].uri) + "\",";
+    json += "\"count\":" + String(count) + ",";
+    json += "\"avgMs\":" + String(count ? sumUs / 1000.0 / count : 0.0, 2) + ",";
+    json += "\"p50Ms\":" + String(histogramPercentileUs(histogram, 0.50f) / 1000.0f, 2) + ",";
+    json += "\"p95Ms\":" + String(histogramPercentileUs(histogram, 0.95f) / 1000.0f, 2) + ",";
+    json += "\"p99Ms\":" + String(histogramPercentileUs(histogram, 0.99f) / 1000.0f, 2) + ",";
+    json += "\"maxMs\":" + String(__atomic_load_n(&histogram.maxUs, __ATOMIC_RELAXED) / 1000.0f, 2) + "}";
+  }
+  json += "]}";
+  
+  if (server.hasArg("reset")) {
+    uint32_t next = httpRouteGeneration + 1;
+    for (int i = 0; i < httpRouteCount; i++) {
+      memset(&httpRoutes[i].latency[next & 1], 0, sizeof(StageHistogram));
+    }
+    __atomic_store_n(&httpRouteGeneration, next, __ATOMIC_RELEASE);
+  }
+  server.send(200, "application/json", json);
+}
+
+// GET /burst?id=N&frame=F serves one frame straight out of a burst pack.
+// Without frame, lists the pack's frames.
+void handleBurst() {
+  if (!server.hasArg("id")) {
+    server.send(400, "text/plain", "Missing burst id parameter");
+    return;
+  }
+  
+  uint32_t id = server.arg("id").toInt();
+  if (!sdCardPresent || id == 0) {
+    server.send(404, "text/plain", "Burst not found");
+    return;
+  }
+  if (activePack.open && activePack.id == id) {
+    server.send(409, "text/plain", "Burst still in progress");
+    return;
+  }
+  
+  if (server.hasArg("frame")) {
+    if (!sendBurstFrame(id, server.arg("frame").toInt(), server.hasArg("thumb"))) {
+      server.send(404, "text/plain", "Frame not found");
+    }
+    return;
+  }
+  
+  String json = "{\"id\":" + String(id) + ",\"frames\":[";
+  int frames = 0;
+  xSemaphoreTake(indexMutex, portMAX_DELAY);
+  for (size_t i = 0; i < imageIndex.size(); i++) {
+    const ImageInfo &info = imageIndex[i];
+    if (info.burstId != id) continue;
+    if (frames++ > 0) json += ",";
+    json += "{\"frame\":" + String(info.frame) + ",\"number\":" + String(info.number) + ",\"size\":" + String(info.size) + "}";
+  }
+  xSemaphoreGive(indexMutex);
+  json += "]}";
+  
+  if (frames == 0) {
+    server.send(404, "text/plain", "Burst not found");
+    return;
+  }
+  server.send(200, "application/json", json);
+}
+
+// GET /archive?format=zip|tar[&from=N][&to=N] downloads the images (all of
+// them, or the numbers from..to) as one archive. Like /stream, the socket is
+// handed to a sender task and the handler returns at once. The body is sent
+// chunked, so the size is never worked out up front; archive_format.cpp
+// builds the ZIP or TAR itself.
+void handleArchive() {
+  String format = server.hasArg("format") ? server.arg("format") : String("zip");
+  bool tar = format == "tar";
+  if (!tar && format != "zip") {
+    server.send(400, "text/plain", "Format must be zip or tar");
+    return;
+  }
+  if (!sdCardPresent) {
+    server.send(404, "text/plain", "No SD card");
+    return;
+  }
+  if (archiveBusy) {
+    server.send(503, "text/plain", "Another archive download is in progress");
+    return;
+  }
+  
+  uint32_t from = server.hasArg("from") ? server.arg("from").toInt() : 1;
+  uint32_t to = server.hasArg("to") ? server.arg("to").toInt() : 0xFFFFFFFF;
+  
+  // Work from a copy so captures and deletes aren't held up meanwhile; a
+  // file deleted before its turn is just left out
+  ArchiveJob *job = new ArchiveJob();
+  job->tar = tar;
+  uint64_t zipSize = ARCHIVE_ZIP_END_BYTES;
+  xSemaphoreTake(indexMutex, portMAX_DELAY);
+  for (size_t i = 0; i < imageIndex.size(); i++) {
+    const ImageInfo &info = imageIndex[i];
+    if (info.number < from || info.number > to) continue;
+    job->images.push_back(info);
+    zipSize += archiveZipFileBytes(info.number, info.size);
+  }
+  xSemaphoreGive(indexMutex);
+  
+  if (job->images.empty()) {
+    delete job;
+    server.send(404, "text/plain", "No images in range");
+    return;
   }
-  
-  if (needsFree && jpegData != NULL) {
-    free(jpegData);
+  // Without ZIP64 a ZIP holds at most 65535 files and 4 GB
+  if (!tar && (job->images.size() > 0xFFFF || zipSize > 0xFFFFFFFF)) {
+    delete job;
+    server.send(413, "text/plain", "Too large for a ZIP - use format=tar or a number range");
+    return;
   }
   
-  if (fb != NULL) {
-    esp_camera_fb_return(fb);
+  job->buf = (uint8_t*)malloc(ARCHIVE_BUFFER_SIZE);
+  if (!job->buf) {
+    delete job;
+    server.send(503, "text/plain", "Out of memory");
+    return;
   }
   
-  if (saved) {
-    Serial.printf("SUCCESS: Image saved as %s!\n", filename.c_str());
-  } else {
-    Serial.println("ERROR: Failed to save image!");
+  archiveBusy = true;
+  job->client = server.client();
+  job->client.print("HTTP/1.1 200 OK\r\n"
+                    "Content-Type: " + String(tar ? "application/x-tar" : "application/zip") + "\r\n"
+                    "Content-Disposition: attachment; filename=\"images." + format + "\"\r\n"
+                    "Cache-Control: no-store\r\n"
+                    "Transfer-Encoding: chunked\r\n"
+                    "Connection: close\r\n\r\n");
+  
+  if (xTaskCreate(archiveTask, "archive", 6144, job, 1, NULL) != pdPASS) {
+    job->client.stop();
+    free(job->buf);
+    delete job;
+    archiveBusy = false;
   }
-  Serial.flush();
 }
 
-String getNextFilename(const char* extension) {
-  int fileNumber = 1;
-  String filename;
-  bool fileExists = true;
-  
-  while (fileExists) {
-    filename = "/" + String(fileNumber) + extension;
-    fileExists = SD.exists(filename.c_str());
-    
-    if (fileExists) {
-      fileNumber++;
-      if (fileNumber > 10000) {
-        break;
-      }
+// Writes all of data, giving up if the client goes away or stops reading
+bool archiveWrite(WiFiClient &client, const uint8_t *data, size_t len) {
+  while (len > 0) {
+    size_t written = client.write(data, len);
+    if (written == 0) {
+      return false;
     }
+    data += written;
+    len -= written;
   }
-  
-  return filename;
+  return true;
+}
+
+// Sends one piece of the archive as a chunk of the chunked response
+bool archiveChunkSink(void *ctx, const uint8_t *data, size_t len) {
+  WiFiClient &client = *(WiFiClient*)ctx;
+  char size[12];
+  int sizeLength = snprintf(size, sizeof(size), "%x\r\n", (unsigned int)len);
+  return archiveWrite(client, (const uint8_t*)size, sizeLength) &&
+         archiveWrite(client, data, len) &&
+         archiveWrite(client, (const uint8_t*)"\r\n", 2);
 }
 
-void deleteAllImages() {
-  Serial.println("\nDeleting all images...");
-  int deleted = 0;
+// Sends one archive, file by file through the job's buffer, then closes
+// the connection
+void archiveTask(void *param) {
+  ArchiveJob *job = (ArchiveJob*)param;
+  WiFiClient &client = job->client;
+  uint8_t *buf = job->buf;
   
-  for (int i = 1; i <= 10000; i++) {
-    String filename = "/" + String(i) + ".jpg";
-    if (SD.exists(filename.c_str())) {
-      SD.remove(filename.c_str());
-      deleted++;
-    } else if (deleted > 0) {
-      break;
+  ArchiveWriter writer;
+  archiveBegin(writer, job->tar, buf, ARCHIVE_BUFFER_SIZE, archiveChunkSink, &client);
+  if (!job->tar) {
+    writer.entries.reserve(job->images.size());
+  }
+  
+  int sent = 0;
+  for (size_t i = 0; i < job->images.size() && writer.ok; i++) {
+    const ImageInfo &info = job->images[i];
+    File file;
+    uint32_t offset = 0;
+    uint32_t length = 0;
+    if (!openIndexedImage(info, file, &offset, &length)) {
+      continue;
+    }
+    file.seek(offset);
+    
+    archiveFileBegin(writer, info.number, info.timestamp, length);
+    uint32_t done = 0;
+    while (writer.ok && done < length) {
+      size_t chunk = file.read(buf, min(length - done, (uint32_t)ARCHIVE_BUFFER_SIZE));
+      if (chunk == 0) break;
+      archiveFileData(writer, buf, chunk);
+      done += chunk;
+    }
+    file.close();
+    if (archiveFileEnd(writer)) {
+      sent++;
     }
   }
   
-  Serial.printf("Deleted %d images\n", deleted);
+  bool ok = archiveFinish(writer) && archiveWrite(client, (const uint8_t*)"0\r\n\r\n", 5);
+  if (ok) {
+    LOG_INFO("Archive sent: %d images as %s", sent, job->tar ? "tar" : "zip");
+  } else {
+    LOG_INFO("Archive download stopped by the client after %d images", sent);
+  }
+  client.stop();
+  free(buf);
+  delete job;
+  archiveBusy = false;
+  vTaskDelete(NULL);
 }
 
-void listImages() {
-  Serial.println("\nListing all images:");
-  int count = 0;
-  
-  for (int i = 1; i <= 10000; i++) {
-    String filename = "/" + String(i) + ".jpg";
-    if (SD.exists(filename.c_str())) {
-      File file = SD.open(filename.c_str(), FILE_READ);
-      size_t fileSize = 0;
-      if (file) {
-        fileSize = file.size();
-        file.close();
-      }
-      Serial.printf("  %s (%u bytes)\n", filename.c_str(), fileSize);
-      count++;
-    } else if (count > 0) {
+void handleImage() {
+  ServerRequest request;
+  ServerResponse response;
+  webHandleImage(request, response, webBackend, false);
+}
+
+// Starts an MJPEG stream. The socket is handed to a sender task of its own
+// and the handler returns at once, so the web server keeps serving others.
+void handleStream() {
+  int slot = -1;
+  portENTER_CRITICAL(&streamMux);
+  for (int i = 0; i < MAX_STREAM_CLIENTS; i++) {
+    if (!streamClients[i].active && streamClients[i].task == NULL) {
+      slot = i;
+      streamClients[i].active = true;
+      streamClients[i].pending = NULL;
       break;
     }
   }
+  portEXIT_CRITICAL(&streamMux);
   
-  if (count == 0) {
-    Serial.println("  No images found");
-  } else {
-    Serial.printf("\nTotal: %d images\n", count);
+  if (slot < 0) {
+    server.send(503, "text/plain", "Too many viewers");
+    return;
   }
-}
-
-bool initWiFi() {
-  Serial.println("\nConnecting to WiFi...");
-  Serial.printf("SSID: %s\n", ssid);
   
-  WiFi.mode(WIFI_STA);
-  WiFi.setSleep(false);
-  WiFi.setAutoReconnect(true);
-  WiFi.begin(ssid, password);
+  portENTER_CRITICAL(&streamMux);
+  streamClientCount++;
+  portEXIT_CRITICAL(&streamMux);
   
-  int attempts = 0;
-  while (WiFi.status() != WL_CONNECTED && attempts < 30) {
-    delay(500);
-    Serial.print(".");
-    attempts++;
-    if (attempts % 10 == 0) {
-      Serial.printf("\nStill connecting... (attempt %d/30)\n", attempts);
-      WiFi.disconnect();
-      delay(100);
-      WiFi.begin(ssid, password);
-    }
+  StreamClient &viewer = streamClients[slot];
+  viewer.client = server.client();
+  viewer.client.setNoDelay(true);
+  viewer.client.print("HTTP/1.1 200 OK\r\n"
+                      "Content-Type: multipart/x-mixed-replace; boundary=" STREAM_BOUNDARY "\r\n"
+                      "Cache-Control: no-cache\r\n"
+                      "Access-Control-Allow-Origin: *\r\n"
+                      "Connection: close\r\n\r\n");
+  
+  if (xTaskCreate(streamClientTask, "viewer", 4096, (void*)(intptr_t)slot, 1, &viewer.task) != pdPASS) {
+    viewer.client.stop();
+    viewer.client = WiFiClient();
+    viewer.task = NULL;
+    portENTER_CRITICAL(&streamMux);
+    viewer.active = false;
+    streamClientCount--;
+    portEXIT_CRITICAL(&streamMux);
+    return;
   }
   
-  if (WiFi.status() == WL_CONNECTED) {
-    Serial.println("\nWiFi connected!");
-    Serial.printf("IP address: %s\n", WiFi.localIP().toString().c_str());
-    Serial.printf("Signal strength (RSSI): %d dBm\n", WiFi.RSSI());
+  xTaskNotifyGive(streamTaskHandle);
+  
+  LOG_INFO("Stream viewer connected (%d watching)", streamClientCount);
+}
+
+// Grabs and encodes preview frames while anyone is watching. Each frame is
+// encoded once and shared by all viewers.
+void streamTask(void *param) {
+  for (;;) {
+    if (streamClientCount == 0) {
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+      continue;
+    }
     
-    if (!MDNS.begin("xiaocamera")) {
-      Serial.println("mDNS responder failed to start");
+    // A burst or reinit owns the camera; the write stage feeds viewers then
+    if (xSemaphoreTakeRecursive(cameraMutex, 0) != pdTRUE) {
+      delay(50);
+      continue;
+    }
+    
+    camera_fb_t *fb = esp_camera_fb_get();
+    if (!fb) {
+      xSemaphoreGiveRecursive(cameraMutex);
+      delay(100);
+      continue;
+    }
+    
+    if (fb->format == PIXFORMAT_JPEG) {
+      publishStreamFrameCopy(fb->buf, fb->len);
+      esp_camera_fb_return(fb);
     } else {
-      Serial.println("mDNS responder started - try http://xiaocamera.local");
+      uint8_t *jpeg_buf = NULL;
+      size_t jpeg_buf_len = 0;
+      int64_t start = esp_timer_get_time();
+      bool success = fmt2jpg(fb->buf, fb->len, fb->width, fb->height, fb->format, STREAM_JPEG_QUALITY, &jpeg_buf, &jpeg_buf_len);
+      metricsRecordSince(STAGE_PREVIEW, start);
+      esp_camera_fb_return(fb);
+      if (success && jpeg_buf) {
+        publishStreamFrame(jpeg_buf, jpeg_buf_len);
+      }
     }
     
-    return true;
-  } else {
-    Serial.println("\nWiFi connection failed!");
-    Serial.printf("WiFi status: %d\n", WiFi.status());
-    Serial.println("Possible issues:");
-    Serial.println("  - Wrong SSID or password");
-    Serial.println("  - WiFi router not in range");
-    Serial.println("  - Router only supports 5GHz (ESP32 only supports 2.4GHz)");
-    return false;
+    xSemaphoreGiveRecursive(cameraMutex);
+    delay(1);
   }
 }
 
-void setupWebServer() {
-  server.on("/", handleRoot);
-  server.on("/image", HTTP_GET, handleImage);
-  server.on("/capture", HTTP_GET, handleCapture);
-  server.on("/delete", HTTP_GET, handleDelete);
-  server.on("/list", HTTP_GET, handleListJSON);
-  server.on("/setquality", HTTP_POST, handleSetQuality);
-  server.on("/setresolution", HTTP_POST, handleSetResolution);
-  server.on("/setpixelformat", HTTP_POST, handleSetPixelFormat);
-  server.on("/setendianness", HTTP_POST, handleSetEndianness);
-  server.on("/getsettings", HTTP_GET, handleGetSettings);
-  // Backend burst endpoints (not exposed in web UI, but available for API use)
-  server.on("/burstcapture", HTTP_POST, handleBurstCapture);
-  server.on("/burststatus", HTTP_GET, handleBurstStatus);
+// Sends frames to one viewer until it disconnects or a write fails
+void streamClientTask(void *param) {
+  int slot = (int)(intptr_t)param;
+  StreamClient &viewer = streamClients[slot];
+  char header[128];
   
-  server.begin();
-  Serial.println("HTTP server started");
-}
-
-void handleRoot() {
-  String html = "<!DOCTYPE html><html><head>";
-  html += "<meta name='viewport' content='width=device-width, initial-scale=1'>";
-  html += "<title>XIAO Camera Gallery</title>";
-  html += "<style>";
-  html += "body { font-family: Arial, sans-serif; margin: 20px; background: #f5f5f5; }";
-  html += "h1 { color: #333; }";
-  html += ".controls { margin: 20px 0; }";
-  html += "button { padding: 10px 20px; margin: 5px; font-size: 16px; cursor: pointer; }";
-  html += ".capture { background: #4CAF50; color: white; border: none; border-radius: 5px; }";
-  html += ".delete { background: #f44336; color: white; border: none; border-radius: 5px; }";
-  html += ".refresh { background: #2196F3; color: white; border: none; border-radius: 5px; }";
-  html += ".download-all { background: #FF9800; color: white; border: none; border-radius: 5px; }";
-  html += ".download-all:disabled { background: #ccc; cursor: not-allowed; }";
-  html += ".gallery { display: grid; grid-template-columns: repeat(auto-fill, minmax(200px, 1fr)); gap: 15px; margin-top: 20px; }";
-  html += ".image-card { background: white; padding: 10px; border-radius: 8px; box-shadow: 0 2px 4px rgba(0,0,0,0.1); }";
-  html += ".image-card img { width: 100%; height: auto; border-radius: 5px; }";
-  html += ".image-card a { display: block; margin-top: 5px; text-align: center; color: #2196F3; text-decoration: none; }";
-  html += ".info { background: white; padding: 15px; border-radius: 8px; margin-bottom: 20px; }";
-  html += ".settings { background: white; padding: 15px; border-radius: 8px; margin-bottom: 20px; }";
-  html += ".settings h3 { margin-top: 0; }";
-  html += ".settings div { margin-bottom: 15px; }";
-  html += ".settings label { font-weight: bold; margin-right: 10px; }";
-  html += ".settings select { padding: 5px; font-size: 14px; }";
-  html += ".settings input[type='range'] { width: 200px; }";
-  html += ".settings button { padding: 5px 10px; margin-left: 5px; font-size: 14px; }";
-  html += ".latest-image { background: white; padding: 15px; border-radius: 8px; margin-bottom: 20px; }";
-  html += ".latest-image img { max-width: 100%; max-height: 400px; border-radius: 5px; }";
-  html += "</style></head><body>";
-  html += "<h1>XIAO Camera Gallery</h1>";
-  
-  html += "<div class='latest-image' id='latestImage' style='background: white; padding: 15px; border-radius: 8px; margin-bottom: 20px; text-align: center; display: none;'>";
-  html += "<h3 style='margin-top: 0;'>Latest Image</h3>";
-  html += "<img id='latestImg' src='' alt='Latest image' style='max-width: 100%; max-height: 400px; border-radius: 5px;'>";
-  html += "<p id='latestInfo' style='margin-top: 10px; color: #666;'></p>";
-  html += "</div>";
-  
-  html += "<div class='settings'>";
-  html += "<h3>Camera Settings</h3>";
-  html += "<div>";
-  html += "<label>Resolution: </label>";
-  html += "<select id='resolutionSelect'>";
-  html += "<option value='0'>96x96 (QQVGA 160x120)</option>";
-  html += "<option value='1'>176x144 (QCIF)</option>";
-  html += "<option value='2'>240x240 (QVGA 320x240)</option>";
-  html += "<option value='3'>640x480 (VGA)</option>";
-  html += "<option value='4'>800x600 (SVGA)</option>";
-  html += "<option value='5'>1024x768 (XGA)</option>";
-  html += "<option value='6'>1280x1024 (SXGA)</option>";
-  html += "<option value='7'>1600x1200 (UXGA)</option>";
-  html += "</select>";
-  html += "<button onclick='changeResolution()'>Apply</button>";
-  html += "</div>";
-  html += "<div>";
-  html += "<label>JPEG Quality (0-63, lower=higher quality): </label>";
-  html += "<input type='range' id='qualitySlider' min='0' max='63' value='12'>";
-  html += "<span id='qualityValue'>12</span>";
-  html += "<button onclick='changeQuality()'>Apply</button>";
-  html += "</div>";
-  html += "<div>";
-  html += "<label>Color Format: </label>";
-  html += "<select id='pixelFormatSelect'>";
-  html += "<option value='0'>RGB (JPEG)</option>";
-  html += "<option value='1'>Grayscale</option>";
-  html += "<option value='2'>RGB565</option>";
-  html += "</select>";
-  html += "<button onclick='changePixelFormat()'>Apply</button>";
-  html += "</div>";
-  html += "<div>";
-  html += "<label>Endianness: </label>";
-  html += "<select id='endiannessSelect'>";
-  html += "<option value='0'>Little Endian</option>";
-  html += "<option value='1'>Big Endian</option>";
-  html += "</select>";
-  html += "<button onclick='changeEndianness()'>Apply</button>";
-  html += "<p style='font-size: 12px; color: #666; margin-top: 5px; margin-left: 0;'>";
-  html += "Only applies to RGB565 format. Use Little Endian for ESP32/MicroPython. ";
-  html += "Use Big Endian if your processing software requires it (e.g., some ML frameworks).";
-  html += "</p>";
-  html += "<p style='font-size: 12px; color: #666; margin-top: 5px; margin-left: 0;'>";
-  html += "<strong>Note:</strong> Burst capture (50 photos at 0.2 second intervals) is available via serial monitor using the <code>b</code> command. ";
-  html += "Burst photos are saved to SD card and use the current camera settings. ";
-  html += "Refreshing this page will show all pictures taken via serial monitor (including burst captures) in the gallery.";
-  html += "</p>";
-  html += "</div>";
-  html += "</div>";
-  
-  html += "<div class='info'>";
-  html += "<p><strong>IP Address:</strong> " + WiFi.localIP().toString() + "</p>";
-  html += "<p><strong>Storage:</strong> ";
-  if (sdCardPresent) {
-    uint64_t totalMB = SD.totalBytes() / (1024 * 1024);
-    uint64_t usedMB = (SD.totalBytes() - SD.usedBytes()) / (1024 * 1024);
-    html += "SD Card (" + String(usedMB) + " MB / " + String(totalMB) + " MB used)";
-  } else {
-    html += "SD Card not available";
-  }
-  html += "</p></div>";
-  
-  html += "<div class='controls'>";
-  html += "<button class='capture' onclick='captureImage()'>Capture New Image</button>";
-  html += "<button class='download-all' id='downloadAllBtn' onclick='downloadAllImages()'>Download All Images</button>";
-  html += "<button class='refresh' onclick='location.reload()'>Refresh</button>";
-  html += "<button class='delete' onclick='deleteAll()'>Delete All Images</button>";
-  html += "</div>";
-  html += "<div id='downloadStatus' style='margin: 10px 0; color: #666;'></div>";
-  
-  html += "<div class='gallery' id='gallery'>";
-  html += "<p>Loading images...</p>";
-  html += "</div>";
-  
-  html += "<script>";
-  html += "let allImages = [];";
-  html += "const gallery = document.getElementById('gallery');";
-  html += "const downloadAllBtn = document.getElementById('downloadAllBtn');";
-  html += "const latestImage = document.getElementById('latestImage');";
-  html += "const latestImg = document.getElementById('latestImg');";
-  html += "const latestInfo = document.getElementById('latestInfo');";
-  html += "function loadImages() {";
-  html += "  fetch('/list')";
-  html += "    .then(response => response.json())";
-  html += "    .then(data => {";
-  html += "      allImages = data.images;";
-  html += "      if (data.images.length === 0) {";
-  html += "        gallery.innerHTML = '<p>No images found. Click Capture to take your first photo!</p>';";
-  html += "        downloadAllBtn.disabled = true;";
-  html += "        latestImage.style.display = 'none';";
-  html += "        return;";
-  html += "      }";
-  html += "      downloadAllBtn.disabled = false;";
-  html += "      gallery.innerHTML = '';";
-  html += "      const latest = data.images[data.images.length - 1];";
-  html += "      latestImg.src = '/image?n=' + latest.number;";
-  html += "      latestInfo.textContent = latest.filename + ' (' + (latest.size / 1024).toFixed(1) + ' KB)';";
-  html += "      latestImage.style.display = 'block';";
-  html += "      data.images.forEach(img => {";
-  html += "        const card = document.createElement('div');";
-  html += "        card.className = 'image-card';";
-  html += "        card.innerHTML = '<img src=\"/image?n=' + img.number + '\" alt=\"' + img.filename + '\">' +";
-  html += "                         '<a href=\"/image?n=' + img.number + '\" download=\"' + img.filename + '\">Download ' + img.filename + '</a>';";
-  html += "        gallery.appendChild(card);";
-  html += "      });";
-  html += "    })";
-  html += "    .catch(err => console.error('Error loading images:', err));";
-  html += "}";
-  html += "const status = document.getElementById('downloadStatus');";
-  html += "function downloadAllImages() {";
-  html += "  if (allImages.length === 0) {";
-  html += "    alert('No images to download!');";
-  html += "    return;";
-  html += "  }";
-  html += "  downloadAllBtn.disabled = true;";
-  html += "  status.innerHTML = 'Downloading ' + allImages.length + ' images...';";
-  html += "  let downloaded = 0;";
-  html += "  allImages.forEach((img, index) => {";
-  html += "    setTimeout(() => {";
-  html += "      const link = document.createElement('a');";
-  html += "      link.href = '/image?n=' + img.number;";
-  html += "      link.download = img.filename;";
-  html += "      link.style.display = 'none';";
-  html += "      document.body.appendChild(link);";
-  html += "      link.click();";
-  html += "      document.body.removeChild(link);";
-  html += "      downloaded++;";
-  html += "      status.innerHTML = 'Downloaded ' + downloaded + ' / ' + allImages.length + ' images...';";
-  html += "      if (downloaded === allImages.length) {";
-  html += "        status.innerHTML = 'All ' + allImages.length + ' images downloaded successfully!';";
-  html += "        downloadAllBtn.disabled = false;";
-  html += "        setTimeout(() => status.innerHTML = '', 5000);";
-  html += "      }";
-  html += "    }, index * 300);";
-  html += "  });";
-  html += "}";
-  html += "function captureImage() {";
-  html += "  status.innerHTML = 'Capturing image...';";
-  html += "  fetch('/capture')";
-  html += "    .then(() => {";
-  html += "      status.innerHTML = 'Image captured! Reloading...';";
-  html += "      setTimeout(() => location.reload(), 2000);";
-  html += "    })";
-  html += "    .catch(() => {";
-  html += "      status.innerHTML = 'Capture failed. Please try again.';";
-  html += "    });";
-  html += "}";
-  html += "function deleteAll() {";
-  html += "  if (confirm('Are you sure you want to delete ALL images?')) {";
-  html += "    fetch('/delete')";
-  html += "      .then(() => setTimeout(() => location.reload(), 1000));";
-  html += "  }";
-  html += "}";
-  html += "function changeQuality() {";
-  html += "  const value = parseInt(qualitySlider.value);";
-  html += "  fetch('/setquality', {";
-  html += "    method: 'POST',";
-  html += "    headers: {'Content-Type': 'text/plain'},";
-  html += "    body: value.toString()";
-  html += "  })";
-  html += "  .then(response => response.json())";
-  html += "  .then(data => {";
-  html += "    if (data.status === 'ok') {";
-  html += "      qualityValue.textContent = data.quality;";
-  html += "      alert('Quality set to ' + data.quality);";
-  html += "    }";
-  html += "  })";
-  html += "  .catch(err => console.error('Error setting quality:', err));";
-  html += "}";
-  html += "function changeResolution() {";
-  html += "  const select = document.getElementById('resolutionSelect');";
-  html += "  const value = select.value;";
-  html += "  fetch('/setresolution', {";
-  html += "    method: 'POST',";
-  html += "    headers: {'Content-Type': 'text/plain'},";
-  html += "    body: value";
-  html += "  })";
-  html += "  .then(response => response.json())";
-  html += "  .then(data => {";
-  html += "    if (data.status === 'ok') {";
-  html += "      alert('Resolution changed. Next capture will use this setting.');";
-  html += "    }";
-  html += "  })";
-  html += "  .catch(err => console.error('Error setting resolution:', err));";
-  html += "}";
-  html += "function changePixelFormat() {";
-  html += "  const select = document.getElementById('pixelFormatSelect');";
-  html += "  const value = select.value;";
-  html += "  fetch('/setpixelformat', {";
-  html += "    method: 'POST',";
-  html += "    headers: {'Content-Type': 'text/plain'},";
-  html += "    body: value";
-  html += "  })";
-  html += "  .then(response => response.json())";
-  html += "  .then(data => {";
-  html += "    if (data.status === 'ok') {";
-  html += "      alert('Pixel format changed. Next capture will use this setting.');";
-  html += "    }";
-  html += "  })";
-  html += "  .catch(err => console.error('Error setting pixel format:', err));";
-  html += "}";
-  html += "function changeEndianness() {";
-  html += "  const select = document.getElementById('endiannessSelect');";
-  html += "  const value = select.value;";
-  html += "  fetch('/setendianness', {";
-  html += "    method: 'POST',";
-  html += "    headers: {'Content-Type': 'text/plain'},";
-  html += "    body: value";
-  html += "  })";
-  html += "  .then(response => response.json())";
-  html += "  .then(data => {";
-  html += "    if (data.status === 'ok') {";
-  html += "      alert('Endianness changed. Next capture will use this setting.');";
-  html += "    }";
-  html += "  })";
-  html += "  .catch(err => console.error('Error setting endianness:', err));";
-  html += "}";
-  html += "const qualitySlider = document.getElementById('qualitySlider');";
-  html += "const qualityValue = document.getElementById('qualityValue');";
-  html += "qualitySlider.addEventListener('input', function() {";
-  html += "  qualityValue.textContent = this.value;";
-  html += "});";
-  html += "fetch('/getsettings')";
-  html += "  .then(response => response.json())";
-  html += "  .then(data => {";
-  html += "    document.getElementById('resolutionSelect').value = data.resolution;";
-  html += "    qualitySlider.value = data.quality;";
-  html += "    qualityValue.textContent = data.quality;";
-  html += "    document.getElementById('pixelFormatSelect').value = data.pixelFormat;";
-  html += "    document.getElementById('endiannessSelect').value = data.endianness;";
-  html += "  });";
-  html += "loadImages();";
-  html += "</script>";
-  
-  html += "</body></html>";
-  
-  server.send(200, "text/html", html);
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(1000));
+    if (!viewer.client.connected()) {
+      break;
+    }
+    
+    portENTER_CRITICAL(&streamMux);
+    StreamFrame *frame = viewer.pending;
+    viewer.pending = NULL;
+    portEXIT_CRITICAL(&streamMux);
+    if (!frame) {
+      continue;
+    }
+    
+    int headerLen = snprintf(header, sizeof(header),
+                             "--" STREAM_BOUNDARY "\r\nContent-Type: image/jpeg\r\nContent-Length: %u\r\n\r\n",
+                             (unsigned int)frame->len);
+    bool ok = viewer.client.write((const uint8_t*)header, headerLen) == (size_t)headerLen &&
+              viewer.client.write(frame->data, frame->len) == frame->len &&
+              viewer.client.write((const uint8_t*)"\r\n", 2) == 2;
+    releaseStreamFrame(frame);
+    if (!ok) {
+      break;
+    }
+  }
+  
+  portENTER_CRITICAL(&streamMux);
+  StreamFrame *leftover = viewer.pending;
+  viewer.pending = NULL;
+  viewer.active = false;
+  streamClientCount--;
+  portEXIT_CRITICAL(&streamMux);
+  if (leftover) {
+    releaseStreamFrame(leftover);
+  }
+  
+  viewer.client.stop();
+  viewer.client = WiFiClient();
+  LOG_INFO("Stream viewer disconnected (%d watching)", streamClientCount);
+  
+  viewer.task = NULL;
+  vTaskDelete(NULL);
 }
 
-void handleBurstCapture() {
-  if (!sdCardPresent) {
-    server.send(400, "application/json", "{\"status\":\"error\",\"message\":\"SD card required for burst capture\"}");
-    return;
-  }
-  if (!server.hasArg("plain")) {
-    server.send(400, "application/json", "{\"status\":\"error\",\"message\":\"Missing parameters\"}");
+// Hands an encoded frame (allocated with malloc/ps_malloc) to every viewer.
+// Takes ownership of data.
+void publishStreamFrame(uint8_t *data, size_t len) {
+  StreamFrame *frame = (StreamFrame*)malloc(sizeof(StreamFrame));
+  if (!frame) {
+    free(data);
     return;
   }
+  frame->data = data;
+  frame->len = len;
+  frame->refs = 0;
   
-  String body = server.arg("plain");
-  
-  // Parse JSON manually (simple parsing)
-  int count = 50;
-  float interval = 0.2;
+  StreamFrame *dropped[MAX_STREAM_CLIENTS];
+  TaskHandle_t wake[MAX_STREAM_CLIENTS];
+  int droppedCount = 0;
+  int wakeCount = 0;
   
-  // Extract count
-  int countIndex = body.indexOf("\"count\":");
-  if (countIndex >= 0) {
-    int countStart = body.indexOf(':', countIndex) + 1;
-    int countEnd = body.indexOf(',', countStart);
-    if (countEnd < 0) countEnd = body.indexOf('}', countStart);
-    if (countEnd > countStart) {
-      count = body.substring(countStart, countEnd).toInt();
+  portENTER_CRITICAL(&streamMux);
+  for (int i = 0; i < MAX_STREAM_CLIENTS; i++) {
+    if (streamClients[i].active && streamClients[i].task != NULL) {
+      if (streamClients[i].pending) {
+        dropped[droppedCount++] = streamClients[i].pending;  // Viewer is behind
+      }
+      streamClients[i].pending = frame;
+      frame->refs++;
+      wake[wakeCount++] = streamClients[i].task;
     }
   }
+  portEXIT_CRITICAL(&streamMux);
   
-  // Extract interval
-  int intervalIndex = body.indexOf("\"interval\":");
-  if (intervalIndex >= 0) {
-    int intervalStart = body.indexOf(':', intervalIndex) + 1;
-    int intervalEnd = body.indexOf('}', intervalStart);
-    if (intervalEnd > intervalStart) {
-      interval = body.substring(intervalStart, intervalEnd).toFloat();
+  for (int i = 0; i < wakeCount; i++) {
+    xTaskNotifyGive(wake[i]);
+  }
+  for (int i = 0; i < droppedCount; i++) {
+    releaseStreamFrame(dropped[i]);
+  }
+  if (wakeCount == 0) {
+    free(frame->data);
+    free(frame);
+  }
+}
+
+void publishStreamFrameCopy(const uint8_t *data, size_t len) {
+  if (streamClientCount == 0) {
+    return;
+  }
+  uint8_t *copy = (uint8_t*)ps_malloc(len);
+  if (!copy) {
+    return;
+  }
+  memcpy(copy, data, len);
+  publishStreamFrame(copy, len);
+}
+
+void releaseStreamFrame(StreamFrame *frame) {
+  portENTER_CRITICAL(&streamMux);
+  bool last = (--frame->refs == 0);
+  portEXIT_CRITICAL(&streamMux);
+  if (last) {
+    free(frame->data);
+    free(frame);
+  }
+}
+
+// Serves the gallery thumbnail, or the image itself if it never got one
+void handleThumb() {
+  ServerRequest request;
+  ServerResponse response;
+  webHandleImage(request, response, webBackend, true);
+}
+
+void handleCapture() {
+  if (pretriggerEnabled) {
+    if (!pretriggerFire()) {
+      server.send(503, "text/plain", "Busy - still saving the last trigger");
+      return;
     }
+    server.send(200, "text/plain", "Triggered - saving pre-trigger frames...");
+    return;
   }
   
-  // Validate
-  if (count < 1 || count > 200) {
-    server.send(400, "application/json", "{\"status\":\"error\",\"message\":\"Count must be between 1 and 200\"}");
+  // Hand the capture to the job task and answer straight away
+  if (!submitJob(JOB_CAPTURE)) {
+    server.send(503, "text/plain", "Busy - try again shortly");
     return;
   }
-  if (interval < 0.1 || interval > 5.0) {
-    server.send(400, "application/json", "{\"status\":\"error\",\"message\":\"Interval must be between 0.1 and 5.0 seconds\"}");
+  server.send(200, "text/plain", "Capturing image...");
+}
+
+// GET /delete removes every image, ?from=N&to=M a range of numbers and
+// ?n=1,5,9 a list of them. The delete runs in the background: progress is at
+// /deletestatus, and /delete?cancel stops it after the current batch.
+void handleDelete() {
+  if (server.hasArg("cancel")) {
+    if (!deleteInProgress) {
+      server.send(409, "text/plain", "No delete in progress");
+      return;
+    }
+    deleteCancel = true;
+    server.send(200, "text/plain", "Cancelling delete");
     return;
   }
   
-  // Send response immediately
-  server.send(200, "application/json", "{\"status\":\"ok\",\"count\":" + String(count) + ",\"interval\":" + String(interval) + "}");
-  
-  // Small delay to ensure response is sent
-  delay(10);
-  
-  // Set burst status
-  burstInProgress = true;
-  burstCurrent = 0;
-  burstTotal = count;
-  
-  // Perform burst capture
-  Serial.printf("\n=== Starting Burst Capture ===\n");
-  Serial.printf("Count: %d photos\n", count);
-  Serial.printf("Interval: %.2f seconds\n", interval);
-  Serial.flush();
-  
-  unsigned long intervalMs = (unsigned long)(interval * 1000);
-  
-  for (int i = 0; i < count; i++) {
-    burstCurrent = i + 1;
-    Serial.printf("\nBurst capture %d/%d\n", i + 1, count);
-    Serial.flush();
-    
-    captureImage();
-    
-    // Handle web server during delay to prevent timeout
-    if (i < count - 1) { // Don't delay after last capture
-      unsigned long startTime = millis();
-      while (millis() - startTime < intervalMs) {
-        if (wifiConnected) {
-          server.handleClient();
-        }
-        delay(10);
+  uint32_t from = server.hasArg("from") ? server.arg("from").toInt() : 1;
+  uint32_t to = server.hasArg("to") ? server.arg("to").toInt() : 0xFFFFFFFF;
+  std::vector<uint32_t> numbers;
+  if (server.hasArg("n")) {
+    String list = server.arg("n");
+    int start = 0;
+    while (start < (int)list.length()) {
+      int comma = list.indexOf(',', start);
+      if (comma < 0) {
+        comma = list.length();
+      }
+      uint32_t number = list.substring(start, comma).toInt();
+      if (number > 0) {
+        numbers.push_back(number);
       }
+      start = comma + 1;
+    }
+    if (numbers.empty()) {
+      server.send(400, "text/plain", "No image numbers given");
+      return;
     }
   }
   
-  burstInProgress = false;
-  burstCurrent = 0;
-  burstTotal = 0;
-  
-  Serial.println("\n=== Burst Capture Complete ===");
-  Serial.flush();
+  if (!startDelete(from, to, numbers)) {
+    server.send(503, "text/plain", deleteInProgress ? "A delete is already in progress" : "Busy - try again shortly");
+    return;
+  }
+  server.send(200, "text/plain", "Deleting images");
 }
 
-void handleBurstStatus() {
+void handleDeleteStatus() {
   String json = "{";
-  json += "\"inProgress\":" + String(burstInProgress ? "true" : "false") + ",";
-  json += "\"current\":" + String(burstCurrent) + ",";
-  json += "\"total\":" + String(burstTotal);
+  json += "\"inProgress\":" + String(deleteInProgress ? "true" : "false") + ",";
+  json += "\"total\":" + String((uint32_t)deleteTotal) + ",";
+  json += "\"done\":" + String((uint32_t)deleteDone) + ",";
+  json += "\"failed\":" + String((uint32_t)deleteFailed) + ",";
+  json += "\"cancelled\":" + String(deleteCancelled ? "true" : "false");
   json += "}";
   server.send(200, "application/json", json);
 }
 
-void handleImage() {
-  if (!server.hasArg("n")) {
-    server.send(400, "text/plain", "Missing image number parameter");
-    return;
+// GET /list[?after=N][&limit=L] and /list?since=TOKEN (see web_routes.cpp).
+// The JSON is sent in chunks, copying a few entries out of the index at a
+// time, so neither the index nor the heap is tied up by a big card.
+void handleListJSON() {
+  ServerRequest request;
+  ServerResponse response;
+  webHandleList(request, response, webBackend);
+}
+
+bool ServerRequest::hasArg(const char *name) {
+  return server.hasArg(name);
+}
+
+std::string ServerRequest::arg(const char *name) {
+  return server.arg(name).c_str();
+}
+
+bool ServerRequest::hasHeader(const char *name) {
+  return server.hasHeader(name);
+}
+
+std::string ServerRequest::header(const char *name) {
+  return server.header(name).c_str();
+}
+
+void ServerResponse::sendHeader(const char *name, const std::string &value) {
+  headers.push_back(std::make_pair(std::string(name), value));
+}
+
+void ServerResponse::send(int code, const char *type, const std::string &body) {
+  for (size_t i = 0; i < headers.size(); i++) {
+    server.sendHeader(headers[i].first.c_str(), headers[i].second.c_str());
   }
-  
-  int imageNum = server.arg("n").toInt();
-  String filename = "/" + String(imageNum) + ".jpg";
-  
-  if (!sdCardPresent || !SD.exists(filename.c_str())) {
-    server.send(404, "text/plain", "Image not found");
-    return;
+  if (type) {
+    server.send(code, type, body.c_str());
+  } else {
+    server.send(code);
   }
-  
-  File file = SD.open(filename.c_str(), FILE_READ);
-  if (!file) {
-    server.send(500, "text/plain", "Failed to open image");
-    return;
+}
+
+// Writes the status line and headers straight to the client, as /archive
+// does, and leaves the client to the body. Only used for 200 and 206.
+HttpConnection *ServerResponse::detach(int code, const char *type, int64_t length) {
+  WiFiClient client = server.client();
+  if (!client.connected()) {
+    return NULL;
   }
-  
-  server.streamFile(file, "image/jpeg");
+  String head = "HTTP/1.1 " + String(code) + (code == 206 ? " Partial Content\r\n" : " OK\r\n");
+  head += "Content-Type: " + String(type) + "\r\n";
+  if (length == WEB_CHUNKED) {
+    head += "Transfer-Encoding: chunked\r\n";
+  } else {
+    head += "Content-Length: " + String((uint32_t)length) + "\r\n";
+  }
+  for (size_t i = 0; i < headers.size(); i++) {
+    head += String(headers[i].first.c_str()) + ": " + headers[i].second.c_str() + "\r\n";
+  }
+  head += "Connection: close\r\n\r\n";
+  client.print(head);
+  return new ClientConnection(client);
+}
+
+size_t ClientConnection::write(const uint8_t *data, size_t len) {
+  return client.connected() ? client.write(data, len) : 0;
+}
+
+void ClientConnection::close() {
+  client.stop();
+}
+
+CardFile::~CardFile() {
   file.close();
 }
 
-void handleCapture() {
-  // Send response immediately, then capture in background
-  server.send(200, "text/plain", "Capturing image...");
-  // Small delay to ensure response is sent before starting capture
-  delay(10);
-  captureImage();
+bool CardFile::seek(uint32_t position) {
+  return file.seek(position);
 }
 
-void handleDelete() {
-  deleteAllImages();
-  server.send(200, "text/plain", "All images deleted");
+size_t CardFile::read(uint8_t *buf, size_t len) {
+  return file.read(buf, len);
 }
 
-void handleListJSON() {
-  String json = "{\"images\":[";
-  bool first = true;
+bool CardBackend::cardPresent() {
+  return sdCardPresent;
+}
+
+bool CardBackend::lookup(uint32_t number, ImageInfo &info) {
+  return indexLookup(number, info);
+}
+
+int CardBackend::listAfter(uint32_t after, ImageInfo *out, int max, bool *more) {
   int count = 0;
-  
-  if (!sdCardPresent) {
-    server.send(200, "application/json", "{\"images\":[]}");
-    return;
+  xSemaphoreTake(indexMutex, portMAX_DELAY);
+  std::vector<ImageInfo>::iterator it = std::upper_bound(imageIndex.begin(), imageIndex.end(), after,
+    [](uint32_t n, const ImageInfo &entry) { return n < entry.number; });
+  while (it != imageIndex.end() && count < max) {
+    out[count++] = *it++;
   }
+  *more = it != imageIndex.end();
+  xSemaphoreGive(indexMutex);
+  return count;
+}
+
+uint32_t CardBackend::generation() {
+  xSemaphoreTake(indexMutex, portMAX_DELAY);
+  uint32_t generation = indexGeneration;
+  xSemaphoreGive(indexMutex);
+  return generation;
+}
+
+std::string CardBackend::token(uint32_t generation) {
+  return indexToken(generation).c_str();
+}
+
+// The change log can't answer for a token from another boot, from before
+// the index was last rebuilt, or older than the log holds
+bool CardBackend::changesSince(const std::string &token, std::vector<uint32_t> &numbers, uint32_t *generation) {
+  String since = token.c_str();
+  int dash = since.indexOf('-');
+  uint32_t bootId = strtoul(since.substring(0, dash > 0 ? dash : 0).c_str(), NULL, 16);
+  uint32_t from = dash > 0 ? since.substring(dash + 1).toInt() : 0;
   
-  for (int i = 1; i <= 10000; i++) {
-    String filename = "/" + String(i) + ".jpg";
-    if (SD.exists(filename.c_str())) {
-      File file = SD.open(filename.c_str(), FILE_READ);
-      size_t fileSize = 0;
-      if (file) {
-        fileSize = file.size();
-        file.close();
-      }
-      String foundFilename = String(i) + ".jpg";
-      if (!first) json += ",";
-      json += "{\"number\":" + String(i) + ",\"filename\":\"" + foundFilename + "\",\"size\":" + String(fileSize) + "}";
-      first = false;
-      count++;
-    } else if (count > 0) {
-      break;
+  xSemaphoreTake(indexMutex, portMAX_DELAY);
+  *generation = indexGeneration;
+  bool reset = dash <= 0 || bootId != indexBootId || from < indexResetGeneration ||
+               from > *generation || *generation - from > INDEX_CHANGE_LOG_SIZE;
+  if (!reset) {
+    for (uint32_t g = from + 1; g <= *generation; g++) {
+      numbers.push_back(indexChanges[g % INDEX_CHANGE_LOG_SIZE].number);
+    }
+  }
+  xSemaphoreGive(indexMutex);
+  return !reset;
+}
+
+WebFile *CardBackend::openImage(const ImageInfo &info, bool thumb, uint32_t *offset, uint32_t *length) {
+  File file;
+  *offset = 0;
+  if (!thumb) {
+    if (!openIndexedImage(info, file, offset, length)) {
+      return NULL;
+    }
+  } else if (info.burstId != 0) {
+    if (!openBurstFrame(info.burstId, info.frame, true, file, offset, length)) {
+      return NULL;
+    }
+  } else {
+    String filename = (info.flags & IMAGE_FLAG_THUMB) ? thumbFilename(info.number) : imageFilename(info.number);
+    file = SD_CARD.open(filename.c_str(), FILE_READ);
+    if (!file) {
+      return NULL;
+    }
+    *length = file.size();
+  }
+  return new CardFile(file);
+}
+
+bool CardBackend::startBody(const WebBodyJob &job) {
+  return webBodyQueue && xQueueSend(webBodyQueue, &job, 0) == pdTRUE;
+}
+
+// Sends queued bodies one after another through the buffer it was given
+void webSenderTask(void *param) {
+  uint8_t *buf = (uint8_t*)param;
+  WebBodyJob job;
+  while (true) {
+    if (xQueueReceive(webBodyQueue, &job, portMAX_DELAY) == pdTRUE) {
+      webSendBody(job, buf, WEB_SENDER_BUFFER_SIZE);
     }
   }
-  
-  json += "]}";
-  server.send(200, "application/json", json);
 }
 
 void handleSetQuality() {
@@ -1386,14 +5035,14 @@ void handleSetResolution() {
         return;
     }
     
-    // Only reinit if resolution actually changed
+    // Only reconfigure if resolution actually changed
     if (currentFrameSize != newSize) {
       currentFrameSize = newSize;
-      Serial.println("Resolution changed - reinitializing camera...");
-      Serial.flush();
-      esp_camera_deinit();
-      delay(100); // Brief delay before reinit
-      initCamera();
+      LOG_INFO("Resolution changed - camera will be reconfigured");
+      if (!submitJob(JOB_REINIT_CAMERA)) {
+        server.send(503, "application/json", "{\"status\":\"error\",\"message\":\"Busy\"}");
+        return;
+      }
     }
     String json = "{\"status\":\"ok\",\"resolution\":" + String(res) + "}";
     server.send(200, "application/json", json);
@@ -1419,11 +5068,11 @@ void handleSetPixelFormat() {
     // Only reinit if format actually changed
     if (currentPixelFormat != newFormat) {
       currentPixelFormat = newFormat;
-      Serial.println("Pixel format changed - reinitializing camera...");
-      Serial.flush();
-      esp_camera_deinit();
-      delay(100); // Brief delay before reinit
-      initCamera();
+      LOG_INFO("Pixel format changed - camera will be reinitialized");
+      if (!submitJob(JOB_REINIT_CAMERA)) {
+        server.send(503, "application/json", "{\"status\":\"error\",\"message\":\"Busy\"}");
+        return;
+      }
     }
     String json = "{\"status\":\"ok\",\"pixelFormat\":" + String(format) + "}";
     server.send(200, "application/json", json);
@@ -1466,9 +5115,21 @@ void handleGetSettings() {
   
   int endiannessValue = currentBigEndian ? 1 : 0;
   
+  // Device details the page shows alongside the settings
+  uint64_t totalMB = 0;
+  uint64_t usedMB = 0;
+  if (sdCardPresent) {
+    totalMB = SD_CARD.totalBytes() / (1024 * 1024);
+    usedMB = SD_CARD.usedBytes() / (1024 * 1024);
+  }
+  
   String json = "{\"quality\":" + String(currentQuality) + 
                 ",\"resolution\":" + String(resValue) + 
                 ",\"pixelFormat\":" + String(pixelFormatValue) + 
-                ",\"endianness\":" + String(endiannessValue) + "}";
+                ",\"endianness\":" + String(endiannessValue) +
+                ",\"ip\":\"" + WiFi.localIP().toString() + "\"" +
+                ",\"sdCard\":" + String(sdCardPresent ? "true" : "false") +
+                ",\"usedMB\":" + String((uint32_t)usedMB) +
+                ",\"totalMB\":" + String((uint32_t)totalMB) + "}";
   server.send(200, "application/json", json);
 }
@@ -0,0 +1,249 @@
+// Generated by scripts/embed_ui.py from web/index.html - do not edit
+#pragma once
+
+#define UI_INDEX_ETAG "\"1095e86cabae7b49\""
+
+const size_t uiIndexGzLen = 3845;  // 13434 bytes uncompressed
+const uint8_t uiIndexGz[] PROGMEM = {
+  0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0xdd, 0x1b, 0x6b, 0x57, 0xdb, 0x46,
+  0xf6, 0x7b, 0xce, 0xe1, 0x3f, 0x0c, 0xec, 0xd9, 0x48, 0x3a, 0x6b, 0xcb, 0x36, 0x0f, 0x37, 0x31,
+  0xb6, 0x39, 0x40, 0x21, 0x65, 0x97, 0x24, 0x34, 0xd0, 0x9e, 0xee, 0xb6, 0xfd, 0x30, 0x48, 0x63,
+  0x7b, 0x8a, 0x2c, 0xa9, 0xd2, 0x18, 0x43, 0x73, 0xf8, 0xef, 0x7b, 0xef, 0x3c, 0xa4, 0x91, 0x2d,
+  0xdb, 0xd0, 0xa6, 0xfd, 0xd0, 0xb6, 0x21, 0x48, 0x73, 0xe7, 0xbe, 0x9f, 0x33, 0x6a, 0x7f, 0xfb,
+  0xeb, 0x8f, 0xa7, 0x37, 0xff, 0xbd, 0x3a, 0x23, 0x13, 0x31, 0x8d, 0x86, 0x7d, 0xfd, 0x93, 0xd1,
+  0x70, 0xb8, 0xf5, 0xaa, 0x3f, 0x65, 0x82, 0x92, 0x98, 0x4e, 0xd9, 0xc0, 0xb9, 0xe7, 0x6c, 0x9e,
+  0x26, 0x99, 0x70, 0x48, 0x90, 0xc4, 0x82, 0xc5, 0x62, 0xe0, 0xcc, 0x79, 0x28, 0x26, 0x83, 0x90,
+  0xdd, 0xf3, 0x80, 0x35, 0xe5, 0x43, 0x83, 0xf0, 0x98, 0x0b, 0x4e, 0xa3, 0x66, 0x1e, 0xd0, 0x88,
+  0x0d, 0x3a, 0x0e, 0x62, 0x11, 0x5c, 0x44, 0x6c, 0xf8, 0xc3, 0xc5, 0xf1, 0x47, 0x72, 0x0a, 0xb8,
+  0x32, 0x4a, 0xde, 0xd1, 0x28, 0x62, 0xd9, 0x63, 0xbf, 0xa5, 0x96, 0x00, 0x26, 0x17, 0x8f, 0xf2,
+  0x97, 0xdb, 0x24, 0x7c, 0x24, 0x9f, 0xc9, 0x08, 0x68, 0x34, 0x47, 0x74, 0xca, 0xa3, 0xc7, 0x1e,
+  0x39, 0xce, 0x00, 0x63, 0x83, 0xe4, 0x34, 0xce, 0x9b, 0x39, 0xcb, 0xf8, 0xe8, 0x90, 0x4c, 0x69,
+  0x36, 0xe6, 0x71, 0x8f, 0xec, 0xb6, 0xd3, 0x87, 0x43, 0x72, 0x4b, 0x83, 0xbb, 0x71, 0x96, 0xcc,
+  0xe2, 0xb0, 0x47, 0xfe, 0x31, 0x3a, 0xc0, 0x7f, 0x0f, 0xc9, 0xd3, 0xd6, 0xab, 0x49, 0x07, 0x50,
+  0x05, 0x49, 0x94, 0x64, 0xf0, 0x7e, 0x6f, 0x6f, 0x4f, 0xbe, 0xf4, 0x91, 0xff, 0x2c, 0x89, 0x72,
+  0x58, 0xb3, 0xd1, 0x90, 0xb6, 0x5c, 0xbe, 0x9d, 0x09, 0x91, 0xc4, 0xb0, 0x96, 0xd2, 0x30, 0xe4,
+  0xf1, 0xb8, 0x47, 0x3a, 0xb8, 0xa8, 0x08, 0x19, 0xf8, 0x03, 0x7c, 0x90, 0x3c, 0xe6, 0xfc, 0x37,
+  0x06, 0x20, 0x5d, 0x7c, 0x11, 0xcc, 0xb2, 0x1c, 0x49, 0xa5, 0x09, 0x07, 0x0d, 0x65, 0x9a, 0x1a,
+  0x4d, 0xc5, 0x2c, 0x63, 0x80, 0xb0, 0xc2, 0xe5, 0xfe, 0xe9, 0xf1, 0xf9, 0x01, 0x50, 0xd4, 0xdc,
+  0xcd, 0x27, 0x5c, 0x30, 0x10, 0x24, 0xc9, 0x42, 0x06, 0x8f, 0x71, 0x12, 0x17, 0x4f, 0xcd, 0x8c,
+  0x86, 0x7c, 0x96, 0x6b, 0xa2, 0x88, 0x32, 0x64, 0x11, 0x13, 0x4b, 0x18, 0x47, 0xfb, 0xfb, 0x7b,
+  0x7b, 0xdd, 0xdf, 0x87, 0x31, 0x63, 0xa3, 0x8c, 0xe5, 0x93, 0x45, 0x94, 0xbb, 0x9d, 0xb7, 0xdd,
+  0xf3, 0xbd, 0xdf, 0xc9, 0x64, 0x32, 0x8f, 0xa3, 0x84, 0x86, 0x4d, 0x30, 0xf5, 0x22, 0xde, 0xf3,
+  0xf3, 0xb7, 0x6f, 0xda, 0xed, 0x3f, 0x8e, 0xb7, 0x17, 0xf2, 0x9c, 0xde, 0x46, 0x2c, 0x5c, 0x24,
+  0x10, 0x04, 0x41, 0x69, 0x8e, 0x38, 0x11, 0x08, 0x9c, 0xcc, 0x59, 0xa8, 0x50, 0x8c, 0x95, 0xf7,
+  0xc1, 0x26, 0xd8, 0x9f, 0x46, 0x14, 0x5c, 0x6c, 0x9c, 0x71, 0x58, 0xc4, 0x9f, 0x4d, 0xc1, 0xa6,
+  0xf0, 0x4e, 0xb0, 0x26, 0x70, 0x37, 0x9b, 0xc6, 0x40, 0x3b, 0x63, 0x29, 0xa3, 0xc2, 0xa5, 0x33,
+  0x91, 0x34, 0x47, 0x3c, 0x02, 0x57, 0x9c, 0xf2, 0x78, 0x4a, 0x1f, 0xdc, 0xdd, 0x36, 0x78, 0x45,
+  0x83, 0x74, 0x46, 0x99, 0xe7, 0xc1, 0x6e, 0x9a, 0x82, 0x27, 0x1c, 0x94, 0x7e, 0xd2, 0x14, 0x49,
+  0x6a, 0x5c, 0x14, 0xe9, 0xf2, 0x29, 0x1d, 0x03, 0x5a, 0x9a, 0x2d, 0xf2, 0xab, 0x15, 0x50, 0xf1,
+  0xb8, 0x25, 0x0d, 0xbc, 0x51, 0xef, 0x1e, 0x9a, 0xf9, 0x84, 0x82, 0x12, 0x7a, 0xa4, 0x4d, 0x76,
+  0xc1, 0x31, 0xf7, 0xe1, 0x4f, 0x36, 0xbe, 0xa5, 0x6e, 0xbb, 0x21, 0xff, 0xf5, 0x3b, 0xde, 0x12,
+  0x35, 0x3e, 0x1d, 0x03, 0x45, 0x19, 0xa1, 0x88, 0xbc, 0xfd, 0xcf, 0x43, 0x32, 0x61, 0x7c, 0x3c,
+  0x11, 0x3d, 0x82, 0x42, 0xad, 0x56, 0xb6, 0x85, 0x83, 0xda, 0xea, 0xba, 0x8d, 0x92, 0xe0, 0xae,
+  0x2a, 0xa6, 0xdc, 0x23, 0xd8, 0x03, 0xea, 0x9a, 0x8f, 0x21, 0x46, 0x02, 0xa6, 0x82, 0xc0, 0xc4,
+  0x9f, 0x71, 0x26, 0x09, 0x13, 0xb2, 0x20, 0xc9, 0xa8, 0xe0, 0x49, 0x6c, 0xec, 0x2d, 0xc9, 0xc5,
+  0xa3, 0x64, 0x93, 0x6a, 0x0e, 0x56, 0xa9, 0x46, 0x33, 0x73, 0x9b, 0x40, 0xfc, 0x4e, 0x6d, 0xb5,
+  0xe7, 0x4c, 0x08, 0xd8, 0x9b, 0xff, 0x89, 0x98, 0x27, 0x7b, 0x45, 0x32, 0x51, 0xda, 0x68, 0x2f,
+  0x00, 0x84, 0xfc, 0xbe, 0x84, 0x30, 0x88, 0x3a, 0x07, 0x4b, 0x88, 0x22, 0x7a, 0xcb, 0x22, 0x93,
+  0xff, 0xe6, 0xda, 0x46, 0xb7, 0x49, 0x14, 0x16, 0x5c, 0x64, 0xea, 0x5d, 0x67, 0x99, 0x89, 0x1c,
+  0xd2, 0x42, 0x20, 0xec, 0xcc, 0xb5, 0x94, 0xa6, 0xf6, 0x97, 0x36, 0xf1, 0x38, 0x9d, 0x89, 0x1f,
+  0xc5, 0x63, 0x0a, 0x29, 0x3e, 0xa3, 0xf1, 0x98, 0x39, 0x3f, 0x97, 0xae, 0x22, 0xfd, 0x7b, 0x61,
+  0xc3, 0x72, 0x7e, 0x04, 0x2a, 0x9a, 0x1d, 0xcd, 0x62, 0xc4, 0x46, 0x62, 0x1d, 0x71, 0x8c, 0xae,
+  0x5c, 0x34, 0xa5, 0x73, 0x7d, 0x79, 0xa3, 0x54, 0xb0, 0x2b, 0xcf, 0x87, 0x58, 0x6d, 0x56, 0xbc,
+  0x1f, 0x5f, 0x98, 0x08, 0xd8, 0x6f, 0xd7, 0x45, 0x9b, 0x31, 0x4d, 0xbf, 0xa5, 0x2a, 0x53, 0xbf,
+  0x25, 0x6b, 0x62, 0x1f, 0xeb, 0x13, 0xd6, 0xab, 0x49, 0xa7, 0xbe, 0xa0, 0xc1, 0xfb, 0xad, 0x57,
+  0xb0, 0x8e, 0x06, 0x0f, 0x22, 0x9a, 0xe7, 0x03, 0xc7, 0x66, 0xc8, 0x21, 0x3c, 0x34, 0x6f, 0x2e,
+  0xd4, 0x0b, 0x89, 0x7f, 0xe0, 0x7c, 0x41, 0x2d, 0xd4, 0x45, 0x61, 0x11, 0xba, 0x32, 0xda, 0x64,
+  0x59, 0x06, 0xa7, 0xd5, 0xb4, 0xab, 0x9e, 0xeb, 0x0c, 0x2f, 0x25, 0x7f, 0x44, 0x32, 0x08, 0x22,
+  0xed, 0x21, 0x34, 0x6a, 0xd2, 0xe6, 0x7d, 0x0c, 0x9c, 0x67, 0xc1, 0xc0, 0x71, 0x08, 0x8d, 0xa0,
+  0x17, 0xd0, 0x5b, 0x78, 0x45, 0xa6, 0xdf, 0xa9, 0x77, 0xc9, 0x5d, 0x6a, 0x53, 0x83, 0xbc, 0xe0,
+  0xd4, 0x31, 0xab, 0xdc, 0xce, 0x64, 0x98, 0x6e, 0xb7, 0x0b, 0x7b, 0xfb, 0xad, 0x14, 0xf7, 0xb7,
+  0xc0, 0x02, 0x1b, 0x4c, 0xa1, 0x11, 0xd6, 0xa8, 0x6b, 0x93, 0x7e, 0xf8, 0x3d, 0x23, 0xdf, 0x43,
+  0x43, 0xb4, 0xa4, 0x1c, 0x58, 0x58, 0x56, 0x0d, 0x42, 0x63, 0xfb, 0x54, 0x50, 0xac, 0x1a, 0xa3,
+  0xe8, 0x2a, 0xda, 0x32, 0x1b, 0x2b, 0xa1, 0x24, 0x07, 0x3a, 0xd6, 0x34, 0xf3, 0xba, 0x48, 0x3b,
+  0x05, 0xa5, 0x13, 0x11, 0x3b, 0x24, 0x89, 0x83, 0x88, 0x07, 0x77, 0x20, 0x46, 0x32, 0x1e, 0x47,
+  0x0c, 0x89, 0x21, 0x67, 0xae, 0xe7, 0x0c, 0xaf, 0x05, 0xcd, 0x04, 0xb1, 0x98, 0x55, 0xf8, 0x56,
+  0x6a, 0xc7, 0xc4, 0xb8, 0x96, 0x7e, 0xa8, 0x7d, 0xfb, 0x5a, 0xbf, 0x36, 0xc2, 0xaa, 0xad, 0x7d,
+  0x99, 0xaa, 0x86, 0x9f, 0x58, 0x0e, 0x65, 0x52, 0x25, 0xf2, 0x7e, 0x4b, 0xbd, 0xc3, 0x76, 0x4e,
+  0xe5, 0x22, 0xe4, 0x34, 0x2b, 0x20, 0xae, 0xe5, 0x4b, 0x89, 0x3d, 0x49, 0xf1, 0x05, 0xb9, 0xa7,
+  0xd1, 0x0c, 0xf4, 0xd1, 0x76, 0x86, 0x6f, 0xbb, 0x0f, 0x6f, 0xbb, 0xc4, 0xfd, 0xf6, 0xdb, 0xef,
+  0xdf, 0x1d, 0x43, 0x3b, 0xd5, 0x7e, 0xe8, 0xec, 0xb6, 0xbd, 0x7e, 0x4b, 0xc1, 0x2d, 0xef, 0x80,
+  0xc6, 0xb2, 0xf3, 0x55, 0xf7, 0xa1, 0xb3, 0xbf, 0x0f, 0x7b, 0x4e, 0x2f, 0xce, 0xd7, 0x80, 0xee,
+  0x3a, 0xc3, 0xdd, 0xfd, 0xf6, 0x03, 0xfc, 0x01, 0x50, 0xc4, 0xbe, 0xb7, 0x2b, 0x9f, 0xd6, 0x6c,
+  0xd9, 0x73, 0x86, 0x5d, 0xd8, 0xb2, 0xff, 0x06, 0xb6, 0xc0, 0x8e, 0x35, 0x90, 0xfb, 0xce, 0x10,
+  0x3a, 0x99, 0x87, 0x6e, 0x1b, 0x20, 0xaf, 0xd7, 0x83, 0x1e, 0x00, 0xcb, 0xed, 0xdd, 0xfd, 0x87,
+  0xaf, 0xba, 0x6f, 0x88, 0xfb, 0xc3, 0x5a, 0xd0, 0x2e, 0x80, 0xee, 0xbe, 0x01, 0x1d, 0x00, 0x3c,
+  0xe0, 0x5d, 0x0f, 0xfc, 0x15, 0x00, 0x03, 0x7d, 0x54, 0x18, 0x30, 0xf1, 0xdd, 0x22, 0x70, 0x4b,
+  0x99, 0xc2, 0x72, 0xa7, 0xc2, 0x63, 0x82, 0x09, 0x26, 0xfc, 0xd2, 0x82, 0xe8, 0x33, 0xc7, 0x69,
+  0x1a, 0x3d, 0xd6, 0x78, 0x4a, 0xd5, 0xea, 0xff, 0xbe, 0x3a, 0x7b, 0x47, 0xbe, 0x9d, 0x41, 0xd0,
+  0x88, 0x47, 0xe2, 0xb6, 0x9b, 0xdd, 0xbd, 0x06, 0xc1, 0x06, 0x2b, 0x1b, 0x4c, 0x20, 0xb8, 0x59,
+  0x46, 0x7e, 0x55, 0x6b, 0x5e, 0xc5, 0x29, 0x64, 0xad, 0x21, 0x76, 0xad, 0x91, 0x0e, 0xa2, 0x61,
+  0xaf, 0x23, 0x0e, 0x89, 0xc0, 0xc1, 0xde, 0x0a, 0x3d, 0x02, 0x73, 0x05, 0x68, 0x62, 0xcf, 0x29,
+  0x4c, 0xbe, 0x2b, 0x3d, 0x27, 0x4f, 0x69, 0x6c, 0x6f, 0xfb, 0x1e, 0x57, 0x51, 0x5f, 0x20, 0x29,
+  0x2c, 0xad, 0x96, 0x53, 0xb3, 0xfb, 0x7c, 0x21, 0x4f, 0x31, 0xad, 0x90, 0xf3, 0x24, 0x9b, 0x52,
+  0xb1, 0xca, 0xb9, 0x53, 0xfe, 0xc0, 0x22, 0x05, 0xb2, 0xce, 0xbb, 0x3f, 0xbd, 0x3b, 0x21, 0x2e,
+  0x2a, 0x6d, 0xbd, 0x4b, 0xbf, 0xcb, 0xe8, 0xa3, 0x1c, 0x9c, 0xd6, 0x7a, 0x33, 0x20, 0x3b, 0xe8,
+  0x1e, 0xbc, 0xc8, 0xc6, 0x57, 0x25, 0x9b, 0xcf, 0x97, 0xff, 0x2c, 0x0e, 0x39, 0x8d, 0x63, 0x96,
+  0xe7, 0xab, 0xa4, 0x67, 0x05, 0xc4, 0x3a, 0xe1, 0x2f, 0xb9, 0x80, 0x21, 0x8f, 0x28, 0x74, 0x6b,
+  0xe5, 0x3f, 0xe1, 0xe3, 0x1a, 0xb0, 0x8d, 0xd2, 0x95, 0x8c, 0xd6, 0x0a, 0x97, 0x9a, 0xb4, 0x6b,
+  0x37, 0x23, 0xbb, 0x8b, 0x85, 0x63, 0xb9, 0x99, 0xad, 0x74, 0x33, 0x6d, 0x99, 0x91, 0x3f, 0xc6,
+  0xd1, 0x23, 0xa1, 0x40, 0x80, 0xb3, 0x9c, 0x40, 0xaa, 0x56, 0xa6, 0x80, 0x2e, 0x07, 0x35, 0xeb,
+  0x93, 0xef, 0x72, 0x46, 0x2a, 0xd2, 0xe2, 0x0a, 0x39, 0xbb, 0xbe, 0xda, 0xdb, 0x6d, 0xbd, 0xe7,
+  0x41, 0x96, 0x5c, 0x3d, 0x8a, 0x49, 0x12, 0xfb, 0x64, 0xeb, 0x15, 0x82, 0x96, 0xe2, 0x12, 0x3e,
+  0x22, 0x8f, 0xc9, 0x2c, 0x23, 0x69, 0x96, 0x04, 0x20, 0x07, 0xa4, 0x5b, 0x92, 0x27, 0x23, 0x31,
+  0xa7, 0x30, 0x39, 0x66, 0xec, 0xd7, 0x19, 0x87, 0x2c, 0x4a, 0xb8, 0x20, 0x2e, 0xf3, 0xc7, 0x3e,
+  0x8c, 0xc2, 0xc9, 0x94, 0x91, 0xf7, 0x97, 0x64, 0x94, 0x41, 0x8a, 0x9e, 0x27, 0xd9, 0x5d, 0xee,
+  0xf9, 0xa8, 0xa9, 0xf4, 0x0b, 0xcb, 0x0b, 0x63, 0x79, 0x96, 0xc4, 0xe3, 0xe1, 0x87, 0x44, 0xb0,
+  0x1e, 0xb6, 0x42, 0xf2, 0x89, 0x9c, 0xc0, 0x64, 0x25, 0x88, 0x99, 0x6c, 0x79, 0x4e, 0xe8, 0x3d,
+  0xe5, 0x11, 0x4e, 0x62, 0x24, 0xb9, 0x87, 0xe8, 0xff, 0xe6, 0xe6, 0xe6, 0x8a, 0xd0, 0x9c, 0xcc,
+  0x19, 0xcc, 0x7e, 0x14, 0x3b, 0x53, 0x9c, 0xe0, 0xc1, 0x8b, 0x82, 0x24, 0x64, 0xc3, 0xab, 0x8f,
+  0xd7, 0x37, 0x04, 0xec, 0x03, 0x38, 0x34, 0x8a, 0x7e, 0x4b, 0x2e, 0x40, 0xdb, 0x29, 0x26, 0x1a,
+  0xe8, 0xf3, 0x4e, 0x00, 0xbd, 0x90, 0xd8, 0xe9, 0x1d, 0xb4, 0x1b, 0x3b, 0x72, 0x9c, 0x06, 0x37,
+  0xd9, 0xe9, 0xb5, 0xfd, 0xdd, 0x27, 0x0d, 0xdd, 0x00, 0x2d, 0x82, 0x76, 0x0d, 0xf8, 0x14, 0xfe,
+  0xda, 0xe9, 0xed, 0x80, 0x42, 0x76, 0x0c, 0x84, 0xd4, 0x3e, 0x25, 0x9f, 0x8e, 0xdf, 0x13, 0x49,
+  0x8d, 0x50, 0xc8, 0x3e, 0x13, 0x06, 0xec, 0xc4, 0x30, 0x18, 0x3a, 0xb9, 0x52, 0x1f, 0x81, 0x39,
+  0x84, 0x35, 0x14, 0x6d, 0x50, 0xff, 0x18, 0x34, 0x9d, 0x23, 0xa4, 0x42, 0xac, 0xf8, 0xcc, 0x05,
+  0x15, 0xb3, 0x5c, 0xa3, 0x45, 0xf3, 0x5d, 0x65, 0xac, 0x29, 0xa0, 0x15, 0x1f, 0x83, 0xb4, 0x48,
+  0x19, 0x95, 0x00, 0xe5, 0xd3, 0x96, 0x40, 0x89, 0x99, 0x66, 0x4c, 0xc3, 0x15, 0xbb, 0xa5, 0xf6,
+  0x72, 0x32, 0x03, 0x0f, 0x40, 0x6e, 0x60, 0x4c, 0xcd, 0xa0, 0xeb, 0x00, 0x75, 0xca, 0x6a, 0x6b,
+  0x8a, 0x70, 0x83, 0xd0, 0x38, 0x24, 0xfd, 0x5b, 0xa8, 0xb0, 0xb2, 0xec, 0x83, 0x47, 0x0f, 0x09,
+  0x34, 0x84, 0x39, 0x6e, 0xe2, 0x99, 0xe2, 0x5d, 0x3a, 0x21, 0x22, 0xd1, 0x23, 0x6d, 0xe9, 0x04,
+  0x26, 0xa2, 0x6b, 0x0b, 0x3d, 0xce, 0x59, 0xaa, 0xc9, 0x1a, 0x1a, 0x0b, 0x5f, 0x5c, 0x91, 0xe3,
+  0x30, 0x44, 0xd9, 0x2d, 0x3b, 0x97, 0xc9, 0x96, 0xa7, 0x7a, 0x15, 0xfb, 0x2b, 0x99, 0x67, 0x8d,
+  0xb3, 0x15, 0x18, 0xae, 0x05, 0x4c, 0x74, 0x63, 0x56, 0xbb, 0x3d, 0x57, 0x6b, 0xb2, 0x8f, 0xb3,
+  0x11, 0xd4, 0xb3, 0x67, 0x0e, 0x68, 0x6a, 0x7a, 0x20, 0xed, 0x30, 0x56, 0xdb, 0xa3, 0xdf, 0xc8,
+  0x5e, 0x15, 0xc3, 0xff, 0x54, 0x7b, 0xe5, 0x07, 0x36, 0x37, 0x0d, 0x6c, 0x99, 0x0a, 0xaa, 0xc8,
+  0xec, 0xa3, 0x04, 0x55, 0x8a, 0xcc, 0x9b, 0xe3, 0x28, 0xaa, 0x36, 0x57, 0xd6, 0x82, 0x44, 0x2a,
+  0x33, 0xcd, 0xd7, 0xfa, 0x25, 0x81, 0xb7, 0x8a, 0x56, 0xbe, 0x9a, 0x58, 0xd1, 0xbd, 0x15, 0x38,
+  0xf5, 0x9b, 0x12, 0x5f, 0x69, 0xe9, 0x55, 0x0c, 0xcb, 0x83, 0x1f, 0x9b, 0x2d, 0xf9, 0x02, 0xc8,
+  0x4b, 0x76, 0xd4, 0xb1, 0x50, 0x3d, 0x33, 0x56, 0x86, 0xaf, 0x48, 0x7a, 0x2d, 0x3d, 0x7b, 0xa1,
+  0xb9, 0xd6, 0x67, 0x5e, 0xed, 0xe5, 0xd6, 0xba, 0xce, 0x5c, 0xda, 0xf7, 0x94, 0x06, 0xcd, 0x83,
+  0xf2, 0x8d, 0x4b, 0xa0, 0x80, 0xb9, 0x4c, 0x36, 0xdc, 0xb9, 0xef, 0xfb, 0x4b, 0xcd, 0x79, 0x1e,
+  0x64, 0x3c, 0xc5, 0xdc, 0x0e, 0xbc, 0x43, 0xbb, 0xac, 0xb5, 0x4b, 0x06, 0xe4, 0xc7, 0x9f, 0x0f,
+  0xb7, 0x5e, 0x81, 0x27, 0x40, 0xd8, 0x9a, 0xf3, 0x9a, 0x01, 0x09, 0x93, 0x60, 0x36, 0x85, 0x60,
+  0xf1, 0xc7, 0x4c, 0x9c, 0x45, 0x0c, 0x7f, 0x3d, 0x79, 0xbc, 0x08, 0xdd, 0x82, 0xac, 0x57, 0x6c,
+  0xaa, 0x9a, 0x72, 0xdd, 0xde, 0x05, 0xa3, 0x97, 0x28, 0xac, 0x31, 0x6d, 0xdd, 0x7e, 0x7b, 0x9a,
+  0x5b, 0xde, 0x3c, 0x7e, 0xce, 0xd6, 0xf1, 0xf2, 0x46, 0x3c, 0x0a, 0xd9, 0xbc, 0x13, 0x03, 0x0a,
+  0xb7, 0xa2, 0xf6, 0x22, 0x9e, 0x8b, 0x9b, 0xe4, 0x8e, 0xa1, 0xb0, 0x8e, 0x03, 0x2f, 0x47, 0xb3,
+  0x38, 0x90, 0x15, 0x76, 0x4a, 0xef, 0xd8, 0x29, 0xcd, 0x42, 0x17, 0xe6, 0x14, 0x8f, 0x7c, 0xde,
+  0x7a, 0x45, 0x88, 0xa2, 0x25, 0x4f, 0x76, 0x2c, 0x2a, 0x41, 0xc6, 0x00, 0xaf, 0x26, 0x04, 0x9a,
+  0xe1, 0xf7, 0x12, 0x3b, 0x91, 0x80, 0xbe, 0xb4, 0xf7, 0x07, 0x4c, 0x99, 0x40, 0xa0, 0x3c, 0x1a,
+  0x72, 0x4a, 0x08, 0x1e, 0xaa, 0xa5, 0x71, 0xd3, 0x21, 0xff, 0xc2, 0xe1, 0xdb, 0x8f, 0x67, 0xd3,
+  0x5b, 0x18, 0xa8, 0x4a, 0x08, 0xa8, 0xd3, 0xd9, 0x37, 0x37, 0x50, 0xbb, 0x00, 0x50, 0xce, 0x4d,
+  0x38, 0x2a, 0xed, 0xb4, 0xc4, 0x04, 0x00, 0x8f, 0xa0, 0xf3, 0xab, 0xec, 0x83, 0x07, 0xe7, 0xf5,
+  0x7d, 0xf1, 0xf2, 0x1e, 0x9f, 0x77, 0x48, 0xa4, 0xbc, 0x6a, 0xb0, 0x13, 0xd1, 0xdf, 0x1e, 0x77,
+  0xe4, 0x90, 0xb5, 0x63, 0x40, 0x46, 0x3c, 0x62, 0x78, 0x60, 0x2d, 0x21, 0x87, 0xf0, 0x16, 0x29,
+  0x2f, 0xfd, 0xe3, 0xf4, 0x29, 0x99, 0x40, 0xfc, 0x01, 0x61, 0x29, 0xc7, 0x33, 0x09, 0x1b, 0x4f,
+  0x59, 0x45, 0xae, 0x48, 0x08, 0x75, 0xcb, 0xfd, 0x16, 0x1d, 0x2a, 0x55, 0x41, 0x49, 0x98, 0x65,
+  0xb1, 0xd4, 0x07, 0x3c, 0x3f, 0x59, 0x86, 0xca, 0x27, 0xc9, 0x5c, 0x4d, 0xd2, 0xae, 0xb6, 0x13,
+  0x34, 0x06, 0x6e, 0x11, 0x16, 0x3e, 0x60, 0x1b, 0x43, 0x81, 0x19, 0x0c, 0x06, 0xa4, 0xad, 0x01,
+  0x48, 0x91, 0xfb, 0xab, 0xaa, 0x4d, 0xa1, 0x68, 0xeb, 0xb8, 0x83, 0x3a, 0x38, 0x8b, 0x43, 0x9f,
+  0x9c, 0x62, 0xd2, 0x20, 0x26, 0x41, 0x62, 0xe5, 0x00, 0xbf, 0x50, 0x7d, 0xc7, 0x88, 0x63, 0x7d,
+  0x4c, 0x27, 0x89, 0x48, 0xb6, 0x31, 0x46, 0x15, 0xa3, 0x64, 0x21, 0x8a, 0xfc, 0xe2, 0xbc, 0x75,
+  0x40, 0x44, 0x36, 0x63, 0x1a, 0xc8, 0x0a, 0x00, 0x5f, 0xe6, 0x11, 0x5f, 0x0f, 0xb8, 0xc8, 0x08,
+  0x8e, 0xb8, 0x06, 0x9b, 0x12, 0x5c, 0x3e, 0x3c, 0xe1, 0x8f, 0xd5, 0xd8, 0x47, 0x34, 0xca, 0x15,
+  0x7a, 0x3b, 0x28, 0x60, 0xa1, 0xd0, 0xc5, 0x8f, 0x4b, 0x5a, 0x69, 0x92, 0xce, 0xcf, 0x72, 0x4b,
+  0x11, 0x55, 0x3e, 0xf8, 0x16, 0xf2, 0x50, 0x31, 0xb2, 0x5a, 0x5d, 0xb6, 0xb3, 0x7e, 0x7f, 0x6f,
+  0xa3, 0x80, 0xf0, 0xf2, 0xf1, 0x78, 0xe0, 0x54, 0x5d, 0x79, 0x00, 0x2e, 0x0d, 0x65, 0x1b, 0x96,
+  0xb8, 0xb8, 0xdd, 0xd5, 0x2b, 0xd8, 0x6f, 0x91, 0x16, 0xc1, 0xd1, 0xcd, 0xf3, 0x45, 0x72, 0x0e,
+  0x9d, 0x77, 0xe8, 0x76, 0x3c, 0x09, 0xf8, 0x9f, 0x13, 0xcf, 0xa9, 0x70, 0x58, 0xab, 0x31, 0x79,
+  0xb8, 0xea, 0x28, 0xcf, 0x68, 0xb5, 0xc8, 0x39, 0x13, 0xc1, 0x84, 0xc9, 0xb2, 0x4f, 0xe6, 0x93,
+  0x04, 0x7a, 0x2c, 0x0c, 0x74, 0xe8, 0x6b, 0x52, 0xcc, 0x4b, 0x14, 0x7f, 0x13, 0x1c, 0x38, 0xc1,
+  0x76, 0x21, 0x63, 0x61, 0x46, 0xe7, 0xb9, 0xdd, 0x12, 0x58, 0xde, 0x85, 0xaa, 0x36, 0xd5, 0xc6,
+  0xce, 0x02, 0xbc, 0x92, 0x73, 0x0b, 0x95, 0x03, 0xf4, 0x95, 0x4a, 0x7d, 0x74, 0x04, 0xfd, 0x17,
+  0x19, 0x40, 0x43, 0x85, 0xbc, 0xb8, 0x4e, 0x0b, 0x39, 0x38, 0x8a, 0xf8, 0x94, 0x8b, 0x01, 0x4c,
+  0x9d, 0xaf, 0xe5, 0xba, 0x54, 0xa2, 0xfc, 0xcd, 0x53, 0xd6, 0xf6, 0x81, 0x8b, 0xd8, 0x85, 0x8a,
+  0x96, 0x02, 0x3e, 0x86, 0xdb, 0xcd, 0xef, 0xfe, 0x2f, 0x39, 0x4e, 0x9b, 0x15, 0xb8, 0x90, 0x0a,
+  0x8a, 0x30, 0x9f, 0x4d, 0xc0, 0xea, 0x9a, 0x91, 0xce, 0xf2, 0x89, 0x0b, 0x95, 0x03, 0xd7, 0xd5,
+  0x79, 0x74, 0xee, 0x1d, 0x16, 0x30, 0x10, 0x1d, 0x72, 0x21, 0x06, 0x23, 0x91, 0x6d, 0x08, 0x0b,
+  0x70, 0x74, 0x36, 0xe2, 0x31, 0x0b, 0x3d, 0x13, 0x66, 0x46, 0x8e, 0x12, 0xb0, 0xdc, 0x6f, 0xa7,
+  0x4c, 0xb9, 0x2c, 0xf0, 0xa1, 0x58, 0xb6, 0xeb, 0x91, 0x22, 0x5d, 0x2c, 0xd5, 0x06, 0x9d, 0xb3,
+  0xbc, 0xd3, 0x87, 0x1e, 0xf4, 0x8c, 0x82, 0xd2, 0x30, 0xd5, 0x81, 0x78, 0x66, 0x1f, 0x0c, 0x11,
+  0x30, 0x3d, 0x9d, 0x4e, 0x78, 0x14, 0xba, 0x95, 0xf4, 0xec, 0x95, 0xdc, 0xd9, 0xd9, 0x40, 0xbf,
+  0x7c, 0xf2, 0xec, 0x0c, 0x52, 0x88, 0xd6, 0xf6, 0xfc, 0x80, 0xa2, 0x69, 0x58, 0x26, 0xed, 0x84,
+  0x16, 0x04, 0x4f, 0xf1, 0xe1, 0x31, 0xc9, 0x5c, 0xe7, 0x0c, 0xff, 0x32, 0x69, 0x53, 0x4b, 0xd2,
+  0x73, 0x1a, 0x04, 0x96, 0x25, 0x39, 0xe5, 0x68, 0xc7, 0x7a, 0xae, 0x49, 0x70, 0xc8, 0x99, 0x4f,
+  0xc0, 0xb3, 0xd4, 0x78, 0x15, 0x12, 0x98, 0x47, 0x02, 0xd5, 0xac, 0x42, 0x05, 0x50, 0x9e, 0x61,
+  0xb9, 0xd5, 0x42, 0x1f, 0x53, 0xe6, 0xad, 0xed, 0x42, 0xbd, 0x15, 0x63, 0x18, 0x40, 0x5b, 0x92,
+  0x8a, 0x63, 0x49, 0x72, 0xd2, 0x9d, 0x58, 0x8c, 0x3d, 0xf3, 0x77, 0x9f, 0x2e, 0x4e, 0x93, 0x29,
+  0x78, 0x0e, 0x16, 0xa5, 0x12, 0xe7, 0x17, 0x72, 0x33, 0xe3, 0x42, 0xb0, 0x8b, 0x89, 0xd5, 0x8c,
+  0x3e, 0xc3, 0x5d, 0x74, 0x4d, 0xd5, 0x4a, 0x1b, 0x90, 0x18, 0x5a, 0xd0, 0x6b, 0x26, 0x14, 0x7a,
+  0x68, 0xdd, 0x59, 0xe8, 0x4f, 0x69, 0x6a, 0x3c, 0xa1, 0x2c, 0x36, 0x1e, 0x5e, 0x49, 0x82, 0xfd,
+  0x14, 0xa0, 0xea, 0xe9, 0x42, 0xcb, 0x0f, 0x6c, 0x37, 0xb4, 0x1c, 0x8b, 0x47, 0x10, 0x6b, 0x06,
+  0xdb, 0xb6, 0x26, 0xeb, 0x4f, 0x68, 0xee, 0x5a, 0xa8, 0xab, 0xb8, 0x25, 0x13, 0x35, 0x88, 0x7d,
+  0x98, 0x87, 0x84, 0xeb, 0xd2, 0x06, 0xb9, 0xf5, 0x10, 0x1b, 0x35, 0xe9, 0xb1, 0x49, 0x6e, 0x0d,
+  0xa6, 0x52, 0x4c, 0x4d, 0xc9, 0x78, 0xb6, 0x06, 0xb5, 0x95, 0xba, 0xaa, 0xbf, 0x58, 0xec, 0x62,
+  0x4c, 0xa7, 0xb0, 0x48, 0x42, 0x99, 0x05, 0x77, 0x7b, 0xaa, 0x6d, 0xc8, 0xd8, 0x14, 0x26, 0x4b,
+  0xcb, 0x14, 0x4f, 0xd5, 0x24, 0xb0, 0x54, 0x0c, 0x86, 0xa4, 0x4d, 0x5e, 0xbf, 0x26, 0xdb, 0x26,
+  0xde, 0x7e, 0x9d, 0xc1, 0x4f, 0x75, 0x4a, 0x81, 0x11, 0x61, 0xdd, 0x6c, 0x39, 0x9e, 0xb7, 0x29,
+  0x9a, 0x2d, 0x03, 0x2e, 0x84, 0xf3, 0x92, 0xc4, 0x32, 0x11, 0x55, 0xcd, 0x14, 0x87, 0x6e, 0x22,
+  0x26, 0x4a, 0x43, 0xf2, 0x17, 0xa3, 0xdc, 0x8a, 0x0f, 0x1c, 0x2e, 0x62, 0xba, 0x65, 0x40, 0x8b,
+  0x49, 0x37, 0x02, 0x94, 0x47, 0xcf, 0x50, 0x22, 0xc0, 0x19, 0x6c, 0xa4, 0x07, 0x3a, 0x8d, 0x22,
+  0x0b, 0x69, 0x29, 0x22, 0x4c, 0xe3, 0xe2, 0x44, 0x22, 0xaf, 0x66, 0x9e, 0x86, 0x26, 0x59, 0xab,
+  0xe4, 0xda, 0x5c, 0xa4, 0x03, 0x6b, 0x73, 0xea, 0xd1, 0x29, 0x62, 0x65, 0xf6, 0x51, 0x12, 0xab,
+  0x29, 0xfb, 0x39, 0xad, 0xba, 0x9e, 0x5a, 0x3c, 0xbb, 0xc9, 0xad, 0x19, 0xd1, 0x9e, 0xdd, 0x42,
+  0x51, 0x50, 0x0d, 0xf4, 0xbb, 0x65, 0xc7, 0x04, 0xcd, 0x91, 0xc1, 0xb7, 0xed, 0x78, 0x2b, 0xda,
+  0x17, 0xc5, 0x6f, 0xd5, 0x69, 0x4c, 0x0b, 0x88, 0xa2, 0xca, 0x82, 0xb8, 0x48, 0x18, 0xfb, 0x00,
+  0x4d, 0x84, 0xc2, 0x7f, 0xe4, 0x7f, 0x17, 0x57, 0x50, 0xdd, 0x94, 0xaf, 0xcd, 0xc1, 0x57, 0x92,
+  0xb9, 0x0f, 0xf5, 0x5f, 0x5e, 0x8d, 0xfa, 0xd8, 0xa2, 0xca, 0xfe, 0x85, 0x66, 0xc1, 0x84, 0xdf,
+  0xb3, 0x23, 0x75, 0xd0, 0x34, 0xf8, 0x8d, 0xa7, 0x6a, 0x03, 0x64, 0xac, 0x1b, 0xa8, 0xfd, 0xc9,
+  0x0c, 0x82, 0x57, 0x06, 0x6e, 0x1d, 0x4b, 0xa0, 0xea, 0x83, 0x76, 0xbb, 0xed, 0x2d, 0xf4, 0x9a,
+  0xd5, 0xc1, 0x59, 0x69, 0xa2, 0x6e, 0xbb, 0xea, 0x17, 0x0b, 0xd3, 0x15, 0xcc, 0x9a, 0x94, 0x6d,
+  0x46, 0xf2, 0x4a, 0x9a, 0x55, 0xdc, 0x14, 0xd1, 0x51, 0x87, 0x57, 0xcd, 0x55, 0x7a, 0x37, 0x68,
+  0xb9, 0x74, 0xb5, 0x45, 0xa1, 0xac, 0x20, 0xab, 0x95, 0xcf, 0xf2, 0xf2, 0x85, 0x5a, 0x54, 0x7a,
+  0x72, 0x03, 0x2f, 0x33, 0xdb, 0x2b, 0x5c, 0xf7, 0x19, 0xdc, 0x9a, 0xae, 0x79, 0x44, 0xa1, 0xf3,
+  0x83, 0x5e, 0xfa, 0x2a, 0x62, 0x14, 0x0f, 0x70, 0x60, 0x2c, 0xa5, 0x63, 0xca, 0x63, 0xdf, 0xb1,
+  0x2b, 0xb4, 0xad, 0xe7, 0xc5, 0x7b, 0x19, 0xbb, 0xf3, 0xd2, 0xf7, 0x45, 0x6b, 0x07, 0x3d, 0x7d,
+  0xa5, 0xe4, 0x1d, 0x56, 0xb7, 0x6d, 0x18, 0x6a, 0xcd, 0xfd, 0x90, 0xda, 0x86, 0x21, 0xa0, 0x11,
+  0x2d, 0xf6, 0x9b, 0x03, 0xd3, 0xa3, 0x17, 0xc1, 0x50, 0x00, 0xea, 0xe6, 0x39, 0x17, 0x30, 0x15,
+  0x4e, 0x8d, 0x7c, 0x2b, 0xd0, 0x58, 0x6d, 0xab, 0x81, 0xc2, 0x96, 0xbe, 0xda, 0x3c, 0x3b, 0xd7,
+  0x22, 0x49, 0xcb, 0x0b, 0x29, 0x05, 0xfc, 0x44, 0x18, 0xf4, 0xfa, 0x2b, 0x88, 0x6f, 0xa4, 0x6a,
+  0x8f, 0x17, 0x2b, 0x89, 0x56, 0xae, 0xc1, 0x1c, 0x13, 0xc0, 0xb6, 0x91, 0xac, 0x83, 0x94, 0x32,
+  0x69, 0x80, 0xb2, 0x61, 0x2e, 0x9a, 0xba, 0xce, 0x71, 0x26, 0xc7, 0x24, 0x92, 0xcf, 0xf4, 0x2f,
+  0x73, 0x0a, 0xa8, 0x31, 0x47, 0xe8, 0x23, 0x97, 0xcb, 0x4b, 0x1d, 0xd3, 0x47, 0x58, 0x4d, 0xb4,
+  0x28, 0x26, 0x40, 0xf4, 0xa9, 0x8d, 0x67, 0xdc, 0x6b, 0xb9, 0x61, 0xf9, 0x5c, 0xad, 0x7b, 0xdb,
+  0x45, 0x03, 0x93, 0xdc, 0x15, 0x0d, 0x49, 0xf1, 0x0e, 0xa5, 0x73, 0x3d, 0x85, 0x44, 0xc8, 0x6a,
+  0x53, 0x1b, 0xf6, 0xa2, 0xd2, 0xe8, 0x56, 0xa2, 0x6a, 0x8e, 0x4e, 0xaf, 0x4e, 0x8b, 0x64, 0x6a,
+  0x58, 0x4a, 0xf8, 0x4f, 0xa6, 0x25, 0xbc, 0x86, 0xac, 0xaf, 0xa6, 0x89, 0xf2, 0x7a, 0x5a, 0x0b,
+  0xed, 0xe4, 0xe5, 0x69, 0xe9, 0x2c, 0x16, 0x3c, 0xc2, 0xe3, 0x69, 0x28, 0x76, 0x3c, 0x87, 0x61,
+  0xc5, 0xd2, 0xac, 0x45, 0xcc, 0xe8, 0xb6, 0xaa, 0x98, 0x5c, 0xe7, 0xf2, 0x2f, 0xdb, 0xcd, 0xf1,
+  0xf8, 0x4a, 0x73, 0xe7, 0x6d, 0xca, 0x1f, 0x92, 0x39, 0x93, 0xaf, 0x55, 0x0b, 0x06, 0x4e, 0x25,
+  0x13, 0x75, 0xab, 0x7c, 0x27, 0x12, 0x41, 0x23, 0x2b, 0x7b, 0x43, 0x1e, 0x24, 0xab, 0x8e, 0x17,
+  0xca, 0x63, 0x86, 0x85, 0x0b, 0x8b, 0x1d, 0x25, 0xfa, 0x4f, 0x46, 0xf6, 0xa3, 0x80, 0x42, 0xab,
+  0x1b, 0xfd, 0xe4, 0x78, 0x3b, 0xc3, 0x53, 0xf9, 0x6b, 0x71, 0x66, 0xe7, 0xbc, 0xd4, 0x76, 0x95,
+  0xfa, 0x24, 0x8d, 0xb9, 0x2e, 0x9f, 0x29, 0x14, 0xea, 0xa4, 0xc2, 0x2d, 0x85, 0x6e, 0x2a, 0x61,
+  0x55, 0x96, 0x53, 0x43, 0x6b, 0x32, 0x5a, 0xad, 0x84, 0xf5, 0x0a, 0x50, 0x78, 0x95, 0x88, 0x38,
+  0xd6, 0x1f, 0xe1, 0xac, 0x5c, 0x3c, 0x7a, 0x0e, 0x34, 0x29, 0x8e, 0xe3, 0x15, 0x0c, 0x28, 0xa2,
+  0x08, 0xd5, 0x28, 0x29, 0xea, 0x97, 0x48, 0x32, 0x48, 0x66, 0x51, 0x88, 0x5f, 0x73, 0x41, 0x9f,
+  0x42, 0x54, 0x43, 0x18, 0x6a, 0x1c, 0xab, 0x6b, 0xc7, 0x86, 0x82, 0xb8, 0xae, 0x6a, 0xd4, 0x16,
+  0x89, 0x55, 0xa6, 0xe8, 0x20, 0xc2, 0xa5, 0x12, 0x5b, 0xbd, 0x78, 0xb4, 0x33, 0xbf, 0xbc, 0xf4,
+  0x02, 0x66, 0x52, 0x9a, 0xe5, 0xec, 0x02, 0xe6, 0x9a, 0xca, 0x2d, 0xa8, 0x2f, 0x97, 0xbd, 0x4a,
+  0x9d, 0x05, 0xca, 0x1a, 0x06, 0xf8, 0xd7, 0x2e, 0x3d, 0x65, 0x62, 0x92, 0x84, 0xa0, 0x02, 0xbc,
+  0x6c, 0x70, 0x1a, 0xea, 0x25, 0x7e, 0xa8, 0xc2, 0xb2, 0xbc, 0x47, 0x3e, 0x3b, 0x3a, 0x0b, 0x36,
+  0x6f, 0x1e, 0x53, 0xe6, 0x00, 0x18, 0x26, 0x85, 0x16, 0xa4, 0x4e, 0x1e, 0x3b, 0x4f, 0x1a, 0x1a,
+  0x3f, 0x68, 0xe9, 0x29, 0x76, 0xc0, 0xbc, 0xd7, 0x02, 0x2b, 0xbd, 0x2b, 0x25, 0x57, 0xf2, 0x3f,
+  0x2f, 0x20, 0x6b, 0xc3, 0xb1, 0x08, 0x46, 0xd3, 0xd8, 0x61, 0xad, 0x49, 0xee, 0x1c, 0x2b, 0x22,
+  0xed, 0x4b, 0xdc, 0x85, 0xbc, 0x2d, 0x77, 0xea, 0x75, 0x6b, 0x62, 0x91, 0x8d, 0x9a, 0xb9, 0x7a,
+  0xc6, 0x2b, 0x17, 0x48, 0xc3, 0x85, 0xb7, 0x98, 0x6b, 0x67, 0x63, 0x41, 0x4b, 0x8c, 0xcd, 0x4d,
+  0xaa, 0xbe, 0x79, 0x31, 0x3c, 0x2d, 0xb4, 0xa8, 0x0b, 0x46, 0xb5, 0x6f, 0xcd, 0x6d, 0xbb, 0xea,
+  0xdb, 0xd1, 0x35, 0x95, 0x79, 0xe9, 0x7b, 0x08, 0xbb, 0xb2, 0x1b, 0xb7, 0x50, 0x68, 0x94, 0x1b,
+  0x2c, 0x7a, 0x41, 0x89, 0xe0, 0xcf, 0x72, 0x84, 0xbf, 0xca, 0xfa, 0xda, 0x9a, 0xa5, 0x2e, 0x8b,
+  0xd9, 0x92, 0x7c, 0xc0, 0xca, 0x66, 0x6e, 0x18, 0xe7, 0x3c, 0x8a, 0xf4, 0x7d, 0x99, 0xba, 0x67,
+  0x43, 0x3b, 0xf9, 0xce, 0x1f, 0x33, 0x73, 0xa9, 0xc6, 0xf5, 0x96, 0xae, 0xdc, 0x9d, 0xbf, 0xcc,
+  0xd4, 0xcb, 0x5f, 0x07, 0xbc, 0xd4, 0xd6, 0x12, 0x83, 0xea, 0xfa, 0xff, 0x26, 0xc6, 0x96, 0xea,
+  0xd4, 0x37, 0xe6, 0x7f, 0xa5, 0xb9, 0x53, 0x8b, 0xee, 0x7a, 0x83, 0xdb, 0x9f, 0x13, 0xbc, 0xcc,
+  0xde, 0x4b, 0xdf, 0x43, 0xbc, 0xd4, 0xdc, 0x25, 0x82, 0xbf, 0x89, 0xb5, 0x4b, 0x5d, 0xfe, 0x95,
+  0xb6, 0x2e, 0xd5, 0x58, 0x7b, 0xce, 0x50, 0x29, 0xb5, 0xeb, 0xec, 0x59, 0xfd, 0x32, 0xa9, 0xbc,
+  0xa2, 0xb3, 0xab, 0xd6, 0x33, 0xf6, 0xab, 0x4f, 0x94, 0x70, 0x7b, 0xb5, 0xc8, 0xd3, 0x30, 0x3c,
+  0xbb, 0x07, 0xe0, 0x4b, 0x9e, 0x83, 0x05, 0x19, 0x88, 0x21, 0xbf, 0x90, 0x02, 0x96, 0x8d, 0x47,
+  0x1a, 0x07, 0x5c, 0x53, 0x26, 0x51, 0x6f, 0x85, 0x33, 0xc9, 0xfe, 0xdd, 0xf8, 0x13, 0x70, 0x53,
+  0x7c, 0xd1, 0xf7, 0x47, 0x2d, 0xfe, 0x82, 0x6a, 0xe6, 0x1b, 0x47, 0x37, 0xa7, 0xaa, 0x7a, 0x5d,
+  0x5b, 0xb4, 0xa6, 0xcf, 0xa9, 0x2f, 0xf6, 0x2f, 0x6b, 0x0d, 0x5e, 0x92, 0x83, 0xab, 0x54, 0x2d,
+  0x80, 0x4d, 0xb8, 0x96, 0xe3, 0xbb, 0x8a, 0xaa, 0x5c, 0xdf, 0x84, 0xa9, 0xfc, 0x9e, 0xc2, 0xab,
+  0x93, 0x8d, 0xa7, 0x9b, 0x10, 0xd8, 0x5f, 0x54, 0xd4, 0xa2, 0xc8, 0x43, 0x3c, 0xd8, 0x23, 0x47,
+  0x26, 0x20, 0x9d, 0xeb, 0xaf, 0x89, 0x7c, 0xe3, 0x16, 0xdd, 0x12, 0x84, 0x5d, 0xf8, 0xfe, 0x44,
+  0xf6, 0xd6, 0xf0, 0xd7, 0xe2, 0xac, 0x53, 0xae, 0x20, 0x9c, 0xea, 0xd6, 0x0d, 0x0e, 0x6c, 0xc2,
+  0x8b, 0x6f, 0x7e, 0xf4, 0x40, 0x2d, 0xaf, 0xa1, 0xab, 0xa7, 0xe6, 0xfd, 0x56, 0x71, 0xbd, 0x8f,
+  0x0f, 0xf2, 0xdb, 0xe9, 0x7e, 0x4b, 0xfe, 0x2f, 0x46, 0x5b, 0xaf, 0xfe, 0x0f, 0x6e, 0x8c, 0x2d,
+  0x0b, 0x7a, 0x34, 0x00, 0x00,
+};
@@ -0,0 +1,377 @@
+#include "web_routes.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+
+// Sends the next remaining bytes of a file from where it was left
+class FileBody : public WebBody {
+public:
+  FileBody(WebFile *file, uint32_t remaining) : file(file), remaining(remaining) {}
+  
+  ~FileBody() {
+    delete file;
+  }
+  
+  size_t fill(uint8_t *buf, size_t size) {
+    size_t chunk = file->read(buf, std::min((size_t)remaining, size));
+    remaining -= chunk;
+    return chunk;
+  }
+  
+private:
+  WebFile *file;
+  uint32_t remaining;
+};
+
+// A JSON body built a few entries at a time, so neither the index nor the
+// heap is tied up by a big card. next() adds the following piece and
+// returns false once the text is complete.
+class JsonBody : public WebBody {
+public:
+  JsonBody() : offset(0), complete(false) {}
+  
+  size_t fill(uint8_t *buf, size_t size) {
+    text.erase(0, offset);
+    offset = 0;
+    while (text.size() < size && !complete) {
+      complete = !next(text);
+    }
+    size_t chunk = std::min(size, text.size());
+    memcpy(buf, text.data(), chunk);
+    offset = chunk;
+    return chunk;
+  }
+  
+protected:
+  virtual bool next(std::string &text) = 0;
+  
+private:
+  std::string text;
+  size_t offset;  // Already handed out
+  bool complete;
+};
+
+static void webListEntry(std::string &text, const ImageInfo &info, bool first) {
+  char entry[160];
+  snprintf(entry, sizeof(entry), "%s{\"number\":%lu,\"filename\":\"%lu.jpg\",\"size\":%lu,\"v\":\"%s\"",
+           first ? "" : ",", (unsigned long)info.number, (unsigned long)info.number,
+           (unsigned long)info.size, imageVersion(info).c_str());
+  text += entry;
+  if (info.burstId != 0) {
+    snprintf(entry, sizeof(entry), ",\"burst\":%u,\"frame\":%u", info.burstId, info.frame);
+    text += entry;
+  }
+  text += "}";
+}
+
+// The body of /list: images numbered above after, at most limit of them
+class ListBody : public JsonBody {
+public:
+  ListBody(WebBackend &backend, uint32_t after, uint32_t limit, uint32_t generation)
+    : backend(backend), cursor(after), limit(limit), generation(generation), sent(0), started(false), more(true) {}
+  
+protected:
+  bool next(std::string &text) {
+    if (!started) {
+      text += "{\"images\":[";
+      started = true;
+      return true;
+    }
+    if (more && (limit == 0 || sent < limit)) {
+      int max = WEB_LIST_BATCH;
+      if (limit != 0 && limit - sent < (uint32_t)max) {
+        max = limit - sent;
+      }
+      ImageInfo batch[WEB_LIST_BATCH];
+      int count = 0;
+      more = false;
+      if (backend.cardPresent()) {
+        count = backend.listAfter(cursor, batch, max, &more);
+      }
+      for (int i = 0; i < count; i++) {
+        webListEntry(text, batch[i], sent + i == 0);
+        cursor = batch[i].number;
+      }
+      sent += count;
+      return true;
+    }
+    text += "],\"token\":\"" + backend.token(generation) + "\"";
+    if (more) {
+      char next[24];
+      snprintf(next, sizeof(next), ",\"next\":%lu", (unsigned long)cursor);
+      text += next;
+    }
+    text += "}";
+    return false;
+  }
+  
+private:
+  WebBackend &backend;
+  uint32_t cursor;
+  uint32_t limit;
+  uint32_t generation;
+  uint32_t sent;
+  bool started;
+  bool more;
+};
+
+// The body of /list?since=: the current entry of each changed image that is
+// still there, then the numbers of those that aren't
+class ChangesBody : public JsonBody {
+public:
+  ChangesBody(WebBackend &backend, const std::vector<uint32_t> &numbers, uint32_t generation, bool reset)
+    : backend(backend), numbers(numbers), generation(generation), reset(reset), started(false), looked(0), added(0) {}
+  
+protected:
+  bool next(std::string &text) {
+    if (!started) {
+      text += "{\"token\":\"" + backend.token(generation) + "\",\"reset\":" + (reset ? "true" : "false") + ",\"added\":[";
+      started = true;
+      return true;
+    }
+    if (looked < numbers.size()) {
+      size_t end = std::min(numbers.size(), looked + WEB_LIST_BATCH);
+      for (; looked < end; looked++) {
+        ImageInfo info;
+        if (backend.lookup(numbers[looked], info)) {
+          webListEntry(text, info, added++ == 0);
+        } else {
+          deleted.push_back(numbers[looked]);
+        }
+      }
+      return true;
+    }
+    text += "],\"deleted\":[";
+    for (size_t i = 0; i < deleted.size(); i++) {
+      char number[16];
+      snprintf(number, sizeof(number), "%s%lu", i ? "," : "", (unsigned long)deleted[i]);
+      text += number;
+    }
+    text += "]}";
+    return false;
+  }
+  
+private:
+  WebBackend &backend;
+  std::vector<uint32_t> numbers;
+  std::vector<uint32_t> deleted;
+  uint32_t generation;
+  bool reset;
+  bool started;
+  size_t looked;
+  int added;
+};
+
+// Hands a detached response to a sender, or sends it here if none can take it
+static void webStartBody(WebBackend &backend, const WebBodyJob &job) {
+  if (!backend.startBody(job)) {
+    WebBodyJob own = job;
+    uint8_t buf[1024];
+    webSendBody(own, buf, sizeof(buf));
+  }
+}
+
+static std::string webTrim(const std::string &text) {
+  size_t start = text.find_first_not_of(" \t");
+  if (start == std::string::npos) {
+    return "";
+  }
+  return text.substr(start, text.find_last_not_of(" \t") - start + 1);
+}
+
+void webHandleImage(HttpRequest &request, HttpResponse &response, WebBackend &backend, bool thumb) {
+  if (!request.hasArg("n")) {
+    response.send(400, "text/plain", "Missing image number parameter");
+    return;
+  }
+  
+  long imageNum = atol(request.arg("n").c_str());
+  
+  ImageInfo info;
+  if (!backend.cardPresent() || imageNum <= 0 || !backend.lookup(imageNum, info)) {
+    response.send(404, "text/plain", "Image not found");
+    return;
+  }
+  
+  uint32_t offset = 0;
+  uint32_t length = 0;
+  WebFile *file = backend.openImage(info, thumb, &offset, &length);
+  if (!file) {
+    response.send(500, "text/plain", "Failed to open image");
+    return;
+  }
+  
+  std::string version = imageVersion(info);
+  char etag[48];
+  snprintf(etag, sizeof(etag), "\"%ld%s-%s\"", imageNum, thumb ? "t" : "", version.c_str());
+  webSendFile(request, response, backend, file, offset, length, etag, info.timestamp, request.arg("v") == version);
+}
+
+void webSendFile(HttpRequest &request, HttpResponse &response, WebBackend &backend, WebFile *file,
+                 uint32_t offset, uint32_t length, const std::string &etag, uint32_t timestamp, bool immutable) {
+  std::string lastModified;
+  if (timestamp > 1600000000) {  // Only when the clock was set when it was written
+    time_t t = timestamp;
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    char date[40];
+    strftime(date, sizeof(date), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    lastModified = date;
+  }
+  
+  response.sendHeader("ETag", etag);
+  response.sendHeader("Cache-Control", immutable ? "public, max-age=31536000, immutable" : "no-cache");
+  response.sendHeader("Accept-Ranges", "bytes");
+  if (lastModified.length()) {
+    response.sendHeader("Last-Modified", lastModified);
+  }
+  
+  bool notModified;
+  if (request.hasHeader("If-None-Match")) {
+    notModified = request.header("If-None-Match").find(etag) != std::string::npos;
+  } else {
+    notModified = lastModified.length() && request.header("If-Modified-Since") == lastModified;
+  }
+  if (notModified) {
+    delete file;
+    response.send(304, NULL, "");
+    return;
+  }
+  
+  // Only a single range is supported; anything else gets the whole file.
+  // If-Range with another validator means the copy being resumed is stale.
+  uint32_t start = 0;
+  uint32_t end = length ? length - 1 : 0;
+  bool partial = false;
+  std::string range = request.header("Range");
+  size_t dash = range.find('-');
+  if (range.compare(0, 6, "bytes=") == 0 && dash != std::string::npos && range.find(',') == std::string::npos &&
+      (!request.hasHeader("If-Range") || request.header("If-Range") == etag || request.header("If-Range") == lastModified)) {
+    std::string first = webTrim(range.substr(6, dash - 6));
+    std::string last = webTrim(range.substr(dash + 1));
+    bool valid = true;
+    if (first.length() == 0) {
+      // bytes=-N: the last N bytes
+      uint32_t suffix = strtoul(last.c_str(), NULL, 10);
+      valid = suffix > 0;
+      start = (suffix < length) ? length - suffix : 0;
+    } else {
+      start = strtoul(first.c_str(), NULL, 10);
+      uint32_t lastByte = strtoul(last.c_str(), NULL, 10);
+      if (last.length()) {
+        end = std::min(lastByte, end);
+      }
+      valid = last.length() == 0 || lastByte >= start;
+    }
+    if (!valid || start >= length) {
+      delete file;
+      response.sendHeader("Content-Range", "bytes */" + std::to_string(length));
+      response.send(416, "text/plain", "Range not satisfiable");
+      return;
+    }
+    partial = true;
+  }
+  
+  uint32_t remaining = end - start + 1;
+  if (length == 0) {
+    remaining = 0;
+  }
+  if (partial) {
+    response.sendHeader("Content-Range", "bytes " + std::to_string(start) + "-" + std::to_string(end) + "/" + std::to_string(length));
+  }
+  file->seek(offset + start);
+  HttpConnection *connection = response.detach(partial ? 206 : 200, "image/jpeg", remaining);
+  if (!connection) {
+    delete file;
+    return;
+  }
+  WebBodyJob job = { connection, new FileBody(file, remaining), false };
+  webStartBody(backend, job);
+}
+
+// GET /list[?after=N][&limit=L] lists images numbered above after, at most
+// limit of them (all if no limit). When more are left, "next" is the after
+// to pass for the following page. "token" goes with /list?since=.
+//
+// GET /list?since=TOKEN: what changed after the token was handed out.
+// "added" has the current entry of every image added or rewritten since,
+// "deleted" the numbers of those gone. "reset":true means the change log
+// can't answer (the index was rebuilt from the card, the device rebooted,
+// or more changed than the log holds, as a big delete can) and the whole
+// list has to be fetched again.
+void webHandleList(HttpRequest &request, HttpResponse &response, WebBackend &backend) {
+  WebBody *body;
+  if (request.hasArg("since")) {
+    std::vector<uint32_t> numbers;
+    uint32_t generation = 0;
+    bool reset = !backend.changesSince(request.arg("since"), numbers, &generation);
+    // An image changed more than once only needs its current state
+    std::sort(numbers.begin(), numbers.end());
+    numbers.erase(std::unique(numbers.begin(), numbers.end()), numbers.end());
+    body = new ChangesBody(backend, numbers, generation, reset);
+  } else {
+    uint32_t after = request.hasArg("after") ? atol(request.arg("after").c_str()) : 0;
+    uint32_t limit = request.hasArg("limit") ? atol(request.arg("limit").c_str()) : 0;
+    // Taken before the first entry is copied, so any change made while the
+    // list goes out is reported again by the next ?since=
+    body = new ListBody(backend, after, limit, backend.generation());
+  }
+  
+  HttpConnection *connection = response.detach(200, "application/json", WEB_CHUNKED);
+  if (!connection) {
+    delete body;
+    return;
+  }
+  WebBodyJob job = { connection, body, true };
+  webStartBody(backend, job);
+}
+
+// Writes all of data, giving up if the client goes away or stops reading
+static bool webWriteAll(HttpConnection *connection, const uint8_t *data, size_t len) {
+  while (len > 0) {
+    size_t written = connection->write(data, len);
+    if (written == 0) {
+      return false;
+    }
+    data += written;
+    len -= written;
+  }
+  return true;
+}
+
+bool webSendBody(WebBodyJob &job, uint8_t *buf, size_t size) {
+  // A chunk's size line goes in front of its data and the CRLF after it,
+  // so each chunk is one write
+  size_t head = job.chunked ? 10 : 0;
+  size_t tail = job.chunked ? 2 : 0;
+  bool ok = true;
+  while (ok) {
+    size_t len = job.body->fill(buf + head, size - head - tail);
+    if (len == 0) break;
+    uint8_t *start = buf + head;
+    if (job.chunked) {
+      char line[12];
+      int lineLength = snprintf(line, sizeof(line), "%x\r\n", (unsigned int)len);
+      start -= lineLength;
+      memcpy(start, line, lineLength);
+      memcpy(buf + head + len, "\r\n", 2);
+      len += lineLength + 2;
+    }
+    ok = webWriteAll(job.connection, start, len);
+  }
+  if (ok && job.chunked) {
+    ok = webWriteAll(job.connection, (const uint8_t*)"0\r\n\r\n", 5);
+  }
+  job.connection->close();
+  delete job.connection;
+  delete job.body;
+  return ok;
+}
+
+std::string imageVersion(const ImageInfo &info) {
+  char version[20];
+  snprintf(version, sizeof(version), "%lx%lx", (unsigned long)info.size, (unsigned long)info.timestamp);
+  return version;
+}
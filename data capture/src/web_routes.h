@@ -0,0 +1,130 @@
+#pragma once
+
+// The routes that serve the card: /image, /thumb, frames of /burst and
+// /list. They are written against the small request and response
+// interfaces below instead of the Arduino WebServer, and reach the index
+// and the card through WebBackend, so the host tests (env:native) run them
+// against test/mocks/web_server_mock.h. main.cpp adapts the WebServer,
+// WiFiClient and SD card to them.
+//
+// A handler only sends the status line and headers itself. A body (an
+// image, or the listing of a whole card) is produced a piece at a time by a
+// WebBody and handed, with the connection, to WebBackend::startBody(), so
+// it can go out from another task the way /stream and /archive do.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include "image_info.h"
+
+#define WEB_LIST_BATCH     16  // Entries copied out of the index per call
+#define WEB_CHUNKED        -1  // detach() length for a chunked body
+#define WEB_MIN_BUFFER    256  // Smallest buffer webSendBody() works with
+
+// The request being handled
+class HttpRequest {
+public:
+  virtual ~HttpRequest() {}
+  virtual bool hasArg(const char *name) = 0;
+  virtual std::string arg(const char *name) = 0;     // "" if not given
+  virtual bool hasHeader(const char *name) = 0;
+  virtual std::string header(const char *name) = 0;  // "" if not sent
+};
+
+// A connection taken over for a body. write() returns the bytes taken, 0
+// once the client has gone.
+class HttpConnection {
+public:
+  virtual ~HttpConnection() {}
+  virtual size_t write(const uint8_t *data, size_t len) = 0;
+  virtual void close() = 0;
+};
+
+// The response to it. Headers set with sendHeader() go out with send() or
+// detach(), whichever ends the response.
+class HttpResponse {
+public:
+  virtual ~HttpResponse() {}
+  virtual void sendHeader(const char *name, const std::string &value) = 0;
+  // A complete response; type is NULL for one without a body (304)
+  virtual void send(int code, const char *type, const std::string &body) = 0;
+  // Sends the status line and headers with "Connection: close" and hands
+  // over the connection for a body of length bytes, or WEB_CHUNKED. NULL if
+  // the client has already gone.
+  virtual HttpConnection *detach(int code, const char *type, int64_t length) = 0;
+};
+
+// A file opened on the card; deleting it closes it
+class WebFile {
+public:
+  virtual ~WebFile() {}
+  virtual bool seek(uint32_t position) = 0;
+  virtual size_t read(uint8_t *buf, size_t len) = 0;
+};
+
+// A response body, produced a piece at a time
+class WebBody {
+public:
+  virtual ~WebBody() {}
+  // Puts the next piece in buf (at most size bytes) and returns its length;
+  // 0 once the body is finished or can't be read any further
+  virtual size_t fill(uint8_t *buf, size_t size) = 0;
+};
+
+// A body and the connection it goes out on, owned by whoever sends it
+struct WebBodyJob {
+  HttpConnection *connection;
+  WebBody *body;
+  bool chunked;
+};
+
+// The index, the card and the body senders as the routes see them. Bodies
+// read the index and the card from the sender, so those calls have to be
+// safe from there as well as from the server.
+class WebBackend {
+public:
+  virtual ~WebBackend() {}
+  virtual bool cardPresent() = 0;
+  virtual bool lookup(uint32_t number, ImageInfo &info) = 0;
+  // Copies up to max entries numbered above after, in order, and says
+  // whether any are left past them
+  virtual int listAfter(uint32_t after, ImageInfo *out, int max, bool *more) = 0;
+  // The index generation now, and the change token naming it
+  virtual uint32_t generation() = 0;
+  virtual std::string token(uint32_t generation) = 0;
+  // Numbers of the images changed since a token (repeats included) and the
+  // generation now. False if the change log can't answer for that token.
+  virtual bool changesSince(const std::string &token, std::vector<uint32_t> &numbers, uint32_t *generation) = 0;
+  // Opens an image, or its thumbnail (the image itself if it has none), and
+  // says where in the file its bytes are. NULL if it can't be opened.
+  virtual WebFile *openImage(const ImageInfo &info, bool thumb, uint32_t *offset, uint32_t *length) = 0;
+  // Takes a detached response to send; false if it can't, and the caller
+  // sends it itself
+  virtual bool startBody(const WebBodyJob &job) = 0;
+};
+
+// GET /image?n=N[&v=V] and /thumb?n=N[&v=V]
+void webHandleImage(HttpRequest &request, HttpResponse &response, WebBackend &backend, bool thumb);
+
+// GET /list[?after=N][&limit=L] and /list?since=TOKEN
+void webHandleList(HttpRequest &request, HttpResponse &response, WebBackend &backend);
+
+// Sends length bytes of file starting at offset as a JPEG, honouring
+// conditional requests (If-None-Match, If-Modified-Since) with a 304 and a
+// single "Range: bytes=" request with a 206, so interrupted downloads can
+// resume. immutable marks the response cacheable for good; otherwise the
+// browser revalidates with the ETag each time. Takes ownership of file.
+void webSendFile(HttpRequest &request, HttpResponse &response, WebBackend &backend, WebFile *file,
+                 uint32_t offset, uint32_t length, const std::string &etag, uint32_t timestamp, bool immutable);
+
+// Sends a job's body through buf (size bytes, at least WEB_MIN_BUFFER),
+// framing it in chunks if it is chunked, then closes the connection and
+// frees the job. False if the client went away.
+bool webSendBody(WebBodyJob &job, uint8_t *buf, size_t size);
+
+// Identifies one particular image behind a number. Numbers start again
+// from 1 after the card is emptied, so the size and write time are part of
+// it; the page puts it in image URLs as ?v= so those URLs can be cached for
+// good.
+std::string imageVersion(const ImageInfo &info);
@@ -0,0 +1,53 @@
+#pragma once
+
+// Host stand-in for the esp32-camera header: just the types the shared
+// modules use, with the same enum order as the real driver.
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef enum {
+  PIXFORMAT_RGB565,
+  PIXFORMAT_YUV422,
+  PIXFORMAT_YUV420,
+  PIXFORMAT_GRAYSCALE,
+  PIXFORMAT_JPEG,
+  PIXFORMAT_RGB888,
+  PIXFORMAT_RAW,
+  PIXFORMAT_RGB444,
+  PIXFORMAT_RGB555,
+} pixformat_t;
+
+typedef enum {
+  FRAMESIZE_96X96,    // 96x96
+  FRAMESIZE_QQVGA,    // 160x120
+  FRAMESIZE_QCIF,     // 176x144
+  FRAMESIZE_HQVGA,    // 240x176
+  FRAMESIZE_240X240,  // 240x240
+  FRAMESIZE_QVGA,     // 320x240
+  FRAMESIZE_CIF,      // 400x296
+  FRAMESIZE_HVGA,     // 480x320
+  FRAMESIZE_VGA,      // 640x480
+  FRAMESIZE_SVGA,     // 800x600
+  FRAMESIZE_XGA,      // 1024x768
+  FRAMESIZE_HD,       // 1280x720
+  FRAMESIZE_SXGA,     // 1280x1024
+  FRAMESIZE_UXGA,     // 1600x1200, the OV2640's largest
+  FRAMESIZE_INVALID
+} framesize_t;
+
+typedef struct {
+  const uint16_t width;
+  const uint16_t height;
+} resolution_info_t;
+
+// Defined by synthetic_camera.h, like the driver defines it
+extern const resolution_info_t resolution[];
+
+typedef struct {
+  uint8_t *buf;
+  size_t len;
+  size_t width;
+  size_t height;
+  pixformat_t format;
+} camera_fb_t;
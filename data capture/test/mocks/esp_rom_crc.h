@@ -0,0 +1,18 @@
+#pragma once
+
+// Host stand-in for the ROM CRC routine: CRC-32 (IEEE), with the same
+// pre- and post-inversion, so calls can be chained from 0 as on the ESP32
+
+#include <stdint.h>
+#include <stddef.h>
+
+static inline uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len) {
+  crc = ~crc;
+  for (uint32_t i = 0; i < len; i++) {
+    crc ^= buf[i];
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+    }
+  }
+  return ~crc;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+// The encoder's hooks for host builds: scratch memory from the heap, and
+// nothing else to yield to. env:native links the encoder into every test,
+// so each one includes this from exactly one file, whether it encodes or not.
+
+#include <stdlib.h>
+#include "jpeg_encoder.h"
+
+void *jpegScratchBorrow(JpegScratch which, size_t size) {
+  return malloc(size);
+}
+
+void jpegScratchRelease(void *ptr) {
+  free(ptr);
+}
+
+void jpegYield() {
+}
@@ -0,0 +1,168 @@
+#pragma once
+
+// Host stand-in for the SD card: a File with the calls the capture path
+// and the web routes make, backed by files in a fresh directory under
+// $TMPDIR (or /tmp). close() flushes to the OS but doesn't fsync, so by
+// default write times are those of the page cache, not of a disk.
+// setTiming() makes every read and write also take a fixed latency plus its
+// size over a throughput, one at a time across all files, like a single
+// card on one bus. Include from exactly one file per test.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define FILE_READ  "r"
+#define FILE_WRITE "w"
+
+// How long the simulated card takes over a read or write; all zero is no
+// delay
+struct SdTiming {
+  double latencyMs;  // Per read() or write() call, whatever its size
+  double MBps;       // Transfer rate on top of that, 0 for unlimited
+  std::mutex bus;    // Held for the transfer and its delay
+};
+
+class File {
+public:
+  File() : handle(NULL), offset(0), timing(NULL) {}
+  File(FILE *f, SdTiming *timing) : handle(f), offset(0), timing(timing) {}
+  
+  size_t write(const uint8_t *data, size_t len) {
+    if (!handle) {
+      return 0;
+    }
+    std::unique_lock<std::mutex> guard(timing->bus);
+    double delayMs = transferMs(len);
+    std::chrono::steady_clock::time_point done = std::chrono::steady_clock::now() +
+      std::chrono::microseconds((long long)(delayMs * 1000));
+    size_t written = fwrite(data, 1, len, handle);
+    if (delayMs > 0) {
+      std::this_thread::sleep_until(done);
+    }
+    offset += written;
+    return written;
+  }
+  
+  size_t read(uint8_t *buf, size_t len) {
+    if (!handle) {
+      return 0;
+    }
+    std::unique_lock<std::mutex> guard(timing->bus);
+    double delayMs = transferMs(len);
+    std::chrono::steady_clock::time_point done = std::chrono::steady_clock::now() +
+      std::chrono::microseconds((long long)(delayMs * 1000));
+    size_t got = fread(buf, 1, len, handle);
+    if (delayMs > 0) {
+      std::this_thread::sleep_until(done);
+    }
+    offset += got;
+    return got;
+  }
+  
+  bool seek(size_t position) {
+    if (!handle || fseek(handle, position, SEEK_SET) != 0) {
+      return false;
+    }
+    offset = position;
+    return true;
+  }
+  
+  size_t size() const {
+    struct stat st;
+    if (!handle || fstat(fileno(handle), &st) != 0) {
+      return 0;
+    }
+    return st.st_size;
+  }
+  
+  size_t position() const {
+    return offset;
+  }
+  
+  void close() {
+    if (handle) {
+      fclose(handle);
+      handle = NULL;
+    }
+  }
+  
+  operator bool() const {
+    return handle != NULL;
+  }
+  
+private:
+  double transferMs(size_t len) const {
+    double ms = timing->latencyMs;
+    if (timing->MBps > 0) {
+      ms += len / (timing->MBps * 1024 * 1024) * 1000;
+    }
+    return ms;
+  }
+  
+  FILE *handle;
+  size_t offset;
+  SdTiming *timing;
+};
+
+class SdShim {
+public:
+  SdShim() {
+    setTiming(0, 0);
+  }
+  
+  // Applies to reads and writes from then on, including on files already
+  // open
+  void setTiming(double latencyMs, double MBps) {
+    timing.latencyMs = latencyMs;
+    timing.MBps = MBps;
+  }
+  
+  // Makes the directory standing in for the card
+  bool begin() {
+    const char *tmp = getenv("TMPDIR");
+    std::string pattern = std::string(tmp ? tmp : "/tmp") + "/sdshim.XXXXXX";
+    std::vector<char> path(pattern.begin(), pattern.end());
+    path.push_back('\0');
+    if (!mkdtemp(path.data())) {
+      return false;
+    }
+    root = path.data();
+    return true;
+  }
+  
+  File open(const char *path, const char *mode) {
+    return File(fopen((root + path).c_str(), mode), &timing);
+  }
+  
+  bool remove(const char *path) {
+    return ::remove((root + path).c_str()) == 0;
+  }
+  
+  // Deletes everything written and the directory itself
+  void end() {
+    DIR *dir = opendir(root.c_str());
+    if (dir) {
+      struct dirent *entry;
+      while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) {
+          ::remove((root + "/" + entry->d_name).c_str());
+        }
+      }
+      closedir(dir);
+    }
+    rmdir(root.c_str());
+  }
+  
+private:
+  std::string root;
+  SdTiming timing;
+};
@@ -0,0 +1,122 @@
+#pragma once
+
+// Host stand-in for the camera driver: the same fixed test scene at every
+// frame size up to UXGA, as RGB565 (high byte first, like the sensor),
+// grayscale or JPEG. JPEG frames are made once with the raw-frame encoder
+// at the requested quality, standing in for the sensor's own JPEG. Grabs
+// copy the frame into one of fbCount buffers, as the driver's DMA does, and
+// wait while all of them are held (the time spent waiting is added up in
+// waitedMs). Include from exactly one file per test.
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include "esp_camera.h"
+#include "jpeg_encoder.h"
+
+const resolution_info_t resolution[] = {
+  {   96,   96 }, {  160,  120 }, {  176,  144 }, {  240,  176 }, {  240,  240 },
+  {  320,  240 }, {  400,  296 }, {  480,  320 }, {  640,  480 }, {  800,  600 },
+  { 1024,  768 }, { 1280,  720 }, { 1280, 1024 }, { 1600, 1200 },
+};
+
+struct SyntheticCamera {
+  std::vector<uint8_t> frame;                  // What every grab delivers
+  std::vector<std::vector<uint8_t> > buffers;  // The driver's frame buffers
+  std::vector<camera_fb_t> fbs;
+  std::vector<bool> held;
+  std::mutex lock;
+  std::condition_variable returned;
+  double waitedMs;
+};
+
+static bool syntheticCameraCollect(void *ctx, const uint8_t *data, size_t len) {
+  std::vector<uint8_t> *out = (std::vector<uint8_t>*)ctx;
+  out->insert(out->end(), data, data + len);
+  return true;
+}
+
+// Colour gradients with a little noise, so the encoder sees something like
+// real content and every run compresses exactly the same data (the scene
+// the on-board benchmark uses)
+static void syntheticCameraFill(uint8_t *pixels, uint16_t width, uint16_t height, pixformat_t format) {
+  uint32_t seed = 0x2545F491;
+  for (uint16_t y = 0; y < height; y++) {
+    for (uint16_t x = 0; x < width; x++) {
+      seed = seed * 1664525 + 1013904223;
+      int noise = (int)(seed >> 28) - 8;
+      int r = x * 255 / width + noise;
+      int g = y * 255 / height + noise;
+      int b = (x + y) * 255 / (width + height) - noise;
+      r = r < 0 ? 0 : (r > 255 ? 255 : r);
+      g = g < 0 ? 0 : (g > 255 ? 255 : g);
+      b = b < 0 ? 0 : (b > 255 ? 255 : b);
+      if (format == PIXFORMAT_RGB565) {
+        uint16_t px = ((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3);
+        *pixels++ = px >> 8;
+        *pixels++ = px & 0xFF;
+      } else {
+        *pixels++ = (r + 2 * g + b) >> 2;
+      }
+    }
+  }
+}
+
+// Sets the camera up like esp_camera_init() with this size and format;
+// jpegQuality (1-100) only matters for PIXFORMAT_JPEG
+bool syntheticCameraInit(SyntheticCamera &camera, framesize_t size, pixformat_t format, int jpegQuality, int fbCount) {
+  uint16_t width = resolution[size].width;
+  uint16_t height = resolution[size].height;
+  camera.frame.clear();
+  if (format == PIXFORMAT_JPEG) {
+    std::vector<uint8_t> raw(width * height * 2);
+    syntheticCameraFill(raw.data(), width, height, PIXFORMAT_RGB565);
+    if (!jpegEncode(raw.data(), width, height, PIXFORMAT_RGB565, false, jpegQuality, syntheticCameraCollect, &camera.frame)) {
+      return false;
+    }
+  } else if (format == PIXFORMAT_RGB565 || format == PIXFORMAT_GRAYSCALE) {
+    camera.frame.resize(width * height * (format == PIXFORMAT_RGB565 ? 2 : 1));
+    syntheticCameraFill(camera.frame.data(), width, height, format);
+  } else {
+    return false;
+  }
+  
+  camera.buffers.assign(fbCount, std::vector<uint8_t>(camera.frame.size()));
+  camera.fbs.assign(fbCount, camera_fb_t());
+  camera.held.assign(fbCount, false);
+  for (int i = 0; i < fbCount; i++) {
+    camera.fbs[i].buf = camera.buffers[i].data();
+    camera.fbs[i].len = camera.frame.size();
+    camera.fbs[i].width = width;
+    camera.fbs[i].height = height;
+    camera.fbs[i].format = format;
+  }
+  camera.waitedMs = 0;
+  return true;
+}
+
+camera_fb_t *syntheticCameraGrab(SyntheticCamera &camera) {
+  std::unique_lock<std::mutex> guard(camera.lock);
+  for (;;) {
+    for (size_t i = 0; i < camera.fbs.size(); i++) {
+      if (!camera.held[i]) {
+        camera.held[i] = true;
+        guard.unlock();
+        memcpy(camera.fbs[i].buf, camera.frame.data(), camera.frame.size());
+        return &camera.fbs[i];
+      }
+    }
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    camera.returned.wait(guard);
+    camera.waitedMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  }
+}
+
+void syntheticCameraReturn(SyntheticCamera &camera, camera_fb_t *fb) {
+  std::lock_guard<std::mutex> guard(camera.lock);
+  camera.held[fb - camera.fbs.data()] = false;
+  camera.returned.notify_one();
+}
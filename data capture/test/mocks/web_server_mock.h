@@ -0,0 +1,159 @@
+#pragma once
+
+// Host stand-in for the WebServer side of web_routes.h: a request built
+// from maps, and a response that records what a client would receive,
+// whether the handler sent it whole or detached the connection and left
+// the body to a sender. MockClient is safe to read from another thread
+// while a sender writes to it; kBps slows its writes down to a link speed.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "web_routes.h"
+
+class MockRequest : public HttpRequest {
+public:
+  std::map<std::string, std::string> args;
+  std::map<std::string, std::string> headers;
+  
+  bool hasArg(const char *name) {
+    return args.count(name) > 0;
+  }
+  
+  std::string arg(const char *name) {
+    return args.count(name) ? args[name] : "";
+  }
+  
+  bool hasHeader(const char *name) {
+    return headers.count(name) > 0;
+  }
+  
+  std::string header(const char *name) {
+    return headers.count(name) ? headers[name] : "";
+  }
+};
+
+// The client end of one request
+struct MockClient {
+  MockClient() : code(0), type(NULL), length(0), detached(false), complete(false), kBps(0) {}
+  
+  int code;
+  const char *type;
+  std::vector<std::pair<std::string, std::string> > headers;
+  int64_t length;        // Content length given to detach(), or WEB_CHUNKED
+  std::string body;      // As received; chunked bodies still framed
+  bool detached;
+  bool complete;         // Sent whole, or the connection closed
+  double kBps;           // Link speed for bodies, 0 for unlimited
+  std::chrono::steady_clock::time_point headersAt;
+  std::chrono::steady_clock::time_point completeAt;
+  std::mutex lock;
+  std::condition_variable changed;
+  
+  std::string header(const char *name) {
+    for (size_t i = 0; i < headers.size(); i++) {
+      if (headers[i].first == name) {
+        return headers[i].second;
+      }
+    }
+    return "";
+  }
+  
+  void waitComplete() {
+    std::unique_lock<std::mutex> guard(lock);
+    changed.wait(guard, [this]() { return complete; });
+  }
+  
+  void finish() {
+    std::unique_lock<std::mutex> guard(lock);
+    complete = true;
+    completeAt = std::chrono::steady_clock::now();
+    changed.notify_all();
+  }
+};
+
+class MockConnection : public HttpConnection {
+public:
+  MockConnection(MockClient &client) : client(client) {}
+  
+  size_t write(const uint8_t *data, size_t len) {
+    if (client.kBps > 0) {
+      std::this_thread::sleep_for(std::chrono::microseconds((long long)(len / client.kBps * 1000000 / 1024)));
+    }
+    std::unique_lock<std::mutex> guard(client.lock);
+    client.body.append((const char*)data, len);
+    return len;
+  }
+  
+  void close() {
+    client.finish();
+  }
+  
+private:
+  MockClient &client;
+};
+
+class MockResponse : public HttpResponse {
+public:
+  MockResponse(MockClient &client) : client(client) {}
+  
+  void sendHeader(const char *name, const std::string &value) {
+    headers.push_back(std::make_pair(std::string(name), value));
+  }
+  
+  void send(int code, const char *type, const std::string &body) {
+    start(code, type);
+    client.body = body;
+    client.length = body.size();
+    client.finish();
+  }
+  
+  HttpConnection *detach(int code, const char *type, int64_t length) {
+    start(code, type);
+    client.length = length;
+    client.detached = true;
+    return new MockConnection(client);
+  }
+  
+private:
+  void start(int code, const char *type) {
+    std::unique_lock<std::mutex> guard(client.lock);
+    client.code = code;
+    client.type = type;
+    client.headers = headers;
+    client.headersAt = std::chrono::steady_clock::now();
+  }
+  
+  MockClient &client;
+  std::vector<std::pair<std::string, std::string> > headers;
+};
+
+// Undoes chunked transfer encoding; "" if the framing is broken or the
+// closing chunk is missing
+inline std::string mockUnchunk(const std::string &framed) {
+  std::string body;
+  size_t at = 0;
+  while (true) {
+    size_t lineEnd = framed.find("\r\n", at);
+    if (lineEnd == std::string::npos) {
+      return "";
+    }
+    size_t size = strtoul(framed.substr(at, lineEnd - at).c_str(), NULL, 16);
+    at = lineEnd + 2;
+    if (size == 0) {
+      return framed.compare(at, std::string::npos, "\r\n") == 0 ? body : "";
+    }
+    if (at + size + 2 > framed.size() || framed.compare(at + size, 2, "\r\n") != 0) {
+      return "";
+    }
+    body.append(framed, at, size);
+    at += size + 2;
+  }
+}
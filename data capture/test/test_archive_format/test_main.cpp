@@ -0,0 +1,276 @@
+// Checks /archive's ZIP and TAR output: files are written through
+// ArchiveWriter into memory, then every header, data descriptor and
+// directory record is read back and checked against what went in.
+
+#include <unity.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+#include <vector>
+#include "archive_format.h"
+#include "jpeg_host.h"  // env:native links the encoder into every suite
+
+struct TestFile {
+  uint32_t number;
+  uint32_t timestamp;
+  std::string data;
+};
+
+static bool collect(void *ctx, const uint8_t *data, size_t len) {
+  std::vector<uint8_t> *out = (std::vector<uint8_t>*)ctx;
+  out->insert(out->end(), data, data + len);
+  return true;
+}
+
+static uint16_t read16(const std::vector<uint8_t> &a, size_t at) {
+  return a[at] | (a[at + 1] << 8);
+}
+
+static uint32_t read32(const std::vector<uint8_t> &a, size_t at) {
+  return a[at] | (a[at + 1] << 8) | (a[at + 2] << 16) | ((uint32_t)a[at + 3] << 24);
+}
+
+// Bitwise CRC-32, independent of the one the writer uses
+static uint32_t crc32(const std::string &data) {
+  uint32_t crc = 0xFFFFFFFF;
+  for (size_t i = 0; i < data.size(); i++) {
+    crc ^= (uint8_t)data[i];
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320 : crc >> 1;
+    }
+  }
+  return ~crc;
+}
+
+static std::vector<TestFile> makeFiles() {
+  std::vector<TestFile> files;
+  TestFile a = { 1, 0, "123456789" };                      // No clock: 1980-01-01
+  TestFile b = { 42, 1700000000, std::string(5000, 'x') };  // Spans several data calls
+  TestFile c = { 123456, 1700000100, std::string(512, '\x7f') };
+  files.push_back(a);
+  files.push_back(b);
+  files.push_back(c);
+  return files;
+}
+
+// Feeds each file in pieces of at most piece bytes, as archiveTask does
+// with its read buffer
+static std::vector<uint8_t> writeArchive(bool tar, const std::vector<TestFile> &files, size_t piece) {
+  std::vector<uint8_t> out;
+  std::vector<uint8_t> buf(ARCHIVE_MIN_BUFFER);
+  ArchiveWriter writer;
+  archiveBegin(writer, tar, buf.data(), buf.size(), collect, &out);
+  for (size_t i = 0; i < files.size(); i++) {
+    const TestFile &file = files[i];
+    TEST_ASSERT_TRUE(archiveFileBegin(writer, file.number, file.timestamp, file.data.size()));
+    for (size_t done = 0; done < file.data.size(); done += piece) {
+      size_t len = file.data.size() - done < piece ? file.data.size() - done : piece;
+      TEST_ASSERT_TRUE(archiveFileData(writer, (const uint8_t*)file.data.data() + done, len));
+    }
+    TEST_ASSERT_TRUE(archiveFileEnd(writer));
+  }
+  TEST_ASSERT_TRUE(archiveFinish(writer));
+  return out;
+}
+
+void setUp(void) {
+  setenv("TZ", "UTC0", 1);
+  tzset();
+}
+
+void tearDown(void) {
+}
+
+void test_crc_matches_reference(void) {
+  TEST_ASSERT_EQUAL_HEX32(0xCBF43926, crc32("123456789"));
+  std::vector<TestFile> files = makeFiles();
+  std::vector<uint8_t> zip = writeArchive(false, files, 700);
+  // The first file's data descriptor follows its header (30 + "1.jpg") and data
+  size_t descriptor = 30 + 5 + files[0].data.size();
+  TEST_ASSERT_EQUAL_HEX32(0x08074b50, read32(zip, descriptor));
+  TEST_ASSERT_EQUAL_HEX32(0xCBF43926, read32(zip, descriptor + 4));
+}
+
+void test_zip_layout(void) {
+  std::vector<TestFile> files = makeFiles();
+  std::vector<uint8_t> zip = writeArchive(false, files, 700);
+  
+  // Local header, name, data, data descriptor for each file in turn
+  std::vector<uint32_t> offsets;
+  size_t at = 0;
+  for (size_t i = 0; i < files.size(); i++) {
+    const TestFile &file = files[i];
+    std::string name = std::to_string(file.number) + ".jpg";
+    offsets.push_back(at);
+    TEST_ASSERT_EQUAL_HEX32(0x04034b50, read32(zip, at));
+    TEST_ASSERT_EQUAL_UINT16(20, read16(zip, at + 4));
+    TEST_ASSERT_EQUAL_UINT16(0x0008, read16(zip, at + 6));   // Sizes in the descriptor
+    TEST_ASSERT_EQUAL_UINT16(0, read16(zip, at + 8));        // Stored
+    TEST_ASSERT_EQUAL_UINT32(0, read32(zip, at + 14));       // CRC and sizes left 0
+    TEST_ASSERT_EQUAL_UINT32(0, read32(zip, at + 18));
+    TEST_ASSERT_EQUAL_UINT32(0, read32(zip, at + 22));
+    TEST_ASSERT_EQUAL_UINT16(name.size(), read16(zip, at + 26));
+    TEST_ASSERT_EQUAL_UINT16(0, read16(zip, at + 28));
+    TEST_ASSERT_EQUAL_MEMORY(name.data(), &zip[at + 30], name.size());
+    at += 30 + name.size();
+    TEST_ASSERT_EQUAL_MEMORY(file.data.data(), &zip[at], file.data.size());
+    at += file.data.size();
+    TEST_ASSERT_EQUAL_HEX32(0x08074b50, read32(zip, at));
+    TEST_ASSERT_EQUAL_HEX32(crc32(file.data), read32(zip, at + 4));
+    TEST_ASSERT_EQUAL_UINT32(file.data.size(), read32(zip, at + 8));
+    TEST_ASSERT_EQUAL_UINT32(file.data.size(), read32(zip, at + 12));
+    at += 16;
+  }
+  
+  // Central directory
+  size_t directory = at;
+  for (size_t i = 0; i < files.size(); i++) {
+    const TestFile &file = files[i];
+    std::string name = std::to_string(file.number) + ".jpg";
+    TEST_ASSERT_EQUAL_HEX32(0x02014b50, read32(zip, at));
+    TEST_ASSERT_EQUAL_UINT16(0x0008, read16(zip, at + 8));
+    TEST_ASSERT_EQUAL_HEX32(crc32(file.data), read32(zip, at + 16));
+    TEST_ASSERT_EQUAL_UINT32(file.data.size(), read32(zip, at + 20));
+    TEST_ASSERT_EQUAL_UINT32(file.data.size(), read32(zip, at + 24));
+    TEST_ASSERT_EQUAL_UINT16(name.size(), read16(zip, at + 28));
+    TEST_ASSERT_EQUAL_UINT32(offsets[i], read32(zip, at + 42));
+    TEST_ASSERT_EQUAL_MEMORY(name.data(), &zip[at + 46], name.size());
+    at += 46 + name.size();
+  }
+  
+  // End record, and nothing after it
+  TEST_ASSERT_EQUAL_HEX32(0x06054b50, read32(zip, at));
+  TEST_ASSERT_EQUAL_UINT16(files.size(), read16(zip, at + 8));
+  TEST_ASSERT_EQUAL_UINT16(files.size(), read16(zip, at + 10));
+  TEST_ASSERT_EQUAL_UINT32(at - directory, read32(zip, at + 12));
+  TEST_ASSERT_EQUAL_UINT32(directory, read32(zip, at + 16));
+  TEST_ASSERT_EQUAL_size_t(zip.size(), at + 22);
+}
+
+// handleArchive() checks the 4 GB limit with this before sending anything
+void test_zip_size_estimate_is_exact(void) {
+  std::vector<TestFile> files = makeFiles();
+  uint64_t expected = ARCHIVE_ZIP_END_BYTES;
+  for (size_t i = 0; i < files.size(); i++) {
+    expected += archiveZipFileBytes(files[i].number, files[i].data.size());
+  }
+  TEST_ASSERT_EQUAL_size_t(expected, writeArchive(false, files, 4096).size());
+}
+
+// The directory is batched in the buffer; many entries must still come out whole
+void test_zip_directory_spans_buffers(void) {
+  std::vector<TestFile> files;
+  for (uint32_t n = 1; n <= 200; n++) {
+    TestFile file = { n, 1700000000 + n, std::string(n % 7, (char)n) };
+    files.push_back(file);
+  }
+  std::vector<uint8_t> zip = writeArchive(false, files, 3);
+  size_t end = zip.size() - 22;
+  TEST_ASSERT_EQUAL_HEX32(0x06054b50, read32(zip, end));
+  TEST_ASSERT_EQUAL_UINT16(200, read16(zip, end + 8));
+  size_t at = read32(zip, end + 16);
+  for (size_t i = 0; i < files.size(); i++) {
+    TEST_ASSERT_EQUAL_HEX32(0x02014b50, read32(zip, at));
+    TEST_ASSERT_EQUAL_HEX32(0x04034b50, read32(zip, read32(zip, at + 42)));
+    at += 46 + read16(zip, at + 28);
+  }
+  TEST_ASSERT_EQUAL_size_t(end, at);
+}
+
+void test_dos_time(void) {
+  uint16_t dosTime, dosDate;
+  archiveDosTime(0, &dosTime, &dosDate);
+  TEST_ASSERT_EQUAL_UINT16(0, dosTime);
+  TEST_ASSERT_EQUAL_UINT16((0 << 9) | (1 << 5) | 1, dosDate);
+  archiveDosTime(1700000000, &dosTime, &dosDate);  // 2023-11-14 22:13:20 UTC
+  TEST_ASSERT_EQUAL_UINT16((22 << 11) | (13 << 5) | (20 / 2), dosTime);
+  TEST_ASSERT_EQUAL_UINT16(((2023 - 1980) << 9) | (11 << 5) | 14, dosDate);
+}
+
+static uint32_t octal(const std::vector<uint8_t> &a, size_t at, size_t len) {
+  return strtoul(std::string((const char*)&a[at], len).c_str(), NULL, 8);
+}
+
+void test_tar_layout(void) {
+  std::vector<TestFile> files = makeFiles();
+  std::vector<uint8_t> tar = writeArchive(true, files, 700);
+  
+  size_t at = 0;
+  for (size_t i = 0; i < files.size(); i++) {
+    const TestFile &file = files[i];
+    std::string name = std::to_string(file.number) + ".jpg";
+    TEST_ASSERT_EQUAL_STRING(name.c_str(), (const char*)&tar[at]);
+    TEST_ASSERT_EQUAL_MEMORY("ustar", &tar[at + 257], 6);
+    TEST_ASSERT_EQUAL_UINT8('0', tar[at + 156]);
+    TEST_ASSERT_EQUAL_UINT32(file.data.size(), octal(tar, at + 124, 11));
+    TEST_ASSERT_EQUAL_UINT32(file.timestamp, octal(tar, at + 136, 11));
+  
+    // Checksum: the header's bytes with the checksum field read as spaces
+    uint32_t sum = 0;
+    for (int b = 0; b < 512; b++) {
+      sum += (b >= 148 && b < 156) ? ' ' : tar[at + b];
+    }
+    TEST_ASSERT_EQUAL_UINT32(sum, octal(tar, at + 148, 6));
+  
+    at += 512;
+    TEST_ASSERT_EQUAL_MEMORY(file.data.data(), &tar[at], file.data.size());
+    at += (file.data.size() + 511) / 512 * 512;
+  }
+  TEST_ASSERT_EQUAL_size_t(tar.size(), at + 1024);
+  for (size_t b = at; b < tar.size(); b++) {
+    TEST_ASSERT_EQUAL_UINT8(0, tar[b]);
+  }
+}
+
+// A read that comes up short is padded to the size in the header, so the
+// files after it still line up
+void test_tar_short_file_is_padded(void) {
+  std::vector<uint8_t> out;
+  std::vector<uint8_t> buf(ARCHIVE_MIN_BUFFER);
+  ArchiveWriter writer;
+  archiveBegin(writer, true, buf.data(), buf.size(), collect, &out);
+  archiveFileBegin(writer, 1, 0, 3000);
+  archiveFileData(writer, (const uint8_t*)"abc", 3);
+  archiveFileEnd(writer);
+  archiveFileBegin(writer, 2, 0, 1);
+  archiveFileData(writer, (const uint8_t*)"z", 1);
+  archiveFileEnd(writer);
+  TEST_ASSERT_TRUE(archiveFinish(writer));
+  
+  size_t second = 512 + (3000 + 511) / 512 * 512;
+  TEST_ASSERT_EQUAL_STRING("2.jpg", (const char*)&out[second]);
+  TEST_ASSERT_EQUAL_UINT8('z', out[second + 512]);
+  TEST_ASSERT_EQUAL_size_t(second + 1024 + 1024, out.size());
+}
+
+static bool failAfter(void *ctx, const uint8_t *data, size_t len) {
+  int *left = (int*)ctx;
+  return (*left)-- > 0;
+}
+
+void test_sink_failure_stops_writer(void) {
+  int left = 2;
+  std::vector<uint8_t> buf(ARCHIVE_MIN_BUFFER);
+  ArchiveWriter writer;
+  archiveBegin(writer, false, buf.data(), buf.size(), failAfter, &left);
+  TEST_ASSERT_TRUE(archiveFileBegin(writer, 1, 0, 4));
+  TEST_ASSERT_TRUE(archiveFileData(writer, (const uint8_t*)"abcd", 4));
+  TEST_ASSERT_FALSE(archiveFileEnd(writer));
+  TEST_ASSERT_FALSE(archiveFileBegin(writer, 2, 0, 4));
+  TEST_ASSERT_FALSE(archiveFinish(writer));
+  TEST_ASSERT_EQUAL(0, (int)writer.entries.size());
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_crc_matches_reference);
+  RUN_TEST(test_zip_layout);
+  RUN_TEST(test_zip_size_estimate_is_exact);
+  RUN_TEST(test_zip_directory_spans_buffers);
+  RUN_TEST(test_dos_time);
+  RUN_TEST(test_tar_layout);
+  RUN_TEST(test_tar_short_file_is_padded);
+  RUN_TEST(test_sink_failure_stops_writer);
+  return UNITY_END();
+}
@@ -0,0 +1,101 @@
+// Host benchmark for the raw-frame JPEG encoder. Encodes a synthetic RGB565
+// frame at every capture resolution in the sensor's byte order and swapped
+// (the web page's Big/Little Endian setting), and reports ms per frame and
+// MPix/s for each. Only the output being identical is checked; the numbers
+// are for comparing changes on one machine, not for predicting the ESP32.
+//
+//   pio test -e native_bench -f test_bench_encoder -v
+
+#include <unity.h>
+#include <stdio.h>
+#include <chrono>
+#include <vector>
+#include "jpeg_encoder.h"
+#include "jpeg_host.h"
+
+struct Size {
+  const char *name;
+  int width;
+  int height;
+};
+
+static const Size sizes[] = {
+  { "QQVGA", 160, 120 }, { "QCIF", 176, 144 }, { "QVGA", 320, 240 }, { "VGA", 640, 480 },
+  { "SVGA", 800, 600 }, { "XGA", 1024, 768 }, { "SXGA", 1280, 1024 }, { "UXGA", 1600, 1200 },
+};
+
+static bool count(void *ctx, const uint8_t *data, size_t len) {
+  *(size_t*)ctx += len;
+  return true;
+}
+
+static bool collect(void *ctx, const uint8_t *data, size_t len) {
+  std::vector<uint8_t> *out = (std::vector<uint8_t>*)ctx;
+  out->insert(out->end(), data, data + len);
+  return true;
+}
+
+static std::vector<uint8_t> makeFrame(int width, int height, bool swapped) {
+  std::vector<uint8_t> pixels(width * height * 2);
+  uint32_t seed = 12345;
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      // Gradient plus a little noise, so the entropy coder has real work
+      seed = seed * 1103515245 + 12345;
+      int noise = (seed >> 16) & 3;
+      uint16_t p = (((x * 31 / width) ^ noise) << 11) | (((y * 63 / height) ^ noise) << 5) | ((x + y) & 31);
+      pixels[(y * width + x) * 2 + (swapped ? 1 : 0)] = p >> 8;
+      pixels[(y * width + x) * 2 + (swapped ? 0 : 1)] = p & 0xFF;
+    }
+  }
+  return pixels;
+}
+
+// Average ms per encode, repeating until at least 200 ms have gone by
+static double timeEncode(const std::vector<uint8_t> &pixels, int width, int height, bool swapBytes, size_t *bytes) {
+  typedef std::chrono::steady_clock Clock;
+  int runs = 0;
+  Clock::time_point start = Clock::now();
+  double elapsed = 0;
+  do {
+    *bytes = 0;
+    jpegEncode(pixels.data(), width, height, PIXFORMAT_RGB565, swapBytes, 80, count, bytes);
+    runs++;
+    elapsed = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+  } while (elapsed < 200);
+  return elapsed / runs;
+}
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+void test_encode_byte_orders(void) {
+  printf("\n%-6s %11s  %21s  %21s\n", "", "", "sensor order", "swapped");
+  printf("%-6s %11s  %10s %10s  %10s %10s\n", "size", "pixels", "ms/frame", "MPix/s", "ms/frame", "MPix/s");
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    const Size &size = sizes[i];
+    std::vector<uint8_t> sensor = makeFrame(size.width, size.height, false);
+    std::vector<uint8_t> swapped = makeFrame(size.width, size.height, true);
+  
+    std::vector<uint8_t> a, b;
+    jpegEncode(sensor.data(), size.width, size.height, PIXFORMAT_RGB565, false, 80, collect, &a);
+    jpegEncode(swapped.data(), size.width, size.height, PIXFORMAT_RGB565, true, 80, collect, &b);
+    TEST_ASSERT_TRUE(a == b);
+  
+    size_t bytes = 0;
+    double mpix = size.width * size.height / 1e6;
+    double sensorMs = timeEncode(sensor, size.width, size.height, false, &bytes);
+    double swappedMs = timeEncode(swapped, size.width, size.height, true, &bytes);
+    printf("%-6s %4dx%-6d  %10.2f %10.1f  %10.2f %10.1f\n", size.name, size.width, size.height,
+           sensorMs, mpix / sensorMs * 1000, swappedMs, mpix / swappedMs * 1000);
+  }
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_encode_byte_orders);
+  return UNITY_END();
+}
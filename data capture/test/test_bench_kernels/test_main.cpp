@@ -0,0 +1,83 @@
+// Host benchmark for the RGB565 colour conversion kernels: MPix/s for the
+// reference, fast and SIMD (SSE2 or NEON) kernels, in both byte orders, at every resolution the
+// web page offers (QQVGA through UXGA). Serial k runs the same comparison on
+// the device.
+//
+//   pio test -e native_bench -f test_bench_kernels -v
+
+#include <unity.h>
+#include <stdio.h>
+#include <chrono>
+#include <vector>
+#include "jpeg_encoder.h"
+#include "jpeg_host.h"
+
+struct Size {
+  const char *name;
+  int width;
+  int height;
+};
+
+static const Size sizes[] = {
+  { "QQVGA", 160, 120 }, { "QCIF", 176, 144 }, { "QVGA", 320, 240 }, { "VGA", 640, 480 },
+  { "SVGA", 800, 600 }, { "XGA", 1024, 768 }, { "SXGA", 1280, 1024 }, { "UXGA", 1600, 1200 },
+};
+
+typedef void (*RowKernel)(const uint8_t *src, int width, bool swapBytes, uint8_t *outY, uint8_t *outCb, uint8_t *outCr);
+
+// Converts a whole frame row by row until at least 200 ms have gone by
+static double mpixPerSecond(RowKernel kernel, const std::vector<uint32_t> &frame, int width, int height, bool swapBytes) {
+  typedef std::chrono::steady_clock Clock;
+  std::vector<uint8_t> y(width), cb(width), cr(width);
+  const uint8_t *pixels = (const uint8_t*)frame.data();
+  long frames = 0;
+  uint32_t sink = 0;
+  Clock::time_point start = Clock::now();
+  double elapsed = 0;
+  do {
+    for (int row = 0; row < height; row++) {
+      kernel(pixels + (size_t)row * width * 2, width, swapBytes, y.data(), cb.data(), cr.data());
+      sink += y[row % width];
+    }
+    frames++;
+    elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+  } while (elapsed < 0.2);
+  TEST_ASSERT_TRUE(sink != 0xFFFFFFFF);  // Keeps the work from being optimised away
+  return (double)width * height * frames / elapsed / 1e6;
+}
+
+void setUp(void) {
+  jpegInitTables();
+}
+
+void tearDown(void) {
+}
+
+void test_kernel_throughput(void) {
+  printf("\nSIMD path: %s\n", jpegSimdName() ? jpegSimdName() : "none (fast kernel)");
+  printf("%-6s %11s  %32s  %32s\n", "", "", "sensor order", "swapped");
+  printf("%-6s %11s  %10s %10s %10s  %10s %10s %10s\n", "size", "pixels",
+         "ref MPix/s", "fast", "simd", "ref MPix/s", "fast", "simd");
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    const Size &size = sizes[i];
+    std::vector<uint32_t> frame(size.width * size.height / 2);
+    uint32_t seed = 1;
+    for (size_t w = 0; w < frame.size(); w++) {
+      seed = seed * 1664525 + 1013904223;
+      frame[w] = seed;
+    }
+    printf("%-6s %4dx%-6d  %10.1f %10.1f %10.1f  %10.1f %10.1f %10.1f\n", size.name, size.width, size.height,
+           mpixPerSecond(jpegRowRgb565Ref, frame, size.width, size.height, false),
+           mpixPerSecond(jpegRowRgb565Fast, frame, size.width, size.height, false),
+           mpixPerSecond(jpegRowRgb565Simd, frame, size.width, size.height, false),
+           mpixPerSecond(jpegRowRgb565Ref, frame, size.width, size.height, true),
+           mpixPerSecond(jpegRowRgb565Fast, frame, size.width, size.height, true),
+           mpixPerSecond(jpegRowRgb565Simd, frame, size.width, size.height, true));
+  }
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_kernel_throughput);
+  return UNITY_END();
+}
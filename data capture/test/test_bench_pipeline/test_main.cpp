@@ -0,0 +1,618 @@
+// Host benchmark for the capture path: frames from a synthetic camera go
+// through the grab, encode and write stages the way grabTask, encodeTask
+// and writeTask run them (thumbnail, quality mapping, streaming encode into
+// the file, aligned card writes), onto a filesystem-backed SD shim. Reports
+// frames/s, bytes/s and ms per frame in each stage for every frame size,
+// format and a few quality settings. A second table runs the same stages
+// one after another and then as three threads joined by bounded queues, as
+// startCapturePipeline() wires the tasks, to show what the overlap buys;
+// there the encoder's output goes to the write thread in blocks, as it goes
+// to writeTask. That comparison runs against a card model (a fixed cost per
+// write plus a transfer rate), since page-cache writes cost next to nothing
+// and leave nothing to overlap, and fails if the pipeline falls short of
+// what its slowest stage allows.
+// The synthetic sensor always has a frame ready, as the driver's second
+// frame buffer does while the first is being encoded, so the grab column
+// is only the copy.
+//
+//   pio test -e native_bench -f test_bench_pipeline -v
+
+#include <unity.h>
+#include <stdio.h>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "jpeg_encoder.h"
+#include "capture_stages.h"
+#include "jpeg_host.h"
+#include "synthetic_camera.h"
+#include "sd_shim.h"
+
+#define SD_WRITE_CHUNK  16384  // As in main.cpp
+#define FB_COUNT        2      // Frame buffers, as the sketch configures the driver
+#define PIPELINE_QUEUE_DEPTH 2 // As in main.cpp
+#define JPEG_SINK_BLOCKS     2 // As in main.cpp
+#define JPEG_SINK_FILES      2 // As in main.cpp
+
+// Card model for the pipelined comparison; -D either to try another card
+#ifndef CARD_WRITE_LATENCY_MS
+#define CARD_WRITE_LATENCY_MS 0.5
+#endif
+#ifndef CARD_WRITE_MBPS
+#define CARD_WRITE_MBPS 4.0
+#endif
+#define PIPELINE_MIN_EFFICIENCY 0.9  // Pipelined fps must reach this share of the bound
+
+typedef std::chrono::steady_clock Clock;
+
+enum Stage { STAGE_GRAB, STAGE_THUMBNAIL, STAGE_ENCODE, STAGE_OPEN, STAGE_WRITE, STAGE_CLOSE, STAGE_COUNT };
+static const char *stageNames[STAGE_COUNT] = { "grab", "thumb", "encode", "open", "write", "close" };
+
+struct FrameOutput;
+
+// One frame on its way through, like the sketch's CaptureJob
+struct BenchJob {
+  camera_fb_t *fb;
+  uint32_t number;
+  int quality;           // Camera quality setting (0-63)
+  framesize_t frameSize;
+  bool bigEndian;
+  bool written;          // Raw frames are encoded straight into their file
+  FrameOutput *output;   // Raw frame queued to the write thread block by block
+  size_t jpegLen;
+  std::vector<uint8_t> thumb;
+  double stageMs[STAGE_COUNT];
+  double blockWaitMs;    // Encode time spent waiting for the write thread to free a block or file
+};
+
+static SdShim card;
+static SyntheticCamera camera;
+static uint8_t cardWriteBuffer[SD_WRITE_CHUNK];
+
+static double msSince(Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+static size_t cardFileWrite(void *ctx, const uint8_t *data, size_t len) {
+  return ((File*)ctx)->write(data, len);
+}
+
+static size_t cardWrite(File &file, const uint8_t *data, size_t len) {
+  return cardWriteAligned(file.position(), data, len, cardWriteBuffer, SD_WRITE_CHUNK, cardFileWrite, &file);
+}
+
+static std::string imageName(uint32_t number, const char *suffix) {
+  return "/" + std::to_string(number) + suffix;
+}
+
+// Stand-in for a FreeRTOS queue of capacity items: send blocks while it's
+// full, receive while it's empty
+template <typename T>
+class BoundedQueue {
+public:
+  explicit BoundedQueue(size_t capacity) : capacity(capacity) {}
+  
+  void send(const T &item) {
+    std::unique_lock<std::mutex> guard(lock);
+    notFull.wait(guard, [this] { return items.size() < capacity; });
+    items.push_back(item);
+    notEmpty.notify_one();
+  }
+  
+  T receive() {
+    std::unique_lock<std::mutex> guard(lock);
+    notEmpty.wait(guard, [this] { return !items.empty(); });
+    T item = items.front();
+    items.pop_front();
+    notFull.notify_one();
+    return item;
+  }
+  
+private:
+  size_t capacity;
+  std::deque<T> items;
+  std::mutex lock;
+  std::condition_variable notFull;
+  std::condition_variable notEmpty;
+};
+
+class WriteQueue;
+
+// Like JpegFileSink: written in place, or queued to the write thread
+struct FileSink {
+  File *file;
+  size_t len;
+  double writeMs;       // Time spent writing in place
+  WriteQueue *blocks;   // NULL to write in place
+  bool failed;          // Set by the write thread
+  double waitMs;        // Time spent waiting for a free block
+};
+
+// A block of encoder output on its way to the write thread
+struct SinkBlock {
+  FileSink *sink;
+  uint8_t *data;
+  size_t len;
+};
+
+// A job, or a block when block.data is set. A NULL job ends the run.
+struct WriteItem {
+  BenchJob *job;
+  SinkBlock block;
+};
+
+// Stand-in for writeTask's queue set: jobs (at most PIPELINE_QUEUE_DEPTH
+// waiting) and encoder blocks (bounded by the free blocks) come out in the
+// order they went in
+class WriteQueue {
+public:
+  void sendJob(BenchJob *job) {
+    std::unique_lock<std::mutex> guard(lock);
+    notFull.wait(guard, [this] { return jobs < PIPELINE_QUEUE_DEPTH; });
+    WriteItem item = { job, { NULL, NULL, 0 } };
+    items.push_back(item);
+    jobs++;
+    notEmpty.notify_one();
+  }
+  
+  void sendBlock(const SinkBlock &block) {
+    std::unique_lock<std::mutex> guard(lock);
+    WriteItem item = { NULL, block };
+    items.push_back(item);
+    notEmpty.notify_one();
+  }
+  
+  WriteItem receive() {
+    std::unique_lock<std::mutex> guard(lock);
+    notEmpty.wait(guard, [this] { return !items.empty(); });
+    WriteItem item = items.front();
+    items.pop_front();
+    if (!item.block.data) {
+      jobs--;
+      notFull.notify_one();
+    }
+    return item;
+  }
+  
+private:
+  std::deque<WriteItem> items;
+  int jobs = 0;
+  std::mutex lock;
+  std::condition_variable notFull;
+  std::condition_variable notEmpty;
+};
+
+// Like the sketch's FrameOutput: a raw frame's sink and file from the encode
+// stage until the write stage closes it
+struct FrameOutput {
+  FileSink sink;
+  File file;
+  bool encodeFailed;
+};
+
+static uint8_t sinkBlocks[JPEG_SINK_BLOCKS][JPEG_SINK_BUFFER_SIZE];
+static BoundedQueue<uint8_t*> freeBlocks(JPEG_SINK_BLOCKS);
+static FrameOutput frameOutputs[JPEG_SINK_FILES];
+static BoundedQueue<FrameOutput*> freeOutputs(JPEG_SINK_FILES);
+
+static bool fileSinkWrite(void *ctx, const uint8_t *data, size_t len) {
+  FileSink *sink = (FileSink*)ctx;
+  if (!sink->blocks) {
+    Clock::time_point start = Clock::now();
+    size_t written = cardWrite(*sink->file, data, len);
+    sink->writeMs += msSince(start);
+    sink->len += written;
+    return written == len;
+  }
+  
+  Clock::time_point start = Clock::now();
+  SinkBlock block = { sink, freeBlocks.receive(), len };
+  sink->waitMs += msSince(start);
+  if (sink->failed) {
+    freeBlocks.send(block.data);
+    return false;
+  }
+  memcpy(block.data, data, len);
+  sink->blocks->sendBlock(block);
+  return true;
+}
+
+// writeSinkBlock(): run on the write thread
+static void writeSinkBlock(const SinkBlock &block) {
+  FileSink *sink = block.sink;
+  if (!sink->failed) {
+    size_t written = cardWrite(*sink->file, block.data, block.len);
+    sink->len += written;
+    sink->failed = (written != block.len);
+  }
+  freeBlocks.send(block.data);
+}
+
+
+static bool bufferSinkWrite(void *ctx, const uint8_t *data, size_t len) {
+  std::vector<uint8_t> *out = (std::vector<uint8_t>*)ctx;
+  out->insert(out->end(), data, data + len);
+  return true;
+}
+
+static void grabStage(BenchJob &job) {
+  Clock::time_point start = Clock::now();
+  job.fb = syntheticCameraGrab(camera);
+  job.stageMs[STAGE_GRAB] += msSince(start);
+}
+
+// encodeFrame(): the thumbnail first, then raw frames are encoded into
+// their file and handed back; sensor JPEG passes through. With blocks the
+// output is queued to the write thread, and the write stage closes the
+// file (encodeFrameQueued()).
+static bool encodeStage(BenchJob &job, WriteQueue *blocks) {
+  camera_fb_t *fb = job.fb;
+  Clock::time_point start = Clock::now();
+  uint16_t width, height;
+  int scale;
+  if (fb->format != PIXFORMAT_JPEG && thumbDimensions(fb->width, fb->height, fb->format, &width, &height, &scale)) {
+    pixformat_t format = (fb->format == PIXFORMAT_GRAYSCALE) ? PIXFORMAT_GRAYSCALE : PIXFORMAT_RGB565;
+    std::vector<uint8_t> pixels(width * height * (format == PIXFORMAT_RGB565 ? 2 : 1));
+    thumbSubsample(fb, width, height, scale, pixels.data());
+    bool swap = (format == PIXFORMAT_RGB565 && job.bigEndian);
+    jpegEncode(pixels.data(), width, height, format, swap, THUMB_JPEG_QUALITY, bufferSinkWrite, &job.thumb);
+  }
+  job.stageMs[STAGE_THUMBNAIL] += msSince(start);
+  
+  if (fb->format == PIXFORMAT_JPEG) {
+    job.jpegLen = fb->len;
+    return true;
+  }
+  
+  int quality = captureJpegQuality(job.quality, fb->format, job.frameSize);
+  bool swap = (fb->format == PIXFORMAT_RGB565 && job.bigEndian);
+  if (blocks) {
+    start = Clock::now();
+    FrameOutput *output = freeOutputs.receive();
+    job.blockWaitMs += msSince(start);
+    start = Clock::now();
+    output->file = card.open(imageName(job.number, ".jpg").c_str(), FILE_WRITE);
+    job.stageMs[STAGE_OPEN] += msSince(start);
+    if (!output->file) {
+      freeOutputs.send(output);
+      syntheticCameraReturn(camera, fb);
+      return false;
+    }
+    FileSink sink = { &output->file, 0, 0, blocks, false, 0 };
+    output->sink = sink;
+    start = Clock::now();
+    output->encodeFailed = !jpegEncode(fb->buf, fb->width, fb->height, fb->format, swap, quality,
+                                       fileSinkWrite, &output->sink);
+    job.stageMs[STAGE_ENCODE] += msSince(start) - output->sink.waitMs;
+    job.blockWaitMs += output->sink.waitMs;
+    job.output = output;
+    syntheticCameraReturn(camera, fb);
+    job.fb = NULL;
+    return true;
+  }
+  
+  start = Clock::now();
+  File file = card.open(imageName(job.number, ".jpg").c_str(), FILE_WRITE);
+  job.stageMs[STAGE_OPEN] += msSince(start);
+  if (!file) {
+    syntheticCameraReturn(camera, fb);
+    return false;
+  }
+  FileSink sink = { &file, 0, 0, NULL, false, 0 };
+  start = Clock::now();
+  bool ok = jpegEncode(fb->buf, fb->width, fb->height, fb->format, swap, quality, fileSinkWrite, &sink);
+  job.stageMs[STAGE_ENCODE] += msSince(start) - sink.writeMs;
+  job.stageMs[STAGE_WRITE] += sink.writeMs;
+  start = Clock::now();
+  file.close();
+  job.stageMs[STAGE_CLOSE] += msSince(start);
+  
+  syntheticCameraReturn(camera, fb);
+  job.fb = NULL;
+  job.jpegLen = sink.len;
+  job.written = true;
+  return ok;
+}
+
+// finishFrameOutput(): every block of the frame is written by now
+static bool finishOutput(BenchJob &job) {
+  FrameOutput *output = job.output;
+  job.output = NULL;
+  Clock::time_point start = Clock::now();
+  output->file.close();
+  job.stageMs[STAGE_CLOSE] += msSince(start);
+  bool ok = !output->encodeFailed && !output->sink.failed;
+  job.jpegLen = output->sink.len;
+  job.written = ok;
+  freeOutputs.send(output);
+  return ok;
+}
+
+// writeFrame(): the image unless the encode stage wrote it, then its thumbnail
+static bool writeStage(BenchJob &job) {
+  if (job.output && !finishOutput(job)) {
+    return false;
+  }
+  bool saved = job.written;
+  if (!job.written) {
+    Clock::time_point start = Clock::now();
+    File file = card.open(imageName(job.number, ".jpg").c_str(), FILE_WRITE);
+    job.stageMs[STAGE_OPEN] += msSince(start);
+    if (file) {
+      start = Clock::now();
+      saved = cardWrite(file, job.fb->buf, job.jpegLen) == job.jpegLen;
+      job.stageMs[STAGE_WRITE] += msSince(start);
+      start = Clock::now();
+      file.close();
+      job.stageMs[STAGE_CLOSE] += msSince(start);
+    }
+  }
+  if (saved && !job.thumb.empty()) {
+    Clock::time_point start = Clock::now();
+    File thumb = card.open(imageName(job.number, ".thumb.jpg").c_str(), FILE_WRITE);
+    job.stageMs[STAGE_OPEN] += msSince(start);
+    if (thumb) {
+      start = Clock::now();
+      saved = cardWrite(thumb, job.thumb.data(), job.thumb.size()) == job.thumb.size();
+      job.stageMs[STAGE_WRITE] += msSince(start);
+      start = Clock::now();
+      thumb.close();
+      job.stageMs[STAGE_CLOSE] += msSince(start);
+    }
+  }
+  if (job.fb) {
+    syntheticCameraReturn(camera, job.fb);
+    job.fb = NULL;
+  }
+  return saved;
+}
+
+static void initJob(BenchJob &job, uint32_t number, int quality, framesize_t frameSize, bool bigEndian) {
+  job.fb = NULL;
+  job.number = number;
+  job.quality = quality;
+  job.frameSize = frameSize;
+  job.bigEndian = bigEndian;
+  job.written = false;
+  job.output = NULL;
+  job.jpegLen = 0;
+  job.thumb.clear();
+  job.blockWaitMs = 0;
+  for (int s = 0; s < STAGE_COUNT; s++) {
+    job.stageMs[s] = 0;
+  }
+}
+
+struct RunResult {
+  int frames;
+  size_t bytes;           // Images and thumbnails
+  double elapsedMs;
+  double stageMs[STAGE_COUNT];
+};
+
+static void removeFrame(uint32_t number) {
+  card.remove(imageName(number, ".jpg").c_str());
+  card.remove(imageName(number, ".thumb.jpg").c_str());
+}
+
+// Captures frames one after another until at least minFrames and minMs
+// have gone by, deleting each frame's files before the next; the deletes
+// aren't counted
+static RunResult runSerial(framesize_t frameSize, bool bigEndian, int quality, int minFrames, double minMs) {
+  RunResult result = {};
+  Clock::time_point start = Clock::now();
+  double removeMs = 0;
+  BenchJob job;
+  do {
+    initJob(job, result.frames + 1, quality, frameSize, bigEndian);
+    grabStage(job);
+    TEST_ASSERT_TRUE(encodeStage(job, NULL));
+    TEST_ASSERT_TRUE(writeStage(job));
+    result.frames++;
+    result.bytes += job.jpegLen + job.thumb.size();
+    for (int s = 0; s < STAGE_COUNT; s++) {
+      result.stageMs[s] += job.stageMs[s];
+    }
+    Clock::time_point removeStart = Clock::now();
+    removeFrame(job.number);
+    removeMs += msSince(removeStart);
+  } while (result.frames < minFrames || msSince(start) - removeMs < minMs);
+  result.elapsedMs = msSince(start) - removeMs;
+  return result;
+}
+
+struct PipelineResult {
+  int saved;
+  double elapsedMs;
+  double busyMs[3];  // Time each stage thread spent working: grab, encode, write
+};
+
+// Runs frames through grab, encode and write threads joined by bounded
+// queues, like grabTask, encodeTask and writeTask; a NULL job tells the
+// next stage the run is over. Files are deleted once it's done.
+static PipelineResult runPipelined(framesize_t frameSize, bool bigEndian, int quality, int frames) {
+  PipelineResult result = {};
+  BoundedQueue<BenchJob*> encodeQueue(PIPELINE_QUEUE_DEPTH);
+  WriteQueue writeQueue;
+  std::vector<BenchJob> jobs(frames);
+  
+  Clock::time_point start = Clock::now();
+  std::thread grab([&] {
+    for (int i = 0; i < frames; i++) {
+      Clock::time_point busy = Clock::now();
+      initJob(jobs[i], i + 1, quality, frameSize, bigEndian);
+      grabStage(jobs[i]);
+      result.busyMs[0] += msSince(busy);
+      encodeQueue.send(&jobs[i]);
+    }
+    encodeQueue.send(NULL);
+  });
+  std::thread encode([&] {
+    while (BenchJob *job = encodeQueue.receive()) {
+      Clock::time_point busy = Clock::now();
+      bool ok = encodeStage(*job, &writeQueue);
+      result.busyMs[1] += msSince(busy) - job->blockWaitMs;
+      if (ok) {
+        writeQueue.sendJob(job);
+      }
+    }
+    writeQueue.sendJob(NULL);
+  });
+  std::thread write([&] {
+    for (;;) {
+      WriteItem item = writeQueue.receive();
+      Clock::time_point busy = Clock::now();
+      if (item.block.data) {
+        writeSinkBlock(item.block);
+      } else if (!item.job) {
+        break;
+      } else if (writeStage(*item.job)) {
+        result.saved++;
+      }
+      result.busyMs[2] += msSince(busy);
+    }
+  });
+  grab.join();
+  encode.join();
+  write.join();
+  result.elapsedMs = msSince(start);
+  
+  for (int i = 0; i < frames; i++) {
+    removeFrame(i + 1);
+  }
+  return result;
+}
+
+struct Format {
+  pixformat_t format;
+  bool bigEndian;
+  const char *name;
+};
+
+static const Format formats[] = {
+  { PIXFORMAT_RGB565, false, "RGB565 LE" }, { PIXFORMAT_RGB565, true, "RGB565 BE" },
+  { PIXFORMAT_GRAYSCALE, false, "Grayscale" }, { PIXFORMAT_JPEG, false, "JPEG" },
+};
+
+static const char *sizeNames[FRAMESIZE_INVALID] = {
+  "96X96", "QQVGA", "QCIF", "HQVGA", "240X240", "QVGA", "CIF", "HVGA", "VGA", "SVGA", "XGA", "HD", "SXGA", "UXGA",
+};
+
+static const int qualities[] = { 12, 40, 63 };  // Camera quality setting (0-63); 12 is the default
+
+static void benchFormat(const Format &format) {
+  printf("\n%-8s %-9s %-3s %7s %9s %9s", "size", "format", "Q", "fps", "KB/frame", "KB/s");
+  for (int s = 0; s < STAGE_COUNT; s++) {
+    printf(" %7s", stageNames[s]);
+  }
+  printf("   (ms per frame)\n");
+  
+  for (int size = 0; size < FRAMESIZE_INVALID; size++) {
+    for (size_t q = 0; q < sizeof(qualities) / sizeof(qualities[0]); q++) {
+      int jpegQuality = captureJpegQuality(qualities[q], PIXFORMAT_RGB565, (framesize_t)size);
+      TEST_ASSERT_TRUE(syntheticCameraInit(camera, (framesize_t)size, format.format, jpegQuality, FB_COUNT));
+      RunResult result = runSerial((framesize_t)size, format.bigEndian, qualities[q], 3, 150);
+      printf("%-8s %-9s %-3d %7.1f %9.1f %9.0f", sizeNames[size], format.name, qualities[q],
+             result.frames * 1000.0 / result.elapsedMs, result.bytes / 1024.0 / result.frames,
+             result.bytes / 1024.0 * 1000.0 / result.elapsedMs);
+      for (int st = 0; st < STAGE_COUNT; st++) {
+        printf(" %7.3f", result.stageMs[st] / result.frames);
+      }
+      printf("\n");
+    }
+  }
+}
+
+// Serial against pipelined at the default quality, the same number of
+// frames each. Each thread's working time per frame is listed (the grab's
+// without its waits for a free frame buffer, the encode's without its waits
+// for a free block, which count as the writer's); serial should run at
+// 1000 / their sum, the pipeline at 1000 / the largest of them ("bound"),
+// and is asserted to get within PIPELINE_MIN_EFFICIENCY of it.
+static void comparePipelined(const Format &format) {
+  static const framesize_t sizes[] = { FRAMESIZE_QVGA, FRAMESIZE_VGA, FRAMESIZE_XGA, FRAMESIZE_SXGA, FRAMESIZE_UXGA };
+  const int quality = 12;
+  card.setTiming(CARD_WRITE_LATENCY_MS, CARD_WRITE_MBPS);
+  printf("\nCard model: %.2f ms per write + %.1f MB/s\n", CARD_WRITE_LATENCY_MS, CARD_WRITE_MBPS);
+  printf("%-8s %-9s %10s %10s %10s %8s %8s %8s %8s   (ms per frame)\n",
+         "size", "format", "serial fps", "piped fps", "bound fps", "speedup", "grab", "encode", "write");
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    int jpegQuality = captureJpegQuality(quality, PIXFORMAT_RGB565, sizes[s]);
+    TEST_ASSERT_TRUE(syntheticCameraInit(camera, sizes[s], format.format, jpegQuality, FB_COUNT));
+    RunResult serial = runSerial(sizes[s], format.bigEndian, quality, 20, 300);
+    camera.waitedMs = 0;
+    PipelineResult piped = runPipelined(sizes[s], format.bigEndian, quality, serial.frames);
+    TEST_ASSERT_EQUAL(serial.frames, piped.saved);
+    piped.busyMs[0] -= camera.waitedMs;
+  
+    double slowest = 0;
+    for (int t = 0; t < 3; t++) {
+      piped.busyMs[t] /= piped.saved;
+      if (piped.busyMs[t] > slowest) slowest = piped.busyMs[t];
+    }
+    double serialFps = serial.frames * 1000.0 / serial.elapsedMs;
+    double pipedFps = piped.saved * 1000.0 / piped.elapsedMs;
+    double boundFps = 1000.0 / slowest;
+    printf("%-8s %-9s %10.1f %10.1f %10.1f %7.2fx %8.3f %8.3f %8.3f\n", sizeNames[sizes[s]], format.name,
+           serialFps, pipedFps, boundFps, pipedFps / serialFps, piped.busyMs[0], piped.busyMs[1], piped.busyMs[2]);
+    char message[96];
+    snprintf(message, sizeof(message), "%s %s: piped %.1f fps, bound %.1f fps", sizeNames[sizes[s]], format.name,
+             pipedFps, boundFps);
+    TEST_ASSERT_TRUE_MESSAGE(pipedFps >= PIPELINE_MIN_EFFICIENCY * boundFps, message);
+  }
+  card.setTiming(0, 0);
+}
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+void test_pipeline_rgb565_le(void) {
+  benchFormat(formats[0]);
+}
+
+void test_pipeline_rgb565_be(void) {
+  benchFormat(formats[1]);
+}
+
+void test_pipeline_grayscale(void) {
+  benchFormat(formats[2]);
+}
+
+void test_pipeline_jpeg(void) {
+  benchFormat(formats[3]);
+}
+
+void test_pipelined_vs_serial(void) {
+  for (size_t f = 0; f < sizeof(formats) / sizeof(formats[0]); f++) {
+    comparePipelined(formats[f]);
+  }
+}
+
+int main(int argc, char **argv) {
+  jpegInitTables();
+  for (int i = 0; i < JPEG_SINK_BLOCKS; i++) {
+    freeBlocks.send(sinkBlocks[i]);
+  }
+  for (int i = 0; i < JPEG_SINK_FILES; i++) {
+    freeOutputs.send(&frameOutputs[i]);
+  }
+  if (!card.begin()) {
+    printf("Couldn't create the SD shim directory\n");
+    return 1;
+  }
+  UNITY_BEGIN();
+  RUN_TEST(test_pipeline_rgb565_le);
+  RUN_TEST(test_pipeline_rgb565_be);
+  RUN_TEST(test_pipeline_grayscale);
+  RUN_TEST(test_pipeline_jpeg);
+  RUN_TEST(test_pipelined_vs_serial);
+  card.end();
+  return UNITY_END();
+}
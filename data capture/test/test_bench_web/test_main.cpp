@@ -0,0 +1,430 @@
+// Host benchmark for the web layer during a burst: a capture thread writes
+// BURST_FRAMES frames and their thumbnails to the SD shim, under the card
+// model, and adds them to an index, while WEB_CLIENTS client threads fetch
+// a status route, /list pages, thumbnails and images through a single
+// server thread that handles one request at a time, as httpTask does. The
+// card routes are the ones in web_routes.cpp. Each run is done twice: with
+// bodies sent by the server thread itself, and with them handed to
+// WEB_SENDER_TASKS sender threads, as main.cpp does. Reports p50/p95/p99
+// per route of the time to the headers (waiting for the server included)
+// and to the last byte, and fails if with senders any route's p99 to the
+// headers is over WEB_MAX_P99_MS, like load_test.py --max-p99 on a board.
+//
+//   pio test -e native_bench -f test_bench_web -v
+
+#include <unity.h>
+#include <stdio.h>
+#include <time.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "web_routes.h"
+#include "web_server_mock.h"
+#include "jpeg_host.h"  // env:native links the encoder into every suite
+#include "sd_shim.h"
+
+#define SD_WRITE_CHUNK          16384  // As in main.cpp
+#define WEB_SENDER_TASKS        2      // As in main.cpp
+#define WEB_SENDER_QUEUE_DEPTH  8      // As in main.cpp
+#define WEB_SENDER_BUFFER_SIZE  4096   // As in main.cpp
+
+#define BURST_FRAMES    200
+#define INITIAL_IMAGES  20      // On the card before the burst starts
+#define FRAME_BYTES     61440   // About an SVGA JPEG
+#define THUMB_BYTES     4096
+#define WEB_CLIENTS     4
+#define LIST_LIMIT      "20"    // As the gallery pages /list
+
+// Card and link model; -D any of them to try others
+#ifndef CARD_WRITE_LATENCY_MS
+#define CARD_WRITE_LATENCY_MS 0.5
+#endif
+#ifndef CARD_WRITE_MBPS
+#define CARD_WRITE_MBPS 4.0
+#endif
+#ifndef WEB_CLIENT_KBPS
+#define WEB_CLIENT_KBPS 1500.0  // Per connection, about what one browser gets over WiFi
+#endif
+#ifndef WEB_MAX_P99_MS
+#define WEB_MAX_P99_MS 50.0
+#endif
+
+typedef std::chrono::steady_clock Clock;
+
+enum Route { ROUTE_STATUS, ROUTE_LIST, ROUTE_THUMB, ROUTE_IMAGE, ROUTE_COUNT };
+static const char *routeNames[ROUTE_COUNT] = { "/status", "/list", "/thumb", "/image" };
+
+static SdShim card;
+
+static double msBetween(Clock::time_point start, Clock::time_point end) {
+  return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+static std::string imageName(uint32_t number, const char *suffix) {
+  return "/" + std::to_string(number) + suffix;
+}
+
+// Stand-in for a FreeRTOS queue of capacity items: trySend() fails while
+// it's full, receive() blocks while it's empty
+template <typename T>
+class BoundedQueue {
+public:
+  explicit BoundedQueue(size_t capacity) : capacity(capacity) {}
+  
+  bool trySend(const T &item) {
+    std::unique_lock<std::mutex> guard(lock);
+    if (items.size() >= capacity) {
+      return false;
+    }
+    items.push_back(item);
+    notEmpty.notify_one();
+    return true;
+  }
+  
+  T receive() {
+    std::unique_lock<std::mutex> guard(lock);
+    notEmpty.wait(guard, [this] { return !items.empty(); });
+    T item = items.front();
+    items.pop_front();
+    return item;
+  }
+  
+private:
+  size_t capacity;
+  std::deque<T> items;
+  std::mutex lock;
+  std::condition_variable notEmpty;
+};
+
+class ShimFile : public WebFile {
+public:
+  ShimFile(const File &file) : file(file) {}
+  
+  ~ShimFile() {
+    file.close();
+  }
+  
+  bool seek(uint32_t position) {
+    return file.seek(position);
+  }
+  
+  size_t read(uint8_t *buf, size_t len) {
+    return file.read(buf, len);
+  }
+  
+private:
+  File file;
+};
+
+// Like webSenderTask: sends queued bodies one after another through a
+// buffer of its own. A job with no body stops it.
+static void senderThread(BoundedQueue<WebBodyJob> *queue) {
+  std::vector<uint8_t> buf(WEB_SENDER_BUFFER_SIZE);
+  while (true) {
+    WebBodyJob job = queue->receive();
+    if (!job.body) break;
+    webSendBody(job, buf.data(), buf.size());
+  }
+}
+
+// The index and card of main.cpp's CardBackend, over the shim. senders is
+// NULL to have the server send every body itself.
+class BenchBackend : public WebBackend {
+public:
+  BenchBackend() : senders(NULL), indexGeneration(0) {}
+  
+  bool cardPresent() {
+    return true;
+  }
+  
+  bool lookup(uint32_t number, ImageInfo &info) {
+    std::unique_lock<std::mutex> guard(lock);
+    std::vector<ImageInfo>::iterator it = std::lower_bound(index.begin(), index.end(), number,
+      [](const ImageInfo &entry, uint32_t n) { return entry.number < n; });
+    if (it == index.end() || it->number != number) {
+      return false;
+    }
+    info = *it;
+    return true;
+  }
+  
+  int listAfter(uint32_t after, ImageInfo *out, int max, bool *more) {
+    std::unique_lock<std::mutex> guard(lock);
+    std::vector<ImageInfo>::iterator it = std::upper_bound(index.begin(), index.end(), after,
+      [](uint32_t n, const ImageInfo &entry) { return n < entry.number; });
+    int count = 0;
+    while (it != index.end() && count < max) {
+      out[count++] = *it++;
+    }
+    *more = it != index.end();
+    return count;
+  }
+  
+  uint32_t generation() {
+    std::unique_lock<std::mutex> guard(lock);
+    return indexGeneration;
+  }
+  
+  std::string token(uint32_t generation) {
+    return "b-" + std::to_string(generation);
+  }
+  
+  bool changesSince(const std::string &token, std::vector<uint32_t> &numbers, uint32_t *generation) {
+    *generation = this->generation();
+    return false;
+  }
+  
+  WebFile *openImage(const ImageInfo &info, bool thumb, uint32_t *offset, uint32_t *length) {
+    File file = card.open(imageName(info.number, (thumb && (info.flags & IMAGE_FLAG_THUMB)) ? "_t.jpg" : ".jpg").c_str(), FILE_READ);
+    if (!file) {
+      return NULL;
+    }
+    *offset = 0;
+    *length = file.size();
+    return new ShimFile(file);
+  }
+  
+  bool startBody(const WebBodyJob &job) {
+    return senders && senders->trySend(job);
+  }
+  
+  void add(uint32_t number) {
+    ImageInfo info = { number, FRAME_BYTES, (uint32_t)time(NULL), IMAGE_FLAG_THUMB, 0, 0 };
+    std::unique_lock<std::mutex> guard(lock);
+    index.push_back(info);
+    indexGeneration++;
+  }
+  
+  uint32_t count() {
+    std::unique_lock<std::mutex> guard(lock);
+    return index.size();
+  }
+  
+  BoundedQueue<WebBodyJob> *senders;
+  
+private:
+  std::mutex lock;
+  std::vector<ImageInfo> index;
+  uint32_t indexGeneration;
+};
+
+// One request on its way to the server thread
+struct BenchRequest {
+  Route route;
+  MockRequest request;
+  MockClient client;
+  Clock::time_point sent;
+};
+
+// What the clients saw, per route
+struct RouteTimes {
+  std::vector<double> headersMs;
+  std::vector<double> completeMs;
+  int errors;
+};
+
+struct RunResult {
+  RouteTimes routes[ROUTE_COUNT];
+  double burstMs;
+};
+
+static bool writeFile(const std::string &name, size_t size) {
+  static uint8_t data[SD_WRITE_CHUNK];
+  File file = card.open(name.c_str(), FILE_WRITE);
+  if (!file) {
+    return false;
+  }
+  size_t written = 0;
+  while (written < size) {
+    size_t chunk = std::min(size - written, sizeof(data));
+    if (file.write(data, chunk) != chunk) break;
+    written += chunk;
+  }
+  file.close();
+  return written == size;
+}
+
+static bool saveImage(BenchBackend &backend, uint32_t number) {
+  if (!writeFile(imageName(number, ".jpg"), FRAME_BYTES) || !writeFile(imageName(number, "_t.jpg"), THUMB_BYTES)) {
+    return false;
+  }
+  backend.add(number);
+  return true;
+}
+
+// Handles requests one at a time until it gets NULL, like httpTask
+static void serverThread(BenchBackend *backend, BoundedQueue<BenchRequest*> *requests) {
+  while (true) {
+    BenchRequest *request = requests->receive();
+    if (!request) break;
+    MockResponse response(request->client);
+    switch (request->route) {
+      case ROUTE_STATUS:
+        response.send(200, "application/json", "{\"inProgress\":true}");
+        break;
+      case ROUTE_LIST:
+        webHandleList(request->request, response, *backend);
+        break;
+      default:
+        webHandleImage(request->request, response, *backend, request->route == ROUTE_THUMB);
+        break;
+    }
+  }
+}
+
+// Polls the status, then fetches a page of /list, a thumbnail and an image,
+// over and over until the burst is saved
+static void clientThread(BenchBackend *backend, BoundedQueue<BenchRequest*> *requests, std::atomic<bool> *done,
+                         RunResult *result, std::mutex *resultLock, int seed) {
+  std::mt19937 random(seed);
+  int route = 0;
+  while (!*done) {
+    BenchRequest request;
+    request.route = (Route)route;
+    request.client.kBps = WEB_CLIENT_KBPS;
+    uint32_t number = 1 + random() % backend->count();
+    if (request.route == ROUTE_LIST) {
+      request.request.args["after"] = std::to_string(number > 10 ? number - 10 : 0);
+      request.request.args["limit"] = LIST_LIMIT;
+    } else if (request.route != ROUTE_STATUS) {
+      request.request.args["n"] = std::to_string(number);
+    }
+    request.sent = Clock::now();
+    requests->trySend(&request);
+    request.client.waitComplete();
+  
+    bool ok = request.client.code == 200;
+    if (request.route == ROUTE_LIST) {
+      ok = ok && mockUnchunk(request.client.body).find("\"token\":") != std::string::npos;
+    } else if (request.route != ROUTE_STATUS) {
+      ok = ok && request.client.body.size() == (request.route == ROUTE_THUMB ? THUMB_BYTES : FRAME_BYTES);
+    }
+    std::unique_lock<std::mutex> guard(*resultLock);
+    RouteTimes &times = result->routes[route];
+    times.headersMs.push_back(msBetween(request.sent, request.client.headersAt));
+    times.completeMs.push_back(msBetween(request.sent, request.client.completeAt));
+    if (!ok) {
+      times.errors++;
+    }
+    guard.unlock();
+    route = (route + 1) % ROUTE_COUNT;
+  }
+}
+
+static RunResult runBurst(bool useSenders) {
+  RunResult result;
+  for (int r = 0; r < ROUTE_COUNT; r++) {
+    result.routes[r].errors = 0;
+  }
+  TEST_ASSERT_TRUE_MESSAGE(card.begin(), "Couldn't create the SD shim directory");
+  card.setTiming(0, 0);
+  BenchBackend backend;
+  for (uint32_t n = 1; n <= INITIAL_IMAGES; n++) {
+    TEST_ASSERT_TRUE(saveImage(backend, n));
+  }
+  card.setTiming(CARD_WRITE_LATENCY_MS, CARD_WRITE_MBPS);
+  
+  BoundedQueue<WebBodyJob> senderQueue(WEB_SENDER_QUEUE_DEPTH);
+  std::vector<std::thread> senders;
+  if (useSenders) {
+    backend.senders = &senderQueue;
+    for (int i = 0; i < WEB_SENDER_TASKS; i++) {
+      senders.push_back(std::thread(senderThread, &senderQueue));
+    }
+  }
+  BoundedQueue<BenchRequest*> requests(WEB_CLIENTS + 1);
+  std::thread server(serverThread, &backend, &requests);
+  std::atomic<bool> done(false);
+  std::mutex resultLock;
+  std::vector<std::thread> clients;
+  for (int i = 0; i < WEB_CLIENTS; i++) {
+    clients.push_back(std::thread(clientThread, &backend, &requests, &done, &result, &resultLock, i + 1));
+  }
+  
+  Clock::time_point start = Clock::now();
+  bool saved = true;
+  for (uint32_t n = INITIAL_IMAGES + 1; n <= INITIAL_IMAGES + BURST_FRAMES && saved; n++) {
+    saved = saveImage(backend, n);
+  }
+  result.burstMs = msBetween(start, Clock::now());
+  done = true;
+  
+  for (size_t i = 0; i < clients.size(); i++) {
+    clients[i].join();
+  }
+  requests.trySend(NULL);
+  server.join();
+  for (size_t i = 0; i < senders.size(); i++) {
+    WebBodyJob stop = { NULL, NULL, false };
+    while (!senderQueue.trySend(stop)) {
+      std::this_thread::yield();
+    }
+  }
+  for (size_t i = 0; i < senders.size(); i++) {
+    senders[i].join();
+  }
+  card.end();
+  TEST_ASSERT_TRUE_MESSAGE(saved, "Burst frame not written");
+  return result;
+}
+
+static double percentile(std::vector<double> values, double fraction) {
+  if (values.empty()) {
+    return 0;
+  }
+  std::sort(values.begin(), values.end());
+  size_t rank = (size_t)(fraction * values.size() + 0.999999);
+  return values[std::max(rank, (size_t)1) - 1];
+}
+
+static void printRun(const char *mode, const RunResult &result) {
+  for (int r = 0; r < ROUTE_COUNT; r++) {
+    const RouteTimes &times = result.routes[r];
+    printf("%-8s %-8s %6d %6d %8.2f %8.2f %8.2f %8.2f %8.2f %8.2f\n", mode, routeNames[r],
+           (int)times.headersMs.size(), times.errors,
+           percentile(times.headersMs, 0.50), percentile(times.headersMs, 0.95), percentile(times.headersMs, 0.99),
+           percentile(times.completeMs, 0.50), percentile(times.completeMs, 0.95), percentile(times.completeMs, 0.99));
+  }
+}
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+void test_routes_during_burst(void) {
+  printf("\n%d-frame burst, %d clients; card %.2f ms per transfer + %.1f MB/s, clients %.0f KB/s\n",
+         BURST_FRAMES, WEB_CLIENTS, CARD_WRITE_LATENCY_MS, CARD_WRITE_MBPS, WEB_CLIENT_KBPS);
+  printf("%-8s %-8s %6s %6s %8s %8s %8s %8s %8s %8s   (ms from request)\n", "bodies", "route", "count", "errors",
+         "hdr p50", "hdr p95", "hdr p99", "end p50", "end p95", "end p99");
+  
+  RunResult inlineRun = runBurst(false);
+  printRun("server", inlineRun);
+  RunResult senderRun = runBurst(true);
+  printRun("senders", senderRun);
+  printf("Burst saved in %.0f ms (bodies from the server) and %.0f ms (from senders)\n", inlineRun.burstMs, senderRun.burstMs);
+  
+  for (int r = 0; r < ROUTE_COUNT; r++) {
+    TEST_ASSERT_EQUAL_INT(0, inlineRun.routes[r].errors);
+    TEST_ASSERT_EQUAL_INT(0, senderRun.routes[r].errors);
+    TEST_ASSERT_TRUE(senderRun.routes[r].headersMs.size() > 0);
+    char message[96];
+    double p99 = percentile(senderRun.routes[r].headersMs, 0.99);
+    snprintf(message, sizeof(message), "%s: p99 %.1f ms to the headers", routeNames[r], p99);
+    TEST_ASSERT_TRUE_MESSAGE(p99 <= WEB_MAX_P99_MS, message);
+  }
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_routes_during_burst);
+  return UNITY_END();
+}
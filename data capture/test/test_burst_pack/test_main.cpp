@@ -0,0 +1,158 @@
+// Checks the burst pack layout: field positions on the card, and a pack
+// assembled in memory the way the burst job writes one, read back the way
+// the index and /burst read it.
+
+#include <unity.h>
+#include <string.h>
+#include <vector>
+#include "burst_pack.h"
+#include "jpeg_host.h"  // env:native links the encoder into every suite
+
+static uint32_t read32(const std::vector<uint8_t> &file, size_t at) {
+  return file[at] | (file[at + 1] << 8) | (file[at + 2] << 16) | ((uint32_t)file[at + 3] << 24);
+}
+
+static void append(std::vector<uint8_t> &file, const void *data, size_t len) {
+  file.insert(file.end(), (const uint8_t*)data, (const uint8_t*)data + len);
+}
+
+struct Frame {
+  std::vector<uint8_t> jpeg;
+  std::vector<uint8_t> thumb;
+  uint32_t timeMs;
+};
+
+static std::vector<Frame> makeFrames() {
+  std::vector<Frame> frames;
+  for (int i = 0; i < 5; i++) {
+    Frame frame;
+    frame.jpeg.assign(1000 + i * 333, (uint8_t)(0x10 + i));
+    if (i != 2) {
+      frame.thumb.assign(100 + i, (uint8_t)(0xA0 + i));  // Frame 2 has no thumbnail
+    }
+    frame.timeMs = i * 40;
+    frames.push_back(frame);
+  }
+  return frames;
+}
+
+// Header, frames with their thumbnails, index table, then the header
+// rewritten with the count and index offset: burstPackBegin/Append/End
+static std::vector<uint8_t> writePack(const std::vector<Frame> &frames, uint32_t firstNumber) {
+  std::vector<uint8_t> file;
+  BurstPackHeader header;
+  burstPackHeaderInit(header, 7, 1700000000);
+  append(file, &header, sizeof(header));
+  
+  std::vector<BurstPackEntry> entries;
+  for (size_t i = 0; i < frames.size(); i++) {
+    BurstPackEntry entry;
+    entry.number = firstNumber + i;
+    entry.offset = file.size();
+    entry.size = frames[i].jpeg.size();
+    append(file, frames[i].jpeg.data(), frames[i].jpeg.size());
+    entry.thumbOffset = frames[i].thumb.empty() ? 0 : file.size();
+    entry.thumbSize = frames[i].thumb.size();
+    append(file, frames[i].thumb.data(), frames[i].thumb.size());
+    entry.timeMs = frames[i].timeMs;
+    entries.push_back(entry);
+  }
+  
+  header.frameCount = entries.size();
+  header.indexOffset = file.size();
+  append(file, entries.data(), entries.size() * sizeof(BurstPackEntry));
+  memcpy(file.data(), &header, sizeof(header));
+  return file;
+}
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+void test_field_positions(void) {
+  std::vector<Frame> frames = makeFrames();
+  std::vector<uint8_t> file = writePack(frames, 100);
+  
+  TEST_ASSERT_EQUAL_MEMORY("XBURST01", file.data(), 8);
+  TEST_ASSERT_EQUAL_UINT32(7, read32(file, 8));             // burstId
+  TEST_ASSERT_EQUAL_UINT32(frames.size(), read32(file, 12));  // frameCount
+  uint32_t indexOffset = read32(file, 16);
+  TEST_ASSERT_EQUAL_UINT32(1700000000, read32(file, 20));   // startTime
+  TEST_ASSERT_EQUAL_UINT32(0, read32(file, 24));
+  TEST_ASSERT_EQUAL_UINT32(0, read32(file, 28));
+  
+  // The index table is the last thing in the file, 24 bytes a frame
+  TEST_ASSERT_EQUAL_size_t(file.size(), indexOffset + frames.size() * 24);
+  
+  // First entry: frame 0 right after the header, its thumbnail after it
+  TEST_ASSERT_EQUAL_UINT32(100, read32(file, indexOffset));
+  TEST_ASSERT_EQUAL_UINT32(32, read32(file, indexOffset + 4));
+  TEST_ASSERT_EQUAL_UINT32(frames[0].jpeg.size(), read32(file, indexOffset + 8));
+  TEST_ASSERT_EQUAL_UINT32(32 + frames[0].jpeg.size(), read32(file, indexOffset + 12));
+  TEST_ASSERT_EQUAL_UINT32(frames[0].thumb.size(), read32(file, indexOffset + 16));
+  TEST_ASSERT_EQUAL_UINT32(0, read32(file, indexOffset + 20));
+}
+
+// What indexBurstPack() and openBurstFrame() do
+void test_frames_read_back(void) {
+  std::vector<Frame> frames = makeFrames();
+  std::vector<uint8_t> file = writePack(frames, 100);
+  
+  BurstPackHeader header;
+  memcpy(&header, file.data(), sizeof(header));
+  TEST_ASSERT_TRUE(burstPackHeaderValid(header));
+  for (uint32_t i = 0; i < header.frameCount; i++) {
+    BurstPackEntry entry;
+    memcpy(&entry, file.data() + burstPackEntryOffset(header, i), sizeof(entry));
+    TEST_ASSERT_EQUAL_UINT32(100 + i, entry.number);
+    TEST_ASSERT_EQUAL_UINT32(frames[i].timeMs, entry.timeMs);
+    TEST_ASSERT_EQUAL_size_t(frames[i].jpeg.size(), entry.size);
+    TEST_ASSERT_EQUAL_MEMORY(frames[i].jpeg.data(), file.data() + entry.offset, entry.size);
+    TEST_ASSERT_EQUAL_size_t(frames[i].thumb.size(), entry.thumbSize);
+    if (entry.thumbSize) {
+      TEST_ASSERT_EQUAL_MEMORY(frames[i].thumb.data(), file.data() + entry.thumbOffset, entry.thumbSize);
+    } else {
+      TEST_ASSERT_EQUAL_UINT32(0, entry.thumbOffset);
+    }
+  }
+}
+
+// A burst that never finished still has the header from burstPackBegin()
+void test_unfinished_pack_is_invalid(void) {
+  BurstPackHeader header;
+  burstPackHeaderInit(header, 3, 0);
+  TEST_ASSERT_FALSE(burstPackHeaderValid(header));
+  header.indexOffset = 32;
+  TEST_ASSERT_TRUE(burstPackHeaderValid(header));
+  header.magic[7] = '2';
+  TEST_ASSERT_FALSE(burstPackHeaderValid(header));
+}
+
+// Deleting one frame blanks the first four bytes of its entry
+void test_deleted_frame_blanks_number(void) {
+  std::vector<Frame> frames = makeFrames();
+  std::vector<uint8_t> file = writePack(frames, 100);
+  BurstPackHeader header;
+  memcpy(&header, file.data(), sizeof(header));
+  
+  uint32_t blank = 0;
+  memcpy(file.data() + burstPackEntryOffset(header, 3), &blank, sizeof(blank));
+  
+  BurstPackEntry entry;
+  memcpy(&entry, file.data() + burstPackEntryOffset(header, 3), sizeof(entry));
+  TEST_ASSERT_EQUAL_UINT32(0, entry.number);
+  TEST_ASSERT_EQUAL_size_t(frames[3].jpeg.size(), entry.size);
+  memcpy(&entry, file.data() + burstPackEntryOffset(header, 4), sizeof(entry));
+  TEST_ASSERT_EQUAL_UINT32(104, entry.number);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_field_positions);
+  RUN_TEST(test_frames_read_back);
+  RUN_TEST(test_unfinished_pack_is_invalid);
+  RUN_TEST(test_deleted_frame_blanks_number);
+  return UNITY_END();
+}
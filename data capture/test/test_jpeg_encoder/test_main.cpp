@@ -0,0 +1,368 @@
+// Round-trip tests for the raw-frame JPEG encoder: frames are encoded,
+// decoded again by the small baseline decoder below, and compared with the
+// source pixels.
+
+#include <unity.h>
+#include <math.h>
+#include <string.h>
+#include <vector>
+#include "jpeg_encoder.h"
+#include "jpeg_host.h"
+
+static bool collect(void *ctx, const uint8_t *data, size_t len) {
+  std::vector<uint8_t> *out = (std::vector<uint8_t>*)ctx;
+  out->insert(out->end(), data, data + len);
+  return true;
+}
+
+static std::vector<uint8_t> encode(const std::vector<uint8_t> &pixels, int width, int height, pixformat_t format,
+                                   bool swapBytes, int quality) {
+  std::vector<uint8_t> out;
+  TEST_ASSERT_TRUE(jpegEncode(pixels.data(), width, height, format, swapBytes, quality, collect, &out));
+  return out;
+}
+
+// A smooth test card in the sensor's RGB565 byte order (high byte first),
+// or swapped
+static std::vector<uint8_t> makeRgb565(int width, int height, bool swapped) {
+  std::vector<uint8_t> pixels(width * height * 2);
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      int r = x * 31 / (width > 1 ? width - 1 : 1);
+      int g = y * 63 / (height > 1 ? height - 1 : 1);
+      int b = 31 - (x + y) * 31 / (width + height - 2 > 0 ? width + height - 2 : 1);
+      uint16_t p = (r << 11) | (g << 5) | b;
+      uint8_t *out = &pixels[(y * width + x) * 2];
+      out[swapped ? 1 : 0] = p >> 8;
+      out[swapped ? 0 : 1] = p & 0xFF;
+    }
+  }
+  return pixels;
+}
+
+static std::vector<uint8_t> makeGray(int width, int height) {
+  std::vector<uint8_t> pixels(width * height);
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      pixels[y * width + x] = (uint8_t)(64 + 96 * sin(x * 0.05) * cos(y * 0.07) + 64);
+    }
+  }
+  return pixels;
+}
+
+// --- Minimal baseline decoder: one scan, no restart markers, 4:2:0 or gray ---
+
+static const uint8_t zigzag[64] = {
+   0,  1,  8, 16,  9,  2,  3, 10, 17, 24, 32, 25, 18, 11,  4,  5,
+  12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13,  6,  7, 14, 21, 28,
+  35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+  58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63
+};
+
+struct Huffman {
+  int maxCode[18];
+  int valPtr[17];
+  int minCode[17];
+  uint8_t vals[256];
+};
+
+struct Decoded {
+  int width;
+  int height;
+  int components;
+  std::vector<uint8_t> pixels;  // RGB888 or gray
+};
+
+struct BitReader {
+  const uint8_t *data;
+  size_t len;
+  size_t pos;
+  uint32_t bits;
+  int count;
+
+  int bit() {
+    if (count == 0) {
+      uint8_t b = pos < len ? data[pos++] : 0;
+      if (b == 0xFF) {
+        pos++;  // Stuffed zero
+      }
+      bits = b;
+      count = 8;
+    }
+    count--;
+    return (bits >> count) & 1;
+  }
+
+  int receive(int n) {
+    int v = 0;
+    for (int i = 0; i < n; i++) v = (v << 1) | bit();
+    return v;
+  }
+};
+
+static void buildHuffman(Huffman &h, const uint8_t *counts, const uint8_t *vals, int total) {
+  memcpy(h.vals, vals, total);
+  int code = 0;
+  int k = 0;
+  for (int len = 1; len <= 16; len++) {
+    h.valPtr[len] = k;
+    h.minCode[len] = code;
+    code += counts[len - 1];
+    k += counts[len - 1];
+    h.maxCode[len] = counts[len - 1] ? code - 1 : -1;
+    code <<= 1;
+  }
+  h.maxCode[17] = 0x7FFFFFFF;
+}
+
+static int decodeSymbol(BitReader &in, const Huffman &h) {
+  int code = in.bit();
+  int len = 1;
+  while (len <= 16 && code > h.maxCode[len]) {
+    code = (code << 1) | in.bit();
+    len++;
+  }
+  if (len > 16) return -1;
+  return h.vals[h.valPtr[len] + code - h.minCode[len]];
+}
+
+static int extend(int v, int n) {
+  return (n && v < (1 << (n - 1))) ? v - (1 << n) + 1 : v;
+}
+
+static void idct(const int *coef, uint8_t *out, int stride) {
+  for (int y = 0; y < 8; y++) {
+    for (int x = 0; x < 8; x++) {
+      double sum = 0;
+      for (int v = 0; v < 8; v++) {
+        for (int u = 0; u < 8; u++) {
+          double cu = u ? 1.0 : M_SQRT1_2;
+          double cv = v ? 1.0 : M_SQRT1_2;
+          sum += cu * cv * coef[v * 8 + u] * cos((2 * x + 1) * u * M_PI / 16) * cos((2 * y + 1) * v * M_PI / 16);
+        }
+      }
+      int value = (int)lround(sum / 4 + 128);
+      out[y * stride + x] = value < 0 ? 0 : (value > 255 ? 255 : value);
+    }
+  }
+}
+
+static bool decode(const std::vector<uint8_t> &jpeg, Decoded &result) {
+  const uint8_t *p = jpeg.data();
+  size_t len = jpeg.size();
+  if (len < 4 || p[0] != 0xFF || p[1] != 0xD8 || p[len - 2] != 0xFF || p[len - 1] != 0xD9) return false;
+
+  uint8_t quant[4][64];
+  Huffman dc[4], ac[4];
+  int compQuant[3] = { 0 }, compH[3] = { 1 }, compV[3] = { 1 }, compDc[3] = { 0 }, compAc[3] = { 0 };
+  size_t pos = 2;
+  while (pos + 4 <= len) {
+    if (p[pos] != 0xFF) return false;
+    uint8_t marker = p[pos + 1];
+    size_t segment = (p[pos + 2] << 8) | p[pos + 3];
+    const uint8_t *s = p + pos + 4;
+    if (marker == 0xDB) {
+      for (size_t i = 0; i + 65 <= segment - 2; i += 65) {
+        memcpy(quant[s[i] & 3], s + i + 1, 64);
+      }
+    } else if (marker == 0xC0) {
+      result.height = (s[1] << 8) | s[2];
+      result.width = (s[3] << 8) | s[4];
+      result.components = s[5];
+      for (int c = 0; c < result.components; c++) {
+        compH[c] = s[7 + c * 3] >> 4;
+        compV[c] = s[7 + c * 3] & 15;
+        compQuant[c] = s[8 + c * 3];
+      }
+    } else if (marker == 0xC4) {
+      size_t i = 0;
+      while (i < segment - 2) {
+        int tableClass = s[i] >> 4;
+        int id = s[i] & 3;
+        int total = 0;
+        for (int k = 0; k < 16; k++) total += s[i + 1 + k];
+        buildHuffman(tableClass ? ac[id] : dc[id], s + i + 1, s + i + 17, total);
+        i += 17 + total;
+      }
+    } else if (marker == 0xDA) {
+      for (int c = 0; c < s[0]; c++) {
+        compDc[c] = s[2 + c * 2] >> 4;
+        compAc[c] = s[2 + c * 2] & 15;
+      }
+      pos += 2 + segment;
+      break;
+    }
+    pos += 2 + segment;
+  }
+
+  int hMax = compH[0], vMax = compV[0];
+  int mcuW = 8 * hMax, mcuH = 8 * vMax;
+  int mcusX = (result.width + mcuW - 1) / mcuW;
+  int mcusY = (result.height + mcuH - 1) / mcuH;
+  int planeW = mcusX * mcuW, planeH = mcusY * mcuH;
+  std::vector<uint8_t> planes[3];
+  for (int c = 0; c < result.components; c++) {
+    planes[c].resize((planeW / (hMax / compH[c])) * (planeH / (vMax / compV[c])));
+  }
+
+  BitReader in = { p, len - 2, pos, 0, 0 };
+  int dcPrev[3] = { 0, 0, 0 };
+  for (int my = 0; my < mcusY; my++) {
+    for (int mx = 0; mx < mcusX; mx++) {
+      for (int c = 0; c < result.components; c++) {
+        int stride = planeW / (hMax / compH[c]);
+        for (int by = 0; by < compV[c]; by++) {
+          for (int bx = 0; bx < compH[c]; bx++) {
+            int coef[64] = { 0 };
+            int t = decodeSymbol(in, dc[compDc[c]]);
+            if (t < 0) return false;
+            dcPrev[c] += extend(in.receive(t), t);
+            coef[0] = dcPrev[c] * quant[compQuant[c]][0];
+            for (int k = 1; k < 64;) {
+              int rs = decodeSymbol(in, ac[compAc[c]]);
+              if (rs < 0) return false;
+              int run = rs >> 4, size = rs & 15;
+              if (size == 0) {
+                if (run != 15) break;
+                k += 16;
+                continue;
+              }
+              k += run;
+              if (k > 63) return false;
+              coef[zigzag[k]] = extend(in.receive(size), size) * quant[compQuant[c]][k];
+              k++;
+            }
+            int x0 = (mx * compH[c] + bx) * 8;
+            int y0 = (my * compV[c] + by) * 8;
+            idct(coef, &planes[c][y0 * stride + x0], stride);
+          }
+        }
+      }
+    }
+  }
+
+  result.pixels.resize(result.width * result.height * (result.components == 3 ? 3 : 1));
+  for (int y = 0; y < result.height; y++) {
+    for (int x = 0; x < result.width; x++) {
+      double Y = planes[0][y * planeW + x];
+      if (result.components == 1) {
+        result.pixels[y * result.width + x] = (uint8_t)Y;
+        continue;
+      }
+      int chromaStride = planeW / 2;
+      double cb = planes[1][(y / 2) * chromaStride + x / 2] - 128.0;
+      double cr = planes[2][(y / 2) * chromaStride + x / 2] - 128.0;
+      double rgb[3] = { Y + 1.402 * cr, Y - 0.344136 * cb - 0.714136 * cr, Y + 1.772 * cb };
+      for (int i = 0; i < 3; i++) {
+        long v = lround(rgb[i]);
+        result.pixels[(y * result.width + x) * 3 + i] = v < 0 ? 0 : (v > 255 ? 255 : v);
+      }
+    }
+  }
+  return true;
+}
+
+static double psnr(const std::vector<uint8_t> &a, const std::vector<uint8_t> &b) {
+  double sum = 0;
+  for (size_t i = 0; i < a.size(); i++) {
+    double d = (double)a[i] - b[i];
+    sum += d * d;
+  }
+  double mse = sum / a.size();
+  return mse == 0 ? 99.0 : 10 * log10(255.0 * 255.0 / mse);
+}
+
+// RGB888 expanded from sensor-order RGB565 the way the encoder reads it
+static std::vector<uint8_t> expandRgb565(const std::vector<uint8_t> &pixels) {
+  std::vector<uint8_t> rgb(pixels.size() / 2 * 3);
+  for (size_t i = 0; i < pixels.size() / 2; i++) {
+    uint8_t hi = pixels[i * 2], lo = pixels[i * 2 + 1];
+    rgb[i * 3] = hi & 0xF8;
+    rgb[i * 3 + 1] = ((hi & 0x07) << 5) | ((lo & 0xE0) >> 3);
+    rgb[i * 3 + 2] = (lo & 0x1F) << 3;
+  }
+  return rgb;
+}
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+void test_rgb565_round_trip(void) {
+  const int sizes[][2] = { { 160, 120 }, { 176, 144 }, { 97, 61 }, { 48, 32 }, { 1, 1 } };
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    int width = sizes[i][0], height = sizes[i][1];
+    std::vector<uint8_t> pixels = makeRgb565(width, height, false);
+    Decoded decoded;
+    TEST_ASSERT_TRUE(decode(encode(pixels, width, height, PIXFORMAT_RGB565, false, 90), decoded));
+    TEST_ASSERT_EQUAL(width, decoded.width);
+    TEST_ASSERT_EQUAL(height, decoded.height);
+    TEST_ASSERT_EQUAL(3, decoded.components);
+    TEST_ASSERT_TRUE_MESSAGE(psnr(expandRgb565(pixels), decoded.pixels) > 35.0, "PSNR under 35 dB");
+  }
+}
+
+void test_grayscale_round_trip(void) {
+  const int width = 123, height = 77;
+  std::vector<uint8_t> pixels = makeGray(width, height);
+  Decoded decoded;
+  TEST_ASSERT_TRUE(decode(encode(pixels, width, height, PIXFORMAT_GRAYSCALE, false, 90), decoded));
+  TEST_ASSERT_EQUAL(1, decoded.components);
+  TEST_ASSERT_TRUE_MESSAGE(psnr(pixels, decoded.pixels) > 35.0, "PSNR under 35 dB");
+}
+
+// Lower quality must still decode, just with more loss
+void test_quality_range(void) {
+  std::vector<uint8_t> pixels = makeRgb565(96, 96, false);
+  std::vector<uint8_t> rgb = expandRgb565(pixels);
+  double previous = 0;
+  const int qualities[] = { 1, 10, 50, 95, 100 };
+  for (size_t i = 0; i < sizeof(qualities) / sizeof(qualities[0]); i++) {
+    Decoded decoded;
+    TEST_ASSERT_TRUE(decode(encode(pixels, 96, 96, PIXFORMAT_RGB565, false, qualities[i]), decoded));
+    double quality = psnr(rgb, decoded.pixels);
+    TEST_ASSERT_TRUE_MESSAGE(quality >= previous - 0.5, "Higher quality decoded worse");
+    previous = quality;
+  }
+}
+
+// Swapped input with swapBytes set must give the very same file
+void test_byte_order_gives_same_output(void) {
+  const int sizes[][2] = { { 160, 120 }, { 97, 61 } };
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    int width = sizes[i][0], height = sizes[i][1];
+    std::vector<uint8_t> sensor = encode(makeRgb565(width, height, false), width, height, PIXFORMAT_RGB565, false, 80);
+    std::vector<uint8_t> swapped = encode(makeRgb565(width, height, true), width, height, PIXFORMAT_RGB565, true, 80);
+    TEST_ASSERT_EQUAL(sensor.size(), swapped.size());
+    TEST_ASSERT_EQUAL_MEMORY(sensor.data(), swapped.data(), sensor.size());
+  }
+}
+
+static bool refuse(void *ctx, const uint8_t *data, size_t len) {
+  return false;
+}
+
+void test_sink_failure_aborts(void) {
+  std::vector<uint8_t> pixels = makeRgb565(320, 240, false);
+  TEST_ASSERT_FALSE(jpegEncode(pixels.data(), 320, 240, PIXFORMAT_RGB565, false, 80, refuse, NULL));
+}
+
+void test_rejects_other_formats(void) {
+  std::vector<uint8_t> pixels(64 * 64 * 2);
+  std::vector<uint8_t> out;
+  TEST_ASSERT_FALSE(jpegEncode(pixels.data(), 64, 64, PIXFORMAT_JPEG, false, 80, collect, &out));
+  TEST_ASSERT_FALSE(jpegEncode(pixels.data(), 64, 64, PIXFORMAT_YUV422, false, 80, collect, &out));
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_rgb565_round_trip);
+  RUN_TEST(test_grayscale_round_trip);
+  RUN_TEST(test_quality_range);
+  RUN_TEST(test_byte_order_gives_same_output);
+  RUN_TEST(test_sink_failure_aborts);
+  RUN_TEST(test_rejects_other_formats);
+  return UNITY_END();
+}
@@ -0,0 +1,128 @@
+// Checks that the fast and SIMD RGB565 colour conversion kernels match the
+// reference kernel bit for bit, for every one of the 65536 pixel values in
+// both byte orders, and that the SIMD level shift matches its reference for
+// every sample value.
+
+#include <unity.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "jpeg_encoder.h"
+#include "jpeg_host.h"
+
+// One row holding every pixel value once, 16-byte aligned (the heap's
+// alignment here) as the SIMD kernel needs
+static std::vector<uint32_t> allPixels(bool swapped) {
+  std::vector<uint32_t> words(65536 / 2);
+  uint8_t *bytes = (uint8_t*)words.data();
+  for (int value = 0; value < 65536; value++) {
+    bytes[value * 2 + (swapped ? 1 : 0)] = value >> 8;
+    bytes[value * 2 + (swapped ? 0 : 1)] = value & 0xFF;
+  }
+  return words;
+}
+
+static void checkRow(const uint8_t *src, int width, bool swapBytes) {
+  std::vector<uint8_t> refY(width), refCb(width), refCr(width);
+  std::vector<uint8_t> fastY(width), fastCb(width), fastCr(width);
+  std::vector<uint8_t> simdY(width), simdCb(width), simdCr(width);
+  jpegRowRgb565Ref(src, width, swapBytes, refY.data(), refCb.data(), refCr.data());
+  jpegRowRgb565Fast(src, width, swapBytes, fastY.data(), fastCb.data(), fastCr.data());
+  jpegRowRgb565Simd(src, width, swapBytes, simdY.data(), simdCb.data(), simdCr.data());
+  for (int x = 0; x < width; x++) {
+    const char *kernel = NULL;
+    if (refY[x] != fastY[x] || refCb[x] != fastCb[x] || refCr[x] != fastCr[x]) {
+      kernel = "fast";
+    } else if (refY[x] != simdY[x] || refCb[x] != simdCb[x] || refCr[x] != simdCr[x]) {
+      kernel = "SIMD";
+    }
+    if (kernel) {
+      char message[96];
+      snprintf(message, sizeof(message), "%s kernel: pixel %d (bytes %02X %02X) differs", kernel, x, src[x * 2], src[x * 2 + 1]);
+      TEST_ASSERT_TRUE_MESSAGE(false, message);
+    }
+  }
+}
+
+void setUp(void) {
+  jpegInitTables();
+}
+
+void tearDown(void) {
+}
+
+// Sensor byte order: high byte first, no swap
+void test_every_pixel_sensor_order(void) {
+  std::vector<uint32_t> row = allPixels(false);
+  checkRow((const uint8_t*)row.data(), 65536, false);
+}
+
+// Low byte first, read with swapBytes
+void test_every_pixel_swapped(void) {
+  std::vector<uint32_t> row = allPixels(true);
+  checkRow((const uint8_t*)row.data(), 65536, true);
+}
+
+// The swap has to land on the same colour: a value stored either way must
+// convert the same once the matching swapBytes is given
+void test_byte_orders_agree(void) {
+  std::vector<uint32_t> sensor = allPixels(false);
+  std::vector<uint32_t> swapped = allPixels(true);
+  std::vector<uint8_t> y1(65536), cb1(65536), cr1(65536), y2(65536), cb2(65536), cr2(65536);
+  jpegRowRgb565Fast((const uint8_t*)sensor.data(), 65536, false, y1.data(), cb1.data(), cr1.data());
+  jpegRowRgb565Fast((const uint8_t*)swapped.data(), 65536, true, y2.data(), cb2.data(), cr2.data());
+  TEST_ASSERT_TRUE(y1 == y2 && cb1 == cb2 && cr1 == cr2);
+}
+
+// Independent check on the weights: every pixel within 1 of the BT.601
+// formula worked in floating point
+void test_matches_bt601(void) {
+  std::vector<uint32_t> row = allPixels(false);
+  const uint8_t *src = (const uint8_t*)row.data();
+  std::vector<uint8_t> y(65536), cb(65536), cr(65536);
+  jpegRowRgb565Ref(src, 65536, false, y.data(), cb.data(), cr.data());
+  for (int value = 0; value < 65536; value++) {
+    double r = (value >> 11) << 3;
+    double g = ((value >> 5) & 0x3F) << 2;
+    double b = (value & 0x1F) << 3;
+    double expected[3] = {
+      0.299 * r + 0.587 * g + 0.114 * b,
+      -0.168736 * r - 0.331264 * g + 0.5 * b + 128,
+      0.5 * r - 0.418688 * g - 0.081312 * b + 128,
+    };
+    uint8_t got[3] = { y[value], cb[value], cr[value] };
+    for (int i = 0; i < 3; i++) {
+      TEST_ASSERT_TRUE_MESSAGE(fabs(got[i] - expected[i]) <= 1.0, "More than 1 off the BT.601 formula");
+    }
+  }
+}
+
+// Every sample value in every position of a block, read from a plane wider
+// than the block as the encoder does
+void test_level_shift(void) {
+  const int stride = 40;
+  std::vector<uint8_t> plane(stride * 8);
+  float ref[64], simd[64];
+  for (int start = 0; start < 256; start++) {
+    for (size_t i = 0; i < plane.size(); i++) {
+      plane[i] = (uint8_t)(start + i * 7);
+    }
+    jpegLevelShiftRef(plane.data() + 3, stride, ref);
+    jpegLevelShiftSimd(plane.data() + 3, stride, simd);
+    TEST_ASSERT_TRUE_MESSAGE(memcmp(ref, simd, sizeof(ref)) == 0, "SIMD level shift differs");
+  }
+}
+
+int main(int argc, char **argv) {
+  jpegInitTables();
+  printf("SIMD path: %s\n", jpegSimdName() ? jpegSimdName() : "none (fast kernel)");
+  UNITY_BEGIN();
+  RUN_TEST(test_every_pixel_sensor_order);
+  RUN_TEST(test_every_pixel_swapped);
+  RUN_TEST(test_byte_orders_agree);
+  RUN_TEST(test_matches_bt601);
+  RUN_TEST(test_level_shift);
+  return UNITY_END();
+}
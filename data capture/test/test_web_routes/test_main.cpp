@@ -0,0 +1,452 @@
+// Checks the card routes in web_routes.cpp against the WebServer mock:
+// status codes and headers of /image and /thumb, conditional and range
+// requests, /list paging and ?since=, and bodies left to a sender arriving
+// the same as those the handler sends itself.
+
+#include <unity.h>
+#include <string.h>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+#include "web_routes.h"
+#include "web_server_mock.h"
+#include "jpeg_host.h"  // env:native links the encoder into every suite
+
+#define TEST_TIMESTAMP  1700000000  // 2023-11-14 22:13:20 GMT
+
+// A card file held in memory
+class MemoryFile : public WebFile {
+public:
+  MemoryFile(const std::string &data) : data(data), position(0) {}
+  
+  bool seek(uint32_t to) {
+    position = std::min((size_t)to, data.size());
+    return true;
+  }
+  
+  size_t read(uint8_t *buf, size_t len) {
+    size_t chunk = std::min(len, data.size() - position);
+    memcpy(buf, data.data() + position, chunk);
+    position += chunk;
+    return chunk;
+  }
+  
+private:
+  std::string data;
+  size_t position;
+};
+
+// An index and card in memory. Images 1..count are standalone files, every
+// other one with a thumbnail; a burst frame sits inside a pack. Detached
+// bodies are sent straight away unless deferred is set, in which case
+// they're kept for the test to send.
+class TestBackend : public WebBackend {
+public:
+  TestBackend(int count) : present(true), deferred(false), indexGeneration(7) {
+    for (int n = 1; n <= count; n++) {
+      ImageInfo info = { (uint32_t)n, 0, (uint32_t)(TEST_TIMESTAMP + n), (uint8_t)(n % 2 ? IMAGE_FLAG_THUMB : 0), 0, 0 };
+      images[n] = imageData(n);
+      info.size = images[n].size();
+      thumbs[n] = "thumb" + std::to_string(n);
+      index.push_back(info);
+    }
+    pack = std::string(300, 'h') + imageData(500) + std::string(40, 't');
+    ImageInfo frame = { 500, (uint32_t)imageData(500).size(), 0, IMAGE_FLAG_BURST, 3, 2 };
+    index.push_back(frame);
+  }
+  
+  static std::string imageData(int n) {
+    std::string data;
+    for (int i = 0; i < 1000 + n * 37; i++) {
+      data += (char)(i * 7 + n);
+    }
+    return data;
+  }
+  
+  bool cardPresent() {
+    return present;
+  }
+  
+  bool lookup(uint32_t number, ImageInfo &info) {
+    for (size_t i = 0; i < index.size(); i++) {
+      if (index[i].number == number) {
+        info = index[i];
+        return true;
+      }
+    }
+    return false;
+  }
+  
+  int listAfter(uint32_t after, ImageInfo *out, int max, bool *more) {
+    size_t i = 0;
+    while (i < index.size() && index[i].number <= after) i++;
+    int count = 0;
+    while (i < index.size() && count < max) {
+      out[count++] = index[i++];
+    }
+    *more = i < index.size();
+    return count;
+  }
+  
+  uint32_t generation() {
+    return indexGeneration;
+  }
+  
+  std::string token(uint32_t generation) {
+    return "b-" + std::to_string(generation);
+  }
+  
+  // Only "b-5" is still in the log: 3 was rewritten twice, 2 and 9999
+  // deleted (9999 never came back)
+  bool changesSince(const std::string &token, std::vector<uint32_t> &numbers, uint32_t *generation) {
+    *generation = indexGeneration;
+    if (token != "b-5") {
+      return false;
+    }
+    numbers.push_back(3);
+    numbers.push_back(9999);
+    numbers.push_back(3);
+    numbers.push_back(2);
+    return true;
+  }
+  
+  WebFile *openImage(const ImageInfo &info, bool thumb, uint32_t *offset, uint32_t *length) {
+    if (info.burstId != 0) {
+      *offset = 300;
+      *length = info.size;
+      return new MemoryFile(pack);
+    }
+    const std::string &data = (thumb && (info.flags & IMAGE_FLAG_THUMB)) ? thumbs[info.number] : images[info.number];
+    *offset = 0;
+    *length = data.size();
+    return new MemoryFile(data);
+  }
+  
+  bool startBody(const WebBodyJob &job) {
+    if (!deferred) {
+      return false;
+    }
+    jobs.push_back(job);
+    return true;
+  }
+  
+  bool present;
+  bool deferred;
+  uint32_t indexGeneration;
+  std::vector<ImageInfo> index;
+  std::map<int, std::string> images;
+  std::map<int, std::string> thumbs;
+  std::string pack;
+  std::vector<WebBodyJob> jobs;
+};
+
+static void get(TestBackend &backend, const char *route, MockRequest &request, MockClient &client) {
+  MockResponse response(client);
+  if (strcmp(route, "/list") == 0) {
+    webHandleList(request, response, backend);
+  } else {
+    webHandleImage(request, response, backend, strcmp(route, "/thumb") == 0);
+  }
+}
+
+static void getImage(TestBackend &backend, const char *n, const char *header, const char *value, MockClient &client) {
+  MockRequest request;
+  request.args["n"] = n;
+  if (header) {
+    request.headers[header] = value;
+  }
+  get(backend, "/image", request, client);
+}
+
+static std::string getList(TestBackend &backend, const char *arg, const char *value, const char *arg2 = NULL, const char *value2 = NULL) {
+  MockRequest request;
+  if (arg) {
+    request.args[arg] = value;
+  }
+  if (arg2) {
+    request.args[arg2] = value2;
+  }
+  MockClient client;
+  get(backend, "/list", request, client);
+  TEST_ASSERT_EQUAL_INT(200, client.code);
+  TEST_ASSERT_EQUAL_INT(WEB_CHUNKED, (int)client.length);
+  TEST_ASSERT_TRUE(client.complete);
+  std::string body = mockUnchunk(client.body);
+  TEST_ASSERT_TRUE_MESSAGE(body.size() > 0, "Broken chunk framing");
+  return body;
+}
+
+// The numbers listed in a JSON array of entries, in order
+static std::vector<uint32_t> listedNumbers(const std::string &json) {
+  std::vector<uint32_t> numbers;
+  size_t at = 0;
+  while ((at = json.find("\"number\":", at)) != std::string::npos) {
+    at += 9;
+    numbers.push_back(strtoul(json.c_str() + at, NULL, 10));
+  }
+  return numbers;
+}
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+void test_image_whole(void) {
+  TestBackend backend(4);
+  std::string version = imageVersion(backend.index[1]);
+  MockClient client;
+  getImage(backend, "2", NULL, NULL, client);
+  TEST_ASSERT_EQUAL_INT(200, client.code);
+  TEST_ASSERT_EQUAL_STRING("image/jpeg", client.type);
+  TEST_ASSERT_TRUE(client.detached && client.complete);
+  TEST_ASSERT_EQUAL_INT((int)backend.images[2].size(), (int)client.length);
+  TEST_ASSERT_TRUE(client.body == backend.images[2]);
+  TEST_ASSERT_EQUAL_STRING(("\"2-" + version + "\"").c_str(), client.header("ETag").c_str());
+  TEST_ASSERT_EQUAL_STRING("no-cache", client.header("Cache-Control").c_str());
+  TEST_ASSERT_EQUAL_STRING("bytes", client.header("Accept-Ranges").c_str());
+  TEST_ASSERT_EQUAL_STRING("Tue, 14 Nov 2023 22:13:22 GMT", client.header("Last-Modified").c_str());
+  
+  // The version the page puts in the URL makes it cacheable for good
+  MockRequest request;
+  request.args["n"] = "2";
+  request.args["v"] = version;
+  MockClient cached;
+  get(backend, "/image", request, cached);
+  TEST_ASSERT_EQUAL_STRING("public, max-age=31536000, immutable", cached.header("Cache-Control").c_str());
+}
+
+void test_image_errors(void) {
+  TestBackend backend(4);
+  MockRequest request;
+  MockClient missing;
+  get(backend, "/image", request, missing);
+  TEST_ASSERT_EQUAL_INT(400, missing.code);
+  
+  MockClient zero, unknown;
+  getImage(backend, "0", NULL, NULL, zero);
+  getImage(backend, "77", NULL, NULL, unknown);
+  TEST_ASSERT_EQUAL_INT(404, zero.code);
+  TEST_ASSERT_EQUAL_INT(404, unknown.code);
+  
+  backend.present = false;
+  MockClient noCard;
+  getImage(backend, "2", NULL, NULL, noCard);
+  TEST_ASSERT_EQUAL_INT(404, noCard.code);
+  TEST_ASSERT_FALSE(noCard.detached);
+}
+
+void test_image_conditional(void) {
+  TestBackend backend(4);
+  MockClient first;
+  getImage(backend, "3", NULL, NULL, first);
+  std::string etag = first.header("ETag");
+  
+  MockClient matched, dated, changed;
+  getImage(backend, "3", "If-None-Match", ("W/\"x\", " + etag).c_str(), matched);
+  getImage(backend, "3", "If-Modified-Since", first.header("Last-Modified").c_str(), dated);
+  getImage(backend, "3", "If-None-Match", "\"3-old\"", changed);
+  TEST_ASSERT_EQUAL_INT(304, matched.code);
+  TEST_ASSERT_NULL(matched.type);
+  TEST_ASSERT_EQUAL_INT(0, (int)matched.body.size());
+  TEST_ASSERT_EQUAL_INT(304, dated.code);
+  TEST_ASSERT_EQUAL_INT(200, changed.code);
+  TEST_ASSERT_TRUE(changed.body == backend.images[3]);
+}
+
+void test_image_ranges(void) {
+  TestBackend backend(4);
+  const std::string &data = backend.images[1];
+  std::string total = std::to_string(data.size());
+  
+  MockClient middle, suffix, open, past, backwards, several;
+  getImage(backend, "1", "Range", "bytes=2-5", middle);
+  getImage(backend, "1", "Range", "bytes=-3", suffix);
+  getImage(backend, "1", "Range", "bytes=1000-", open);
+  getImage(backend, "1", "Range", ("bytes=" + total + "-").c_str(), past);
+  getImage(backend, "1", "Range", "bytes=5-2", backwards);
+  getImage(backend, "1", "Range", "bytes=0-1,5-6", several);
+  
+  TEST_ASSERT_EQUAL_INT(206, middle.code);
+  TEST_ASSERT_EQUAL_STRING(("bytes 2-5/" + total).c_str(), middle.header("Content-Range").c_str());
+  TEST_ASSERT_TRUE(middle.body == data.substr(2, 4));
+  TEST_ASSERT_EQUAL_INT(206, suffix.code);
+  TEST_ASSERT_TRUE(suffix.body == data.substr(data.size() - 3));
+  TEST_ASSERT_EQUAL_INT(206, open.code);
+  TEST_ASSERT_TRUE(open.body == data.substr(1000));
+  TEST_ASSERT_EQUAL_INT(416, past.code);
+  TEST_ASSERT_EQUAL_STRING(("bytes */" + total).c_str(), past.header("Content-Range").c_str());
+  TEST_ASSERT_EQUAL_INT(416, backwards.code);
+  TEST_ASSERT_EQUAL_INT(200, several.code);
+  TEST_ASSERT_TRUE(several.body == data);
+  
+  // A resume of a copy with another validator gets the whole image
+  MockRequest request;
+  request.args["n"] = "1";
+  request.headers["Range"] = "bytes=2-5";
+  request.headers["If-Range"] = "\"1-old\"";
+  MockClient stale;
+  get(backend, "/image", request, stale);
+  TEST_ASSERT_EQUAL_INT(200, stale.code);
+  TEST_ASSERT_TRUE(stale.body == data);
+}
+
+// A burst frame is served from its offset in the pack
+void test_burst_frame(void) {
+  TestBackend backend(4);
+  std::string frame = TestBackend::imageData(500);
+  MockClient whole, part;
+  getImage(backend, "500", NULL, NULL, whole);
+  getImage(backend, "500", "Range", "bytes=-10", part);
+  TEST_ASSERT_EQUAL_INT(200, whole.code);
+  TEST_ASSERT_TRUE(whole.body == frame);
+  TEST_ASSERT_EQUAL_STRING("", whole.header("Last-Modified").c_str());  // Written before the clock was set
+  TEST_ASSERT_EQUAL_INT(206, part.code);
+  TEST_ASSERT_TRUE(part.body == frame.substr(frame.size() - 10));
+}
+
+void test_thumb_falls_back_to_image(void) {
+  TestBackend backend(4);
+  MockRequest withThumb, without;
+  withThumb.args["n"] = "3";
+  without.args["n"] = "4";
+  MockClient a, b;
+  get(backend, "/thumb", withThumb, a);
+  get(backend, "/thumb", without, b);
+  TEST_ASSERT_EQUAL_INT(200, a.code);
+  TEST_ASSERT_EQUAL_STRING("thumb3", a.body.c_str());
+  TEST_ASSERT_EQUAL_INT(0, (int)a.header("ETag").find("\"3t-"));
+  TEST_ASSERT_EQUAL_INT(200, b.code);
+  TEST_ASSERT_TRUE(b.body == backend.images[4]);
+}
+
+// Paging through 40 images 16 at a time lists each once, in order
+void test_list_pages(void) {
+  TestBackend backend(40);
+  std::vector<uint32_t> all;
+  std::string after = "0";
+  int pages = 0;
+  while (true) {
+    std::string json = getList(backend, "after", after.c_str(), "limit", "16");
+    TEST_ASSERT_EQUAL_INT(0, (int)json.find("{\"images\":[{\"number\":"));
+    TEST_ASSERT_TRUE(json.find("\"token\":\"b-7\"") != std::string::npos);
+    std::vector<uint32_t> numbers = listedNumbers(json);
+    all.insert(all.end(), numbers.begin(), numbers.end());
+    pages++;
+    size_t next = json.find("\"next\":");
+    if (next == std::string::npos) break;
+    after = std::to_string(strtoul(json.c_str() + next + 7, NULL, 10));
+    TEST_ASSERT_EQUAL_UINT32(numbers.back(), strtoul(after.c_str(), NULL, 10));
+  }
+  TEST_ASSERT_EQUAL_INT(3, pages);
+  TEST_ASSERT_EQUAL_INT(41, (int)all.size());
+  for (int i = 0; i < 40; i++) {
+    TEST_ASSERT_EQUAL_UINT32(i + 1, all[i]);
+  }
+  TEST_ASSERT_EQUAL_UINT32(500, all[40]);
+  
+  // Without a limit everything comes in one response; the burst frame
+  // carries its pack and frame
+  std::string json = getList(backend, NULL, NULL);
+  TEST_ASSERT_EQUAL_INT(41, (int)listedNumbers(json).size());
+  TEST_ASSERT_TRUE(json.find("\"burst\":3,\"frame\":2}") != std::string::npos);
+  TEST_ASSERT_TRUE(json.find("\"next\"") == std::string::npos);
+  TEST_ASSERT_TRUE(json.find("{\"number\":1,\"filename\":\"1.jpg\",\"size\":" + std::to_string(backend.index[0].size) +
+                             ",\"v\":\"" + imageVersion(backend.index[0]) + "\"}") != std::string::npos);
+  
+  backend.present = false;
+  TEST_ASSERT_EQUAL_STRING("{\"images\":[],\"token\":\"b-7\"}", getList(backend, NULL, NULL).c_str());
+}
+
+void test_list_changes(void) {
+  TestBackend backend(4);
+  backend.index.erase(backend.index.begin() + 1);  // Image 2 deleted
+  std::string json = getList(backend, "since", "b-5");
+  TEST_ASSERT_EQUAL_INT(0, (int)json.find("{\"token\":\"b-7\",\"reset\":false,\"added\":[{\"number\":3,"));
+  TEST_ASSERT_EQUAL_INT(1, (int)listedNumbers(json).size());
+  TEST_ASSERT_TRUE(json.find("],\"deleted\":[2,9999]}") != std::string::npos);
+  
+  TEST_ASSERT_EQUAL_STRING("{\"token\":\"b-7\",\"reset\":true,\"added\":[],\"deleted\":[]}",
+                           getList(backend, "since", "a-1").c_str());
+}
+
+// Bodies left to a sender come out the same through a buffer of any size,
+// and only once the sender has run
+void test_sender_bodies(void) {
+  TestBackend backend(40);
+  MockClient inlineImage, inlineList;
+  getImage(backend, "7", NULL, NULL, inlineImage);
+  MockRequest listRequest;
+  get(backend, "/list", listRequest, inlineList);
+  
+  size_t sizes[] = { WEB_MIN_BUFFER, 1000, 4096 };
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    backend.deferred = true;
+    MockClient image, list;
+    getImage(backend, "7", NULL, NULL, image);
+    get(backend, "/list", listRequest, list);
+    TEST_ASSERT_EQUAL_INT(2, (int)backend.jobs.size());
+    TEST_ASSERT_TRUE(image.detached && !image.complete);
+    TEST_ASSERT_EQUAL_INT(0, (int)list.body.size());
+  
+    std::vector<uint8_t> buf(sizes[s]);
+    for (size_t i = 0; i < backend.jobs.size(); i++) {
+      TEST_ASSERT_TRUE(webSendBody(backend.jobs[i], buf.data(), buf.size()));
+    }
+    backend.jobs.clear();
+    TEST_ASSERT_TRUE(image.complete && list.complete);
+    TEST_ASSERT_TRUE(image.body == inlineImage.body);
+    TEST_ASSERT_TRUE(mockUnchunk(list.body) == mockUnchunk(inlineList.body));
+  }
+}
+
+// Takes the first write, then acts as if the client had gone
+class GoneConnection : public HttpConnection {
+public:
+  GoneConnection(bool *closed) : writes(0), closed(closed) {}
+  
+  size_t write(const uint8_t *data, size_t len) {
+    return writes++ == 0 ? len : 0;
+  }
+  
+  void close() {
+    *closed = true;
+  }
+  
+private:
+  int writes;
+  bool *closed;
+};
+
+void test_client_gone(void) {
+  TestBackend backend(4);
+  backend.deferred = true;
+  MockClient client;
+  getImage(backend, "4", NULL, NULL, client);
+  TEST_ASSERT_EQUAL_INT(1, (int)backend.jobs.size());
+  
+  WebBodyJob job = backend.jobs[0];
+  delete job.connection;
+  bool closed = false;
+  job.connection = new GoneConnection(&closed);
+  uint8_t buf[WEB_MIN_BUFFER];
+  TEST_ASSERT_FALSE(webSendBody(job, buf, sizeof(buf)));
+  TEST_ASSERT_TRUE(closed);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_image_whole);
+  RUN_TEST(test_image_errors);
+  RUN_TEST(test_image_conditional);
+  RUN_TEST(test_image_ranges);
+  RUN_TEST(test_burst_frame);
+  RUN_TEST(test_thumb_falls_back_to_image);
+  RUN_TEST(test_list_pages);
+  RUN_TEST(test_list_changes);
+  RUN_TEST(test_sender_bodies);
+  RUN_TEST(test_client_gone);
+  return UNITY_END();
+}